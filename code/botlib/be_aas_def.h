@@ -152,6 +152,7 @@ typedef struct aas_routingupdate_s
 	unsigned short int tmptraveltime;			//temporary travel time
 	unsigned short int *areatraveltimes;		//travel times within the area
 	qboolean inlist;							//true if the update is in the list
+	int bucket;									//bucket queue slot the update is in
 	struct aas_routingupdate_s *next;
 	struct aas_routingupdate_s *prev;
 } aas_routingupdate_t;
@@ -171,6 +172,17 @@ typedef struct aas_reversedreachability_s
 	aas_reversedlink_t *first;
 } aas_reversedreachability_t;
 
+//reversed reachability link stored with the links of the other areas in one
+//array, the links of an area are in the same order as the reversed links
+typedef struct aas_routinglink_s
+{
+	int areanum;								//reachable from this area
+	int linknum;								//the aas_areareachability_t
+	int travelflags;							//travel flag for the reachability type
+	unsigned short int traveltime;				//travel time of the reachability
+	unsigned char reachnum;						//reachability number within the area
+} aas_routinglink_t;
+
 //areas a reachability goes through
 typedef struct aas_reachabilityareas_s
 {
@@ -254,6 +266,10 @@ typedef struct aas_s
 	int frameroutingupdates;
 	//reversed reachability links
 	aas_reversedreachability_t *reversedreachability;
+	//the reversed reachability links of area i are
+	//routinglinks[routinglinkindex[i]] up to routinglinks[routinglinkindex[i+1]]
+	int *routinglinkindex;
+	aas_routinglink_t *routinglinks;
 	//travel times within the areas
 	unsigned short ***areatraveltimes;
 	//array of size numclusters with cluster cache
@@ -83,6 +83,15 @@ int numportalcacheupdates;
 
 int routingcachesize;
 int max_routingcachesize;
+//use the FIFO label correcting routing updates instead of the bucket queue
+static int fiforouting;
+
+//routing cache statistics, reset when the routing is initialized
+static int numroutingcaches;
+static int peakroutingcachesize;
+static int numareacachehits, numareacachemisses;
+static int numportalcachehits, numportalcachemisses;
+static int numcacheevictions;
 
 //===========================================================================
 //
@@ -99,6 +108,41 @@ void AAS_RoutingInfo(void)
 } //end of the function AAS_RoutingInfo
 #endif //ROUTING_DEBUG
 //===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_PrintCacheHits(const char *name, int hits, int misses)
+{
+	int lookups;
+
+	lookups = hits + misses;
+	botimport.Print(PRT_MESSAGE, "%s cache: %d lookups, %d hits, %d misses, %.1f%% hit rate\n",
+					name, lookups, hits, misses, lookups ? hits * 100.0 / lookups : 0.0);
+} //end of the function AAS_PrintCacheHits
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RoutingCacheStats(void)
+{
+	if (!aasworld.loaded)
+	{
+		botimport.Print(PRT_MESSAGE, "no AAS data loaded\n");
+		return;
+	} //end if
+	AAS_PrintCacheHits("area", numareacachehits, numareacachemisses);
+	AAS_PrintCacheHits("portal", numportalcachehits, numportalcachemisses);
+	botimport.Print(PRT_MESSAGE, "%d evictions\n", numcacheevictions);
+	botimport.Print(PRT_MESSAGE, "%d caches using %d bytes, peak %d bytes, limit %d bytes\n",
+					numroutingcaches, routingcachesize,
+					peakroutingcachesize > routingcachesize ? peakroutingcachesize : routingcachesize,
+					max_routingcachesize);
+} //end of the function AAS_RoutingCacheStats
+//===========================================================================
 // returns the number of the area in the cluster
 // assumes the given area is in the given cluster or a portal of the cluster
 //
@@ -197,8 +241,21 @@ int AAS_TravelFlagForType(int traveltype)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+static ID_INLINE qboolean AAS_CacheEvictable(const aas_routingcache_t *cache)
+{
+	//area cache leading towards a portal is never freed so it is not kept
+	//in the time sorted list, eviction can then always take the oldest cache
+	return cache->type != CACHETYPE_AREA || aasworld.areasettings[cache->areanum].cluster >= 0;
+} //end of the function AAS_CacheEvictable
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 void AAS_UnlinkCache(aas_routingcache_t *cache)
 {
+	if (!AAS_CacheEvictable(cache)) return;
 	if (cache->time_next) cache->time_next->time_prev = cache->time_prev;
 	else aasworld.newestcache = cache->time_prev;
 	if (cache->time_prev) cache->time_prev->time_next = cache->time_next;
@@ -214,6 +271,7 @@ void AAS_UnlinkCache(aas_routingcache_t *cache)
 //===========================================================================
 void AAS_LinkCache(aas_routingcache_t *cache)
 {
+	if (!AAS_CacheEvictable(cache)) return;
 	if (aasworld.newestcache)
 	{
 		aasworld.newestcache->time_next = cache;
@@ -237,6 +295,7 @@ void AAS_FreeRoutingCache(aas_routingcache_t *cache)
 {
 	AAS_UnlinkCache(cache);
 	routingcachesize -= cache->size;
+	numroutingcaches--;
 	FreeMemory(cache);
 } //end of the function AAS_FreeRoutingCache
 //===========================================================================
@@ -461,6 +520,26 @@ void AAS_CreateReversedReachability(void)
 			aasworld.reversedreachability[reach->areanum].numlinks++;
 		} //end for
 	} //end for
+	//copy the reversed links into one array for the routing updates
+	if (aasworld.routinglinkindex) FreeMemory(aasworld.routinglinkindex);
+	ptr = (char *) GetMemory((aasworld.numareas + 1) * sizeof(int) +
+							aasworld.reachabilitysize * sizeof(aas_routinglink_t));
+	aasworld.routinglinkindex = (int *) ptr;
+	aasworld.routinglinks = (aas_routinglink_t *) (ptr + (aasworld.numareas + 1) * sizeof(int));
+	for (n = 0, i = 0; i < aasworld.numareas; i++)
+	{
+		aasworld.routinglinkindex[i] = n;
+		for (revlink = aasworld.reversedreachability[i].first; revlink; revlink = revlink->next, n++)
+		{
+			reach = &aasworld.reachability[revlink->linknum];
+			aasworld.routinglinks[n].areanum = revlink->areanum;
+			aasworld.routinglinks[n].linknum = revlink->linknum;
+			aasworld.routinglinks[n].travelflags = AAS_TravelFlagForType_inline(reach->traveltype);
+			aasworld.routinglinks[n].traveltime = reach->traveltime;
+			aasworld.routinglinks[n].reachnum = revlink->linknum - aasworld.areasettings[revlink->areanum].firstreachablearea;
+		} //end for
+	} //end for
+	aasworld.routinglinkindex[aasworld.numareas] = n;
 #ifdef DEBUG
 	botimport.Print(PRT_MESSAGE, "reversed reachability %d msec\n", Sys_MilliSeconds() - starttime);
 #endif
@@ -700,33 +779,29 @@ int AAS_FreeOldestCache(void)
 	int clusterareanum;
 	aas_routingcache_t *cache;
 
-	for (cache = aasworld.oldestcache; cache; cache = cache->time_next) {
-		// never free area cache leading towards a portal
-		if (cache->type == CACHETYPE_AREA && aasworld.areasettings[cache->areanum].cluster < 0) {
-			continue;
-		}
-		break;
+	//only cache that may be freed is in the time sorted list
+	cache = aasworld.oldestcache;
+	if (!cache) {
+		return qfalse;
 	}
-	if (cache) {
-		// unlink the cache
-		if (cache->type == CACHETYPE_AREA) {
-			//number of the area in the cluster
-			clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
-			// unlink from cluster area cache
-			if (cache->prev) cache->prev->next = cache->next;
-			else aasworld.clusterareacache[cache->cluster][clusterareanum] = cache->next;
-			if (cache->next) cache->next->prev = cache->prev;
-		}
-		else {
-			// unlink from portal cache
-			if (cache->prev) cache->prev->next = cache->next;
-			else aasworld.portalcache[cache->areanum] = cache->next;
-			if (cache->next) cache->next->prev = cache->prev;
-		}
-		AAS_FreeRoutingCache(cache);
-		return qtrue;
+	// unlink the cache
+	if (cache->type == CACHETYPE_AREA) {
+		//number of the area in the cluster
+		clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
+		// unlink from cluster area cache
+		if (cache->prev) cache->prev->next = cache->next;
+		else aasworld.clusterareacache[cache->cluster][clusterareanum] = cache->next;
+		if (cache->next) cache->next->prev = cache->prev;
 	}
-	return qfalse;
+	else {
+		// unlink from portal cache
+		if (cache->prev) cache->prev->next = cache->next;
+		else aasworld.portalcache[cache->areanum] = cache->next;
+		if (cache->next) cache->next->prev = cache->prev;
+	}
+	AAS_FreeRoutingCache(cache);
+	numcacheevictions++;
+	return qtrue;
 } //end of the function AAS_FreeOldestCache
 //===========================================================================
 //
@@ -734,17 +809,29 @@ int AAS_FreeOldestCache(void)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+static ID_INLINE int AAS_RoutingCacheSize(int numtraveltimes)
+{
+	return sizeof(aas_routingcache_t)
+						+ numtraveltimes * sizeof(unsigned short int)
+						+ numtraveltimes * sizeof(unsigned char);
+} //end of the function AAS_RoutingCacheSize
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 {
 	aas_routingcache_t *cache;
 	int size;
 
 	//
-	size = sizeof(aas_routingcache_t)
-						+ numtraveltimes * sizeof(unsigned short int)
-						+ numtraveltimes * sizeof(unsigned char);
+	size = AAS_RoutingCacheSize(numtraveltimes);
 	//
 	routingcachesize += size;
+	if (routingcachesize > peakroutingcachesize) peakroutingcachesize = routingcachesize;
+	numroutingcaches++;
 	//
 	cache = (aas_routingcache_t *) GetClearedMemory(size);
 	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t)
@@ -916,8 +1003,7 @@ void AAS_CreateAllRoutingCache(void)
 //===========================================================================
 
 //the route cache header
-//this header is followed by numportalcache + numareacache aas_routingcache_t
-//structures that store routing cache
+//this header is followed by numportalcache + numareacache routing cache records
 typedef struct routecacheheader_s
 {
 	int ident;
@@ -930,12 +1016,58 @@ typedef struct routecacheheader_s
 	int numareacache;
 } routecacheheader_t;
 
+//a routing cache record is followed by the travel times and reachabilities,
+//the number of which follows from the cache type and cluster
+typedef struct routecacherecord_s
+{
+	int cluster;
+	int areanum;
+	int travelflags;
+} routecacherecord_t;
+
 #define RCID						(('C'<<24)+('R'<<16)+('E'<<8)+'M')
-#define RCVERSION					2
+#define RCVERSION					3
 
 //void AAS_DecompressVis(byte *in, int numareas, byte *decompressed);
 //int AAS_CompressVis(byte *vis, int numareas, byte *dest);
 
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_CacheNumTravelTimes(int type, int cluster)
+{
+	if (type == CACHETYPE_PORTAL) return aasworld.numportals;
+	return aasworld.clusters[cluster].numreachabilityareas;
+} //end of the function AAS_CacheNumTravelTimes
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				number of bytes written
+// Changes Globals:		-
+//===========================================================================
+static int AAS_WriteCache(fileHandle_t fp, aas_routingcache_t *cache, int type)
+{
+	routecacherecord_t record;
+	int numtraveltimes;
+
+	numtraveltimes = AAS_CacheNumTravelTimes(type, cache->cluster);
+	record.cluster = cache->cluster;
+	record.areanum = cache->areanum;
+	record.travelflags = cache->travelflags;
+	botimport.FS_Write(&record, sizeof(routecacherecord_t), fp);
+	botimport.FS_Write(cache->traveltimes, numtraveltimes * sizeof(unsigned short int), fp);
+	botimport.FS_Write(cache->reachabilities, numtraveltimes * sizeof(unsigned char), fp);
+	return sizeof(routecacherecord_t) + numtraveltimes * (sizeof(unsigned short int) + sizeof(unsigned char));
+} //end of the function AAS_WriteCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 void AAS_WriteRouteCache(void)
 {
 	int i, j, numportalcache, numareacache, totalsize;
@@ -991,8 +1123,7 @@ void AAS_WriteRouteCache(void)
 	{
 		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
 		{
-			botimport.FS_Write(cache, cache->size, fp);
-			totalsize += cache->size;
+			totalsize += AAS_WriteCache(fp, cache, CACHETYPE_PORTAL);
 		} //end for
 	} //end for
 	for (i = 0; i < aasworld.numclusters; i++)
@@ -1002,8 +1133,7 @@ void AAS_WriteRouteCache(void)
 		{
 			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
 			{
-				botimport.FS_Write(cache, cache->size, fp);
-				totalsize += cache->size;
+				totalsize += AAS_WriteCache(fp, cache, CACHETYPE_AREA);
 			} //end for
 		} //end for
 	} //end for
@@ -1033,20 +1163,119 @@ void AAS_WriteRouteCache(void)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
+static void AAS_SetClusterAreaReachabilityCount(int *first, int *counts, int cluster, int clusterareanum, int areanum)
 {
-	int size;
+	if (cluster <= 0 || cluster >= aasworld.numclusters) return;
+	if (clusterareanum < 0 || clusterareanum >= aasworld.clusters[cluster].numreachabilityareas) return;
+	counts[first[cluster] + clusterareanum] = aasworld.areasettings[areanum].numreachableareas;
+} //end of the function AAS_SetClusterAreaReachabilityCount
+//===========================================================================
+// returns for every cluster area with reachabilities the number of
+// reachabilities of the area, the areas of cluster i start at first[i]
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int *AAS_ClusterAreaReachabilityCounts(int **first)
+{
+	int i, size, cluster, *counts;
+	aas_portal_t *portal;
+
+	*first = (int *) GetClearedMemory(aasworld.numclusters * sizeof(int));
+	for (size = 0, i = 0; i < aasworld.numclusters; i++)
+	{
+		(*first)[i] = size;
+		size += aasworld.clusters[i].numreachabilityareas;
+	} //end for
+	counts = (int *) GetClearedMemory(size * sizeof(int) + 1);
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		cluster = aasworld.areasettings[i].cluster;
+		if (cluster > 0)
+		{
+			AAS_SetClusterAreaReachabilityCount(*first, counts, cluster, aasworld.areasettings[i].clusterareanum, i);
+		} //end if
+		else if (cluster < 0)
+		{
+			//a portal is an area of both the front and back cluster
+			portal = &aasworld.portals[-cluster];
+			AAS_SetClusterAreaReachabilityCount(*first, counts, portal->frontcluster, portal->clusterareanum[0], i);
+			AAS_SetClusterAreaReachabilityCount(*first, counts, portal->backcluster, portal->clusterareanum[1], i);
+		} //end else if
+	} //end for
+	return counts;
+} //end of the function AAS_ClusterAreaReachabilityCounts
+//===========================================================================
+// read a routing cache record, the cache is not yet added to any list
+// numreach has the number of reachabilities of every area the cache
+// routes from
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_ReadCache(fileHandle_t fp, int type, int *clusterfirst, int *clusterreach)
+{
+	int i, numtraveltimes, numreach;
+	qboolean valid;
+	routecacherecord_t record;
 	aas_routingcache_t *cache;
 
-	botimport.FS_Read(&size, sizeof(size), fp);
-	cache = (aas_routingcache_t *) GetMemory(size);
-	cache->size = size;
-	botimport.FS_Read((unsigned char *)cache + sizeof(size), size - sizeof(size), fp);
-	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t) - sizeof(unsigned short) +
-		(size - sizeof(aas_routingcache_t) + sizeof(unsigned short)) / 3 * 2;
+	if (botimport.FS_Read(&record, sizeof(routecacherecord_t), fp) != sizeof(routecacherecord_t)) return NULL;
+	if (record.cluster <= 0 || record.cluster >= aasworld.numclusters) return NULL;
+	if (record.areanum <= 0 || record.areanum >= aasworld.numareas) return NULL;
+	if (type == CACHETYPE_AREA &&
+		AAS_ClusterAreaNum(record.cluster, record.areanum) >= aasworld.clusters[record.cluster].numareas) return NULL;
+	//
+	numtraveltimes = AAS_CacheNumTravelTimes(type, record.cluster);
+	cache = AAS_AllocRoutingCache(numtraveltimes);
+	cache->type = type;
+	cache->time = AAS_RoutingTime();
+	cache->cluster = record.cluster;
+	cache->areanum = record.areanum;
+	VectorCopy(aasworld.areas[record.areanum].center, cache->origin);
+	cache->starttraveltime = 1;
+	cache->travelflags = record.travelflags;
+	valid = botimport.FS_Read(cache->traveltimes, numtraveltimes * sizeof(unsigned short int), fp) ==
+				numtraveltimes * sizeof(unsigned short int) &&
+			botimport.FS_Read(cache->reachabilities, numtraveltimes * sizeof(unsigned char), fp) ==
+				numtraveltimes * sizeof(unsigned char);
+	//the reachabilities have to be of the area routed from
+	for (i = 0; valid && i < numtraveltimes; i++)
+	{
+		if (type == CACHETYPE_PORTAL)
+			numreach = aasworld.areasettings[aasworld.portals[i].areanum].numreachableareas;
+		else
+			numreach = clusterreach[clusterfirst[record.cluster] + i];
+		if (cache->reachabilities[i] >= numreach &&
+			(cache->reachabilities[i] || cache->traveltimes[i])) valid = qfalse;
+	} //end for
+	if (!valid)
+	{
+		//not linked yet so only the cache size has to be given back
+		routingcachesize -= cache->size;
+		numroutingcaches--;
+		FreeMemory(cache);
+		return NULL;
+	} //end if
 	return cache;
 } //end of the function AAS_ReadCache
 //===========================================================================
+// frees all routing caches and starts with empty cache lists
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ClearRoutingCaches(void)
+{
+	AAS_FreeAllClusterAreaCache();
+	AAS_InitClusterAreaCache();
+	AAS_FreeAllPortalCache();
+	AAS_InitPortalCache();
+} //end of the function AAS_ClearRoutingCaches
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -1055,6 +1284,8 @@ aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
 int AAS_ReadRouteCache(void)
 {
 	int i, clusterareanum;//, size;
+	int *clusterfirst, *clusterreach;
+	qboolean ok;
 	fileHandle_t fp;
 	char filename[MAX_QPATH];
 	routecacheheader_t routecacheheader;
@@ -1070,49 +1301,65 @@ int AAS_ReadRouteCache(void)
 	if (routecacheheader.ident != RCID)
 	{
 		AAS_Error("%s is not a route cache dump\n", filename);
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
 	if (routecacheheader.version != RCVERSION)
 	{
-		AAS_Error("route cache dump has wrong version %d, should be %d\n", routecacheheader.version, RCVERSION);
+		//AAS_Error("route cache dump has wrong version %d, should be %d\n", routecacheheader.version, RCVERSION);
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
 	if (routecacheheader.numareas != aasworld.numareas)
 	{
 		//AAS_Error("route cache dump has wrong number of areas\n");
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
 	if (routecacheheader.numclusters != aasworld.numclusters)
 	{
 		//AAS_Error("route cache dump has wrong number of clusters\n");
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
 	if (routecacheheader.areacrc !=
 		CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas ))
 	{
 		//AAS_Error("route cache dump area CRC incorrect\n");
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
 	if (routecacheheader.clustercrc !=
 		CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters ))
 	{
 		//AAS_Error("route cache dump cluster CRC incorrect\n");
+		botimport.FS_FCloseFile(fp);
 		return qfalse;
 	} //end if
+	clusterreach = AAS_ClusterAreaReachabilityCounts(&clusterfirst);
 	//read all the portal cache
 	for (i = 0; i < routecacheheader.numportalcache; i++)
 	{
-		cache = AAS_ReadCache(fp);
+		cache = AAS_ReadCache(fp, CACHETYPE_PORTAL, clusterfirst, clusterreach);
+		if (!cache) break;
+		AAS_LinkCache(cache);
 		cache->next = aasworld.portalcache[cache->areanum];
 		cache->prev = NULL;
 		if (aasworld.portalcache[cache->areanum])
 			aasworld.portalcache[cache->areanum]->prev = cache;
 		aasworld.portalcache[cache->areanum] = cache;
 	} //end for
+	ok = (i >= routecacheheader.numportalcache);
 	//read all the cluster area cache
-	for (i = 0; i < routecacheheader.numareacache; i++)
+	for (i = 0; ok && i < routecacheheader.numareacache; i++)
 	{
-		cache = AAS_ReadCache(fp);
+		cache = AAS_ReadCache(fp, CACHETYPE_AREA, clusterfirst, clusterreach);
+		if (!cache)
+		{
+			ok = qfalse;
+			break;
+		} //end if
+		AAS_LinkCache(cache);
 		clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
 		cache->next = aasworld.clusterareacache[cache->cluster][clusterareanum];
 		cache->prev = NULL;
@@ -1120,6 +1367,16 @@ int AAS_ReadRouteCache(void)
 			aasworld.clusterareacache[cache->cluster][clusterareanum]->prev = cache;
 		aasworld.clusterareacache[cache->cluster][clusterareanum] = cache;
 	} //end for
+	FreeMemory(clusterfirst);
+	FreeMemory(clusterreach);
+	if (!ok)
+	{
+		//don't keep part of a damaged dump, the warm-up fills in everything again
+		AAS_ClearRoutingCaches();
+		botimport.Print(PRT_WARNING, "%s is truncated or corrupt\n", filename);
+		botimport.FS_FCloseFile(fp);
+		return qfalse;
+	} //end if
 	// read the visareas
 	/*
 	aasworld.areavisibility = (byte **) GetClearedMemory(aasworld.numareas * sizeof(byte *));
@@ -1135,6 +1392,8 @@ int AAS_ReadRouteCache(void)
 	*/
 	//
 	botimport.FS_FCloseFile(fp);
+	botimport.Print(PRT_MESSAGE, "loaded %d portal and %d area caches from %s\n",
+						routecacheheader.numportalcache, routecacheheader.numareacache, filename);
 	return qtrue;
 } //end of the function AAS_ReadRouteCache
 //===========================================================================
@@ -1219,6 +1478,8 @@ void AAS_InitReachabilityAreas(void)
 //===========================================================================
 void AAS_InitRouting(void)
 {
+	int numthreads;
+
 	AAS_InitTravelFlagFromType();
 	//
 	AAS_InitAreaContentsTravelFlags();
@@ -1244,8 +1505,23 @@ void AAS_InitRouting(void)
 	//
 	routingcachesize = 0;
 	max_routingcachesize = 1024 * (int) LibVarValue("max_routingcache", "4096");
-	// read any routing cache if available
-	AAS_ReadRouteCache();
+	fiforouting = (int) LibVarValue("fiforouting", "0");
+	numroutingcaches = 0;
+	peakroutingcachesize = 0;
+	numareacachehits = numareacachemisses = 0;
+	numportalcachehits = numportalcachemisses = 0;
+	numcacheevictions = 0;
+	// read any routing cache if available, otherwise fill in and save
+	// the caches for the common travel flags when asked to
+	if (!AAS_ReadRouteCache())
+	{
+		numthreads = (int) LibVarValue("routingwarmup", "0");
+		if (numthreads > 0)
+		{
+			AAS_WarmUpRoutingCache(numthreads);
+			AAS_WriteRouteCache();
+		} //end if
+	} //end if
 } //end of the function AAS_InitRouting
 //===========================================================================
 //
@@ -1268,6 +1544,10 @@ void AAS_FreeRoutingCaches(void)
 	// free reversed reachability links
 	if (aasworld.reversedreachability) FreeMemory(aasworld.reversedreachability);
 	aasworld.reversedreachability = NULL;
+	// free the routing links
+	if (aasworld.routinglinkindex) FreeMemory(aasworld.routinglinkindex);
+	aasworld.routinglinkindex = NULL;
+	aasworld.routinglinks = NULL;
 	// free routing algorithm memory
 	if (aasworld.areaupdate) FreeMemory(aasworld.areaupdate);
 	aasworld.areaupdate = NULL;
@@ -1284,13 +1564,15 @@ void AAS_FreeRoutingCaches(void)
 	aasworld.areacontentstravelflags = NULL;
 } //end of the function AAS_FreeRoutingCaches
 //===========================================================================
-// update the given routing cache
+// calculate the travel times of the given routing cache, the routing update
+// fields are passed in so several caches can be filled at the same time
 //
 // Parameter:			areacache		: routing cache to update
+//						areaupdate		: routing update fields for the cluster
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+static void AAS_FillAreaRoutingCacheFIFO(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate)
 {
 	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
 	int numreachabilityareas;
@@ -1300,13 +1582,8 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	const aas_reversedreachability_t *revreach;
 	const aas_reversedlink_t *revlink;
 
-#ifdef ROUTING_DEBUG
-	numareacacheupdates++;
-#endif //ROUTING_DEBUG
 	//number of reachability areas within this cluster
 	numreachabilityareas = aasworld.clusters[areacache->cluster].numreachabilityareas;
-	//
-	aasworld.frameroutingupdates++;
 	//clear the routing update fields
 //	Com_Memset(aasworld.areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
 	//
@@ -1317,7 +1594,7 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	//
 	Com_Memset(startareatraveltimes, 0, sizeof(startareatraveltimes));
 	//
-	curupdate = &aasworld.areaupdate[clusterareanum];
+	curupdate = &areaupdate[clusterareanum];
 	curupdate->areanum = areacache->areanum;
 	//VectorCopy(areacache->origin, curupdate->start);
 	curupdate->areatraveltimes = startareatraveltimes;
@@ -1373,7 +1650,7 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			{
 				areacache->traveltimes[clusterareanum] = t;
 				areacache->reachabilities[clusterareanum] = linknum - aasworld.areasettings[nextareanum].firstreachablearea;
-				nextupdate = &aasworld.areaupdate[clusterareanum];
+				nextupdate = &areaupdate[clusterareanum];
 				nextupdate->areanum = nextareanum;
 				nextupdate->tmptraveltime = t;
 				//VectorCopy(reach->start, nextupdate->start);
@@ -1394,14 +1671,312 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_FillAreaRoutingCacheFIFO
+//===========================================================================
+// bucket queue on the travel times of routing updates (Dial's algorithm)
+// the travel times taken from the queue never decrease, so the buckets are
+// a ring of slots indexed by travel time, updates that are too far ahead for
+// the ring wait in an overflow list
+//===========================================================================
+#define BUCKETQUEUE_SLOTS			1024		//must be a power of two
+#define BUCKETQUEUE_MASK			(BUCKETQUEUE_SLOTS - 1)
+#define BUCKETQUEUE_WORDS			(BUCKETQUEUE_SLOTS / 32)
+
+typedef struct aas_bucketqueue_s
+{
+	int base;									//travel time last taken from the queue
+	int overflowmin;							//lowest travel time in the overflow list
+	aas_routingupdate_t *overflow;				//updates too far ahead for the slots
+	unsigned int used[BUCKETQUEUE_WORDS];		//bit set for every slot with updates
+	aas_routingupdate_t *slots[BUCKETQUEUE_SLOTS];
+} aas_bucketqueue_t;
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_LowestBit(unsigned int bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(bits);
+#else
+	int n;
+
+	for (n = 0; !(bits & 1); n++) bits >>= 1;
+	return n;
+#endif
+} //end of the function AAS_LowestBit
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_BucketQueueInit(aas_bucketqueue_t *queue, int base)
+{
+	queue->base = base;
+	queue->overflowmin = 0;
+	queue->overflow = NULL;
+	Com_Memset(queue->used, 0, sizeof(queue->used));
+} //end of the function AAS_BucketQueueInit
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE void AAS_BucketQueueInsert(aas_bucketqueue_t *queue, aas_routingupdate_t *update)
+{
+	int slot;
+
+	update->prev = NULL;
+	if (update->tmptraveltime - queue->base < BUCKETQUEUE_SLOTS)
+	{
+		slot = update->tmptraveltime & BUCKETQUEUE_MASK;
+		if (queue->used[slot >> 5] & (1u << (slot & 31)))
+		{
+			update->next = queue->slots[slot];
+			update->next->prev = update;
+		} //end if
+		else
+		{
+			update->next = NULL;
+			queue->used[slot >> 5] |= 1u << (slot & 31);
+		} //end else
+		queue->slots[slot] = update;
+		update->bucket = slot;
+	} //end if
+	else
+	{
+		if (!queue->overflow || update->tmptraveltime < queue->overflowmin)
+		{
+			queue->overflowmin = update->tmptraveltime;
+		} //end if
+		update->next = queue->overflow;
+		if (update->next) update->next->prev = update;
+		queue->overflow = update;
+		update->bucket = -1;
+	} //end else
+	update->inlist = qtrue;
+} //end of the function AAS_BucketQueueInsert
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE void AAS_BucketQueueRemove(aas_bucketqueue_t *queue, aas_routingupdate_t *update)
+{
+	if (update->prev)
+	{
+		update->prev->next = update->next;
+	} //end if
+	else if (update->bucket < 0)
+	{
+		queue->overflow = update->next;
+	} //end else if
+	else
+	{
+		queue->slots[update->bucket] = update->next;
+		if (!update->next) queue->used[update->bucket >> 5] &= ~(1u << (update->bucket & 31));
+	} //end else
+	if (update->next) update->next->prev = update->prev;
+	update->inlist = qfalse;
+} //end of the function AAS_BucketQueueRemove
+//===========================================================================
+// the overflow updates close enough to the lowest one are moved to the slots
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_BucketQueueRebase(aas_bucketqueue_t *queue)
+{
+	aas_routingupdate_t *update, *nextupdate;
+
+	queue->base = queue->overflowmin;
+	update = queue->overflow;
+	queue->overflow = NULL;
+	for (; update; update = nextupdate)
+	{
+		nextupdate = update->next;
+		AAS_BucketQueueInsert(queue, update);
+	} //end for
+} //end of the function AAS_BucketQueueRebase
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				the update with the lowest travel time or NULL
+// Changes Globals:		-
+//===========================================================================
+static aas_routingupdate_t *AAS_BucketQueuePop(aas_bucketqueue_t *queue)
+{
+	int i, slot, word, traveltime;
+	unsigned int bits;
+	aas_routingupdate_t *update;
+
+	while(1)
+	{
+		//find the first used slot on the ring starting at the base
+		slot = queue->base & BUCKETQUEUE_MASK;
+		word = slot >> 5;
+		bits = queue->used[word] & (~0u << (slot & 31));
+		for (i = 0; !bits && i < BUCKETQUEUE_WORDS; i++)
+		{
+			word = (word + 1) & (BUCKETQUEUE_WORDS - 1);
+			bits = queue->used[word];
+		} //end for
+		if (bits)
+		{
+			slot = (word << 5) + AAS_LowestBit(bits);
+			traveltime = queue->base + ((slot - queue->base) & BUCKETQUEUE_MASK);
+		} //end if
+		//the overflow list may have caught up with the slots
+		if (queue->overflow && (!bits || queue->overflowmin <= traveltime))
+		{
+			AAS_BucketQueueRebase(queue);
+			continue;
+		} //end if
+		if (!bits) return NULL;
+		queue->base = traveltime;
+		update = queue->slots[slot];
+		AAS_BucketQueueRemove(queue, update);
+		return update;
+	} //end while
+} //end of the function AAS_BucketQueuePop
+//===========================================================================
+// same as AAS_FillAreaRoutingCacheFIFO but every area is expanded only once,
+// in order of travel time, using the routing links
+//
+// Parameter:			areacache		: routing cache to update
+//						areaupdate		: routing update fields for the cluster
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FillAreaRoutingCacheBuckets(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate)
+{
+	int i, t, areanum, nextareanum, cluster, badtravelflags, clusterareanum;
+	int numreachabilityareas;
+	unsigned short int startareatraveltimes[128]; //NOTE: not more than 128 reachabilities per area allowed
+	aas_routingupdate_t *curupdate, *nextupdate;
+	const aas_routinglink_t *link, *lastlink;
+	aas_bucketqueue_t queue;
+
+	//number of reachability areas within this cluster
+	numreachabilityareas = aasworld.clusters[areacache->cluster].numreachabilityareas;
+	//
+	badtravelflags = ~areacache->travelflags;
+	//
+	clusterareanum = AAS_ClusterAreaNum(areacache->cluster, areacache->areanum);
+	if (clusterareanum >= numreachabilityareas) return;
+	//
+	Com_Memset(startareatraveltimes, 0, sizeof(startareatraveltimes));
+	//
+	curupdate = &areaupdate[clusterareanum];
+	curupdate->areanum = areacache->areanum;
+	curupdate->areatraveltimes = startareatraveltimes;
+	curupdate->tmptraveltime = areacache->starttraveltime;
+	//
+	areacache->traveltimes[clusterareanum] = areacache->starttraveltime;
+	AAS_BucketQueueInit(&queue, curupdate->tmptraveltime);
+	AAS_BucketQueueInsert(&queue, curupdate);
+	//while there are updates in the queue
+	while ((curupdate = AAS_BucketQueuePop(&queue)) != NULL)
+	{
+		areanum = curupdate->areanum;
+		//all the reversed reachability links lead into the area of the update
+		if (aasworld.areasettings[areanum].areaflags & AREA_DISABLED) continue;
+		if (AAS_AreaContentsTravelFlags_inline(areanum) & badtravelflags) continue;
+		//
+		link = &aasworld.routinglinks[aasworld.routinglinkindex[areanum]];
+		lastlink = &aasworld.routinglinks[aasworld.routinglinkindex[areanum + 1]];
+		for (i = 0; link < lastlink; link++, i++)
+		{
+			//if there is used an undesired travel type
+			if (link->travelflags & badtravelflags) continue;
+			//number of the area the reversed reachability leads to
+			nextareanum = link->areanum;
+			//get the cluster number of the area
+			cluster = aasworld.areasettings[nextareanum].cluster;
+			//don't leave the cluster
+			if (cluster > 0 && cluster != areacache->cluster) continue;
+			//get the number of the area in the cluster
+			clusterareanum = AAS_ClusterAreaNum(areacache->cluster, nextareanum);
+			if (clusterareanum >= numreachabilityareas) continue;
+			//time already travelled plus the traveltime through
+			//the current area plus the travel time from the reachability
+			t = curupdate->tmptraveltime + curupdate->areatraveltimes[i] + link->traveltime;
+			if (t > 0xffff) continue;
+			//
+			if (!areacache->traveltimes[clusterareanum] ||
+					areacache->traveltimes[clusterareanum] > t)
+			{
+				areacache->traveltimes[clusterareanum] = t;
+				areacache->reachabilities[clusterareanum] = link->reachnum;
+				nextupdate = &areaupdate[clusterareanum];
+				if (nextupdate->inlist) AAS_BucketQueueRemove(&queue, nextupdate);
+				nextupdate->areanum = nextareanum;
+				nextupdate->tmptraveltime = t;
+				nextupdate->areatraveltimes = aasworld.areatraveltimes[nextareanum][link->reachnum];
+				AAS_BucketQueueInsert(&queue, nextupdate);
+			} //end if
+		} //end for
+	} //end while
+} //end of the function AAS_FillAreaRoutingCacheBuckets
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FillAreaRoutingCache(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate)
+{
+	if (fiforouting) AAS_FillAreaRoutingCacheFIFO(areacache, areaupdate);
+	else AAS_FillAreaRoutingCacheBuckets(areacache, areaupdate);
+} //end of the function AAS_FillAreaRoutingCache
+//===========================================================================
+// update the given routing cache
+//
+// Parameter:			areacache		: routing cache to update
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+{
+#ifdef ROUTING_DEBUG
+	numareacacheupdates++;
+#endif //ROUTING_DEBUG
+	//
+	aasworld.frameroutingupdates++;
+	AAS_FillAreaRoutingCache(areacache, aasworld.areaupdate);
 } //end of the function AAS_UpdateAreaRoutingCache
 //===========================================================================
+// find the routing cache of an area without touching the cache LRU list
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int travelflags)
+static aas_routingcache_t *AAS_FindAreaRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	for (cache = aasworld.clusterareacache[clusternum][AAS_ClusterAreaNum(clusternum, areanum)]; cache; cache = cache->next)
+	{
+		//if there aren't used any undesired travel types for the cache
+		if (cache->travelflags == travelflags) break;
+	} //end for
+	return cache;
+} //end of the function AAS_FindAreaRoutingCache
+//===========================================================================
+// create an empty routing cache for an area and add it to the cluster cache
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_CreateAreaRoutingCache(int clusternum, int areanum, int travelflags)
 {
 	int clusterareanum;
 	aas_routingcache_t *cache, *clustercache;
@@ -1410,29 +1985,42 @@ aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int tra
 	clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
 	//pointer to the cache for the area in the cluster
 	clustercache = aasworld.clusterareacache[clusternum][clusterareanum];
+	//
+	cache = AAS_AllocRoutingCache(aasworld.clusters[clusternum].numreachabilityareas);
+	cache->type = CACHETYPE_AREA;
+	cache->cluster = clusternum;
+	cache->areanum = areanum;
+	VectorCopy(aasworld.areas[areanum].center, cache->origin);
+	cache->starttraveltime = 1;
+	cache->travelflags = travelflags;
+	cache->prev = NULL;
+	cache->next = clustercache;
+	if (clustercache) clustercache->prev = cache;
+	aasworld.clusterareacache[clusternum][clusterareanum] = cache;
+	return cache;
+} //end of the function AAS_CreateAreaRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
 	//find the cache without undesired travel flags
-	for (cache = clustercache; cache; cache = cache->next)
-	{
-		//if there aren't used any undesired travel types for the cache
-		if (cache->travelflags == travelflags) break;
-	} //end for
+	cache = AAS_FindAreaRoutingCache(clusternum, areanum, travelflags);
 	//if there was no cache
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache(aasworld.clusters[clusternum].numreachabilityareas);
-		cache->cluster = clusternum;
-		cache->areanum = areanum;
-		VectorCopy(aasworld.areas[areanum].center, cache->origin);
-		cache->starttraveltime = 1;
-		cache->travelflags = travelflags;
-		cache->prev = NULL;
-		cache->next = clustercache;
-		if (clustercache) clustercache->prev = cache;
-		aasworld.clusterareacache[clusternum][clusterareanum] = cache;
+		numareacachemisses++;
+		cache = AAS_CreateAreaRoutingCache(clusternum, areanum, travelflags);
 		AAS_UpdateAreaRoutingCache(cache);
 	} //end if
 	else
 	{
+		numareacachehits++;
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
@@ -1442,12 +2030,16 @@ aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int tra
 	return cache;
 } //end of the function AAS_GetAreaRoutingCache
 //===========================================================================
+// calculate the travel times of the given portal cache, when cachedonly is
+// set only the existing area caches are used and no shared state is changed
 //
-// Parameter:			-
+// Parameter:			portalcache		: portal cache to update
+//						portalupdate	: routing update fields for all portals
+//						cachedonly		: don't create missing area caches
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+static void AAS_FillPortalRoutingCache(aas_routingcache_t *portalcache, aas_routingupdate_t *portalupdate, qboolean cachedonly)
 {
 	int i, portalnum, clusterareanum, clusternum;
 	unsigned short int t;
@@ -1456,13 +2048,10 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 	aas_routingcache_t *cache;
 	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
 
-#ifdef ROUTING_DEBUG
-	numportalcacheupdates++;
-#endif //ROUTING_DEBUG
 	//clear the routing update fields
-//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+//	Com_Memset(portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
 	//
-	curupdate = &aasworld.portalupdate[aasworld.numportals];
+	curupdate = &portalupdate[aasworld.numportals];
 	curupdate->cluster = portalcache->cluster;
 	curupdate->areanum = portalcache->areanum;
 	curupdate->tmptraveltime = portalcache->starttraveltime;
@@ -1490,8 +2079,18 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 		//
 		cluster = &aasworld.clusters[curupdate->cluster];
 		//
-		cache = AAS_GetAreaRoutingCache(curupdate->cluster,
+		if (cachedonly)
+		{
+			//an area without cache has no travel times to any portal
+			cache = AAS_FindAreaRoutingCache(curupdate->cluster,
 								curupdate->areanum, portalcache->travelflags);
+			if (!cache) continue;
+		} //end if
+		else
+		{
+			cache = AAS_GetAreaRoutingCache(curupdate->cluster,
+								curupdate->areanum, portalcache->travelflags);
+		} //end else
 		//take all portals of the cluster
 		for (i = 0; i < cluster->numportals; i++)
 		{
@@ -1511,7 +2110,7 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 					portalcache->traveltimes[portalnum] > t)
 			{
 				portalcache->traveltimes[portalnum] = t;
-				nextupdate = &aasworld.portalupdate[portalnum];
+				nextupdate = &portalupdate[portalnum];
 				if (portal->frontcluster == curupdate->cluster)
 				{
 					nextupdate->cluster = portal->backcluster;
@@ -1538,6 +2137,19 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_FillPortalRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+{
+#ifdef ROUTING_DEBUG
+	numportalcacheupdates++;
+#endif //ROUTING_DEBUG
+	AAS_FillPortalRoutingCache(portalcache, aasworld.portalupdate, qfalse);
 } //end of the function AAS_UpdatePortalRoutingCache
 //===========================================================================
 //
@@ -1545,34 +2157,64 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int travelflags)
+static aas_routingcache_t *AAS_FindPortalRoutingCache(int areanum, int travelflags)
 {
 	aas_routingcache_t *cache;
 
-	//find the cached portal routing if existing
 	for (cache = aasworld.portalcache[areanum]; cache; cache = cache->next)
 	{
 		if (cache->travelflags == travelflags) break;
 	} //end for
+	return cache;
+} //end of the function AAS_FindPortalRoutingCache
+//===========================================================================
+// create an empty portal routing cache for a goal area
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_CreatePortalRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	cache = AAS_AllocRoutingCache(aasworld.numportals);
+	cache->type = CACHETYPE_PORTAL;
+	cache->cluster = clusternum;
+	cache->areanum = areanum;
+	VectorCopy(aasworld.areas[areanum].center, cache->origin);
+	cache->starttraveltime = 1;
+	cache->travelflags = travelflags;
+	//add the cache to the cache list
+	cache->prev = NULL;
+	cache->next = aasworld.portalcache[areanum];
+	if (aasworld.portalcache[areanum]) aasworld.portalcache[areanum]->prev = cache;
+	aasworld.portalcache[areanum] = cache;
+	return cache;
+} //end of the function AAS_CreatePortalRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	//find the cached portal routing if existing
+	cache = AAS_FindPortalRoutingCache(areanum, travelflags);
 	//if the portal routing isn't cached
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache(aasworld.numportals);
-		cache->cluster = clusternum;
-		cache->areanum = areanum;
-		VectorCopy(aasworld.areas[areanum].center, cache->origin);
-		cache->starttraveltime = 1;
-		cache->travelflags = travelflags;
-		//add the cache to the cache list
-		cache->prev = NULL;
-		cache->next = aasworld.portalcache[areanum];
-		if (aasworld.portalcache[areanum]) aasworld.portalcache[areanum]->prev = cache;
-		aasworld.portalcache[areanum] = cache;
+		numportalcachemisses++;
+		cache = AAS_CreatePortalRoutingCache(clusternum, areanum, travelflags);
 		//update the cache
 		AAS_UpdatePortalRoutingCache(cache);
 	} //end if
 	else
 	{
+		numportalcachehits++;
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
@@ -1582,12 +2224,185 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 	return cache;
 } //end of the function AAS_GetPortalRoutingCache
 //===========================================================================
+// travel flags the routing caches are filled in for at map load
+//===========================================================================
+static const int aas_warmuptravelflags[] =
+{
+	TFL_DEFAULT,
+	TFL_DEFAULT|TFL_ROCKETJUMP
+};
+
+#define MAX_WARMUPJOBS				64
+
+typedef struct aas_warmup_s
+{
+	int numjobs;							//number of jobs the caches are spread over
+	int numcaches;							//number of caches to fill
+	aas_routingcache_t **caches;			//caches to fill
+	aas_routingupdate_t *update[MAX_WARMUPJOBS];	//routing update fields of every job
+} aas_warmup_t;
+//===========================================================================
+// every job fills an interleaved share of the caches using its own
+// routing update fields
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_WarmUpAreaCacheJob(void *data, int index)
+{
+	aas_warmup_t *warmup = (aas_warmup_t *) data;
+	int i;
+
+	for (i = index; i < warmup->numcaches; i += warmup->numjobs)
+	{
+		AAS_FillAreaRoutingCache(warmup->caches[i], warmup->update[index]);
+	} //end for
+} //end of the function AAS_WarmUpAreaCacheJob
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags, int *traveltime, int *reachnum)
+static void AAS_WarmUpPortalCacheJob(void *data, int index)
+{
+	aas_warmup_t *warmup = (aas_warmup_t *) data;
+	int i;
+
+	for (i = index; i < warmup->numcaches; i += warmup->numjobs)
+	{
+		AAS_FillPortalRoutingCache(warmup->caches[i], warmup->update[index], qtrue);
+	} //end for
+} //end of the function AAS_WarmUpPortalCacheJob
+//===========================================================================
+// add an area cache to the warm-up if it doesn't exist yet
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_WarmUpAddAreaCache(aas_warmup_t *warmup, int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	//only reachability areas have travel times
+	if (AAS_ClusterAreaNum(clusternum, areanum) >= aasworld.clusters[clusternum].numreachabilityareas) return;
+	if (AAS_FindAreaRoutingCache(clusternum, areanum, travelflags)) return;
+	cache = AAS_CreateAreaRoutingCache(clusternum, areanum, travelflags);
+	cache->time = AAS_RoutingTime();
+	AAS_LinkCache(cache);
+	warmup->caches[warmup->numcaches++] = cache;
+} //end of the function AAS_WarmUpAddAreaCache
+//===========================================================================
+// fill the area and portal routing caches for the common travel flags,
+// the caches are allocated here and filled in by numthreads threads
+//
+// Parameter:			numthreads		: number of threads to use
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_WarmUpRoutingCache(int numthreads)
+{
+	int i, j, n, size, maxupdates, travelflags, clusternum, starttime;
+	int numareacaches, numportalcaches;
+	aas_warmup_t warmup;
+	aas_portal_t *portal;
+	aas_routingcache_t *cache;
+
+	if (numthreads > MAX_WARMUPJOBS) numthreads = MAX_WARMUPJOBS;
+	starttime = botimport.Sys_Milliseconds();
+	//the routing update fields are shared by the area and portal passes
+	maxupdates = aasworld.numportals + 1;
+	n = 0;
+	for (i = 1; i < aasworld.numclusters; i++)
+	{
+		if (aasworld.clusters[i].numreachabilityareas > maxupdates)
+			maxupdates = aasworld.clusters[i].numreachabilityareas;
+		n += aasworld.clusters[i].numareas;
+	} //end for
+	if (n < aasworld.numareas) n = aasworld.numareas;
+	Com_Memset(&warmup, 0, sizeof(warmup));
+	warmup.numjobs = numthreads;
+	warmup.caches = (aas_routingcache_t **) GetMemory(n * sizeof(aas_routingcache_t *));
+	for (i = 0; i < warmup.numjobs; i++)
+	{
+		warmup.update[i] = (aas_routingupdate_t *) GetClearedMemory(maxupdates * sizeof(aas_routingupdate_t));
+	} //end for
+	numareacaches = 0;
+	numportalcaches = 0;
+	for (j = 0; j < ARRAY_LEN(aas_warmuptravelflags); j++)
+	{
+		travelflags = aas_warmuptravelflags[j];
+		//don't fill in more than the cache eviction would throw away again
+		size = 0;
+		for (i = 1; i < aasworld.numclusters; i++)
+		{
+			n = aasworld.clusters[i].numreachabilityareas;
+			size += n * AAS_RoutingCacheSize(n);
+		} //end for
+		for (i = 1; i < aasworld.numareas; i++)
+		{
+			if (AAS_AreaReachability(i)) size += AAS_RoutingCacheSize(aasworld.numportals);
+		} //end for
+		if (routingcachesize + size > max_routingcachesize)
+		{
+			botimport.Print(PRT_WARNING, "routing cache warm-up for travel flags 0x%x needs %d KB, max_routingcache is %d KB\n",
+								travelflags, (routingcachesize + size) >> 10, max_routingcachesize >> 10);
+			break;
+		} //end if
+		//area caches for all reachability areas and portals of every cluster
+		warmup.numcaches = 0;
+		for (i = 1; i < aasworld.numareas; i++)
+		{
+			clusternum = aasworld.areasettings[i].cluster;
+			if (clusternum > 0)
+			{
+				AAS_WarmUpAddAreaCache(&warmup, clusternum, i, travelflags);
+			} //end if
+			else if (clusternum < 0)
+			{
+				portal = &aasworld.portals[-clusternum];
+				AAS_WarmUpAddAreaCache(&warmup, portal->frontcluster, i, travelflags);
+				AAS_WarmUpAddAreaCache(&warmup, portal->backcluster, i, travelflags);
+			} //end else if
+		} //end for
+		botimport.RunJobs(AAS_WarmUpAreaCacheJob, &warmup, warmup.numjobs, numthreads);
+		numareacaches += warmup.numcaches;
+		//portal caches for all goal areas, these only read the area caches
+		warmup.numcaches = 0;
+		for (i = 1; i < aasworld.numareas; i++)
+		{
+			if (!AAS_AreaReachability(i)) continue;
+			if (AAS_FindPortalRoutingCache(i, travelflags)) continue;
+			clusternum = aasworld.areasettings[i].cluster;
+			//just assume the goal area is part of the front cluster
+			if (clusternum < 0) clusternum = aasworld.portals[-clusternum].frontcluster;
+			cache = AAS_CreatePortalRoutingCache(clusternum, i, travelflags);
+			cache->time = AAS_RoutingTime();
+			AAS_LinkCache(cache);
+			warmup.caches[warmup.numcaches++] = cache;
+		} //end for
+		botimport.RunJobs(AAS_WarmUpPortalCacheJob, &warmup, warmup.numjobs, numthreads);
+		numportalcaches += warmup.numcaches;
+	} //end for
+	for (i = 0; i < warmup.numjobs; i++)
+	{
+		FreeMemory(warmup.update[i]);
+	} //end for
+	FreeMemory(warmup.caches);
+	botimport.Print(PRT_MESSAGE, "routing cache warm-up: %d area and %d portal caches in %d msec on %d threads\n",
+						numareacaches, numportalcaches, botimport.Sys_Milliseconds() - starttime, numthreads);
+} //end of the function AAS_WarmUpRoutingCache
+//===========================================================================
+// when cachedonly is set no routing caches are created, evicted or moved on
+// the LRU list and -1 is returned if one of the needed caches doesn't exist
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_AreaRouteToGoalAreaCache(int areanum, vec3_t origin, int goalareanum, int travelflags, int *traveltime, int *reachnum, qboolean cachedonly)
 {
 	int clusternum, goalclusternum, portalnum, i, clusterareanum, bestreachnum;
 	unsigned short int t, besttime;
@@ -1626,8 +2441,10 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		return qfalse;
 	} //end if
 
-	// make sure the routing cache doesn't grow to large
-	while ( routingcachesize > 2 * 1024 * 1024 ) {
+	// make sure the routing cache doesn't grow to large, this is done here
+	// and not on allocation because a routing update holds on to the cache
+	// it is filling in
+	while ( !cachedonly && routingcachesize > max_routingcachesize ) {
 		if ( !AAS_FreeOldestCache() ) {
 			break;
 		}
@@ -1676,7 +2493,9 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 	if (clusternum > 0 && goalclusternum > 0 && clusternum == goalclusternum)
 	{
 		//
-		areacache = AAS_GetAreaRoutingCache(clusternum, goalareanum, travelflags);
+		if (cachedonly) areacache = AAS_FindAreaRoutingCache(clusternum, goalareanum, travelflags);
+		else areacache = AAS_GetAreaRoutingCache(clusternum, goalareanum, travelflags);
+		if (!areacache) return -1;
 		//the number of the area in the cluster
 		clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
 		//the cluster the area is in
@@ -1710,7 +2529,9 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		goalclusternum = portal->frontcluster;
 	} //end if
 	//get the portal routing cache
-	portalcache = AAS_GetPortalRoutingCache(goalclusternum, goalareanum, travelflags);
+	if (cachedonly) portalcache = AAS_FindPortalRoutingCache(goalareanum, travelflags);
+	else portalcache = AAS_GetPortalRoutingCache(goalclusternum, goalareanum, travelflags);
+	if (!portalcache) return -1;
 	//if the area is a cluster portal, read directly from the portal cache
 	if (clusternum < 0)
 	{
@@ -1733,7 +2554,9 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		//
 		portal = &aasworld.portals[portalnum];
 		//get the cache of the portal area
-		areacache = AAS_GetAreaRoutingCache(clusternum, portal->areanum, travelflags);
+		if (cachedonly) areacache = AAS_FindAreaRoutingCache(clusternum, portal->areanum, travelflags);
+		else areacache = AAS_GetAreaRoutingCache(clusternum, portal->areanum, travelflags);
+		if (!areacache) return -1;
 		//current area inside the current cluster
 		clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
 		//if the area is NOT a reachability area
@@ -1770,6 +2593,16 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 	*reachnum = bestreachnum;
 	*traveltime = besttime;
 	return qtrue;
+} //end of the function AAS_AreaRouteToGoalAreaCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags, int *traveltime, int *reachnum)
+{
+	return AAS_AreaRouteToGoalAreaCache(areanum, origin, goalareanum, travelflags, traveltime, reachnum, qfalse);
 } //end of the function AAS_AreaRouteToGoalArea
 //===========================================================================
 //
@@ -1788,6 +2621,25 @@ int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, in
 	return 0;
 } //end of the function AAS_AreaTravelTimeToGoalArea
 //===========================================================================
+// same as AAS_AreaTravelTimeToGoalArea but only reads the routing caches
+// that already exist, so it can be called from several threads at once
+// as long as nothing else changes the routing caches
+//
+// Parameter:			-
+// Returns:				travel time, 0 if the goal isn't reachable and
+//						-1 if a routing cache needed for the answer is missing
+// Changes Globals:		-
+//===========================================================================
+int AAS_AreaTravelTimeToGoalAreaCached(int areanum, vec3_t origin, int goalareanum, int travelflags)
+{
+	int result, traveltime, reachnum = 0;
+
+	result = AAS_AreaRouteToGoalAreaCache(areanum, origin, goalareanum, travelflags, &traveltime, &reachnum, qtrue);
+	if (result < 0) return -1;
+	if (result) return traveltime;
+	return 0;
+} //end of the function AAS_AreaTravelTimeToGoalAreaCached
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -39,6 +39,8 @@ unsigned short int AAS_AreaTravelTime(int areanum, vec3_t start, vec3_t end);
 //
 void AAS_CreateAllRoutingCache(void);
 void AAS_WriteRouteCache(void);
+//fill the routing caches for the common travel flags on several threads
+void AAS_WarmUpRoutingCache(int numthreads);
 //
 void AAS_RoutingInfo(void);
 #endif //AASINTERN
@@ -59,6 +61,11 @@ int AAS_EnableRoutingArea(int areanum, int enable);
 unsigned short int AAS_AreaTravelTime(int areanum, vec3_t start, vec3_t end);
 //returns the travel time from the area to the goal area using the given travel flags
 int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags);
+//same as above but only reads existing routing caches, returns -1 if one is missing
+//safe to call from several threads as long as no routing caches are changed meanwhile
+int AAS_AreaTravelTimeToGoalAreaCached(int areanum, vec3_t origin, int goalareanum, int travelflags);
+//prints routing cache hit rate, evictions and memory use
+void AAS_RoutingCacheStats(void);
 //predict a route up to a stop event
 int AAS_PredictRoute(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
@@ -192,6 +192,8 @@ campspot_t *campspots = NULL;
 int g_gametype = 0;
 //additional dropped item weight
 libvar_t *droppedweight = NULL;
+//threads used to choose item goals for a batch of bots
+libvar_t *goalthreads = NULL;
 
 //========================================================================
 //
@@ -1284,48 +1286,61 @@ int BotGetSecondGoal(int goalstate, bot_goal_t *goal)
 	return qtrue;
 } //end of the function BotGetSecondGoal
 //===========================================================================
-// pops a new long term goal on the goal stack in the goalstate
+// returns the travel time, when cachedonly is set only existing routing
+// caches are used and -1 is returned if one is missing
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelflags)
+static int BotItemTravelTime(int areanum, vec3_t origin, int goalareanum, int travelflags, qboolean cachedonly)
+{
+	if (cachedonly)
+		return AAS_AreaTravelTimeToGoalAreaCached(areanum, origin, goalareanum, travelflags);
+	return AAS_AreaTravelTimeToGoalArea(areanum, origin, goalareanum, travelflags);
+} //end of the function BotItemTravelTime
+//===========================================================================
+// finds the best long term or nearby goal item, doesn't change the goal
+// state so with cachedonly set it can be called from worker threads
+//
+// Parameter:				-
+// Returns:					the best item or NULL, *missing is set when a
+//							routing cache was needed that doesn't exist
+// Changes Globals:		-
+//===========================================================================
+static levelitem_t *BotBestItemGoal(int goalstate, int areanum, vec3_t origin, int *inventory, int travelflags,
+										qboolean nearby, bot_goal_t *ltg, float maxtime,
+										unsigned int *seed, qboolean cachedonly, qboolean *missing)
 {
-	int areanum, t, weightnum;
+	int t, weightnum, ltg_time;
 	float weight, bestweight, avoidtime;
 	iteminfo_t *iteminfo;
 	itemconfig_t *ic;
 	levelitem_t *li, *bestitem;
-	bot_goal_t goal;
 	bot_goalstate_t *gs;
 
+	*missing = qfalse;
 	gs = BotGoalStateFromHandle(goalstate);
 	if (!gs)
-		return qfalse;
-	if (!gs->itemweightconfig)
-		return qfalse;
-	//get the area the bot is in
-	areanum = BotReachabilityArea(origin, gs->client);
-	//if the bot is in solid or if the area the bot is in has no reachability links
-	if (!areanum || !AAS_AreaReachability(areanum))
+		return NULL;
+	//
+	if (ltg)
 	{
-		//use the last valid area the bot was in
-		areanum = gs->lastreachabilityarea;
+		ltg_time = BotItemTravelTime(areanum, origin, ltg->areanum, travelflags, cachedonly);
+		if (ltg_time < 0)
+		{
+			*missing = qtrue;
+			return NULL;
+		} //end if
 	} //end if
-	//remember the last area with reachabilities the bot was in
-	gs->lastreachabilityarea = areanum;
-	//if still in solid
-	if (!areanum)
-		return qfalse;
+	else ltg_time = 99999;
 	//the item configuration
 	ic = itemconfig;
 	if (!itemconfig)
-		return qfalse;
+		return NULL;
 	//best weight and item so far
 	bestweight = 0;
 	bestitem = NULL;
-	Com_Memset(&goal, 0, sizeof(bot_goal_t));
 	//go through the items in the level
 	for (li = levelitems; li; li = li->next)
 	{
@@ -1354,9 +1369,9 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 		weightnum = gs->itemweightindex[iteminfo->number];
 		if (weightnum < 0)
 			continue;
-
+		//
 #ifdef UNDECIDEDFUZZY
-		weight = FuzzyWeightUndecided(inventory, gs->itemweightconfig, weightnum);
+		weight = FuzzyWeightUndecidedSeed(inventory, gs->itemweightconfig, weightnum, seed);
 #else
 		weight = FuzzyWeight(inventory, gs->itemweightconfig, weightnum);
 #endif //UNDECIDEDFUZZY
@@ -1371,9 +1386,14 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 		if (weight > 0)
 		{
 			//get the travel time towards the goal area
-			t = AAS_AreaTravelTimeToGoalArea(areanum, origin, li->goalareanum, travelflags);
+			t = BotItemTravelTime(areanum, origin, li->goalareanum, travelflags, cachedonly);
+			if (t < 0)
+			{
+				*missing = qtrue;
+				return NULL;
+			} //end if
 			//if the goal is reachable
-			if (t > 0)
+			if (t > 0 && (!nearby || t < maxtime))
 			{
 				//if this item won't respawn before we get there
 				avoidtime = BotAvoidGoalTime(goalstate, li->number);
@@ -1384,41 +1404,49 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 				//
 				if (weight > bestweight)
 				{
-					bestweight = weight;
-					bestitem = li;
+					t = 0;
+					if (ltg && !li->timeout)
+					{
+						//get the travel time from the goal to the long term goal
+						t = BotItemTravelTime(li->goalareanum, li->goalorigin, ltg->areanum, travelflags, cachedonly);
+						if (t < 0)
+						{
+							*missing = qtrue;
+							return NULL;
+						} //end if
+					} //end if
+					//if the travel back is possible and doesn't take too long
+					if (t <= ltg_time)
+					{
+						bestweight = weight;
+						bestitem = li;
+					} //end if
 				} //end if
 			} //end if
 		} //end if
 	} //end for
-	//if no goal item found
-	if (!bestitem)
-	{
-		/*
-		//if not in lava or slime
-		if (!AAS_AreaLava(areanum) && !AAS_AreaSlime(areanum))
-		{
-			if (AAS_RandomGoalArea(areanum, travelflags, &goal.areanum, goal.origin))
-			{
-				VectorSet(goal.mins, -15, -15, -15);
-				VectorSet(goal.maxs, 15, 15, 15);
-				goal.entitynum = 0;
-				goal.number = 0;
-				goal.flags = GFL_ROAM;
-				goal.iteminfo = 0;
-				//push the goal on the stack
-				BotPushGoal(goalstate, &goal);
-				//
-#ifdef DEBUG
-				botimport.Print(PRT_MESSAGE, "chosen roam goal area %d\n", goal.areanum);
-#endif //DEBUG
-				return qtrue;
-			} //end if
-		} //end if
-		*/
-		return qfalse;
-	} //end if
+	return bestitem;
+} //end of the function BotBestItemGoal
+//===========================================================================
+// avoids the item for a while and pushes it on the goal stack
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotPushItemGoal(int goalstate, levelitem_t *bestitem)
+{
+	float avoidtime;
+	iteminfo_t *iteminfo;
+	bot_goal_t goal;
+	bot_goalstate_t *gs;
+
+	gs = BotGoalStateFromHandle(goalstate);
+	if (!gs)
+		return;
+	Com_Memset(&goal, 0, sizeof(bot_goal_t));
 	//create a bot goal for this item
-	iteminfo = &ic->iteminfo[bestitem->iteminfo];
+	iteminfo = &itemconfig->iteminfo[bestitem->iteminfo];
 	VectorCopy(bestitem->goalorigin, goal.origin);
 	VectorCopy(iteminfo->mins, goal.mins);
 	VectorCopy(iteminfo->maxs, goal.maxs);
@@ -1448,31 +1476,18 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 	BotAddToAvoidGoals(gs, bestitem->number, avoidtime);
 	//push the goal on the stack
 	BotPushGoal(goalstate, &goal);
-	//
-	return qtrue;
-} //end of the function BotChooseLTGItem
+} //end of the function BotPushItemGoal
 //===========================================================================
+// returns the area to choose goals from and remembers it in the goal state
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelflags,
-														bot_goal_t *ltg, float maxtime)
+static int BotGoalChoiceArea(bot_goalstate_t *gs, vec3_t origin)
 {
-	int areanum, t, weightnum, ltg_time;
-	float weight, bestweight, avoidtime;
-	iteminfo_t *iteminfo;
-	itemconfig_t *ic;
-	levelitem_t *li, *bestitem;
-	bot_goal_t goal;
-	bot_goalstate_t *gs;
+	int areanum;
 
-	gs = BotGoalStateFromHandle(goalstate);
-	if (!gs)
-		return qfalse;
-	if (!gs->itemweightconfig)
-		return qfalse;
 	//get the area the bot is in
 	areanum = BotReachabilityArea(origin, gs->client);
 	//if the bot is in solid or if the area the bot is in has no reachability links
@@ -1483,132 +1498,211 @@ int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 	} //end if
 	//remember the last area with reachabilities the bot was in
 	gs->lastreachabilityarea = areanum;
+	return areanum;
+} //end of the function BotGoalChoiceArea
+//===========================================================================
+// pops a new long term goal on the goal stack in the goalstate
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelflags)
+{
+	int areanum;
+	qboolean missing;
+	levelitem_t *bestitem;
+	bot_goalstate_t *gs;
+
+	gs = BotGoalStateFromHandle(goalstate);
+	if (!gs)
+		return qfalse;
+	if (!gs->itemweightconfig)
+		return qfalse;
+	areanum = BotGoalChoiceArea(gs, origin);
 	//if still in solid
 	if (!areanum)
 		return qfalse;
-	//
-	if (ltg) ltg_time = AAS_AreaTravelTimeToGoalArea(areanum, origin, ltg->areanum, travelflags);
-	else ltg_time = 99999;
-	//the item configuration
-	ic = itemconfig;
-	if (!itemconfig)
-		return qfalse;
-	//best weight and item so far
-	bestweight = 0;
-	bestitem = NULL;
-	Com_Memset(&goal, 0, sizeof(bot_goal_t));
-	//go through the items in the level
-	for (li = levelitems; li; li = li->next)
+	bestitem = BotBestItemGoal(goalstate, areanum, origin, inventory, travelflags,
+								qfalse, NULL, 0, NULL, qfalse, &missing);
+	//if no goal item found
+	if (!bestitem)
 	{
-		if (g_gametype == GT_SINGLE_PLAYER) {
-			if (li->flags & IFL_NOTSINGLE)
-				continue;
-		}
-		else if (g_gametype >= GT_TEAM) {
-			if (li->flags & IFL_NOTTEAM)
-				continue;
-		}
-		else {
-			if (li->flags & IFL_NOTFREE)
-				continue;
-		}
-		if (li->flags & IFL_NOTBOT)
-			continue;
-		//if the item is in a possible goal area
-		if (!li->goalareanum)
-			continue;
-		//FIXME: is this a good thing? added this for items that never spawned into the game (f.i. CTF flags in obelisk)
-		if (!li->entitynum && !(li->flags & IFL_ROAM))
-			continue;
-		//get the fuzzy weight function for this item
-		iteminfo = &ic->iteminfo[li->iteminfo];
-		weightnum = gs->itemweightindex[iteminfo->number];
-		if (weightnum < 0)
-			continue;
-		//
-#ifdef UNDECIDEDFUZZY
-		weight = FuzzyWeightUndecided(inventory, gs->itemweightconfig, weightnum);
-#else
-		weight = FuzzyWeight(inventory, gs->itemweightconfig, weightnum);
-#endif //UNDECIDEDFUZZY
-#ifdef DROPPEDWEIGHT
-		//HACK: to make dropped items more attractive
-		if (li->timeout)
-			weight += droppedweight->value;
-#endif //DROPPEDWEIGHT
-		//use weight scale for item_botroam
-		if (li->flags & IFL_ROAM) weight *= li->weight;
-		//
-		if (weight > 0)
+		/*
+		//if not in lava or slime
+		if (!AAS_AreaLava(areanum) && !AAS_AreaSlime(areanum))
 		{
-			//get the travel time towards the goal area
-			t = AAS_AreaTravelTimeToGoalArea(areanum, origin, li->goalareanum, travelflags);
-			//if the goal is reachable
-			if (t > 0 && t < maxtime)
+			if (AAS_RandomGoalArea(areanum, travelflags, &goal.areanum, goal.origin))
 			{
-				//if this item won't respawn before we get there
-				avoidtime = BotAvoidGoalTime(goalstate, li->number);
-				if (avoidtime - t * 0.009 > 0)
-					continue;
-				//
-				weight /= (float) t * TRAVELTIME_SCALE;
+				VectorSet(goal.mins, -15, -15, -15);
+				VectorSet(goal.maxs, 15, 15, 15);
+				goal.entitynum = 0;
+				goal.number = 0;
+				goal.flags = GFL_ROAM;
+				goal.iteminfo = 0;
+				//push the goal on the stack
+				BotPushGoal(goalstate, &goal);
 				//
-				if (weight > bestweight)
-				{
-					t = 0;
-					if (ltg && !li->timeout)
-					{
-						//get the travel time from the goal to the long term goal
-						t = AAS_AreaTravelTimeToGoalArea(li->goalareanum, li->goalorigin, ltg->areanum, travelflags);
-					} //end if
-					//if the travel back is possible and doesn't take too long
-					if (t <= ltg_time)
-					{
-						bestweight = weight;
-						bestitem = li;
-					} //end if
-				} //end if
+#ifdef DEBUG
+				botimport.Print(PRT_MESSAGE, "chosen roam goal area %d\n", goal.areanum);
+#endif //DEBUG
+				return qtrue;
 			} //end if
 		} //end if
-	} //end for
+		*/
+		return qfalse;
+	} //end if
+	BotPushItemGoal(goalstate, bestitem);
+	//
+	return qtrue;
+} //end of the function BotChooseLTGItem
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelflags,
+														bot_goal_t *ltg, float maxtime)
+{
+	int areanum;
+	qboolean missing;
+	levelitem_t *bestitem;
+	bot_goalstate_t *gs;
+
+	gs = BotGoalStateFromHandle(goalstate);
+	if (!gs)
+		return qfalse;
+	if (!gs->itemweightconfig)
+		return qfalse;
+	areanum = BotGoalChoiceArea(gs, origin);
+	//if still in solid
+	if (!areanum)
+		return qfalse;
+	bestitem = BotBestItemGoal(goalstate, areanum, origin, inventory, travelflags,
+								qtrue, ltg, maxtime, NULL, qfalse, &missing);
 	//if no goal item found
 	if (!bestitem)
 		return qfalse;
-	//create a bot goal for this item
-	iteminfo = &ic->iteminfo[bestitem->iteminfo];
-	VectorCopy(bestitem->goalorigin, goal.origin);
-	VectorCopy(iteminfo->mins, goal.mins);
-	VectorCopy(iteminfo->maxs, goal.maxs);
-	goal.areanum = bestitem->goalareanum;
-	goal.entitynum = bestitem->entitynum;
-	goal.number = bestitem->number;
-	goal.flags = GFL_ITEM;
-	if (bestitem->timeout)
-		goal.flags |= GFL_DROPPED;
-	if (bestitem->flags & IFL_ROAM)
-		goal.flags |= GFL_ROAM;
-	goal.iteminfo = bestitem->iteminfo;
-	//if it's a dropped item
-	if (bestitem->timeout)
-	{
-		avoidtime = AVOID_DROPPED_TIME;
-	} //end if
-	else
-	{
-		avoidtime = iteminfo->respawntime;
-		if (!avoidtime)
-			avoidtime = AVOID_DEFAULT_TIME;
-		if (avoidtime < AVOID_MINIMUM_TIME)
-			avoidtime = AVOID_MINIMUM_TIME;
-	} //end else
-	//add the chosen goal to the goals to avoid for a while
-	BotAddToAvoidGoals(gs, bestitem->number, avoidtime);
-	//push the goal on the stack
-	BotPushGoal(goalstate, &goal);
+	BotPushItemGoal(goalstate, bestitem);
 	//
 	return qtrue;
 } //end of the function BotChooseNBGItem
 //===========================================================================
+// a batch of goal choices shared with the worker threads
+//===========================================================================
+typedef struct bot_goalchoicebatch_s
+{
+	bot_goalchoice_t *choices;
+	int areanum[MAX_CLIENTS];			//area to choose from, 0 if no choice is made
+	unsigned int seed[MAX_CLIENTS];		//random seed for the undecided fuzzy weights
+	qboolean serial[MAX_CLIENTS];		//evaluate on the main thread after the jobs
+	levelitem_t *bestitem[MAX_CLIENTS];	//best item found
+} bot_goalchoicebatch_t;
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static levelitem_t *BotBestItemGoalChoice(bot_goalchoicebatch_t *batch, int index, qboolean cachedonly, qboolean *missing)
+{
+	bot_goalchoice_t *choice;
+	unsigned int seed;
+
+	choice = &batch->choices[index];
+	//every evaluation of the choice starts from the same seed
+	seed = batch->seed[index];
+	return BotBestItemGoal(choice->goalstate, batch->areanum[index], choice->origin, choice->inventory,
+							choice->travelflags, choice->nearby, (choice->nearby && choice->ltg.areanum) ? &choice->ltg : NULL,
+							choice->maxtime, &seed, cachedonly, missing);
+} //end of the function BotBestItemGoalChoice
+//===========================================================================
+// only reads the existing routing caches, choices that need a missing
+// cache are redone on the main thread
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotChooseItemGoalJob(void *data, int index)
+{
+	bot_goalchoicebatch_t *batch = (bot_goalchoicebatch_t *) data;
+	qboolean missing;
+
+	if (!batch->areanum[index] || batch->serial[index])
+		return;
+	batch->bestitem[index] = BotBestItemGoalChoice(batch, index, qtrue, &missing);
+	if (missing)
+		batch->serial[index] = qtrue;
+} //end of the function BotChooseItemGoalJob
+//===========================================================================
+// the bot areas are found and the goal states updated in order on the main
+// thread because that does traces, the item evaluation runs on worker
+// threads and the chosen goals are pushed in order afterwards
+//
+// Parameter:				-
+// Returns:					number of bots that got a new goal
+// Changes Globals:		-
+//===========================================================================
+int BotChooseItemGoals(bot_goalchoice_t *choices, int numchoices)
+{
+	int i, j, numthreads, numchosen;
+	qboolean missing;
+	bot_goalchoicebatch_t batch;
+	bot_goalstate_t *gs;
+
+	if (numchoices > MAX_CLIENTS)
+	{
+		botimport.Print(PRT_ERROR, "BotChooseItemGoals: %d choices, max is %d\n", numchoices, MAX_CLIENTS);
+		numchoices = MAX_CLIENTS;
+	} //end if
+	numthreads = (int) goalthreads->value;
+	batch.choices = choices;
+	for (i = 0; i < numchoices; i++)
+	{
+		choices[i].chosen = qfalse;
+		batch.areanum[i] = 0;
+		batch.serial[i] = qfalse;
+		batch.bestitem[i] = NULL;
+		//the same random numbers whatever the number of threads
+		batch.seed[i] = rand();
+		gs = BotGoalStateFromHandle(choices[i].goalstate);
+		if (!gs || !gs->itemweightconfig)
+			continue;
+		batch.areanum[i] = BotGoalChoiceArea(gs, choices[i].origin);
+		//a bot choosing more than once depends on its earlier choice
+		for (j = 0; j < i; j++)
+		{
+			if (choices[j].goalstate == choices[i].goalstate)
+			{
+				batch.serial[i] = qtrue;
+				break;
+			} //end if
+		} //end for
+		if (numthreads <= 1)
+			batch.serial[i] = qtrue;
+	} //end for
+	if (numthreads > 1)
+	{
+		botimport.RunJobs(BotChooseItemGoalJob, &batch, numchoices, numthreads);
+	} //end if
+	numchosen = 0;
+	for (i = 0; i < numchoices; i++)
+	{
+		if (!batch.areanum[i])
+			continue;
+		if (batch.serial[i])
+			batch.bestitem[i] = BotBestItemGoalChoice(&batch, i, qfalse, &missing);
+		if (!batch.bestitem[i])
+			continue;
+		BotPushItemGoal(choices[i].goalstate, batch.bestitem[i]);
+		choices[i].chosen = qtrue;
+		numchosen++;
+	} //end for
+	return numchosen;
+} //end of the function BotChooseItemGoals
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -1797,6 +1891,7 @@ int BotSetupGoalAI(void)
 	} //end if
 	//
 	droppedweight = LibVar("droppedweight", "1000");
+	goalthreads = LibVar("goalthreads", "1");
 	//everything went ok
 	return BLERR_NOERROR;
 } //end of the function BotSetupGoalAI
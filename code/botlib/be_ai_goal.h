@@ -49,6 +49,21 @@ typedef struct bot_goal_s
 	int iteminfo;				//item information
 } bot_goal_t;
 
+#define MAX_GOALCHOICE_INVENTORY	256
+
+//one bot in a batch of goal choices, no pointers so the game VM can pass an array
+typedef struct bot_goalchoice_s
+{
+	int goalstate;				//goal state of the bot
+	int travelflags;			//travel flags of the bot
+	vec3_t origin;				//origin of the bot
+	int inventory[MAX_GOALCHOICE_INVENTORY];	//inventory of the bot
+	int nearby;					//choose a nearby goal instead of a long term goal
+	bot_goal_t ltg;				//long term goal for a nearby goal, areanum 0 if none
+	float maxtime;				//maximum travel time to a nearby goal
+	int chosen;					//set to true when a goal was pushed on the goal stack
+} bot_goalchoice_t;
+
 //reset the whole goal state, but keep the item weights
 void BotResetGoalState(int goalstate);
 //reset avoid goals
@@ -79,6 +94,13 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 //be larger than the travel time towards the long term goal from the current bot position
 int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelflags,
 							bot_goal_t *ltg, float maxtime);
+//choose a long term or nearby goal item for each of the bots
+//the choices are evaluated on worker threads, the undecided weights come from a
+//random seed per choice so the result only depends on the seeds and not on the
+//number of threads, it is not the same as calling BotChooseLTGItem or
+//BotChooseNBGItem for each bot which use random(), a nearby choice with
+//ltg.areanum 0 is made without a long term goal
+int BotChooseItemGoals(bot_goalchoice_t *choices, int numchoices);
 //returns true if the bot touches the goal
 int BotTouchingGoal(vec3_t origin, bot_goal_t *goal);
 //returns true if the goal should be visible but isn't
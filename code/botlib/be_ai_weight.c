@@ -45,7 +45,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "be_ai_weight.h"
 
 #define MAX_INVENTORYVALUE			999999
-#define EVALUATERECURSIVELY
+#define COMPILEDWEIGHTS
 
 #define MAX_WEIGHT_FILES			128
 weightconfig_t	*weightFileList[MAX_WEIGHT_FILES];
@@ -138,6 +138,7 @@ void FreeWeightConfig2(weightconfig_t *config)
 		FreeFuzzySeperators_r(config->weights[i].firstseperator);
 		if (config->weights[i].name) FreeMemory(config->weights[i].name);
 	} //end for
+	if (config->switches) FreeMemory(config->switches);
 	FreeMemory(config);
 } //end of the function FreeWeightConfig2
 //===========================================================================
@@ -282,6 +283,93 @@ fuzzyseperator_t *ReadFuzzySeperators_r(source_t *source)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+static void CountFuzzySeperators_r(fuzzyseperator_t *fs, int *numswitches, int *numcases)
+{
+	(*numswitches)++;
+	for (; fs; fs = fs->next)
+	{
+		(*numcases)++;
+		if (fs->child) CountFuzzySeperators_r(fs->child, numswitches, numcases);
+	} //end for
+} //end of the function CountFuzzySeperators_r
+//===========================================================================
+// every list of seperators becomes one switch with its cases stored in order
+//
+// Parameter:				-
+// Returns:					number of the compiled switch
+// Changes Globals:		-
+//===========================================================================
+static int CompileFuzzySeperators_r(weightconfig_t *config, fuzzyseperator_t *firstfs)
+{
+	int s, c, n;
+	fuzzyseperator_t *fs;
+	fuzzyswitch_t *sw;
+
+	s = config->numswitches++;
+	sw = &config->switches[s];
+	n = 0;
+	for (fs = firstfs; fs; fs = fs->next) n++;
+	sw->index = firstfs->index;
+	sw->firstcase = config->numcases;
+	sw->numcases = n;
+	sw->ascending = qtrue;
+	config->numcases += n;
+	for (fs = firstfs, c = sw->firstcase; fs; fs = fs->next, c++)
+	{
+		config->casevalues[c] = fs->value;
+		if (c > sw->firstcase && fs->value < config->casevalues[c-1]) sw->ascending = qfalse;
+		config->cases[c].weight = fs->weight;
+		config->cases[c].minweight = fs->minweight;
+		config->cases[c].maxweight = fs->maxweight;
+		if (fs->child) config->cases[c].child = CompileFuzzySeperators_r(config, fs->child);
+		else config->cases[c].child = -1;
+	} //end for
+	return s;
+} //end of the function CompileFuzzySeperators_r
+//===========================================================================
+// compiles the fuzzy seperators into flat arrays, has to be called again
+// whenever the seperators change
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void CompileWeightConfig(weightconfig_t *config)
+{
+	int i, numswitches, numcases;
+	char *ptr;
+
+	if (config->switches) FreeMemory(config->switches);
+	numswitches = 0;
+	numcases = 0;
+	for (i = 0; i < config->numweights; i++)
+	{
+		if (config->weights[i].firstseperator)
+			CountFuzzySeperators_r(config->weights[i].firstseperator, &numswitches, &numcases);
+	} //end for
+	ptr = (char *) GetMemory(numswitches * sizeof(fuzzyswitch_t) +
+							numcases * (sizeof(fuzzycase_t) + sizeof(int)) + 1);
+	config->switches = (fuzzyswitch_t *) ptr;
+	ptr += numswitches * sizeof(fuzzyswitch_t);
+	config->cases = (fuzzycase_t *) ptr;
+	ptr += numcases * sizeof(fuzzycase_t);
+	config->casevalues = (int *) ptr;
+	config->numswitches = 0;
+	config->numcases = 0;
+	for (i = 0; i < config->numweights; i++)
+	{
+		if (config->weights[i].firstseperator)
+			config->weights[i].firstswitch = CompileFuzzySeperators_r(config, config->weights[i].firstseperator);
+		else
+			config->weights[i].firstswitch = -1;
+	} //end for
+} //end of the function CompileWeightConfig
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 weightconfig_t *ReadWeightConfig(char *filename)
 {
 	int newindent, avail = 0, n;
@@ -425,6 +513,7 @@ weightconfig_t *ReadWeightConfig(char *filename)
 	} //end while
 	//free the source at the end of a pass
 	FreeSource(source);
+	CompileWeightConfig(config);
 	//if the file was located in a pak file
 	botimport.Print(PRT_MESSAGE, "loaded %s\n", filename);
 #ifdef DEBUG
@@ -611,30 +700,44 @@ float FuzzyWeight_r(int *inventory, fuzzyseperator_t *fs)
 	return fs->weight;
 } //end of the function FuzzyWeight_r
 //===========================================================================
+// random number between 0 and 1, taken from the given seed when there is
+// one so that the weights don't depend on the order threads call rand()
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE float FuzzyRandom(unsigned int *seed)
+{
+	if (!seed) return random();
+	*seed = *seed * 1103515245 + 12345;
+	return ((*seed >> 16) & 0x7fff) / ((float)0x7fff);
+} //end of the function FuzzyRandom
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-float FuzzyWeightUndecided_r(int *inventory, fuzzyseperator_t *fs)
+float FuzzyWeightUndecided_r(int *inventory, fuzzyseperator_t *fs, unsigned int *seed)
 {
 	float scale, w1, w2;
 
 	if (inventory[fs->index] < fs->value)
 	{
-		if (fs->child) return FuzzyWeightUndecided_r(inventory, fs->child);
-		else return fs->minweight + random() * (fs->maxweight - fs->minweight);
+		if (fs->child) return FuzzyWeightUndecided_r(inventory, fs->child, seed);
+		else return fs->minweight + FuzzyRandom(seed) * (fs->maxweight - fs->minweight);
 	} //end if
 	else if (fs->next)
 	{
 		if (inventory[fs->index] < fs->next->value)
 		{
 			//first weight
-			if (fs->child) w1 = FuzzyWeightUndecided_r(inventory, fs->child);
-			else w1 = fs->minweight + random() * (fs->maxweight - fs->minweight);
+			if (fs->child) w1 = FuzzyWeightUndecided_r(inventory, fs->child, seed);
+			else w1 = fs->minweight + FuzzyRandom(seed) * (fs->maxweight - fs->minweight);
 			//second weight
 			if (fs->next->child) w2 = FuzzyWeight_r(inventory, fs->next->child);
-			else w2 = fs->next->minweight + random() * (fs->next->maxweight - fs->next->minweight);
+			else w2 = fs->next->minweight + FuzzyRandom(seed) * (fs->next->maxweight - fs->next->minweight);
 			//the scale factor
 			if(fs->next->value == MAX_INVENTORYVALUE) // is fs->next the default case?
         		return w2;      // can't interpolate, return default weight
@@ -643,71 +746,162 @@ float FuzzyWeightUndecided_r(int *inventory, fuzzyseperator_t *fs)
 			//scale between the two weights
 			return (1 - scale) * w1 + scale * w2;
 		} //end if
-		return FuzzyWeightUndecided_r(inventory, fs->next);
+		return FuzzyWeightUndecided_r(inventory, fs->next, seed);
 	} //end else if
 	return fs->weight;
 } //end of the function FuzzyWeightUndecided_r
 //===========================================================================
+// returns the first case with a value larger than the inventory amount,
+// the same case the seperator list walks to, or numcases if there's none
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum)
+static ID_INLINE int FuzzyCaseNum(const int *values, int numcases, int amount, int ascending)
 {
-#ifdef EVALUATERECURSIVELY
-	return FuzzyWeight_r(inventory, wc->weights[weightnum].firstseperator);
-#else
-	fuzzyseperator_t *s;
+	int i, n;
 
-	s = wc->weights[weightnum].firstseperator;
-	if (!s) return 0;
-	while(1)
+	if (ascending)
 	{
-		if (inventory[s->index] < s->value)
+		//no early out so the compares can be vectorized
+		n = 0;
+		for (i = 0; i < numcases; i++)
 		{
-			if (s->child) s = s->child;
-			else return s->weight;
-		} //end if
-		else
-		{
-			if (s->next) s = s->next;
-			else return s->weight;
-		} //end else
+			n += (amount >= values[i]);
+		} //end for
+		return n;
 	} //end if
-	return 0;
-#endif
-} //end of the function FuzzyWeight
+	for (i = 0; i < numcases; i++)
+	{
+		if (amount < values[i]) break;
+	} //end for
+	return i;
+} //end of the function FuzzyCaseNum
 //===========================================================================
+// same result as FuzzyWeight_r for the compiled seperators
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-float FuzzyWeightUndecided(int *inventory, weightconfig_t *wc, int weightnum)
+static float FuzzyWeightSwitch_r(int *inventory, weightconfig_t *wc, int s)
 {
-#ifdef EVALUATERECURSIVELY
-	return FuzzyWeightUndecided_r(inventory, wc->weights[weightnum].firstseperator);
-#else
-	fuzzyseperator_t *s;
+	int amount, c;
+	float scale, w1, w2;
+	const fuzzyswitch_t *sw;
+	const fuzzycase_t *cases;
+	const int *values;
 
-	s = wc->weights[weightnum].firstseperator;
-	if (!s) return 0;
-	while(1)
+	sw = &wc->switches[s];
+	values = wc->casevalues + sw->firstcase;
+	cases = wc->cases + sw->firstcase;
+	amount = inventory[sw->index];
+	c = FuzzyCaseNum(values, sw->numcases, amount, sw->ascending);
+	if (c == 0)
 	{
-		if (inventory[s->index] < s->value)
-		{
-			if (s->child) s = s->child;
-			else return s->minweight + random() * (s->maxweight - s->minweight);
-		} //end if
-		else
-		{
-			if (s->next) s = s->next;
-			else return s->minweight + random() * (s->maxweight - s->minweight);
-		} //end else
+		if (cases[0].child >= 0) return FuzzyWeightSwitch_r(inventory, wc, cases[0].child);
+		else return cases[0].weight;
 	} //end if
-	return 0;
-#endif
+	if (c >= sw->numcases)
+	{
+		return cases[sw->numcases-1].weight;
+	} //end if
+	//second weight
+	if (cases[c].child >= 0) w2 = FuzzyWeightSwitch_r(inventory, wc, cases[c].child);
+	else w2 = cases[c].weight;
+	//can't interpolate with the default case
+	if (values[c] == MAX_INVENTORYVALUE)
+		return w2;
+	//first weight
+	if (cases[c-1].child >= 0) w1 = FuzzyWeightSwitch_r(inventory, wc, cases[c-1].child);
+	else w1 = cases[c-1].weight;
+	//scale between the two weights
+	scale = (float) (amount - values[c-1]) / (values[c] - values[c-1]);
+	return (1 - scale) * w1 + scale * w2;
+} //end of the function FuzzyWeightSwitch_r
+//===========================================================================
+// same result as FuzzyWeightUndecided_r for the compiled seperators, the
+// random numbers are drawn in the same order
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static float FuzzyWeightUndecidedSwitch_r(int *inventory, weightconfig_t *wc, int s, unsigned int *seed)
+{
+	int amount, c;
+	float scale, w1, w2;
+	const fuzzyswitch_t *sw;
+	const fuzzycase_t *cases;
+	const int *values;
+
+	sw = &wc->switches[s];
+	values = wc->casevalues + sw->firstcase;
+	cases = wc->cases + sw->firstcase;
+	amount = inventory[sw->index];
+	c = FuzzyCaseNum(values, sw->numcases, amount, sw->ascending);
+	if (c == 0)
+	{
+		if (cases[0].child >= 0) return FuzzyWeightUndecidedSwitch_r(inventory, wc, cases[0].child, seed);
+		else return cases[0].minweight + FuzzyRandom(seed) * (cases[0].maxweight - cases[0].minweight);
+	} //end if
+	if (c >= sw->numcases)
+	{
+		return cases[sw->numcases-1].weight;
+	} //end if
+	//first weight
+	if (cases[c-1].child >= 0) w1 = FuzzyWeightUndecidedSwitch_r(inventory, wc, cases[c-1].child, seed);
+	else w1 = cases[c-1].minweight + FuzzyRandom(seed) * (cases[c-1].maxweight - cases[c-1].minweight);
+	//second weight
+	if (cases[c].child >= 0) w2 = FuzzyWeightSwitch_r(inventory, wc, cases[c].child);
+	else w2 = cases[c].minweight + FuzzyRandom(seed) * (cases[c].maxweight - cases[c].minweight);
+	//can't interpolate with the default case
+	if (values[c] == MAX_INVENTORYVALUE)
+		return w2;
+	//scale between the two weights
+	scale = (float) (amount - values[c-1]) / (values[c] - values[c-1]);
+	return (1 - scale) * w1 + scale * w2;
+} //end of the function FuzzyWeightUndecidedSwitch_r
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum)
+{
+#ifdef COMPILEDWEIGHTS
+	if (wc->weights[weightnum].firstswitch < 0) return 0;
+	return FuzzyWeightSwitch_r(inventory, wc, wc->weights[weightnum].firstswitch);
+#else
+	return FuzzyWeight_r(inventory, wc->weights[weightnum].firstseperator);
+#endif //COMPILEDWEIGHTS
+} //end of the function FuzzyWeight
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+float FuzzyWeightUndecidedSeed(int *inventory, weightconfig_t *wc, int weightnum, unsigned int *seed)
+{
+#ifdef COMPILEDWEIGHTS
+	if (wc->weights[weightnum].firstswitch < 0) return 0;
+	return FuzzyWeightUndecidedSwitch_r(inventory, wc, wc->weights[weightnum].firstswitch, seed);
+#else
+	return FuzzyWeightUndecided_r(inventory, wc->weights[weightnum].firstseperator, seed);
+#endif //COMPILEDWEIGHTS
+} //end of the function FuzzyWeightUndecidedSeed
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+float FuzzyWeightUndecided(int *inventory, weightconfig_t *wc, int weightnum)
+{
+	return FuzzyWeightUndecidedSeed(inventory, wc, weightnum, NULL);
 } //end of the function FuzzyWeightUndecided
 //===========================================================================
 //
@@ -746,6 +940,7 @@ void EvolveWeightConfig(weightconfig_t *config)
 	{
 		EvolveFuzzySeperator_r(config->weights[i].firstseperator);
 	} //end for
+	CompileWeightConfig(config);
 } //end of the function EvolveWeightConfig
 //===========================================================================
 //
@@ -789,6 +984,7 @@ void ScaleWeight(weightconfig_t *config, char *name, float scale)
 			break;
 		} //end if
 	} //end for
+	CompileWeightConfig(config);
 } //end of the function ScaleWeight
 //===========================================================================
 //
@@ -831,6 +1027,7 @@ void ScaleFuzzyBalanceRange(weightconfig_t *config, float scale)
 	{
 		ScaleFuzzySeperatorBalanceRange_r(config->weights[i].firstseperator, scale);
 	} //end for
+	CompileWeightConfig(config);
 } //end of the function ScaleFuzzyBalanceRange
 //===========================================================================
 //
@@ -902,6 +1099,7 @@ void InterbreedWeightConfigs(weightconfig_t *config1, weightconfig_t *config2,
 									config2->weights[i].firstseperator,
 									configout->weights[i].firstseperator);
 	} //end for
+	CompileWeightConfig(configout);
 } //end of the function InterbreedWeightConfigs
 //===========================================================================
 //
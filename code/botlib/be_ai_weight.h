@@ -45,11 +45,30 @@ typedef struct fuzzyseperator_s
 	struct fuzzyseperator_s *next;
 } fuzzyseperator_t;
 
+//compiled fuzzy switch, the cases are stored in order in the case arrays
+typedef struct fuzzyswitch_s
+{
+	int index;					//inventory index the switch is on
+	int firstcase;				//first case in the case arrays
+	int numcases;				//number of cases
+	int ascending;				//true if the case values never decrease
+} fuzzyswitch_t;
+
+//compiled fuzzy case
+typedef struct fuzzycase_s
+{
+	int child;					//switch of the case, -1 if the case returns a weight
+	float weight;
+	float minweight;
+	float maxweight;
+} fuzzycase_t;
+
 //fuzzy weight
 typedef struct weight_s
 {
 	char *name;
 	struct fuzzyseperator_s *firstseperator;
+	int firstswitch;			//compiled switch, -1 if none
 } weight_t;
 
 //weight configuration
@@ -58,6 +77,12 @@ typedef struct weightconfig_s
 	int numweights;
 	weight_t weights[MAX_WEIGHTS];
 	char		filename[MAX_QPATH];
+	//fuzzy seperators compiled into flat arrays
+	int numswitches;
+	fuzzyswitch_t *switches;
+	int numcases;
+	int *casevalues;			//case values apart so they can be compared in one go
+	fuzzycase_t *cases;
 } weightconfig_t;
 
 //reads a weight configuration
@@ -71,6 +96,8 @@ int FindFuzzyWeight(weightconfig_t *wc, char *name);
 //returns the fuzzy weight for the given inventory and weight
 float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum);
 float FuzzyWeightUndecided(int *inventory, weightconfig_t *wc, int weightnum);
+//same as FuzzyWeightUndecided but the random numbers come from the seed, NULL uses rand()
+float FuzzyWeightUndecidedSeed(int *inventory, weightconfig_t *wc, int weightnum, unsigned int *seed);
 //scales the weight with the given name
 void ScaleWeight(weightconfig_t *config, char *name, float scale);
 //scale the balance range
@@ -678,6 +678,7 @@ static void Init_AAS_Export( aas_export_t *aas ) {
 	aas->AAS_AreaTravelTimeToGoalArea = AAS_AreaTravelTimeToGoalArea;
 	aas->AAS_EnableRoutingArea = AAS_EnableRoutingArea;
 	aas->AAS_PredictRoute = AAS_PredictRoute;
+	aas->AAS_RoutingCacheStats = AAS_RoutingCacheStats;
 	//--------------------------------------------
 	// be_aas_altroute.c
 	//--------------------------------------------
@@ -781,6 +782,7 @@ static void Init_AI_Export( ai_export_t *ai ) {
 	ai->BotGetSecondGoal = BotGetSecondGoal;
 	ai->BotChooseLTGItem = BotChooseLTGItem;
 	ai->BotChooseNBGItem = BotChooseNBGItem;
+	ai->BotChooseItemGoals = BotChooseItemGoals;
 	ai->BotTouchingGoal = BotTouchingGoal;
 	ai->BotItemGoalInVisButNotVisible = BotItemGoalInVisButNotVisible;
 	ai->BotGetLevelItemGoal = BotGetLevelItemGoal;
@@ -39,6 +39,7 @@ struct aas_predictroute_s;
 struct bot_consolemessage_s;
 struct bot_match_s;
 struct bot_goal_s;
+struct bot_goalchoice_s;
 struct bot_moveresult_s;
 struct bot_initmove_s;
 struct weaponinfo_s;
@@ -205,6 +206,8 @@ typedef struct botlib_import_s
 	void		(*DebugPolygonDelete)(int id);
 
 	int			(*Sys_Milliseconds)(void);
+	//calls func( data, index ) for every index in [0, count) on up to numThreads threads
+	void		(*RunJobs)(void (*func)(void *data, int index), void *data, int count, int numThreads);
 } botlib_import_t;
 
 typedef struct aas_export_s
@@ -248,6 +251,7 @@ typedef struct aas_export_s
 	int			(*AAS_PredictRoute)(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
 							int stopevent, int stopcontents, int stoptfl, int stopareanum);
+	void		(*AAS_RoutingCacheStats)(void);
 	//--------------------------------------------
 	// be_aas_altroute.c
 	//--------------------------------------------
@@ -351,6 +355,7 @@ typedef struct ai_export_s
 	int		(*BotChooseLTGItem)(int goalstate, vec3_t origin, int *inventory, int travelflags);
 	int		(*BotChooseNBGItem)(int goalstate, vec3_t origin, int *inventory, int travelflags,
 								struct bot_goal_s *ltg, float maxtime);
+	int		(*BotChooseItemGoals)(struct bot_goalchoice_s *choices, int numchoices);
 	int		(*BotTouchingGoal)(vec3_t origin, struct bot_goal_s *goal);
 	int		(*BotItemGoalInVisButNotVisible)(int viewer, vec3_t eye, vec3_t viewangles, struct bot_goal_s *goal);
 	int		(*BotGetLevelItemGoal)(int index, char *classname, struct bot_goal_s *goal);
@@ -486,6 +491,9 @@ name:						default:			module(s):			description:
 
 "max_aaslinks"				"4096"				be_aas_sample.c		maximum links in the AAS
 "max_routingcache"			"4096"				be_aas_route.c		maximum routing cache size in KB
+"routingwarmup"				"0"					be_aas_route.c		threads used to fill the routing cache at map load
+"fiforouting"				"0"					be_aas_route.c		use the FIFO routing updates instead of the bucket queue
+"goalthreads"				"1"					be_ai_goal.c		threads used to choose item goals for a batch of bots
 "forceclustering"			"0"					be_aas_main.c		force recalculation of clusters
 "forcereachability"			"0"					be_aas_main.c		force recalculation of reachabilities
 "forcewrite"				"0"					be_aas_main.c		force writing of aas file
@@ -527,8 +527,11 @@ static void *VM_ArgPtr( intptr_t intValue ) {
 
 	if ( cgvm->entryPoint )
 		return (void *)(intValue);
-	else
-		return (void *)(cgvm->dataBase + (intValue & cgvm->dataMask));
+
+	if ( cgvm->wasm )
+		VM_CheckBounds( cgvm, intValue, 1 );
+
+	return (void *)(cgvm->dataBase + (intValue & cgvm->dataMask));
 }
 
 
@@ -754,8 +754,11 @@ static void *VM_ArgPtr( intptr_t intValue ) {
 
 	if ( uivm->entryPoint )
 		return (void *)(intValue);
-	else
-		return (void *)(uivm->dataBase + (intValue & uivm->dataMask));
+
+	if ( uivm->wasm )
+		VM_CheckBounds( uivm, intValue, 1 );
+
+	return (void *)(uivm->dataBase + (intValue & uivm->dataMask));
 }
 
 
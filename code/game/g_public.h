@@ -397,11 +397,42 @@ typedef enum {
 	BOTLIB_PC_SOURCE_FILE_AND_LINE,
 
 	// engine extensions
+	G_TRACE_BATCH,	// ( trace_t *results, const traceRay_t *rays, int count, int passEntityNum, int contentmask, int capsule );
+	G_BOT_CHOOSE_ITEM_GOALS,	// ( bot_goalchoice_t *choices, int numchoices );
 	G_TRAP_GETVALUE = COM_TRAP_GETVALUE
 
 } gameImport_t;
 
 
+//
+// direct calls for native game modules
+//
+// A shared library game may export
+//   int dllEntryTable( int version, const gameTable_t *table );
+// next to dllEntry. The server passes GAME_TABLE_VERSION and the table right
+// after dllEntry, the module returns GAME_TABLE_VERSION if it accepts it and
+// may then call these instead of packing the same traps through dllSyscall.
+// Pointers are used as they are, nothing is range checked or copied.
+// New entries are only ever appended, check size before using them.
+//
+#define	GAME_TABLE_VERSION	1
+
+typedef struct {
+	int			version;
+	int			size;		// sizeof( gameTable_t ) of the server
+
+	void		(*LinkEntity)( sharedEntity_t *ent );
+	void		(*UnlinkEntity)( sharedEntity_t *ent );
+	int			(*EntitiesInBox)( const vec3_t mins, const vec3_t maxs, int *list, int maxcount );
+	qboolean	(*EntityContact)( const vec3_t mins, const vec3_t maxs, const sharedEntity_t *ent, qboolean capsule );
+	void		(*Trace)( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule );
+	void		(*TraceBatch)( trace_t *results, const traceRay_t *rays, int count, int passEntityNum, int contentmask, qboolean capsule );
+	int			(*PointContents)( const vec3_t point, int passEntityNum );
+	qboolean	(*InPVS)( const vec3_t p1, const vec3_t p2 );
+	qboolean	(*InPVSIgnorePortals)( const vec3_t p1, const vec3_t p2 );
+} gameTable_t;
+
+
 //
 // functions exported by the game subsystem
 //
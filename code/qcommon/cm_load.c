@@ -62,11 +62,20 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_simd;
+cvar_t		*cm_cache;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+int			cm_generation;
+cmTraceContext_t	cm_traceContext;
+
+static int	cm_loadCount;		// unique generations, cm_generation is restored with a saved world
+
+struct cmWorld_s {
+	clipMap_t			map;
+	int					generation;
+	cmTraceContext_t	traceContext;
+};
 
 
 
@@ -225,6 +234,42 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#ifdef CM_SIMD_PLANES
+/*
+=================
+CMod_SetupBrushPlanes
+
+Copies side planes in SoA layout so they can be loaded into vector registers
+=================
+*/
+static void CMod_SetupBrushPlanes( void ) {
+	cbrush_t	*b;
+	double		*data;
+	int			i, j, n, total;
+
+	total = 0;
+	for ( i = 0, b = cm.brushes; i < cm.numBrushes; i++, b++ ) {
+		total += PAD( b->numsides, CM_SIMD_WIDTH ) * 4;
+	}
+
+	data = Hunk_Alloc( total * sizeof( *data ), h_high );
+
+	for ( i = 0, b = cm.brushes; i < cm.numBrushes; i++, b++ ) {
+		n = PAD( b->numsides, CM_SIMD_WIDTH );
+		b->planes = data;
+		for ( j = 0; j < b->numsides; j++ ) {
+			const cplane_t *plane = b->sides[j].plane;
+			data[j + 0*n] = plane->normal[0];
+			data[j + 1*n] = plane->normal[1];
+			data[j + 2*n] = plane->normal[2];
+			data[j + 3*n] = plane->dist;
+		}
+		data += n * 4;
+	}
+}
+#endif
+
+
 /*
 =================
 CMod_LoadBrushes
@@ -260,6 +305,9 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#ifdef CM_SIMD_PLANES
+	CMod_SetupBrushPlanes();
+#endif
 }
 
 
@@ -508,10 +556,12 @@ void CMod_LoadVisibility( lump_t *l ) {
 /*
 =================
 CMod_LoadPatches
+
+Patch collision is taken from the cache when it matches checksum
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, int checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -521,6 +571,9 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	int			numPatches, n;
+	struct patchCollide_s	**list;
+	qboolean	cached;
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -532,9 +585,25 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	numPatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) == MST_PATCH ) {
+			numPatches++;
+		}
+	}
+
+	list = NULL;
+	cached = qfalse;
+#ifndef BSPC
+	if ( numPatches && cm_cache->integer ) {
+		list = Hunk_AllocateTempMemory( numPatches * sizeof( *list ) );
+		cached = CM_LoadPatchCollideCache( checksum, list, numPatches );
+	}
+#endif
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
-	for ( i = 0 ; i < count ; i++, in++ ) {
+	for ( i = 0, n = 0 ; i < count ; i++, in++ ) {
 		if ( LittleLong( in->surfaceType ) != MST_PATCH ) {
 			continue;		// ignore other surfaces
 		}
@@ -542,6 +611,15 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
 
+		shaderNum = LittleLong( in->shaderNum );
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+
+		if ( cached ) {
+			patch->pc = list[ n++ ];
+			continue;
+		}
+
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
 		height = LittleLong( in->patchHeight );
@@ -557,13 +635,21 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 			points[j][2] = LittleFloat( dv_p->xyz[2] );
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
+		if ( list ) {
+			list[ n++ ] = patch->pc;
+		}
 	}
+
+#ifndef BSPC
+	if ( list ) {
+		if ( !cached ) {
+			CM_WritePatchCollideCache( checksum, list, numPatches );
+		}
+		Hunk_FreeTempMemory( list );
+	}
+#endif
 }
 
 //==================================================================
@@ -614,6 +700,10 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE_ND|CVAR_CHEAT);
+	cm_simd = Cvar_Get ("cm_simd", "1", 0);
+	Cvar_SetDescription( cm_simd, "Test several brush planes per instruction when tracing, 0 uses the scalar code." );
+	cm_cache = Cvar_Get ("cm_cache", "1", CVAR_ARCHIVE_ND);
+	Cvar_SetDescription( cm_cache, "Keep generated patch collision in cmcache/ below fs_homepath and reuse it on later loads of the same map." );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -677,13 +767,15 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], last_checksum );
 
 	CMod_CheckLeafBrushes();
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile( buf.v );
 
+	cm_generation = ++cm_loadCount;
+
 	CM_InitBoxHull();
 
 	CM_FloodAreaConnections();
@@ -706,6 +798,62 @@ void CM_ClearMap( void ) {
 }
 
 
+/*
+==================
+CM_AllocWorld
+
+Storage for a clip map that is not current, the map data itself stays on the hunk
+==================
+*/
+cmWorld_t *CM_AllocWorld( void ) {
+	cmWorld_t *world;
+
+	world = Z_Malloc( sizeof( *world ) );
+	Com_Memset( world, 0, sizeof( *world ) );
+
+	return world;
+}
+
+
+/*
+==================
+CM_FreeWorld
+==================
+*/
+void CM_FreeWorld( cmWorld_t *world ) {
+	if ( world ) {
+		Z_Free( world );
+	}
+}
+
+
+/*
+==================
+CM_SaveWorld
+==================
+*/
+void CM_SaveWorld( cmWorld_t *world ) {
+	world->map = cm;
+	world->generation = cm_generation;
+	world->traceContext = cm_traceContext;
+}
+
+
+/*
+==================
+CM_RestoreWorld
+
+Makes a saved clip map current, debug surfaces of the previous one are dropped
+==================
+*/
+void CM_RestoreWorld( const cmWorld_t *world ) {
+	cm = world->map;
+	cm_generation = world->generation;
+	cm_traceContext = world->traceContext;
+	CM_ClearLevelPatches();
+}
+
+
 /*
 ==================
 CM_ClipHandleToModel
@@ -719,7 +867,7 @@ cmodel_t *CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &cm_traceContext.box.model;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -779,48 +927,45 @@ int CM_LeafArea( int leafnum ) {
 
 /*
 ===================
-CM_InitBoxHull
+CM_SetupBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-void CM_InitBoxHull( void )
+static void CM_SetupBoxHull( cmBoxHull_t *box, cbrush_t *brush, cbrushside_t *sides, cplane_t *planes )
 {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	box->planes = planes;
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+	box->brush = brush;
+	box->brush->numsides = 6;
+	box->brush->sides = sides;
+	box->brush->contents = CONTENTS_BODY;
 
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+	box->model.leaf.numLeafBrushes = 1;
 
 	for ( i = 0; i < 6; i++ )
 	{
 		side = i & 1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides + i];
-		s->plane = cm.planes + ( cm.numPlanes + i * 2 + side );
+		s = &sides[i];
+		s->plane = planes + ( i * 2 + side );
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[i * 2];
+		p = &planes[i * 2];
 		p->type = i >> 1;
 		p->signbits = 0;
 		VectorClear( p->normal );
 		p->normal[i >> 1] = 1;
 
-		p = &box_planes[i * 2 + 1];
+		p = &planes[i * 2 + 1];
 		p->type = 3 + ( i >> 1 );
 		p->signbits = 0;
 		VectorClear( p->normal );
@@ -833,42 +978,141 @@ void CM_InitBoxHull( void )
 
 /*
 ===================
-CM_TempBoxModel
+CM_InitBoxHull
+
+The main thread box lives in the extra indexes allocated along with the map
+===================
+*/
+void CM_InitBoxHull( void )
+{
+	cmTraceContext_t *ctx = &cm_traceContext;
+
+	Com_Memset( ctx, 0, sizeof( *ctx ) );
+
+	CM_SetupBoxHull( &ctx->box, &cm.brushes[cm.numBrushes], &cm.brushsides[cm.numBrushSides], &cm.planes[cm.numPlanes] );
+
+//	ctx->box.model.leaf.firstLeafBrush = cm.numBrushes;
+	ctx->box.model.leaf.firstLeafBrush = cm.numLeafBrushes;
+	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+
+	ctx->brushCheck = Hunk_Alloc( ( cm.numBrushes + BOX_BRUSHES ) * 2 * sizeof( int ), h_high );
+	ctx->brushBits = ctx->brushCheck + cm.numBrushes + BOX_BRUSHES;
+	ctx->patchCheck = Hunk_Alloc( ( cm.numSurfaces + 1 ) * 2 * sizeof( int ), h_high );
+	ctx->patchBits = ctx->patchCheck + cm.numSurfaces + 1;
+	ctx->generation = cm_generation;
+}
+
+
+/*
+===================
+CM_CreateTraceContext
+
+Must be called from the main thread after the map has been loaded
+===================
+*/
+cmTraceContext_t *CM_CreateTraceContext( void )
+{
+	cmTraceContext_t *ctx;
+	int size;
+
+	if ( !cm.numNodes ) {
+		Com_Error( ERR_DROP, "CM_CreateTraceContext: map not loaded" );
+	}
+
+	size = sizeof( *ctx ) + ( cm.numBrushes + BOX_BRUSHES + cm.numSurfaces + 1 ) * 2 * sizeof( int );
+	ctx = Z_Malloc( size );
+	Com_Memset( ctx, 0, size );
+
+	ctx->brushCheck = (int *)( ctx + 1 );
+	ctx->brushBits = ctx->brushCheck + cm.numBrushes + BOX_BRUSHES;
+	ctx->patchCheck = ctx->brushBits + cm.numBrushes + BOX_BRUSHES;
+	ctx->patchBits = ctx->patchCheck + cm.numSurfaces + 1;
+	ctx->generation = cm_generation;
+
+	CM_SetupBoxHull( &ctx->box, &ctx->box.brushStorage, ctx->box.sideStorage, ctx->box.planeStorage );
+	ctx->box.model.leaf.firstLeafBrush = cm.numLeafBrushes;
+
+	return ctx;
+}
+
+
+/*
+===================
+CM_FreeTraceContext
+===================
+*/
+void CM_FreeTraceContext( cmTraceContext_t *ctx )
+{
+	if ( ctx && ctx != &cm_traceContext ) {
+		Z_Free( ctx );
+	}
+}
+
+
+/*
+===================
+CM_ContextModel
+===================
+*/
+cmodel_t *CM_ContextModel( cmTraceContext_t *ctx, clipHandle_t handle )
+{
+	if ( handle == BOX_MODEL_HANDLE ) {
+		return &ctx->box.model;
+	}
+
+	return CM_ClipHandleToModel( handle );
+}
+
+
+/*
+===================
+CM_TempBoxModelCtx
 
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 Capsules are handled differently though.
 ===================
 */
-clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+clipHandle_t CM_TempBoxModelCtx( cmTraceContext_t *ctx, const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cmBoxHull_t *box = &ctx->box;
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, box->model.mins );
+	VectorCopy( maxs, box->model.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	box->planes[0].dist = maxs[0];
+	box->planes[1].dist = -maxs[0];
+	box->planes[2].dist = mins[0];
+	box->planes[3].dist = -mins[0];
+	box->planes[4].dist = maxs[1];
+	box->planes[5].dist = -maxs[1];
+	box->planes[6].dist = mins[1];
+	box->planes[7].dist = -mins[1];
+	box->planes[8].dist = maxs[2];
+	box->planes[9].dist = -maxs[2];
+	box->planes[10].dist = mins[2];
+	box->planes[11].dist = -mins[2];
+
+	VectorCopy( mins, box->brush->bounds[0] );
+	VectorCopy( maxs, box->brush->bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
 
 
+/*
+===================
+CM_TempBoxModel
+===================
+*/
+clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	return CM_TempBoxModelCtx( &cm_traceContext, mins, maxs, capsule );
+}
+
+
 /*
 ===================
 CM_ModelBounds
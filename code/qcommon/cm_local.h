@@ -28,6 +28,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
 
+// brush side planes are also kept in SoA layout to test several of them per instruction
+#if idx64 && !defined(BSPC)
+#define CM_SIMD_PLANES
+#endif
+#define CM_SIMD_WIDTH			4		// planes tested at once, padding of the SoA arrays
+
 
 // forced double-precison functions
 #define DotProductDP(x,y)		((double)(x)[0]*(y)[0]+(double)(x)[1]*(y)[1]+(double)(x)[2]*(y)[2])
@@ -106,12 +112,12 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	int			checkcount;		// to avoid repeated testings in CM_BoxBrushes
+	double		*planes;		// normal x, y, z and dist arrays of the sides, padded to CM_SIMD_WIDTH
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -123,6 +129,29 @@ typedef struct {
 	int			floodvalid;
 } cArea_t;
 
+
+// temporary box model, brush and planes of the main context live in the clip map arrays
+typedef struct {
+	cmodel_t		model;
+	cbrush_t		*brush;
+	cplane_t		*planes;
+
+	cbrush_t		brushStorage;
+	cbrushside_t	sideStorage[6];
+	cplane_t		planeStorage[12];
+} cmBoxHull_t;
+
+// everything a trace writes to, so traces with different contexts can run concurrently
+struct cmTraceContext_s {
+	int			generation;		// cm_generation it was created for
+	int			checkcount;		// last visit stamp handed out to a trace
+	int			*brushCheck;	// [cm.numBrushes+1] to avoid repeated testings
+	int			*brushBits;		// which traces of a packet tested the brush
+	int			*patchCheck;	// [cm.numSurfaces+1]
+	int			*patchBits;
+	cmBoxHull_t	box;
+};
+
 typedef struct {
 	char		name[MAX_QPATH];
 
@@ -178,10 +207,14 @@ typedef struct {
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
+extern	int			cm_generation;		// incremented on each map load
+extern	cmTraceContext_t	cm_traceContext;	// used by the main thread API
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
+extern	cvar_t		*cm_simd;
+extern	cvar_t		*cm_cache;
 extern	cvar_t		*cm_playerCurveClip;
 
 // cm_test.c
@@ -208,8 +241,20 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmTraceContext_t	*ctx;
+	int			checkcount;	// visit stamp of this trace
+	int			checkbit;	// bit of this trace in the stamp, packets share stamps
 } traceWork_t;
 
+// part of a trace which is being walked through the tree with a packet
+#define CM_TRACE_PACKET	16	// up to 32 for the visit bits
+
+typedef struct {
+	traceWork_t	*tw;
+	float		p1f, p2f;
+	vec3_t		p1, p2;
+} cmTraceSegment_t;
+
 typedef struct leafList_s {
 	int		count;
 	int		maxcount;
@@ -229,6 +274,7 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
+cmodel_t	*CM_ContextModel( cmTraceContext_t *ctx, clipHandle_t handle );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
 
@@ -238,3 +284,5 @@ struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *p
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_ClearLevelPatches( void );
+qboolean CM_LoadPatchCollideCache( int checksum, struct patchCollide_s **list, int count );
+void CM_WritePatchCollideCache( int checksum, struct patchCollide_s * const *list, int count );
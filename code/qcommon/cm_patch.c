@@ -1261,6 +1261,216 @@ struct patchCollide_s *CM_GeneratePatchCollide( int width, int height, vec3_t *p
 	return pf;
 }
 
+#ifndef BSPC
+/*
+================================================================================
+
+PATCH COLLIDE CACHE
+
+Generated patch collision of a map is kept in cmcache/<bsp checksum>.cmc below
+fs_homepath.  The file is the header followed by the patchCollide_t of every
+patch surface in surface order, their planes and facets, with pointers stored
+as offsets from the end of the header.  It is read in one go into the hunk and
+the offsets are turned back into pointers in place.
+
+================================================================================
+*/
+
+#define	CM_CACHE_IDENT		(('C'<<24)+('M'<<16)+('C'<<8)+'Q')
+#define	CM_CACHE_VERSION	1
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		checksum;		// of the whole bsp file
+	int		numPatches;
+	int		patchSize;		// layout of the native structures
+	int		planeSize;
+	int		facetSize;
+	int		length;			// of the data following the header
+} cmCacheHeader_t;
+
+
+/*
+==================
+CM_PatchCacheName
+==================
+*/
+static const char *CM_PatchCacheName( int checksum, const char *ext ) {
+	return va( "cmcache/%08x.%s", (unsigned)checksum, ext );
+}
+
+
+/*
+==================
+CM_ValidatePatchCache
+
+Makes sure offsets and plane indexes of a loaded patch stay in the data,
+the offsets are left for the caller to rebase
+==================
+*/
+static qboolean CM_ValidatePatchCache( const byte *data, int length, int count ) {
+	const patchCollide_t	*pc;
+	const patchPlane_t		*plane;
+	const facet_t			*facet;
+	size_t			planes, facets;
+	int				i, j, k;
+
+	// the headers themselves have to fit before any of them is read
+	if ( length < 0 || (size_t)length < count * sizeof( *pc ) ) {
+		return qfalse;
+	}
+
+	for ( i = 0, pc = (patchCollide_t *)data; i < count; i++, pc++ ) {
+		if ( pc->numPlanes < 0 || pc->numPlanes > MAX_PATCH_PLANES || pc->numFacets < 0 || pc->numFacets > MAX_FACETS ) {
+			return qfalse;
+		}
+
+		planes = (size_t)pc->planes;
+		facets = (size_t)pc->facets;
+		if ( planes % sizeof( int ) || planes < count * sizeof( *pc ) || planes + pc->numPlanes * sizeof( patchPlane_t ) > (size_t)length ) {
+			return qfalse;
+		}
+		if ( facets % sizeof( int ) || facets < count * sizeof( *pc ) || facets + pc->numFacets * sizeof( facet_t ) > (size_t)length ) {
+			return qfalse;
+		}
+
+		for ( j = 0, plane = (const patchPlane_t *)( data + planes ); j < pc->numPlanes; j++, plane++ ) {
+			if ( (unsigned)plane->signbits > 7 ) {
+				return qfalse;
+			}
+		}
+
+		for ( j = 0, facet = (const facet_t *)( data + facets ); j < pc->numFacets; j++, facet++ ) {
+			if ( (unsigned)facet->surfacePlane >= pc->numPlanes || (unsigned)facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+				return qfalse;
+			}
+			for ( k = 0; k < facet->numBorders; k++ ) {
+				if ( (unsigned)facet->borderPlanes[k] >= pc->numPlanes ) {
+					return qfalse;
+				}
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+==================
+CM_LoadPatchCollideCache
+
+Fills in list with the cached patch collision of the map with given checksum,
+returns qfalse if there is no usable cache
+==================
+*/
+qboolean CM_LoadPatchCollideCache( int checksum, struct patchCollide_s **list, int count ) {
+	cmCacheHeader_t	header;
+	fileHandle_t	f;
+	patchCollide_t	*pc;
+	byte			*temp, *data;
+	int				length, i;
+
+	length = FS_SV_FOpenFileRead( CM_PatchCacheName( checksum, "cmc" ), &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		return qfalse;
+	}
+
+	if ( length < sizeof( header ) || FS_Read( &header, sizeof( header ), f ) != sizeof( header )
+		|| header.ident != CM_CACHE_IDENT || header.version != CM_CACHE_VERSION
+		|| header.checksum != checksum || header.numPatches != count
+		|| header.patchSize != sizeof( patchCollide_t ) || header.planeSize != sizeof( patchPlane_t )
+		|| header.facetSize != sizeof( facet_t ) || header.length != length - (int)sizeof( header ) ) {
+		FS_FCloseFile( f );
+		return qfalse;
+	}
+
+	// read into zone memory first so a rejected file doesn't leave a dead hunk block
+	temp = Z_Malloc( header.length );
+	if ( FS_Read( temp, header.length, f ) != header.length || !CM_ValidatePatchCache( temp, header.length, count ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: ignoring broken %s\n", CM_PatchCacheName( checksum, "cmc" ) );
+		FS_FCloseFile( f );
+		Z_Free( temp );
+		return qfalse;
+	}
+
+	FS_FCloseFile( f );
+
+	data = Hunk_Alloc( header.length, h_high );
+	Com_Memcpy( data, temp, header.length );
+	Z_Free( temp );
+
+	for ( i = 0, pc = (patchCollide_t *)data; i < count; i++, pc++ ) {
+		pc->planes = (patchPlane_t *)( data + (size_t)pc->planes );
+		pc->facets = (facet_t *)( data + (size_t)pc->facets );
+		list[i] = pc;
+	}
+
+	Com_DPrintf( "Loaded %i patches from %s\n", count, CM_PatchCacheName( checksum, "cmc" ) );
+
+	return qtrue;
+}
+
+
+/*
+==================
+CM_WritePatchCollideCache
+==================
+*/
+void CM_WritePatchCollideCache( int checksum, struct patchCollide_s * const *list, int count ) {
+	cmCacheHeader_t	header;
+	patchCollide_t	pc;
+	fileHandle_t	f;
+	char			name[MAX_QPATH];
+	size_t			offset;
+	int				i;
+
+	header.ident = CM_CACHE_IDENT;
+	header.version = CM_CACHE_VERSION;
+	header.checksum = checksum;
+	header.numPatches = count;
+	header.patchSize = sizeof( patchCollide_t );
+	header.planeSize = sizeof( patchPlane_t );
+	header.facetSize = sizeof( facet_t );
+	header.length = count * sizeof( patchCollide_t );
+	for ( i = 0; i < count; i++ ) {
+		header.length += list[i]->numPlanes * sizeof( patchPlane_t ) + list[i]->numFacets * sizeof( facet_t );
+	}
+
+	// write under a temporary name so concurrent loads never see a partial file
+	Q_strncpyz( name, CM_PatchCacheName( checksum, "tmp" ), sizeof( name ) );
+	f = FS_SV_FOpenFileWrite( name );
+	if ( f == FS_INVALID_HANDLE ) {
+		return;
+	}
+
+	FS_Write( &header, sizeof( header ), f );
+
+	offset = count * sizeof( patchCollide_t );
+	for ( i = 0; i < count; i++ ) {
+		pc = *list[i];
+		pc.planes = (patchPlane_t *)offset;
+		offset += pc.numPlanes * sizeof( patchPlane_t );
+		pc.facets = (facet_t *)offset;
+		offset += pc.numFacets * sizeof( facet_t );
+		FS_Write( &pc, sizeof( pc ), f );
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		FS_Write( list[i]->planes, list[i]->numPlanes * sizeof( patchPlane_t ), f );
+		FS_Write( list[i]->facets, list[i]->numFacets * sizeof( facet_t ), f );
+	}
+
+	FS_FCloseFile( f );
+
+	// rename() won't replace an existing file everywhere
+	FS_SV_Remove( CM_PatchCacheName( checksum, "cmc" ) );
+	FS_SV_Rename( name, CM_PatchCacheName( checksum, "cmc" ) );
+}
+#endif // !BSPC
+
+
 /*
 ================================================================================
 
@@ -1345,12 +1555,14 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
+			if ( tw->ctx == &cm_traceContext ) {
+				if (!cv) {
+					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+				}
+				if (cv->integer) {
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
 			}
 #endif //BSPC
 			pp = &pc->planes[facet->surfacePlane];
@@ -1534,12 +1746,15 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 				//	enterFrac = 0;
 				//}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
+				// debug surface is only tracked for the main thread traces
+				if ( tw->ctx == &cm_traceContext ) {
+					if (!cv) {
+						cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+					}
+					if (cv && cv->integer) {
+						debugPatchCollide = pc;
+						debugFacet = facet;
+					}
 				}
 #endif //BSPC
 
@@ -25,6 +25,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 void		CM_LoadMap( const char *name, qboolean clientload, int *checksum);
 void		CM_ClearMap( void );
+
+// several clip maps can stay loaded, all other functions use the current one
+typedef struct cmWorld_s cmWorld_t;
+cmWorld_t	*CM_AllocWorld( void );
+void		CM_FreeWorld( cmWorld_t *world );
+void		CM_SaveWorld( cmWorld_t *world );
+void		CM_RestoreWorld( const cmWorld_t *world );
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
 
@@ -38,9 +45,28 @@ char		*CM_EntityString (void);
 int			CM_PointContents( const vec3_t p, clipHandle_t model );
 int			CM_TransformedPointContents( const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles );
 
+// traces sharing a context can't run concurrently, CM_BoxTrace and CM_TempBoxModel use the
+// main thread one, other threads must create own contexts after the map has been loaded
+typedef struct cmTraceContext_s cmTraceContext_t;
+
+cmTraceContext_t *CM_CreateTraceContext( void );
+void		CM_FreeTraceContext( cmTraceContext_t *ctx );
+clipHandle_t CM_TempBoxModelCtx( cmTraceContext_t *ctx, const vec3_t mins, const vec3_t maxs, int capsule );
+void		CM_BoxTraceCtx( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask, qboolean capsule );
+void		CM_TransformedBoxTraceCtx( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask,
+						const vec3_t origin, const vec3_t angles, qboolean capsule );
+
 void		CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask, qboolean capsule );
+void		CM_BoxTraceBatchCtx( cmTraceContext_t *ctx, trace_t *results, const traceRay_t *rays, int count,
+						clipHandle_t model, int brushmask, qboolean capsule );
+void		CM_BoxTraceBatch( trace_t *results, const traceRay_t *rays, int count,
+						clipHandle_t model, int brushmask, qboolean capsule );
 void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask,
@@ -63,5 +89,8 @@ qboolean	CM_AreasConnected( int area1, int area2 );
 
 int			CM_WriteAreaBits( byte *buffer, int area );
 
+// cm_trace.c
+void		CM_TraceTest_f( void );
+
 // cm_patch.c
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, float *points) );
@@ -21,6 +21,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#ifdef CM_SIMD_PLANES
+#ifdef __AVX__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -226,6 +234,43 @@ static void CM_TestBoxInBrush( traceWork_t *tw, const cbrush_t *brush ) {
 }
 
 
+/*
+================
+CM_Visited
+
+Marks brush or patch as tested by the trace, traces of a packet share the
+stamp and have own bits
+================
+*/
+static ID_INLINE qboolean CM_Visited( const traceWork_t *tw, int *stamps, int *bits, int index ) {
+	if ( stamps[index] != tw->checkcount ) {
+		stamps[index] = tw->checkcount;
+		bits[index] = tw->checkbit;
+		return qfalse;
+	}
+	if ( bits[index] & tw->checkbit ) {
+		return qtrue;
+	}
+	bits[index] |= tw->checkbit;
+	return qfalse;
+}
+
+
+/*
+================
+CM_LeafBrush
+
+The temporary box brush index refers to the box of the trace context
+================
+*/
+static cbrush_t *CM_LeafBrush( const traceWork_t *tw, int brushnum ) {
+	if ( brushnum == cm.numBrushes ) {
+		return tw->ctx->box.brush;
+	}
+	return &cm.brushes[ brushnum ];
+}
+
+
 /*
 ================
 CM_TestInLeaf
@@ -233,18 +278,17 @@ CM_TestInLeaf
 */
 static void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		b = CM_LeafBrush( tw, brushnum );
+		if ( CM_Visited( tw, tw->ctx->brushCheck, tw->ctx->brushBits, brushnum ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -263,14 +307,14 @@ static void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( CM_Visited( tw, tw->ctx->patchCheck, tw->ctx->patchBits, surfnum ) ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -296,13 +340,16 @@ capsule inside capsule check
 */
 static void CM_TestCapsuleInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	int i;
+	cmodel_t *cmod;
 	vec3_t mins, maxs;
 	vec3_t top, bottom;
 	vec3_t p1, p2, tmp;
 	vec3_t offset, symetricSize[2];
 	float radius, halfwidth, halfheight, offs, r;
 
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ContextModel( tw->ctx, model );
+	VectorCopy( cmod->mins, mins );
+	VectorCopy( cmod->maxs, maxs );
 
 	VectorAdd(tw->start, tw->sphere.offset, top);
 	VectorSubtract(tw->start, tw->sphere.offset, bottom);
@@ -371,7 +418,9 @@ static void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	int i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ContextModel( tw->ctx, model );
+	VectorCopy( cmod->mins, mins );
+	VectorCopy( cmod->maxs, maxs );
 
 	// offset for capsule center
 	for ( i = 0 ; i < 3 ; i++ ) {
@@ -389,9 +438,9 @@ static void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	h = CM_TempBoxModelCtx( tw->ctx, tw->size[0], tw->size[1], qfalse );
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
+	cmod = CM_ContextModel( tw->ctx, h );
 	CM_TestInLeaf( tw, &cmod->leaf );
 }
 
@@ -423,12 +472,9 @@ static void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
+	tw->checkcount = ++tw->ctx->checkcount;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -456,7 +502,9 @@ CM_TraceThroughPatch
 static void CM_TraceThroughPatch( traceWork_t *tw, const cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	if ( tw->ctx == &cm_traceContext ) {
+		c_patch_traces++;
+	}
 
 	oldFrac = tw->trace.fraction;
 
@@ -469,6 +517,78 @@ static void CM_TraceThroughPatch( traceWork_t *tw, const cPatch_t *patch ) {
 }
 
 
+#ifdef CM_SIMD_PLANES
+/*
+================
+CM_BrushDistances
+
+Distances from the trace start and end to CM_SIMD_WIDTH side planes of the brush
+starting at first, adjusted for mins/maxs. Uses the same double precision operations
+in the same order as the scalar loop in CM_TraceThroughBrush, so results are bit for
+bit identical.
+================
+*/
+static void CM_BrushDistances( const traceWork_t *tw, const cbrush_t *brush, int first, double *d1, double *d2 ) {
+	const double *nx, *ny, *nz, *pd;
+	int			n;
+
+	n = PAD( brush->numsides, CM_SIMD_WIDTH );
+	nx = brush->planes + first;
+	ny = nx + n;
+	nz = ny + n;
+	pd = nz + n;
+
+#ifdef __AVX__
+	{
+		const __m256d zero = _mm256_setzero_pd();
+		__m256d x, y, z, dist;
+
+		x = _mm256_loadu_pd( nx );
+		y = _mm256_loadu_pd( ny );
+		z = _mm256_loadu_pd( nz );
+		// tw->offsets[ plane->signbits ] picks maxs for negative normal components
+		dist = _mm256_add_pd( _mm256_add_pd(
+			_mm256_mul_pd( _mm256_blendv_pd( _mm256_set1_pd( tw->size[0][0] ), _mm256_set1_pd( tw->size[1][0] ), _mm256_cmp_pd( x, zero, _CMP_LT_OQ ) ), x ),
+			_mm256_mul_pd( _mm256_blendv_pd( _mm256_set1_pd( tw->size[0][1] ), _mm256_set1_pd( tw->size[1][1] ), _mm256_cmp_pd( y, zero, _CMP_LT_OQ ) ), y ) ),
+			_mm256_mul_pd( _mm256_blendv_pd( _mm256_set1_pd( tw->size[0][2] ), _mm256_set1_pd( tw->size[1][2] ), _mm256_cmp_pd( z, zero, _CMP_LT_OQ ) ), z ) );
+		dist = _mm256_sub_pd( _mm256_loadu_pd( pd ), dist );
+		_mm256_storeu_pd( d1, _mm256_sub_pd( _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( _mm256_set1_pd( tw->start[0] ), x ),
+			_mm256_mul_pd( _mm256_set1_pd( tw->start[1] ), y ) ), _mm256_mul_pd( _mm256_set1_pd( tw->start[2] ), z ) ), dist ) );
+		_mm256_storeu_pd( d2, _mm256_sub_pd( _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( _mm256_set1_pd( tw->end[0] ), x ),
+			_mm256_mul_pd( _mm256_set1_pd( tw->end[1] ), y ) ), _mm256_mul_pd( _mm256_set1_pd( tw->end[2] ), z ) ), dist ) );
+	}
+#else
+	{
+		const __m128d zero = _mm_setzero_pd();
+		const __m128d sx = _mm_set1_pd( tw->start[0] ), sy = _mm_set1_pd( tw->start[1] ), sz = _mm_set1_pd( tw->start[2] );
+		const __m128d ex = _mm_set1_pd( tw->end[0] ), ey = _mm_set1_pd( tw->end[1] ), ez = _mm_set1_pd( tw->end[2] );
+		const __m128d lx = _mm_set1_pd( tw->size[0][0] ), ly = _mm_set1_pd( tw->size[0][1] ), lz = _mm_set1_pd( tw->size[0][2] );
+		const __m128d hx = _mm_set1_pd( tw->size[1][0] ), hy = _mm_set1_pd( tw->size[1][1] ), hz = _mm_set1_pd( tw->size[1][2] );
+		__m128d x, y, z, m, ox, oy, oz, dist;
+		int i;
+
+		for ( i = 0; i < CM_SIMD_WIDTH; i += 2 ) {
+			x = _mm_loadu_pd( nx + i );
+			y = _mm_loadu_pd( ny + i );
+			z = _mm_loadu_pd( nz + i );
+			// tw->offsets[ plane->signbits ] picks maxs for negative normal components
+			m = _mm_cmplt_pd( x, zero );
+			ox = _mm_or_pd( _mm_and_pd( m, hx ), _mm_andnot_pd( m, lx ) );
+			m = _mm_cmplt_pd( y, zero );
+			oy = _mm_or_pd( _mm_and_pd( m, hy ), _mm_andnot_pd( m, ly ) );
+			m = _mm_cmplt_pd( z, zero );
+			oz = _mm_or_pd( _mm_and_pd( m, hz ), _mm_andnot_pd( m, lz ) );
+			dist = _mm_add_pd( _mm_add_pd( _mm_mul_pd( ox, x ), _mm_mul_pd( oy, y ) ), _mm_mul_pd( oz, z ) );
+			dist = _mm_sub_pd( _mm_loadu_pd( pd + i ), dist );
+			_mm_storeu_pd( d1 + i, _mm_sub_pd( _mm_add_pd( _mm_add_pd( _mm_mul_pd( sx, x ), _mm_mul_pd( sy, y ) ), _mm_mul_pd( sz, z ) ), dist ) );
+			_mm_storeu_pd( d2 + i, _mm_sub_pd( _mm_add_pd( _mm_add_pd( _mm_mul_pd( ex, x ), _mm_mul_pd( ey, y ) ), _mm_mul_pd( ez, z ) ), dist ) );
+		}
+	}
+#endif
+}
+#endif
+
+
 /*
 ================
 CM_TraceThroughBrush
@@ -486,6 +606,10 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 	double		t;
 	vec3_t		startp;
 	vec3_t		endp;
+#ifdef CM_SIMD_PLANES
+	double		dists[2][CM_SIMD_WIDTH];
+	qboolean	simd;
+#endif
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
@@ -495,7 +619,9 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 		return;
 	}
 
-	c_brush_traces++;
+	if ( tw->ctx == &cm_traceContext ) {
+		c_brush_traces++;
+	}
 
 	getout = qfalse;
 	startout = qfalse;
@@ -575,15 +701,30 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 		// find the latest time the trace crosses a plane towards the interior
 		// and the earliest time the trace crosses a plane towards the exterior
 		//
+#ifdef CM_SIMD_PLANES
+		simd = brush->planes && cm_simd->integer;
+#endif
 		for (i = 0; i < brush->numsides; i++) {
 			side = brush->sides + i;
 			plane = side->plane;
 
-			// adjust the plane distance apropriately for mins/maxs
-			dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
+#ifdef CM_SIMD_PLANES
+			if ( simd ) {
+				// test next group of planes at once, keeping the early exits
+				if ( ( i & ( CM_SIMD_WIDTH - 1 ) ) == 0 ) {
+					CM_BrushDistances( tw, brush, i, dists[0], dists[1] );
+				}
+				d1 = dists[0][ i & ( CM_SIMD_WIDTH - 1 ) ];
+				d2 = dists[1][ i & ( CM_SIMD_WIDTH - 1 ) ];
+			} else
+#endif
+			{
+				// adjust the plane distance apropriately for mins/maxs
+				dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
 
-			d1 = DotProductDP( tw->start, plane->normal ) - dist;
-			d2 = DotProductDP( tw->end, plane->normal ) - dist;
+				d1 = DotProductDP( tw->start, plane->normal ) - dist;
+				d2 = DotProductDP( tw->end, plane->normal ) - dist;
+			}
 
 			if (d2 > 0) {
 				getout = qtrue;	// endpoint is not in solid
@@ -664,7 +805,7 @@ CM_TraceThroughLeaf
 */
 static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -672,11 +813,10 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		b = CM_LeafBrush( tw, brushnum );
+		if ( CM_Visited( tw, tw->ctx->brushCheck, tw->ctx->brushBits, brushnum ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -700,14 +840,14 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( CM_Visited( tw, tw->ctx->patchCheck, tw->ctx->patchBits, surfnum ) ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -927,12 +1067,15 @@ capsule vs. capsule collision (not rotated)
 */
 static void CM_TraceCapsuleThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	int i;
+	cmodel_t *cmod;
 	vec3_t mins, maxs;
 	vec3_t top, bottom, starttop, startbottom, endtop, endbottom;
 	vec3_t offset, symetricSize[2];
 	float radius, halfwidth, halfheight, offs, h;
 
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ContextModel( tw->ctx, model );
+	VectorCopy( cmod->mins, mins );
+	VectorCopy( cmod->maxs, maxs );
 	// test trace bounds vs. capsule bounds
 	if ( tw->bounds[0][0] > maxs[0] + RADIUS_EPSILON
 		|| tw->bounds[0][1] > maxs[1] + RADIUS_EPSILON
@@ -995,7 +1138,9 @@ static void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t mod
 	int i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ContextModel( tw->ctx, model );
+	VectorCopy( cmod->mins, mins );
+	VectorCopy( cmod->maxs, maxs );
 
 	// offset for capsule center
 	for ( i = 0 ; i < 3 ; i++ ) {
@@ -1013,9 +1158,9 @@ static void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t mod
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	h = CM_TempBoxModelCtx( tw->ctx, tw->size[0], tw->size[1], qfalse );
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
+	cmod = CM_ContextModel( tw->ctx, h );
 	CM_TraceThroughLeaf( tw, &cmod->leaf );
 }
 
@@ -1133,36 +1278,201 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 }
 
 
+/*
+==================
+CM_TracePacketThroughTree
+
+Same traversal as CM_TraceThroughTree for a set of traces at once, so each
+node and leaf is fetched once per packet instead of once per trace.
+Every trace visits its leafs in the same order as it would alone.
+==================
+*/
+static void CM_TracePacketThroughTree( cmTraceSegment_t **segs, int count, int num ) {
+	cmTraceSegment_t	*near0[CM_TRACE_PACKET], *near1[CM_TRACE_PACKET], *far0[CM_TRACE_PACKET];
+	cmTraceSegment_t	split[CM_TRACE_PACKET*2];
+	int			n0, n1, f0, ns;
+	cmTraceSegment_t	*seg, *out;
+	traceWork_t	*tw;
+	cNode_t		*node;
+	cplane_t	*plane;
+	double		t1, t2, offset;
+	float		frac, frac2;
+	float		idist;
+	int			i, n, side;
+	float		midf;
+
+	// drop traces which already hit something nearer
+	for ( i = 0, n = 0; i < count; i++ ) {
+		if ( segs[i]->tw->trace.fraction > segs[i]->p1f ) {
+			segs[n++] = segs[i];
+		}
+	}
+
+	if ( n == 0 ) {
+		return;
+	}
+
+	if ( n == 1 ) {
+		seg = segs[0];
+		CM_TraceThroughTree( seg->tw, num, seg->p1f, seg->p2f, seg->p1, seg->p2 );
+		return;
+	}
+
+	// if < 0, we are in a leaf node
+	if ( num < 0 ) {
+		const cLeaf_t *leaf = &cm.leafs[-1-num];
+		for ( i = 0; i < n; i++ ) {
+			CM_TraceThroughLeaf( segs[i]->tw, leaf );
+		}
+		return;
+	}
+
+	node = cm.nodes + num;
+	plane = node->plane;
+
+	n0 = n1 = f0 = ns = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		seg = segs[i];
+		tw = seg->tw;
+
+		// adjust the plane distance apropriately for mins/maxs
+		if ( plane->type < 3 ) {
+			t1 = seg->p1[plane->type] - plane->dist;
+			t2 = seg->p2[plane->type] - plane->dist;
+			offset = tw->extents[plane->type];
+		} else {
+			t1 = DotProductDP( plane->normal, seg->p1 ) - plane->dist;
+			t2 = DotProductDP( plane->normal, seg->p2 ) - plane->dist;
+			if ( tw->isPoint ) {
+				offset = 0;
+			} else {
+				// this is silly
+				offset = 2048;
+			}
+		}
+
+		// see which sides we need to consider
+		if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+			near0[n0++] = seg;
+			continue;
+		}
+		if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+			near1[n1++] = seg;
+			continue;
+		}
+
+		// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+		if ( t1 < t2 ) {
+			idist = 1.0/(t1-t2);
+			side = 1;
+			frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+		} else if (t1 > t2) {
+			idist = 1.0/(t1-t2);
+			side = 0;
+			frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+		} else {
+			side = 0;
+			frac = 1;
+			frac2 = 0;
+		}
+
+		// move up to the node
+		if ( frac < 0 ) {
+			frac = 0;
+		} else if ( frac > 1 ) {
+			frac = 1;
+		}
+
+		out = &split[ns++];
+		midf = seg->p1f + (seg->p2f - seg->p1f)*frac;
+		out->tw = tw;
+		out->p1f = seg->p1f;
+		out->p2f = midf;
+		VectorCopy( seg->p1, out->p1 );
+		out->p2[0] = seg->p1[0] + frac*(seg->p2[0] - seg->p1[0]);
+		out->p2[1] = seg->p1[1] + frac*(seg->p2[1] - seg->p1[1]);
+		out->p2[2] = seg->p1[2] + frac*(seg->p2[2] - seg->p1[2]);
+		if ( side ) {
+			near1[n1++] = out;
+		} else {
+			near0[n0++] = out;
+		}
+
+		// go past the node
+		if ( frac2 < 0 ) {
+			frac2 = 0;
+		} else if ( frac2 > 1 ) {
+			frac2 = 1;
+		}
+
+		out = &split[ns++];
+		midf = seg->p1f + (seg->p2f - seg->p1f)*frac2;
+		out->tw = tw;
+		out->p1f = midf;
+		out->p2f = seg->p2f;
+		out->p1[0] = seg->p1[0] + frac2*(seg->p2[0] - seg->p1[0]);
+		out->p1[1] = seg->p1[1] + frac2*(seg->p2[1] - seg->p1[1]);
+		out->p1[2] = seg->p1[2] + frac2*(seg->p2[2] - seg->p1[2]);
+		VectorCopy( seg->p2, out->p2 );
+
+		// the back child is walked after the front one anyway, far parts
+		// of the traces which start behind the plane need a third pass
+		if ( side ) {
+			far0[f0++] = out;
+		} else {
+			near1[n1++] = out;
+		}
+	}
+
+	if ( n0 ) {
+		CM_TracePacketThroughTree( near0, n0, node->children[0] );
+	}
+	if ( n1 ) {
+		CM_TracePacketThroughTree( near1, n1, node->children[1] );
+	}
+	if ( f0 ) {
+		CM_TracePacketThroughTree( far0, f0, node->children[0] );
+	}
+}
+
+
 //======================================================================
 
 
 /*
 ==================
-CM_Trace
+CM_SetupTrace
+
+Fills in the trace work, returns qfalse if there is nothing to trace against
 ==================
 */
-static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
-						clipHandle_t model, const vec3_t origin, int brushmask, qboolean capsule, const sphere_t *sphere ) {
+static qboolean CM_SetupTrace( cmTraceContext_t *ctx, traceWork_t *tw, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						const vec3_t origin, int brushmask, qboolean capsule, const sphere_t *sphere ) {
 	int			i;
-	traceWork_t	tw;
 	vec3_t		offset;
-	cmodel_t	*cmod;
-
-	cmod = CM_ClipHandleToModel( model );
-
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
-	Com_Memset( &tw, 0, sizeof(tw) );
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy(origin, tw.modelOrigin);
+	Com_Memset( tw, 0, sizeof(*tw) );
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy(origin, tw->modelOrigin);
 
 	if (!cm.numNodes) {
-		*results = tw.trace;
+		return qfalse;	// map not loaded, shouldn't happen
+	}
 
-		return;	// map not loaded, shouldn't happen
+	if ( ctx->generation != cm_generation ) {
+		Com_Error( ERR_DROP, "CM_Trace: trace context from a previous map" );
+	}
+
+	tw->ctx = ctx;
+	tw->checkcount = ++ctx->checkcount;	// for multi-check avoidance
+	tw->checkbit = 1;
+
+	if ( ctx == &cm_traceContext ) {
+		c_traces++;			// for statistics, may be zeroed
 	}
 
 	// allow NULL to be passed in for 0,0,0
@@ -1174,91 +1484,121 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	}
 
 	// set basic parms
-	tw.contents = brushmask;
+	tw->contents = brushmask;
 
 	// adjust so that mins and maxs are always symetric, which
 	// avoids some complications with plane expanding of rotated
 	// bmodels
 	for ( i = 0 ; i < 3 ; i++ ) {
 		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
 	}
 
 	// if a sphere is already specified
 	if ( sphere ) {
-		tw.sphere = *sphere;
+		tw->sphere = *sphere;
 	}
 	else {
-		tw.sphere.use = capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+		tw->sphere.use = capsule;
+		tw->sphere.radius = ( tw->size[1][0] > tw->size[1][2] ) ? tw->size[1][2]: tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius );
 	}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
 
-	// tw.offsets[signbits] = vector to apropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+	// tw->offsets[signbits] = vector to apropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
 
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
 
 	//
 	// calculate bounds
 	//
-	if ( tw.sphere.use ) {
+	if ( tw->sphere.use ) {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				tw->bounds[0][i] = tw->end[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			}
 		}
 	}
 	else {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
 			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
 			}
 		}
 	}
 
+	return qtrue;
+}
+
+
+/*
+==================
+CM_SetupSweep
+
+Check for point special case
+==================
+*/
+static void CM_SetupSweep( traceWork_t *tw ) {
+	if ( tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0 ) {
+		tw->isPoint = qtrue;
+		VectorClear( tw->extents );
+	} else {
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+
+/*
+==================
+CM_TraceModel
+==================
+*/
+static void CM_TraceModel( traceWork_t *tw, const vec3_t start, const vec3_t end, clipHandle_t model, const cmodel_t *cmod ) {
 	//
 	// check for position test special case
 	//
@@ -1266,43 +1606,32 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 		if ( model ) {
 #ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TestInLeaf( &tw, &cmod->leaf );
+				tw->sphere.use = qfalse;
+				CM_TestInLeaf( tw, &cmod->leaf );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TestCapsuleInCapsule( &tw, model );
+				CM_TestCapsuleInCapsule( tw, model );
 			}
 			else
 #endif
 			if ( model == CAPSULE_MODEL_HANDLE ) {
-				if ( tw.sphere.use ) {
-					CM_TestCapsuleInCapsule( &tw, model );
+				if ( tw->sphere.use ) {
+					CM_TestCapsuleInCapsule( tw, model );
 				}
 				else {
-					CM_TestBoundingBoxInCapsule( &tw, model );
+					CM_TestBoundingBoxInCapsule( tw, model );
 				}
 			}
 			else {
-				CM_TestInLeaf( &tw, &cmod->leaf );
+				CM_TestInLeaf( tw, &cmod->leaf );
 			}
 		} else {
-			CM_PositionTest( &tw );
+			CM_PositionTest( tw );
 		}
 	} else {
-		//
-		// check for point special case
-		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
-			tw.isPoint = qtrue;
-			VectorClear( tw.extents );
-		} else {
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
-		}
+		CM_SetupSweep( tw );
 
 		//
 		// general sweeping through world
@@ -1310,48 +1639,159 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 		if ( model ) {
 #ifdef ALWAYS_BBOX_VS_BBOX
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				tw->sphere.use = qfalse;
+				CM_TraceThroughLeaf( tw, &cmod->leaf );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TraceCapsuleThroughCapsule( &tw, model );
+				CM_TraceCapsuleThroughCapsule( tw, model );
 			}
 			else
 #endif
 			if ( model == CAPSULE_MODEL_HANDLE ) {
-				if ( tw.sphere.use ) {
-					CM_TraceCapsuleThroughCapsule( &tw, model );
+				if ( tw->sphere.use ) {
+					CM_TraceCapsuleThroughCapsule( tw, model );
 				}
 				else {
-					CM_TraceBoundingBoxThroughCapsule( &tw, model );
+					CM_TraceBoundingBoxThroughCapsule( tw, model );
 				}
 			}
 			else {
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				CM_TraceThroughLeaf( tw, &cmod->leaf );
 			}
 		} else {
-			CM_TraceThroughTree( &tw, 0, 0, 1, tw.start, tw.end );
+			CM_TraceThroughTree( tw, 0, 0, 1, tw->start, tw->end );
 		}
 	}
+}
+
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( const traceWork_t *tw, trace_t *results, const vec3_t start, const vec3_t end ) {
+	int			i;
+
+	*results = tw->trace;
 
 	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 ) {
-		VectorCopy (end, tw.trace.endpos);
+	if ( results->fraction == 1 ) {
+		VectorCopy (end, results->endpos);
 	} else {
 		for ( i=0 ; i<3 ; i++ ) {
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
+			results->endpos[i] = start[i] + results->fraction * (end[i] - start[i]);
 		}
 	}
 
         // If allsolid is set (was entirely inside something solid), the plane is not valid.
         // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
         // Otherwise, the normal on the plane should have unit length
-        assert(tw.trace.allsolid ||
-               tw.trace.fraction == 1.0 ||
-               VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+        assert(results->allsolid ||
+               results->fraction == 1.0 ||
+               VectorLengthSquared(results->plane.normal) > 0.9999);
+}
+
+
+/*
+==================
+CM_Trace
+==================
+*/
+static void CM_Trace( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, const vec3_t origin, int brushmask, qboolean capsule, const sphere_t *sphere ) {
+	traceWork_t	tw;
+
+	if ( !CM_SetupTrace( ctx, &tw, start, end, mins, maxs, origin, brushmask, capsule, sphere ) ) {
+		*results = tw.trace;
+		return;
+	}
+
+	CM_TraceModel( &tw, start, end, model, CM_ContextModel( ctx, model ) );
+
+	CM_FinishTrace( &tw, results, start, end );
+}
+
+
+/*
+==================
+CM_BoxTraceBatchCtx
+
+Traces count boxes against the same model, world sweeps are grouped
+in packets which walk the tree together
+==================
+*/
+void CM_BoxTraceBatchCtx( cmTraceContext_t *ctx, trace_t *results, const traceRay_t *rays, int count,
+						clipHandle_t model, int brushmask, qboolean capsule ) {
+	traceWork_t	tw[CM_TRACE_PACKET];
+	cmTraceSegment_t	segs[CM_TRACE_PACKET], *list[CM_TRACE_PACKET];
+	const traceRay_t	*ray;
+	const cmodel_t	*cmod;
+	int			i, j, n, sweeps, checkcount;
+
+	if ( !cm.numNodes ) {
+		for ( i = 0; i < count; i++ ) {
+			Com_Memset( &results[i], 0, sizeof( results[i] ) );
+			results[i].fraction = 1;
+		}
+		return;
+	}
+
+	cmod = CM_ContextModel( ctx, model );
+
+	for ( i = 0; i < count; i += CM_TRACE_PACKET ) {
+		n = MIN( count - i, CM_TRACE_PACKET );
+
+		for ( j = 0, ray = rays + i; j < n; j++, ray++ ) {
+			CM_SetupTrace( ctx, &tw[j], ray->start, ray->end, ray->mins, ray->maxs, vec3_origin, brushmask, capsule, NULL );
+			if ( model || VectorCompare( ray->start, ray->end ) ) {
+				// position tests and inline models do not walk the tree
+				CM_TraceModel( &tw[j], ray->start, ray->end, model, cmod );
+				segs[j].tw = NULL;
+			} else {
+				CM_SetupSweep( &tw[j] );
+				segs[j].tw = &tw[j];
+				segs[j].p1f = 0;
+				segs[j].p2f = 1;
+				VectorCopy( tw[j].start, segs[j].p1 );
+				VectorCopy( tw[j].end, segs[j].p2 );
+			}
+		}
+
+		// compact the world sweeps, they share a visit stamp
+		checkcount = ++ctx->checkcount;
+		for ( j = 0, sweeps = 0; j < n; j++ ) {
+			if ( segs[j].tw ) {
+				segs[j].tw->checkcount = checkcount;
+				segs[j].tw->checkbit = 1 << sweeps;
+				list[sweeps++] = &segs[j];
+			}
+		}
+		if ( sweeps ) {
+			CM_TracePacketThroughTree( list, sweeps, 0 );
+		}
+
+		for ( j = 0, ray = rays + i; j < n; j++, ray++ ) {
+			CM_FinishTrace( &tw[j], &results[i+j], ray->start, ray->end );
+		}
+	}
+}
+
+
+/*
+==================
+CM_BoxTraceCtx
+
+Traces using own visit stamps and temporary box, so it can run concurrently
+with traces that use other contexts
+==================
+*/
+void CM_BoxTraceCtx( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask, qboolean capsule ) {
+	CM_Trace( ctx, results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
 
@@ -1363,19 +1803,30 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask, qboolean capsule ) {
-	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+	CM_Trace( &cm_traceContext, results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_BoxTraceBatch
+==================
+*/
+void CM_BoxTraceBatch( trace_t *results, const traceRay_t *rays, int count,
+						clipHandle_t model, int brushmask, qboolean capsule ) {
+	CM_BoxTraceBatchCtx( &cm_traceContext, results, rays, count, model, brushmask, capsule );
+}
+
+
+/*
+==================
+CM_TransformedBoxTraceCtx
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
+void CM_TransformedBoxTraceCtx( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask,
 						const vec3_t origin, const vec3_t angles, qboolean capsule ) {
@@ -1449,7 +1900,7 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	}
 
 	// sweep the box through the model
-	CM_Trace( &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
+	CM_Trace( ctx, &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
 
 	// if the bmodel was rotated and there was a collision
 	if ( rotated && trace.fraction != 1.0 ) {
@@ -1466,3 +1917,307 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+
+/*
+==================
+CM_TransformedBoxTrace
+==================
+*/
+void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask,
+						const vec3_t origin, const vec3_t angles, qboolean capsule ) {
+	CM_TransformedBoxTraceCtx( &cm_traceContext, results, start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+}
+
+
+#ifndef BSPC
+/*
+===============================================================================
+
+CONCURRENCY TEST
+
+===============================================================================
+*/
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		origin, angles;
+	clipHandle_t	model;
+	int			brushmask;
+	qboolean	capsule;
+	qboolean	transformed;
+} cmTraceTest_t;
+
+typedef struct {
+	const cmTraceTest_t	*tests;
+	trace_t				*results;
+	cmTraceContext_t	**contexts;
+	int					count;
+	int					numChunks;
+} cmTraceJobs_t;
+
+
+static void CM_RandomPoint( vec3_t point, const vec3_t mins, const vec3_t maxs ) {
+	int i;
+
+	for ( i = 0; i < 3; i++ ) {
+		point[i] = mins[i] + random() * ( maxs[i] - mins[i] );
+	}
+}
+
+
+static void CM_RunTraceTest( cmTraceContext_t *ctx, const cmTraceTest_t *test, trace_t *result ) {
+	clipHandle_t h;
+
+	h = test->model;
+	if ( h == BOX_MODEL_HANDLE ) {
+		// target box is the same as the traced one, placed at the model origin
+		h = CM_TempBoxModelCtx( ctx, test->mins, test->maxs, qfalse );
+	}
+
+	if ( test->transformed ) {
+		CM_TransformedBoxTraceCtx( ctx, result, test->start, test->end, test->mins, test->maxs,
+			h, test->brushmask, test->origin, test->angles, test->capsule );
+	} else {
+		CM_BoxTraceCtx( ctx, result, test->start, test->end, test->mins, test->maxs,
+			h, test->brushmask, test->capsule );
+	}
+}
+
+
+static void CM_TraceTestJob( void *data, int index ) {
+	const cmTraceJobs_t *jobs = (const cmTraceJobs_t *)data;
+	int i, first, last;
+
+	first = jobs->count * index / jobs->numChunks;
+	last = jobs->count * ( index + 1 ) / jobs->numChunks;
+
+	for ( i = first; i < last; i++ ) {
+		CM_RunTraceTest( jobs->contexts[ index ], &jobs->tests[ i ], &jobs->results[ i ] );
+	}
+}
+
+
+/*
+==================
+CM_CompareTraces
+==================
+*/
+static int CM_CompareTraces( const char *name, const trace_t *ref, const trace_t *res, const cmTraceTest_t *tests, int count ) {
+	int i, failed;
+
+	for ( i = 0, failed = 0; i < count; i++ ) {
+		if ( memcmp( &ref[i], &res[i], sizeof( ref[i] ) ) != 0 ) {
+			if ( failed < 8 ) {
+				Com_Printf( S_COLOR_YELLOW "%s trace %i (model %i) mismatch: fraction %f/%f, contents %i/%i\n", name, i, tests[i].model,
+					ref[i].fraction, res[i].fraction, ref[i].contents, res[i].contents );
+			}
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+
+static const int cm_testMasks[2] = {
+	CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_PLAYERCLIP,
+	CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_CORPSE
+};
+
+
+/*
+==================
+CM_TraceTest_f
+
+Runs random traces against the loaded map with the scalar brush tests as
+reference, then again with SIMD plane tests, batched and concurrently with
+per-job contexts, and compares the results bit for bit
+==================
+*/
+void CM_TraceTest_f( void ) {
+	cmTraceJobs_t	jobs;
+	cmTraceTest_t	*tests, *test;
+	trace_t			*ref, *res, *out;
+	traceRay_t		*rays;
+	int				*index;
+	const cmodel_t	*world;
+	int				count, threads, i, n, group;
+	int				scalarTime, simdTime, singleTime, batchTime, parallelTime, start;
+	int				simdFailed, batchFailed, parallelFailed;
+	int				simd;
+	vec3_t			wmins, wmaxs;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	count = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 10000;
+	threads = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 4;
+	if ( count < 1 ) {
+		count = 1;
+	}
+	if ( threads < 1 ) {
+		threads = 1;
+	}
+
+	world = &cm.cmodels[0];
+	VectorCopy( world->mins, wmins );
+	VectorCopy( world->maxs, wmaxs );
+
+	tests = Z_Malloc( count * sizeof( *tests ) );
+	ref = Z_Malloc( count * sizeof( *ref ) );
+	res = Z_Malloc( count * sizeof( *res ) );
+	out = Z_Malloc( count * sizeof( *out ) );
+	rays = Z_Malloc( count * sizeof( *rays ) );
+	index = Z_Malloc( count * sizeof( *index ) );
+	Com_Memset( tests, 0, count * sizeof( *tests ) );
+
+	for ( i = 0, test = tests; i < count; i++, test++ ) {
+		if ( i > 0 && ( rand() & 3 ) ) {
+			// spread from the same start like pellets or visibility checks
+			*test = test[-1];
+			VectorSet( test->end, test->end[0] + crandom() * 128, test->end[1] + crandom() * 128, test->end[2] + crandom() * 128 );
+			continue;
+		}
+
+		CM_RandomPoint( test->start, wmins, wmaxs );
+		switch ( rand() % 4 ) {
+		case 0: // position test
+			VectorCopy( test->start, test->end );
+			break;
+		case 1: // short move
+			VectorSet( test->end, crandom() * 64, crandom() * 64, crandom() * 64 );
+			VectorAdd( test->start, test->end, test->end );
+			break;
+		default:
+			CM_RandomPoint( test->end, wmins, wmaxs );
+			break;
+		}
+
+		if ( rand() & 1 ) {
+			VectorSet( test->mins, -15 - ( rand() & 15 ), -15 - ( rand() & 15 ), -24 - ( rand() & 15 ) );
+			VectorSet( test->maxs, 15 + ( rand() & 15 ), 15 + ( rand() & 15 ), 32 + ( rand() & 15 ) );
+			test->capsule = ( rand() % 8 ) == 0;
+		}
+
+		switch ( rand() % 8 ) {
+		case 0:
+			test->model = BOX_MODEL_HANDLE;
+			test->capsule = qfalse;
+			break;
+		case 1:
+		case 2:
+			if ( cm.numSubModels > 1 ) {
+				test->model = 1 + rand() % ( cm.numSubModels - 1 );
+				break;
+			}
+			// fall through
+		default:
+			test->model = 0;
+			break;
+		}
+
+		if ( test->model != 0 || ( rand() & 7 ) == 0 ) {
+			test->transformed = qtrue;
+			if ( test->model == BOX_MODEL_HANDLE ) {
+				CM_RandomPoint( test->origin, wmins, wmaxs );
+			} else if ( rand() & 1 ) {
+				VectorSet( test->origin, crandom() * 64, crandom() * 64, crandom() * 64 );
+			}
+			if ( rand() & 1 ) {
+				VectorSet( test->angles, random() * 360, random() * 360, random() * 360 );
+			}
+		}
+
+		test->brushmask = cm_testMasks[ rand() & 1 ];
+	}
+
+	simd = cm_simd->integer;
+
+	// scalar reference
+	Cvar_Set( "cm_simd", "0" );
+	scalarTime = Sys_Milliseconds();
+	for ( i = 0; i < count; i++ ) {
+		CM_RunTraceTest( &cm_traceContext, &tests[i], &ref[i] );
+	}
+	scalarTime = Sys_Milliseconds() - scalarTime;
+	Cvar_Set( "cm_simd", "1" );
+
+	Com_Memset( res, 0, count * sizeof( *res ) );
+	simdTime = Sys_Milliseconds();
+	for ( i = 0; i < count; i++ ) {
+		CM_RunTraceTest( &cm_traceContext, &tests[i], &res[i] );
+	}
+	simdTime = Sys_Milliseconds() - simdTime;
+	simdFailed = CM_CompareTraces( "simd", ref, res, tests, count );
+
+	// world traces grouped by the parameters shared by a batch
+	Com_Memcpy( res, ref, count * sizeof( *res ) );
+	singleTime = batchTime = 0;
+	for ( group = 0; group < 4; group++ ) {
+		for ( i = 0, n = 0, test = tests; i < count; i++, test++ ) {
+			if ( test->model == 0 && !test->transformed && test->brushmask == cm_testMasks[ group & 1 ] && test->capsule == ( group >> 1 ) ) {
+				VectorCopy( test->start, rays[n].start );
+				VectorCopy( test->end, rays[n].end );
+				VectorCopy( test->mins, rays[n].mins );
+				VectorCopy( test->maxs, rays[n].maxs );
+				index[n++] = i;
+			}
+		}
+
+		start = Sys_Milliseconds();
+		for ( i = 0; i < n; i++ ) {
+			CM_BoxTrace( &out[i], rays[i].start, rays[i].end, rays[i].mins, rays[i].maxs, 0, cm_testMasks[ group & 1 ], group >> 1 );
+		}
+		singleTime += Sys_Milliseconds() - start;
+
+		start = Sys_Milliseconds();
+		CM_BoxTraceBatch( out, rays, n, 0, cm_testMasks[ group & 1 ], group >> 1 );
+		batchTime += Sys_Milliseconds() - start;
+
+		for ( i = 0; i < n; i++ ) {
+			res[ index[i] ] = out[i];
+		}
+	}
+	batchFailed = CM_CompareTraces( "batch", ref, res, tests, count );
+
+	// more chunks than threads so workers keep stealing, one context per chunk
+	Com_Memset( res, 0, count * sizeof( *res ) );
+	jobs.tests = tests;
+	jobs.results = res;
+	jobs.count = count;
+	jobs.numChunks = MIN( count, threads * 8 );
+	jobs.contexts = Z_Malloc( jobs.numChunks * sizeof( *jobs.contexts ) );
+	for ( i = 0; i < jobs.numChunks; i++ ) {
+		jobs.contexts[i] = CM_CreateTraceContext();
+	}
+
+	parallelTime = Sys_Milliseconds();
+	Sys_RunJobs( CM_TraceTestJob, &jobs, jobs.numChunks, threads );
+	parallelTime = Sys_Milliseconds() - parallelTime;
+	parallelFailed = CM_CompareTraces( "threaded", ref, res, tests, count );
+
+	Cvar_Set( "cm_simd", va( "%i", simd ) );
+
+	for ( i = 0; i < jobs.numChunks; i++ ) {
+		CM_FreeTraceContext( jobs.contexts[i] );
+	}
+	Z_Free( jobs.contexts );
+	Z_Free( index );
+	Z_Free( rays );
+	Z_Free( out );
+	Z_Free( res );
+	Z_Free( ref );
+	Z_Free( tests );
+
+	Com_Printf( "%i traces: scalar %i msec, simd %i msec (%i mismatches), %i threads %i msec (%i mismatches)\n",
+		count, scalarTime, simdTime, simdFailed, threads, parallelTime, parallelFailed );
+	Com_Printf( "batchable world traces: single %i msec, batched %i msec (%i mismatches)\n",
+		singleTime, batchTime, batchFailed );
+}
+#endif // !BSPC
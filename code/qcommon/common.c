@@ -2285,6 +2285,42 @@ qboolean Hunk_CheckMark( void ) {
 	return qfalse;
 }
 
+/*
+=================
+Hunk_GetPermanent
+
+Returns the permanent use of both ends of the hunk, to be passed to Hunk_Rewind
+=================
+*/
+void Hunk_GetPermanent( int *low, int *high ) {
+	*low = hunk_low.permanent;
+	*high = hunk_high.permanent;
+}
+
+
+/*
+=================
+Hunk_Rewind
+
+Releases everything allocated since Hunk_GetPermanent returned low and high,
+fails if temp memory is in use or the level mark would be crossed
+=================
+*/
+qboolean Hunk_Rewind( int low, int high ) {
+	if ( low < hunk_low.mark || low > hunk_low.permanent || high < hunk_high.mark || high > hunk_high.permanent ) {
+		return qfalse;
+	}
+
+	if ( hunk_low.temp != hunk_low.permanent || hunk_high.temp != hunk_high.permanent ) {
+		return qfalse;
+	}
+
+	hunk_low.permanent = hunk_low.temp = low;
+	hunk_high.permanent = hunk_high.temp = high;
+
+	return qtrue;
+}
+
 void CL_ShutdownCGame( void );
 void CL_ShutdownUI( void );
 void SV_ShutdownGameProgs( void );
@@ -3684,6 +3720,33 @@ void Com_Init( char *commandLine ) {
 		"Runtime checks in compiled vm code, bitmask:\n 1 - program stack overflow\n" \
 		" 2 - opcode stack overflow\n 4 - jump target range\n 8 - data read/write range" );
 
+	Com_StartupVariable( "vm_optimize" );
+	vm_optimize = Cvar_Get( "vm_optimize", "0", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( vm_optimize, "0", "7", CV_INTEGER );
+	Cvar_SetDescription( vm_optimize,
+		"Use optimizing code generator for compiled vm, bitmask:\n 1 - qagame\n 2 - cgame\n 4 - ui" );
+
+	Com_StartupVariable( "vm_verify" );
+	vm_verify = Cvar_Get( "vm_verify", "0", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( vm_verify, "0", "7", CV_INTEGER );
+	Cvar_SetDescription( vm_verify,
+		"Replay every call into compiled vm in the interpreter and compare results, bitmask:\n" \
+		" 1 - qagame\n 2 - cgame\n 4 - ui\nVery slow, needs extra hunk memory, for debugging only" );
+
+	Com_StartupVariable( "vm_tiered" );
+	vm_tiered = Cvar_Get( "vm_tiered", "0", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( vm_tiered, "0", "7", CV_INTEGER );
+	Cvar_SetDescription( vm_tiered,
+		"Start compiled vm with profiling baseline code and recompile hot functions\n" \
+		"with the optimizing code generator in background, bitmask:\n 1 - qagame\n 2 - cgame\n 4 - ui" );
+
+	vm_tierThreshold = Cvar_Get( "vm_tierThreshold", "1000", 0 );
+	Cvar_CheckRange( vm_tierThreshold, "1", NULL, CV_INTEGER );
+	Cvar_SetDescription( vm_tierThreshold, "Number of calls into profiling vm code before hot functions are recompiled" );
+
+	vm_cache = Cvar_Get( "vm_cache", "1", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( vm_cache, "Keep compiled vm code in vmcache/ below fs_homepath and reuse it on later loads of the same module." );
+
 	Com_StartupVariable( "journal" );
 	com_journal = Cvar_Get( "journal", "0", CVAR_INIT | CVAR_PROTECTED );
 	Cvar_CheckRange( com_journal, "0", "2", CV_INTEGER );
@@ -3806,6 +3869,9 @@ void Com_Init_After_Filesystem( void ) {
 
 	Cmd_AddCommand( "quit", Com_Quit_f );
 	Cmd_AddCommand( "changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand( "huffbench", MSG_HuffBench_f );
+	Cmd_AddCommand( "msgcheck", MSG_Check_f );
+	Cmd_AddCommand( "cm_traceTest", CM_TraceTest_f );
 	Cmd_AddCommand( "writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteWriteCfgName );
 	Cmd_AddCommand( "game_restart", Com_GameRestart_f );
@@ -4125,6 +4191,10 @@ void Com_Frame( qboolean noDelay ) {
 	int	timeAfter;
 
 	if ( setjmp( abortframe ) ) {
+		// the error may have been thrown in the middle of a packet batch
+		Sys_EndPacketBatch();
+		// or of a pass over a secondary server world
+		SV_AbortWorldPass();
 #ifdef EMSCRIPTEN
 		outsideError = 0;
 		outsideMsg = 0;
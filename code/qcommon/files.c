@@ -816,6 +816,21 @@ void FS_HomeRemove( const char *osPath )
 }
 
 
+/*
+===========
+FS_SV_Remove
+
+Removes a file relative to the home path, without the gamedir
+===========
+*/
+void FS_SV_Remove( const char *file )
+{
+	FS_CheckFilenameIsNotAllowed( file, __func__, qfalse );
+
+	remove( FS_BuildOSPath( fs_homepath->string, file, NULL ) );
+}
+
+
 /*
 ================
 FS_FileExists
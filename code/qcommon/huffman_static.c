@@ -137,7 +137,7 @@ const uint16_t HuffmanDecoderTable[ 2048 ] =
 };
 
 
-static const uint16_t HuffmanEncoderTable[ 256 ] =
+const uint16_t HuffmanEncoderTable[ 256 ] =
 {
 	34, 437, 1159, 1735, 2584, 280, 263, 1014, 341, 839, 1687, 183, 311, 726, 920, 2761,
 	599, 1417, 7945, 8073, 7642, 16186, 8890, 12858, 3913, 6362, 2746, 13882, 7866, 1080, 1273, 3400,
@@ -215,3 +215,110 @@ int HuffmanGetSymbol( unsigned int* symbol, const byte* buffer, int bitIndex )
 	return (int)(entry >> 8);
 	//return code;
 }
+
+
+/*
+** Multi-symbol variants used by MSG_WriteBits/MSG_ReadBits: the raw low bits
+** and up to four symbol codes of a value are gathered in a 64-bit accumulator
+** (at most 7 + 4*11 bits) and stored or fetched in one pass, producing exactly
+** the same bitstream as the per-bit/per-symbol functions above.
+*/
+
+void HuffmanPutBits( byte* fout, int bitIndex, uint64_t code, int count )
+{
+	byte *p = fout + ( bitIndex >> 3 );
+	const int bitOffset = bitIndex & 7;
+
+	// the current byte keeps already written bits, following bytes are overwritten
+	if ( bitOffset )
+	{
+		*p++ |= (byte)( code << bitOffset );
+		code >>= 8 - bitOffset;
+		count -= 8 - bitOffset;
+	}
+
+	while ( count > 0 )
+	{
+		*p++ = (byte)code;
+		code >>= 8;
+		count -= 8;
+	}
+}
+
+
+int HuffmanPutValue( byte* fout, int bitIndex, uint32_t value, int bits )
+{
+	const int nbits = bits & 7;
+	uint64_t code;
+	uint16_t result;
+	int count, i;
+
+	code = value & ( ( 1U << nbits ) - 1 );
+	count = nbits;
+	value >>= nbits;
+
+	for ( i = nbits; i < bits; i += 8 )
+	{
+		result = HuffmanEncoderTable[ value & 0xFF ];
+		code |= (uint64_t)( ( result >> 4 ) & 0x7FF ) << count;
+		count += result & 15;
+		value >>= 8;
+	}
+
+	HuffmanPutBits( fout, bitIndex, code, count );
+
+	return count;
+}
+
+
+// returns at least 57 bits starting at bitIndex, zero past bufferSize
+uint64_t HuffmanGetWindow( const byte* buffer, int bitIndex, int bufferSize )
+{
+	const int byteIndex = bitIndex >> 3;
+	uint64_t window;
+	int i;
+
+	if ( byteIndex + 8 <= bufferSize )
+	{
+#ifdef Q3_LITTLE_ENDIAN
+		memcpy( &window, buffer + byteIndex, 8 );
+#else
+		window = 0;
+		for ( i = 0; i < 8; i++ )
+			window |= (uint64_t)buffer[ byteIndex + i ] << ( i * 8 );
+#endif
+	}
+	else
+	{
+		window = 0;
+		for ( i = 0; byteIndex + i < bufferSize; i++ )
+			window |= (uint64_t)buffer[ byteIndex + i ] << ( i * 8 );
+	}
+
+	return window >> ( bitIndex & 7 );
+}
+
+
+int HuffmanGetValue( uint32_t* value, const byte* buffer, int bitIndex, int bits, int bufferSize )
+{
+	const int nbits = bits & 7;
+	uint64_t window;
+	uint16_t entry;
+	int count, i;
+
+	window = HuffmanGetWindow( buffer, bitIndex, bufferSize );
+
+	*value = (uint32_t)window & ( ( 1U << nbits ) - 1 );
+	window >>= nbits;
+	count = nbits;
+
+	for ( i = nbits; i < bits; i += 8 )
+	{
+		entry = HuffmanDecoderTable[ window & 0x7FF ];
+		*value |= (uint32_t)( entry & 0xFF ) << i;
+		window >>= entry >> 8;
+		count += entry >> 8;
+	}
+
+	return count;
+}
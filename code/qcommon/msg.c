@@ -97,7 +97,6 @@ bit functions
 
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
-	int	i;
 
 	if ( bits == 0 || bits < -31 || bits > 32 ) {
 		Com_Error( ERR_DROP, "MSG_WriteBits: bad bits %i", bits );
@@ -129,22 +128,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		}
 	} else {
 		value &= (0xffffffff>>(32-bits));
-		if ( bits & 7 ) {
-			int nbits;
-			nbits = bits&7;
-			for ( i = 0; i < nbits ; i++ ) {
-				HuffmanPutBit( msg->data, msg->bit, (value & 1) );
-				msg->bit++;
-				value = (value>>1);
-			}
-			bits = bits - nbits;
-		}
-		if ( bits ) {
-			for( i = 0 ; i < bits ; i += 8 ) {
-				msg->bit += HuffmanPutSymbol( msg->data, msg->bit, (value & 0xFF) );
-				value = (value>>8);
-			}
-		}
+		msg->bit += HuffmanPutValue( msg->data, msg->bit, value, bits );
 		msg->cursize = (msg->bit>>3)+1;
 	}
 
@@ -154,11 +138,45 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 }
 
 
+/*
+=================
+MSG_WriteBitSlice
+
+Appends bits previously written to a separate non-oob message,
+huffman codes don't depend on the bit position so they can be copied as is
+=================
+*/
+void MSG_WriteBitSlice( msg_t *msg, const byte *data, int bits ) {
+	uint32_t chunk;
+	int n;
+
+	if ( msg->overflowed != qfalse || bits <= 0 )
+		return;
+
+	while ( bits > 0 ) {
+		n = ( bits < 32 ) ? bits : 32;
+		chunk = data[0] | ( data[1] << 8 ) | ( data[2] << 16 ) | ( (uint32_t)data[3] << 24 );
+		if ( n < 32 ) {
+			chunk &= ( 1U << n ) - 1;
+		}
+		HuffmanPutBits( msg->data, msg->bit, chunk, n );
+		msg->bit += n;
+		bits -= n;
+		data += 4;
+	}
+
+	msg->cursize = (msg->bit>>3)+1;
+
+	if ( msg->bit > msg->maxbits ) {
+		msg->overflowed = qtrue;
+	}
+}
+
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int		value;
 	qboolean	sgn;
-	int		i;
-	unsigned int	sym;
+	uint32_t	sym;
 	const byte *buffer = msg->data; // dereference optimization
 
 	if ( msg->bit >= msg->maxbits )
@@ -197,28 +215,337 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		else
 			Com_Error( ERR_DROP, "can't read %d bits", bits );
 	} else {
-		const int nbits = bits & 7;
-		int bitIndex = msg->bit; // dereference optimization
-		int bitIndex2;
-		if ( nbits )
-		{		
-			for ( i = 0; i < nbits; i++ ) {
-				value |= HuffmanGetBit( buffer, bitIndex ) << i;
-				bitIndex++;
-			}
-			bits -= nbits;
+		msg->bit += HuffmanGetValue( &sym, buffer, msg->bit, bits, msg->maxsize );
+		msg->readcount = (msg->bit >> 3) + 1;
+		value = sym;
+	}
+
+	if ( sgn && bits < 32 ) {
+		if ( value & ( 1 << ( bits - 1 ) ) ) {
+			value |= -1 ^ ( ( 1 << bits ) - 1 );
 		}
-		if ( bits )
-		{
-			for ( i = 0; i < bits; i += 8 )
-			{
-				bitIndex2 = HuffmanGetSymbol( &sym, buffer, bitIndex );
-				bitIndex = bitIndex + bitIndex2;
-				value |= ( sym << (i+nbits) );
+	}
+
+	return value;
+}
+
+
+
+/*
+=================
+MSG_HuffBench_f
+
+Measures static huffman throughput on the messages of a recorded demo,
+per-symbol functions against the multi-symbol ones used by MSG_*Bits,
+and verifies that both produce the recorded bitstream
+=================
+*/
+void MSG_HuffBench_f( void ) {
+	static byte		in[ MAX_MSGLEN_BUF ];
+	static byte		out[ MAX_MSGLEN_BUF ];
+	static byte		symbols[ MAX_MSGLEN * 8 ];
+	static byte		decoded[ MAX_MSGLEN * 8 ];
+	int64_t			time[4], start;
+	int64_t			totalBytes, totalSymbols;
+	unsigned int	sym;
+	uint32_t		value;
+	const byte		*data;
+	byte			*buf;
+	int				fileLen, len, pos;
+	int				passes, pass;
+	int				bit, maxbits, numSymbols, i;
+	int				mismatches;
+	const char		*name;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: huffbench <demo> [passes]\n" );
+		return;
+	}
+
+	name = Cmd_Argv( 1 );
+	fileLen = FS_ReadFile( name, (void **)&buf );
+	if ( !buf ) {
+		Com_Printf( "Couldn't load %s\n", name );
+		return;
+	}
+
+	passes = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 10;
+	if ( passes < 1 )
+		passes = 1;
+
+	Com_Memset( time, 0, sizeof( time ) );
+	totalBytes = totalSymbols = 0;
+	mismatches = 0;
+
+	for ( pass = 0; pass < passes; pass++ ) {
+		// sequence number, length, message data
+		for ( pos = 0; pos + 8 <= fileLen; pos += 8 + len ) {
+			len = LittleLong( *(int *)( buf + pos + 4 ) );
+			if ( len < 0 || len > MAX_MSGLEN || pos + 8 + len > fileLen ) {
+				break;
+			}
+			data = buf + pos + 8;
+			maxbits = len * 8;
+
+			Com_Memcpy( in, data, len );
+			Com_Memset( in + len, 0, MAX_MSGLEN_BUF - len );
+
+			// decode one symbol at a time
+			start = Sys_Microseconds();
+			for ( bit = 0, numSymbols = 0; bit < maxbits; numSymbols++ ) {
+				bit += HuffmanGetSymbol( &sym, in, bit );
+				symbols[ numSymbols ] = sym;
+			}
+			time[0] += Sys_Microseconds() - start;
+
+			// decode as MSG_ReadLong/MSG_ReadByte do
+			start = Sys_Microseconds();
+			for ( bit = 0, i = 0; i + 4 <= numSymbols; i += 4 ) {
+				bit += HuffmanGetValue( &value, in, bit, 32, MAX_MSGLEN_BUF );
+				decoded[i+0] = value;
+				decoded[i+1] = value >> 8;
+				decoded[i+2] = value >> 16;
+				decoded[i+3] = value >> 24;
+			}
+			for ( ; i < numSymbols; i++ ) {
+				bit += HuffmanGetValue( &value, in, bit, 8, MAX_MSGLEN_BUF );
+				decoded[ i ] = value;
+			}
+			time[1] += Sys_Microseconds() - start;
+			if ( memcmp( decoded, symbols, numSymbols ) ) {
+				mismatches++;
 			}
+
+			// encode one symbol at a time
+			start = Sys_Microseconds();
+			for ( bit = 0, i = 0; i < numSymbols; i++ ) {
+				bit += HuffmanPutSymbol( out, bit, symbols[ i ] );
+			}
+			time[2] += Sys_Microseconds() - start;
+			if ( memcmp( out, in, len ) ) {
+				mismatches++;
+			}
+
+			// encode as MSG_WriteLong/MSG_WriteByte do
+			start = Sys_Microseconds();
+			for ( bit = 0, i = 0; i + 4 <= numSymbols; i += 4 ) {
+				value = symbols[i] | ( symbols[i+1] << 8 ) | ( symbols[i+2] << 16 ) | ( (uint32_t)symbols[i+3] << 24 );
+				bit += HuffmanPutValue( out, bit, value, 32 );
+			}
+			for ( ; i < numSymbols; i++ ) {
+				bit += HuffmanPutValue( out, bit, symbols[ i ], 8 );
+			}
+			time[3] += Sys_Microseconds() - start;
+			if ( memcmp( out, in, len ) ) {
+				mismatches++;
+			}
+
+			totalBytes += len;
+			totalSymbols += numSymbols;
+		}
+	}
+
+	FS_FreeFile( buf );
+
+	if ( !totalBytes ) {
+		Com_Printf( "No messages found in %s\n", name );
+		return;
+	}
+
+	Com_Printf( "%i passes, %lli compressed bytes, %lli symbols\n", passes, (long long)totalBytes, (long long)totalSymbols );
+	for ( i = 0; i < 4; i++ ) {
+		static const char *labels[4] = { "decode symbol", "decode value", "encode symbol", "encode value" };
+		Com_Printf( "%-14s %6lli usec, %8.2f MB/s\n", labels[i], (long long)time[i],
+			time[i] ? (double)totalSymbols / (double)time[i] : 0.0 );
+	}
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "%i mismatching messages\n", mismatches );
+	}
+}
+
+
+/*
+=============================================================================
+
+buffered bit functions
+
+Delta encoders write long runs of short fields. Instead of storing every
+value separately, the writer appends huffman codes to a 64-bit register
+and stores it 32 bits at a time, the reader decodes from a 64-bit window
+that is refilled only when it runs short. The resulting bitstream is the
+same as with MSG_WriteBits/MSG_ReadBits, which are still used for
+everything around them. msg->bit/cursize/readcount are only valid again
+after MSG_EndWriter/MSG_EndReader.
+
+=============================================================================
+*/
+
+typedef struct {
+	msg_t		*msg;
+	uint64_t	pending;	// coded bits not yet stored at msg->bit
+	int			count;		// number of pending bits
+	int			startBit;
+} bitWriter_t;
+
+typedef struct {
+	msg_t		*msg;
+	uint64_t	window;		// bits from position bit on
+	int			avail;		// number of valid bits in window
+	int			bit;
+	int			startBit;
+} bitReader_t;
+
+static qboolean msg_unbuffered;	// route buffered calls through MSG_WriteBits/MSG_ReadBits for msgcheck
+
+
+static void MSG_BeginWriter( bitWriter_t *bw, msg_t *msg ) {
+	bw->msg = msg;
+	bw->pending = 0;
+	bw->count = 0;
+	bw->startBit = msg->bit;
+}
+
+
+static void MSG_EndWriter( bitWriter_t *bw ) {
+	msg_t *msg = bw->msg;
+
+	if ( bw->count ) {
+		HuffmanPutBits( msg->data, msg->bit, bw->pending, bw->count );
+		msg->bit += bw->count;
+		bw->pending = 0;
+		bw->count = 0;
+	}
+
+	// MSG_WriteBits already keeps cursize of oob messages in bytes
+	if ( msg->bit != bw->startBit && !msg->oob ) {
+		msg->cursize = (msg->bit>>3)+1;
+	}
+}
+
+
+// appends up to 32 bits, stores the register once it holds 32 or more
+static void MSG_AppendBits( bitWriter_t *bw, uint32_t code, int count ) {
+	msg_t *msg = bw->msg;
+
+	bw->pending |= (uint64_t)code << bw->count;
+	bw->count += count;
+
+	if ( bw->count >= 32 ) {
+		HuffmanPutBits( msg->data, msg->bit, bw->pending & 0xFFFFFFFF, 32 );
+		msg->bit += 32;
+		bw->pending >>= 32;
+		bw->count -= 32;
+	}
+}
+
+
+// same as MSG_WriteBits, oob messages have no huffman bits to buffer and go straight to it
+static void MSG_PutBits( bitWriter_t *bw, int value, int bits ) {
+	msg_t *msg = bw->msg;
+	uint32_t v;
+	uint16_t code;
+	int nbits, i;
+
+	if ( msg_unbuffered || msg->oob ) {
+		MSG_WriteBits( msg, value, bits );
+		return;
+	}
+
+	if ( msg->overflowed != qfalse )
+		return;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+
+	v = value & (0xffffffff>>(32-bits));
+	nbits = bits & 7;
+
+	// raw low bits first, then each byte as a symbol
+	if ( nbits ) {
+		MSG_AppendBits( bw, v & ( ( 1U << nbits ) - 1 ), nbits );
+		v >>= nbits;
+	}
+
+	for ( i = nbits; i < bits; i += 8 ) {
+		code = HuffmanEncoderTable[ v & 0xFF ];
+		MSG_AppendBits( bw, ( code >> 4 ) & 0x7FF, code & 15 );
+		v >>= 8;
+	}
+
+	if ( msg->bit + bw->count > msg->maxbits ) {
+		MSG_EndWriter( bw );
+		msg->overflowed = qtrue;
+	}
+}
+
+
+static void MSG_BeginReader( bitReader_t *br, msg_t *msg ) {
+	br->msg = msg;
+	br->window = 0;
+	br->avail = 0;
+	br->bit = msg->bit;
+	br->startBit = msg->bit;
+}
+
+
+static void MSG_EndReader( bitReader_t *br ) {
+	msg_t *msg = br->msg;
+
+	if ( br->bit != br->startBit ) {
+		msg->bit = br->bit;
+		msg->readcount = (msg->bit >> 3) + 1;
+	}
+}
+
+
+// same as MSG_ReadBits, oob messages are read by it directly
+static int MSG_GetBits( bitReader_t *br, int bits ) {
+	uint32_t value;
+	uint16_t entry;
+	qboolean sgn;
+	int nbits, n, i;
+
+	if ( msg_unbuffered || br->msg->oob ) {
+		return MSG_ReadBits( br->msg, bits );
+	}
+
+	if ( br->bit >= br->msg->maxbits )
+		return 0;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+		sgn = qtrue;
+	} else {
+		sgn = qfalse;
+	}
+
+	nbits = bits & 7;
+
+	if ( nbits ) {
+		if ( br->avail < nbits ) {
+			br->window = HuffmanGetWindow( br->msg->data, br->bit, br->msg->maxsize );
+			br->avail = 57;
 		}
-		msg->bit = bitIndex;
-		msg->readcount = (bitIndex >> 3) + 1;
+		value = (uint32_t)br->window & ( ( 1U << nbits ) - 1 );
+		br->window >>= nbits;
+		br->avail -= nbits;
+		br->bit += nbits;
+	} else {
+		value = 0;
+	}
+
+	for ( i = nbits; i < bits; i += 8 ) {
+		if ( br->avail < 11 ) {
+			br->window = HuffmanGetWindow( br->msg->data, br->bit, br->msg->maxsize );
+			br->avail = 57;
+		}
+		entry = HuffmanDecoderTable[ br->window & 0x7FF ];
+		value |= (uint32_t)( entry & 0xFF ) << i;
+		n = entry >> 8;
+		br->window >>= n;
+		br->avail -= n;
+		br->bit += n;
 	}
 
 	if ( sgn && bits < 32 ) {
@@ -227,11 +554,10 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		}
 	}
 
-	return value;
+	return (int)value;
 }
 
 
-
 //================================================================================
 
 //
@@ -770,6 +1096,9 @@ const netField_t entityStateFields[] =
 	{ NETF(frame), 16 }
 };
 
+// MSG_EntityChangeMask keeps one bit per field in a uint64_t, fails to compile if a field is added past 64
+typedef char entityChangeMaskFits_t[ ARRAY_LEN( entityStateFields ) <= 64 ? 1 : -1 ];
+
 #ifdef USE_MV
 
 #include "../game/bg_public.h"
@@ -990,6 +1319,35 @@ void MSG_PlayerStateToEntityState( playerState_t *ps, entityState_t *s, qboolean
 #define	FLOAT_INT_BITS	13
 #define	FLOAT_INT_BIAS	(1<<(FLOAT_INT_BITS-1))
 
+/*
+==================
+MSG_EntityChangeMask
+
+Returns a mask with bit i set when entityStateFields[i] differs,
+0 if the entities are identical
+==================
+*/
+uint64_t MSG_EntityChangeMask( const entityState_t *from, const entityState_t *to ) {
+	const netField_t *field;
+	const int	*fromF, *toF;
+	uint64_t	mask;
+	int			i, numFields;
+
+	numFields = ARRAY_LEN( entityStateFields );
+
+	mask = 0;
+	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
+		fromF = (int *)( (byte *)from + field->offset );
+		toF = (int *)( (byte *)to + field->offset );
+		if ( *fromF != *toF ) {
+			mask |= 1ULL << i;
+		}
+	}
+
+	return mask;
+}
+
+
 /*
 ==================
 MSG_WriteDeltaEntity
@@ -1002,20 +1360,16 @@ identical, under the assumption that the in-order delta code will catch it.
 ==================
 */
 void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entityState_t *to, qboolean force ) {
-	int			i, lc;
-	int			numFields;
-	const netField_t *field;
-	int			trunc;
-	float		fullFloat;
-	const int	*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
+	uint64_t	changeMask;
+#ifdef USE_MV
+	int			i, numFields;
+#endif
 
 	// all fields should be 32 bits to avoid any compiler packing issues
 	// the "number" field is not part of the field list
 	// if this assert fails, someone added a field to the entityState_t
 	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
 
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
@@ -1027,23 +1381,48 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 		return;
 	}
 
+	changeMask = MSG_EntityChangeMask( from, to );
+
+#ifdef USE_MV
+	// merged fields are never sent for player entities
+	if ( MSG_entMergeMask && to->number < MAX_CLIENTS ) {
+		numFields = ARRAY_LEN( entityStateFields );
+		for ( i = 0; i < numFields; i++ ) {
+			if ( entityStateFields[i].mergeMask & MSG_entMergeMask ) {
+				changeMask &= ~( 1ULL << i );
+			}
+		}
+	}
+#endif
+
+	MSG_WriteDeltaEntityMask( msg, to, changeMask, force );
+}
+
+
+/*
+==================
+MSG_WriteDeltaEntityMask
+
+Same as MSG_WriteDeltaEntity with the changed fields already known,
+changeMask is MSG_EntityChangeMask( from, to ) for the delta source
+==================
+*/
+void MSG_WriteDeltaEntityMask( msg_t *msg, const entityState_t *to, uint64_t changeMask, qboolean force ) {
+	int			i, lc;
+	const netField_t *field;
+	int			trunc;
+	float		fullFloat;
+	const int	*toF;
+	bitWriter_t	bw;
+
 	if ( to->number < 0 || to->number >= MAX_GENTITIES ) {
 		Com_Error( ERR_DROP, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
+	// last changed field + 1
 	lc = 0;
-	// build the change vector as bytes so it is endien independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-#ifdef USE_MV
-		if ( ( field->mergeMask & MSG_entMergeMask ) && to->number < MAX_CLIENTS )
-			continue;
-#endif
-
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
+	while ( changeMask >> lc ) {
+		lc++;
 	}
 
 	if ( lc == 0 ) {
@@ -1058,28 +1437,23 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 		return;
 	}
 
-	MSG_WriteBits( msg, to->number, GENTITYNUM_BITS );
-	MSG_WriteBits( msg, 0, 1 );			// not removed
-	MSG_WriteBits( msg, 1, 1 );			// we have a delta
+	MSG_BeginWriter( &bw, msg );
 
-	MSG_WriteByte( msg, lc );	// # of changes
+	MSG_PutBits( &bw, to->number, GENTITYNUM_BITS );
+	MSG_PutBits( &bw, 0, 1 );			// not removed
+	MSG_PutBits( &bw, 1, 1 );			// we have a delta
+
+	MSG_PutBits( &bw, lc, 8 );	// # of changes
 
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-#ifdef USE_MV
-		if ( *fromF == *toF || ( ( field->mergeMask & MSG_entMergeMask ) && (to->number < MAX_CLIENTS) ) ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
+		if ( !( changeMask & ( 1ULL << i ) ) ) {
+			MSG_PutBits( &bw, 0, 1 );	// no change
 			continue;
 		}
-#else
-		if ( *fromF == *toF ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
-			continue;
-		}
-#endif
 
-		MSG_WriteBits( msg, 1, 1 );	// changed
+		toF = (int *)( (byte *)to + field->offset );
+
+		MSG_PutBits( &bw, 1, 1 );	// changed
 
 		if ( field->bits == 0 ) {
 			// float
@@ -1087,30 +1461,32 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 			trunc = (int)fullFloat;
 
 			if (fullFloat == 0.0f) {
-				MSG_WriteBits( msg, 0, 1 );
+				MSG_PutBits( &bw, 0, 1 );
 			} else {
-				MSG_WriteBits( msg, 1, 1 );
+				MSG_PutBits( &bw, 1, 1 );
 				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
 					trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
 					// send as small integer
-					MSG_WriteBits( msg, 0, 1 );
-					MSG_WriteBits( msg, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+					MSG_PutBits( &bw, 0, 1 );
+					MSG_PutBits( &bw, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
 				} else {
 					// send as full floating point value
-					MSG_WriteBits( msg, 1, 1 );
-					MSG_WriteBits( msg, *toF, 32 );
+					MSG_PutBits( &bw, 1, 1 );
+					MSG_PutBits( &bw, *toF, 32 );
 				}
 			}
 		} else {
 			if (*toF == 0) {
-				MSG_WriteBits( msg, 0, 1 );
+				MSG_PutBits( &bw, 0, 1 );
 			} else {
-				MSG_WriteBits( msg, 1, 1 );
+				MSG_PutBits( &bw, 1, 1 );
 				// integer
-				MSG_WriteBits( msg, *toF, field->bits );
+				MSG_PutBits( &bw, *toF, field->bits );
 			}
 		}
 	}
+
+	MSG_EndWriter( &bw );
 }
 
 /*
@@ -1134,6 +1510,7 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 	int			print;
 	int			trunc;
 	int			startBit, endBit;
+	bitReader_t	br;
 
 	if ( number < 0 || number >= MAX_GENTITIES ) {
 		Com_Error( ERR_DROP, "Bad delta entity number: %i", number );
@@ -1186,22 +1563,24 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 		print = 0;
 #endif
 
+	MSG_BeginReader( &br, msg );
+
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( ! MSG_ReadBits( msg, 1 ) ) {
+		if ( ! MSG_GetBits( &br, 1 ) ) {
 			// no change
 			*toF = *fromF;
 		} else {
 			if ( field->bits == 0 ) {
 				// float
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
+				if ( MSG_GetBits( &br, 1 ) == 0 ) {
 						*(float *)toF = 0.0f; 
 				} else {
-					if ( MSG_ReadBits( msg, 1 ) == 0 ) {
+					if ( MSG_GetBits( &br, 1 ) == 0 ) {
 						// integral float
-						trunc = MSG_ReadBits( msg, FLOAT_INT_BITS );
+						trunc = MSG_GetBits( &br, FLOAT_INT_BITS );
 						// bias to allow equal parts positive and negative
 						trunc -= FLOAT_INT_BIAS;
 						*(float *)toF = trunc; 
@@ -1210,18 +1589,18 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 						}
 					} else {
 						// full floating point value
-						*toF = MSG_ReadBits( msg, 32 );
+						*toF = MSG_GetBits( &br, 32 );
 						if ( print ) {
 							Com_Printf( "%s:%f ", field->name, *(float *)toF );
 						}
 					}
 				}
 			} else {
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
+				if ( MSG_GetBits( &br, 1 ) == 0 ) {
 					*toF = 0;
 				} else {
 					// integer
-					*toF = MSG_ReadBits( msg, field->bits );
+					*toF = MSG_GetBits( &br, field->bits );
 					if ( print ) {
 						Com_Printf( "%s:%i ", field->name, *toF );
 					}
@@ -1230,6 +1609,9 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 //			pcount[i]++;
 		}
 	}
+
+	MSG_EndReader( &br );
+
 	for ( i = lc, field = &entityStateFields[lc] ; i < numFields ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
@@ -1544,6 +1926,7 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 	const int		*fromF, *toF;
 	float			fullFloat;
 	int				trunc, lc;
+	bitWriter_t		bw;
 
 	if ( !from ) {
 		from = &dummy;
@@ -1560,18 +1943,20 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 		}
 	}
 
-	MSG_WriteByte( msg, lc );	// # of changes
+	MSG_BeginWriter( &bw, msg );
+
+	MSG_PutBits( &bw, lc, 8 );	// # of changes
 
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
 		if ( *fromF == *toF ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
+			MSG_PutBits( &bw, 0, 1 );	// no change
 			continue;
 		}
 
-		MSG_WriteBits( msg, 1, 1 );	// changed
+		MSG_PutBits( &bw, 1, 1 );	// changed
 //		pcount[i]++;
 
 		if ( field->bits == 0 ) {
@@ -1582,16 +1967,16 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 			if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
 				trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
 				// send as small integer
-				MSG_WriteBits( msg, 0, 1 );
-				MSG_WriteBits( msg, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+				MSG_PutBits( &bw, 0, 1 );
+				MSG_PutBits( &bw, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
 			} else {
 				// send as full floating point value
-				MSG_WriteBits( msg, 1, 1 );
-				MSG_WriteBits( msg, *toF, 32 );
+				MSG_PutBits( &bw, 1, 1 );
+				MSG_PutBits( &bw, *toF, 32 );
 			}
 		} else {
 			// integer
-			MSG_WriteBits( msg, *toF, field->bits );
+			MSG_PutBits( &bw, *toF, field->bits );
 		}
 	}
 
@@ -1625,53 +2010,56 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 	}
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_PutBits( &bw, 0, 1 );	// no change
+		MSG_EndWriter( &bw );
 		return;
 	}
-	MSG_WriteBits( msg, 1, 1 );	// changed
+	MSG_PutBits( &bw, 1, 1 );	// changed
 
 	if ( statsbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, statsbits, MAX_STATS );
+		MSG_PutBits( &bw, 1, 1 );	// changed
+		MSG_PutBits( &bw, statsbits, MAX_STATS );
 		for (i=0 ; i<MAX_STATS ; i++)
 			if (statsbits & (1<<i) )
-				MSG_WriteShort (msg, to->stats[i]);
+				MSG_PutBits( &bw, to->stats[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_PutBits( &bw, 0, 1 );	// no change
 	}
 
 
 	if ( persistantbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, persistantbits, MAX_PERSISTANT );
+		MSG_PutBits( &bw, 1, 1 );	// changed
+		MSG_PutBits( &bw, persistantbits, MAX_PERSISTANT );
 		for (i=0 ; i<MAX_PERSISTANT ; i++)
 			if (persistantbits & (1<<i) )
-				MSG_WriteShort (msg, to->persistant[i]);
+				MSG_PutBits( &bw, to->persistant[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_PutBits( &bw, 0, 1 );	// no change
 	}
 
 
 	if ( ammobits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, ammobits, MAX_WEAPONS );
+		MSG_PutBits( &bw, 1, 1 );	// changed
+		MSG_PutBits( &bw, ammobits, MAX_WEAPONS );
 		for (i=0 ; i<MAX_WEAPONS ; i++)
 			if (ammobits & (1<<i) )
-				MSG_WriteShort (msg, to->ammo[i]);
+				MSG_PutBits( &bw, to->ammo[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_PutBits( &bw, 0, 1 );	// no change
 	}
 
 
 	if ( powerupbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, powerupbits, MAX_POWERUPS );
+		MSG_PutBits( &bw, 1, 1 );	// changed
+		MSG_PutBits( &bw, powerupbits, MAX_POWERUPS );
 		for (i=0 ; i<MAX_POWERUPS ; i++)
 			if (powerupbits & (1<<i) )
-				MSG_WriteLong( msg, to->powerups[i] );
+				MSG_PutBits( &bw, to->powerups[i], 32 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_PutBits( &bw, 0, 1 );	// no change
 	}
+
+	MSG_EndWriter( &bw );
 }
 
 
@@ -1691,6 +2079,7 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerStat
 	int			*toF;
 	int			trunc;
 	playerState_t	dummy;
+	bitReader_t	br;
 
 	if ( !from ) {
 		from = &dummy;
@@ -1724,19 +2113,21 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerStat
 		Com_Error( ERR_DROP, "invalid playerState field count" );
 	}
 
+	MSG_BeginReader( &br, msg );
+
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( ! MSG_ReadBits( msg, 1 ) ) {
+		if ( ! MSG_GetBits( &br, 1 ) ) {
 			// no change
 			*toF = *fromF;
 		} else {
 			if ( field->bits == 0 ) {
 				// float
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
+				if ( MSG_GetBits( &br, 1 ) == 0 ) {
 					// integral float
-					trunc = MSG_ReadBits( msg, FLOAT_INT_BITS );
+					trunc = MSG_GetBits( &br, FLOAT_INT_BITS );
 					// bias to allow equal parts positive and negative
 					trunc -= FLOAT_INT_BIAS;
 					*(float *)toF = trunc; 
@@ -1745,20 +2136,23 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerStat
 					}
 				} else {
 					// full floating point value
-					*toF = MSG_ReadBits( msg, 32 );
+					*toF = MSG_GetBits( &br, 32 );
 					if ( print ) {
 						Com_Printf( "%s:%f ", field->name, *(float *)toF );
 					}
 				}
 			} else {
 				// integer
-				*toF = MSG_ReadBits( msg, field->bits );
+				*toF = MSG_GetBits( &br, field->bits );
 				if ( print ) {
 					Com_Printf( "%s:%i ", field->name, *toF );
 				}
 			}
 		}
 	}
+
+	MSG_EndReader( &br );
+
 	for ( i=lc,field = &playerStateFields[lc];i<numFields; i++, field++) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
@@ -1824,6 +2218,133 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerStat
 	}
 }
 
+
+/*
+=================
+MSG_RandomizeFields
+=================
+*/
+static void MSG_RandomizeFields( void *state, const netField_t *fields, int numFields ) {
+	int *f;
+	int i;
+
+	for ( i = 0; i < numFields; i++ ) {
+		f = (int *)( (byte *)state + fields[i].offset );
+		switch ( rand() & 3 ) {
+			case 0: *f = 0; break;
+			case 1: break; // unchanged
+			case 2: if ( fields[i].bits == 0 ) *(float *)f = (float)( rand() % 8192 - 4096 ); else *f = rand() % 512 - 256; break;
+			case 3: *f = ( rand() << 16 ) ^ rand(); if ( fields[i].bits == 0 ) *(float *)f = *f * 0.001f; break;
+		}
+	}
+}
+
+
+/*
+=================
+MSG_Check_f
+
+Writes and reads random entity and player state deltas with both the
+buffered and the plain bit functions and compares the results
+=================
+*/
+#define MSG_CHECK_BATCH 16
+void MSG_Check_f( void ) {
+	static byte		data[3][ MAX_MSGLEN_BUF ], slice[ MAX_MSGLEN_BUF ];
+	static entityState_t	efrom[ MSG_CHECK_BATCH ], eto[ MSG_CHECK_BATCH ], eout[3][ MSG_CHECK_BATCH ];
+	static playerState_t	pfrom[ MSG_CHECK_BATCH ], pto[ MSG_CHECK_BATCH ], pout[3][ MSG_CHECK_BATCH ];
+	int64_t			writeTime[3], readTime[3], start;
+	msg_t			msg[3], side;
+	int				count, n, k, b, i, prefix, number;
+	int				failed;
+
+	count = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 10000;
+	if ( count < 1 )
+		count = 1;
+
+	Com_Memset( writeTime, 0, sizeof( writeTime ) );
+	Com_Memset( readTime, 0, sizeof( readTime ) );
+	failed = 0;
+
+	for ( n = 0; n < count; n += MSG_CHECK_BATCH ) {
+		for ( b = 0; b < MSG_CHECK_BATCH; b++ ) {
+			Com_Memset( &efrom[b], 0, sizeof( efrom[b] ) );
+			Com_Memset( &pfrom[b], 0, sizeof( pfrom[b] ) );
+			MSG_RandomizeFields( &efrom[b], entityStateFields, ARRAY_LEN( entityStateFields ) );
+			MSG_RandomizeFields( &pfrom[b], playerStateFields, ARRAY_LEN( playerStateFields ) );
+			efrom[b].number = rand() % MAX_GENTITIES;
+			eto[b] = efrom[b];
+			pto[b] = pfrom[b];
+			MSG_RandomizeFields( &eto[b], entityStateFields, ARRAY_LEN( entityStateFields ) );
+			MSG_RandomizeFields( &pto[b], playerStateFields, ARRAY_LEN( playerStateFields ) );
+			for ( i = 0; i < MAX_STATS; i++ ) {
+				if ( rand() & 1 ) pto[b].stats[i] = rand() % 400;
+				if ( rand() & 1 ) pto[b].persistant[i] = rand() % 400;
+			}
+			for ( i = 0; i < MAX_WEAPONS; i++ ) {
+				if ( rand() & 1 ) pto[b].ammo[i] = rand() % 400;
+				if ( rand() & 1 ) pto[b].powerups[i] = ( rand() << 16 ) ^ rand();
+			}
+		}
+		prefix = 1 + ( rand() & 7 );
+		number = rand();
+
+		// k == 0: plain MSG_WriteBits/MSG_ReadBits, k == 1: buffered, k == 2: spliced entities
+		for ( k = 0; k < 3; k++ ) {
+			msg_unbuffered = ( k == 0 ) ? qtrue : qfalse;
+
+			MSG_Init( &msg[k], data[k], MAX_MSGLEN );
+			Com_Memset( data[k], 0xAA, sizeof( data[k] ) );
+
+			// start at a random bit offset
+			MSG_WriteBits( &msg[k], number, prefix );
+
+			start = Sys_Microseconds();
+			for ( b = 0; b < MSG_CHECK_BATCH; b++ ) {
+				if ( k == 2 ) {
+					MSG_Init( &side, slice, MAX_MSGLEN );
+					MSG_WriteDeltaEntity( &side, &efrom[b], &eto[b], qtrue );
+					MSG_WriteBitSlice( &msg[k], slice, side.bit );
+				} else {
+					MSG_WriteDeltaEntity( &msg[k], &efrom[b], &eto[b], qtrue );
+				}
+				MSG_WriteDeltaPlayerstate( &msg[k], &pfrom[b], &pto[b] );
+			}
+			writeTime[k] += Sys_Microseconds() - start;
+
+			MSG_BeginReading( &msg[k] );
+			MSG_ReadBits( &msg[k], prefix );
+
+			start = Sys_Microseconds();
+			for ( b = 0; b < MSG_CHECK_BATCH; b++ ) {
+				i = MSG_ReadBits( &msg[k], GENTITYNUM_BITS );
+				MSG_ReadDeltaEntity( &msg[k], &efrom[b], &eout[k][b], i );
+				MSG_ReadDeltaPlayerstate( &msg[k], &pfrom[b], &pout[k][b] );
+			}
+			readTime[k] += Sys_Microseconds() - start;
+		}
+
+		if ( msg[0].overflowed || msg[0].cursize != msg[1].cursize || memcmp( data[0], data[1], msg[0].cursize )
+			|| msg[0].bit != msg[1].bit || msg[0].readcount != msg[1].readcount
+			|| memcmp( eout[0], eout[1], sizeof( eout[0] ) ) || memcmp( pout[0], pout[1], sizeof( pout[0] ) ) ) {
+			failed++;
+		} else if ( msg[0].cursize != msg[2].cursize || memcmp( data[0], data[2], msg[0].cursize )
+			|| memcmp( eout[0], eout[2], sizeof( eout[0] ) ) ) {
+			failed++;
+		}
+	}
+
+	msg_unbuffered = qfalse;
+
+	Com_Printf( "%i deltas, plain: write %lli read %lli usec, buffered: write %lli read %lli usec, spliced: write %lli usec\n", n,
+		(long long)writeTime[0], (long long)readTime[0], (long long)writeTime[1], (long long)readTime[1], (long long)writeTime[2] );
+	if ( failed ) {
+		Com_Printf( S_COLOR_RED "%i mismatching batches\n", failed );
+	} else {
+		Com_Printf( "no mismatches\n" );
+	}
+}
+
 //===========================================================================
 
 #if defined( USE_MV ) && defined( USE_MV_ZCMD )
@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -102,6 +106,13 @@ typedef int SOCKET;
 typedef int	ioctlarg_t;
 #	define socketError			errno
 
+#	if defined(__linux__) && !defined(EMSCRIPTEN)
+#		define USE_MMSG
+#		define USE_EPOLL
+#		include <sys/epoll.h>
+#		include <sys/timerfd.h>
+#	endif
+
 #endif
 
 #ifdef EMSCRIPTEN
@@ -135,6 +146,12 @@ static cvar_t	*net_mcast6addr;
 static cvar_t	*net_mcast6iface;
 #endif
 static cvar_t	*net_dropsim;
+#ifdef USE_MMSG
+static cvar_t	*net_mmsg;
+#endif
+#ifdef USE_EPOLL
+static cvar_t	*net_epoll;
+#endif
 
 static struct sockaddr_in socksRelayAddr;
 
@@ -184,7 +201,60 @@ typedef struct
 static nip_localaddr_t localIP[MAX_IPS];
 static int numIP;
 
+// datagrams moved vs. socket syscalls issued, reported by net_stats
+typedef struct {
+	int64_t		recvPackets;
+	int64_t		recvCalls;
+	int64_t		sendPackets;
+	int64_t		sendCalls;
+} netStats_t;
+
+static netStats_t	netStats;
+
+#ifdef USE_MMSG
+#define NET_MMSG_BATCH	32
+
+// outgoing datagrams collected between Sys_BeginPacketBatch and Sys_EndPacketBatch
+typedef struct {
+	struct mmsghdr			hdr[ NET_MMSG_BATCH ];
+	struct iovec			iov[ NET_MMSG_BATCH ];
+	struct sockaddr_storage	addr[ NET_MMSG_BATCH ];
+	byte					data[ NET_MMSG_BATCH ][ MAX_PACKETLEN ];
+	SOCKET					sock;
+	int						count;
+} mmsgQueue_t;
+
+static mmsgQueue_t	sendQueue4;
+#ifdef USE_IPV6
+static mmsgQueue_t	sendQueue6;
+#endif
+static qboolean		sendBatching;
+
+// receive ring drained by a single recvmmsg
+static struct mmsghdr			recvHdr[ NET_MMSG_BATCH ];
+static struct iovec				recvIov[ NET_MMSG_BATCH ];
+static struct sockaddr_storage	recvAddr[ NET_MMSG_BATCH ];
+static byte						recvData[ NET_MMSG_BATCH ][ MAX_MSGLEN_BUF ];
+#endif
+
+#ifdef USE_EPOLL
+#define NET_EPOLL_EVENTS	8
+
+// sockets are registered once per NET_Config, NET_Sleep only waits
+static struct {
+	int			fd;
+	int			timerfd;
+	int			sockets;	// number of registered network sockets
+	qboolean	console;	// stdin is registered
+} netEpoll = { -1, -1, 0, qfalse };
+
+extern qboolean stdin_active;
+
+static void	NET_EpollSetup( void );
+#endif
+
 static void	NET_Restart_f( void );
+static void	NET_Stats_f( void );
 
 //=============================================================================
 
@@ -633,6 +703,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
     } else {
       ret = recvfrom( ip_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
     }
+		netStats.recvCalls++;
 		if (ret == SOCKET_ERROR)
 		{
 			err = socketError;
@@ -650,6 +721,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 		}
 		else
 		{
+			netStats.recvPackets++;
 			memset( ((struct sockaddr_in *)&from)->sin_zero, 0, 8 );
 		
       if ( usingSocks ) { //&& memcmp( &from, &socksRelayAddr, sizeof( struct sockaddr_in ) ) == 0 ) {
@@ -699,6 +771,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 	{
 		fromlen = sizeof(from);
 		ret = recvfrom(ip6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+		netStats.recvCalls++;
 
 		if (ret == SOCKET_ERROR)
 		{
@@ -709,6 +782,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 		}
 		else
 		{
+			netStats.recvPackets++;
 			net_from->type = NA_BAD;
 			SockadrToNetadr( &from, net_from );
 			net_message->readcount = 0;
@@ -728,6 +802,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 	{
 		fromlen = sizeof(from);
 		ret = recvfrom(multicast6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+		netStats.recvCalls++;
 
 		if (ret == SOCKET_ERROR)
 		{
@@ -738,6 +813,7 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 		}
 		else
 		{
+			netStats.recvPackets++;
 			net_from->type = NA_BAD;
 			SockadrToNetadr( &from, net_from );
 			net_message->readcount = 0;
@@ -760,6 +836,122 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 //=============================================================================
 
 
+#ifdef USE_MMSG
+/*
+==================
+NET_FlushSendQueue
+
+Hands all queued datagrams of one socket to the kernel
+==================
+*/
+static void NET_FlushSendQueue( mmsgQueue_t *q )
+{
+	int sent, ret, err;
+
+	sent = 0;
+	while ( sent < q->count ) {
+		ret = sendmmsg( q->sock, q->hdr + sent, q->count - sent, 0 );
+		netStats.sendCalls++;
+		if ( ret <= 0 ) {
+			err = socketError;
+			if ( ret == SOCKET_ERROR && err == EINTR )
+				continue;
+			// wouldblock is silent
+			if ( ret == SOCKET_ERROR && err != EAGAIN )
+				Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+			// the first pending datagram failed, drop it like sendto() would
+			sent++;
+			continue;
+		}
+		netStats.sendPackets += ret;
+		sent += ret;
+	}
+
+	q->count = 0;
+}
+
+
+/*
+==================
+NET_FlushSendQueues
+==================
+*/
+static void NET_FlushSendQueues( void )
+{
+	if ( sendQueue4.count )
+		NET_FlushSendQueue( &sendQueue4 );
+#ifdef USE_IPV6
+	if ( sendQueue6.count )
+		NET_FlushSendQueue( &sendQueue6 );
+#endif
+}
+
+
+/*
+==================
+NET_QueueSendPacket
+==================
+*/
+static void NET_QueueSendPacket( mmsgQueue_t *q, SOCKET sock, int length, const void *data, const struct sockaddr_storage *addr, socklen_t addrlen )
+{
+	struct mmsghdr *h;
+	int n;
+
+	if ( q->count >= NET_MMSG_BATCH || ( q->count && q->sock != sock ) )
+		NET_FlushSendQueue( q );
+
+	n = q->count++;
+	q->sock = sock;
+
+	memcpy( q->data[n], data, length );
+	memcpy( &q->addr[n], addr, addrlen );
+
+	q->iov[n].iov_base = q->data[n];
+	q->iov[n].iov_len = length;
+
+	h = &q->hdr[n];
+	memset( h, 0, sizeof( *h ) );
+	h->msg_hdr.msg_name = &q->addr[n];
+	h->msg_hdr.msg_namelen = addrlen;
+	h->msg_hdr.msg_iov = &q->iov[n];
+	h->msg_hdr.msg_iovlen = 1;
+}
+#endif // USE_MMSG
+
+
+/*
+==================
+Sys_BeginPacketBatch
+
+Datagrams sent until Sys_EndPacketBatch may be
+queued and handed to the kernel with a single syscall
+==================
+*/
+void Sys_BeginPacketBatch( void )
+{
+#ifdef USE_MMSG
+	if ( net_mmsg && net_mmsg->integer && !usingSocks )
+		sendBatching = qtrue;
+#endif
+}
+
+
+/*
+==================
+Sys_EndPacketBatch
+==================
+*/
+void Sys_EndPacketBatch( void )
+{
+#ifdef USE_MMSG
+	if ( sendBatching ) {
+		NET_FlushSendQueues();
+		sendBatching = qfalse;
+	}
+#endif
+}
+
+
 /*
 ==================
 Sys_SendPacket
@@ -818,6 +1010,24 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
     ret = sendto( ip_socket, socksBuf, length+5+socksBuf[4]+2, 0, (struct sockaddr *) &socksRelayAddr, sizeof(struct sockaddr_in) );
 	}
 	else {
+#ifdef USE_MMSG
+		if ( sendBatching ) {
+			if ( length <= MAX_PACKETLEN ) {
+				if ( to->type == NA_IP ) {
+					NET_QueueSendPacket( &sendQueue4, ip_socket, length, data, &addr, sizeof( struct sockaddr_in ) );
+					return;
+				}
+#ifdef USE_IPV6
+				if ( to->type == NA_IP6 ) {
+					NET_QueueSendPacket( &sendQueue6, ip6_socket, length, data, &addr, sizeof( struct sockaddr_in6 ) );
+					return;
+				}
+#endif
+			}
+			// keep ordering with already queued datagrams
+			NET_FlushSendQueues();
+		}
+#endif
 		if(addr.ss_family == AF_INET)
 			ret = sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
 #ifdef USE_IPV6
@@ -826,6 +1036,8 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 #endif
 	}
 
+	netStats.sendCalls++;
+
 	if( ret == SOCKET_ERROR ) {
 		int err = socketError;
 
@@ -840,6 +1052,8 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 		}
 
 		Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+	} else {
+		netStats.sendPackets++;
 	}
 }
 
@@ -1820,6 +2034,18 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP );
 
+#ifdef USE_EPOLL
+	net_epoll = Cvar_Get( "net_epoll", "1", CVAR_LATCH | CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( net_epoll, "Wait for network and console input with epoll() instead of select()" );
+	modified += net_epoll->modified;
+	net_epoll->modified = qfalse;
+#endif
+
+#ifdef USE_MMSG
+	net_mmsg = Cvar_Get( "net_mmsg", "1", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( net_mmsg, "Receive and send datagrams in batches with recvmmsg()/sendmmsg(), see net_stats" );
+#endif
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -1871,6 +2097,10 @@ static void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if( stop ) {
+#ifdef USE_MMSG
+		NET_FlushSendQueues();
+		sendBatching = qfalse;
+#endif
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1906,6 +2136,12 @@ static void NET_Config( qboolean enableNetworking ) {
 #endif
 		}
 	}
+
+#ifdef USE_EPOLL
+	if( stop || start ) {
+		NET_EpollSetup();
+	}
+#endif
 }
 
 
@@ -1931,6 +2167,7 @@ void NET_Init( void ) {
 	NET_Config( qtrue );
 	
 	Cmd_AddCommand( "net_restart", NET_Restart_f );
+	Cmd_AddCommand( "net_stats", NET_Stats_f );
 }
 
 
@@ -1953,6 +2190,107 @@ void NET_Shutdown( void ) {
 }
 
 
+/*
+====================
+NET_DispatchPacket
+
+Passes one received packet to the server or client
+====================
+*/
+static void NET_DispatchPacket( const netadr_t *from, msg_t *netmsg )
+{
+	if ( net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f )
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if ( rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value) )
+			return; // drop this packet
+	}
+
+	if ( netmsg->readcount > 0 ) {
+		memmove( netmsg->data, netmsg->data + netmsg->readcount, netmsg->cursize - netmsg->readcount );
+		netmsg->cursize = netmsg->cursize - netmsg->readcount;
+		netmsg->readcount = 0;
+	}
+
+#ifdef DEDICATED
+	Com_RunAndTimeServerPacket( from, netmsg );
+#else
+	if ( com_sv_running->integer || com_dedicated->integer )
+		Com_RunAndTimeServerPacket( from, netmsg );
+	else
+		CL_PacketEvent( from, netmsg );
+#endif
+}
+
+
+#ifdef USE_MMSG
+/*
+====================
+NET_RecvBatch
+
+Drains a socket with recvmmsg() into the receive ring
+====================
+*/
+static void NET_RecvBatch( const SOCKET *sock )
+{
+	SOCKET s = *sock;
+	netadr_t from;
+	msg_t netmsg;
+	int i, ret, err;
+
+	do
+	{
+		for ( i = 0; i < NET_MMSG_BATCH; i++ )
+		{
+			recvIov[i].iov_base = recvData[i];
+			recvIov[i].iov_len = MAX_MSGLEN;
+			memset( &recvHdr[i], 0, sizeof( recvHdr[i] ) );
+			recvHdr[i].msg_hdr.msg_name = &recvAddr[i];
+			recvHdr[i].msg_hdr.msg_namelen = sizeof( recvAddr[i] );
+			recvHdr[i].msg_hdr.msg_iov = &recvIov[i];
+			recvHdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg( s, recvHdr, NET_MMSG_BATCH, MSG_DONTWAIT, NULL );
+		netStats.recvCalls++;
+
+		if ( ret == SOCKET_ERROR )
+		{
+			err = socketError;
+
+			if ( err == ENOSYS ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: recvmmsg() is not supported, disabling net_mmsg\n" );
+				Cvar_Set( "net_mmsg", "0" );
+			} else if ( err != EAGAIN && err != ECONNRESET && err != EINTR ) {
+				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+			}
+			return;
+		}
+
+		netStats.recvPackets += ret;
+
+		for ( i = 0; i < ret; i++ )
+		{
+			from.type = NA_BAD;
+			SockadrToNetadr( &recvAddr[i], &from );
+
+			if ( recvHdr[i].msg_len >= MAX_MSGLEN || ( recvHdr[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+			{
+				Com_Printf( "Oversize packet from %s\n", NET_AdrToString( &from ) );
+				continue;
+			}
+
+			MSG_Init( &netmsg, recvData[i], MAX_MSGLEN );
+			netmsg.cursize = recvHdr[i].msg_len;
+			NET_DispatchPacket( &from, &netmsg );
+		}
+
+		// packet handlers may restart networking
+	} while ( ret == NET_MMSG_BATCH && *sock == s );
+}
+#endif // USE_MMSG
+
+
 /*
 ====================
 NET_Event
@@ -1965,39 +2303,184 @@ static void NET_Event( const fd_set *fdr )
 	byte bufData[ MAX_MSGLEN_BUF ];
 	netadr_t from;
 	msg_t netmsg;
-	
+#ifdef USE_MMSG
+	fd_set fdrest;
+
+	if ( net_mmsg->integer && !usingSocks )
+	{
+		fdrest = *fdr;
+		if ( ip_socket != INVALID_SOCKET && FD_ISSET( ip_socket, &fdrest ) )
+		{
+			FD_CLR( ip_socket, &fdrest );
+			NET_RecvBatch( &ip_socket );
+		}
+#ifdef USE_IPV6
+		if ( ip6_socket != INVALID_SOCKET && FD_ISSET( ip6_socket, &fdrest ) )
+		{
+			FD_CLR( ip6_socket, &fdrest );
+			NET_RecvBatch( &ip6_socket );
+		}
+#endif
+		fdr = &fdrest;
+	}
+#endif
+
 	while( 1 )
 	{
 		MSG_Init( &netmsg, bufData, MAX_MSGLEN );
 
 		if ( NET_GetPacket( &from, &netmsg, fdr ) )
-		{
-			if ( net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f )
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if ( rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value) )
-					continue; // drop this packet
-			}
+			NET_DispatchPacket( &from, &netmsg );
+		else
+			break;
+	}
+}
 
-      if(netmsg.readcount > 0) {
-        memcpy(netmsg.data, &bufData[netmsg.readcount], netmsg.cursize - netmsg.readcount);
-        netmsg.cursize = netmsg.cursize - netmsg.readcount;
-        netmsg.readcount = 0;
-      }
 
-#ifdef DEDICATED
-			Com_RunAndTimeServerPacket( &from, &netmsg );
-#else
-			if ( com_sv_running->integer || com_dedicated->integer )
-				Com_RunAndTimeServerPacket( &from, &netmsg );
-			else
-				CL_PacketEvent( &from, &netmsg );
+#ifdef USE_EPOLL
+/*
+====================
+NET_EpollAdd
+====================
+*/
+static qboolean NET_EpollAdd( int fd, unsigned int events )
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.fd = fd;
+
+	if ( epoll_ctl( netEpoll.fd, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: epoll_ctl: %s\n", NET_ErrorString() );
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+====================
+NET_EpollSetup
+
+(Re)builds the epoll set after sockets have been opened or closed
+====================
+*/
+static void NET_EpollSetup( void )
+{
+	if ( netEpoll.fd != -1 ) {
+		close( netEpoll.fd );
+		netEpoll.fd = -1;
+	}
+
+	netEpoll.sockets = 0;
+	netEpoll.console = qfalse;
+
+	if ( !networkingEnabled || !net_epoll->integer )
+		return;
+
+	if ( netEpoll.timerfd == -1 ) {
+		netEpoll.timerfd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+		if ( netEpoll.timerfd == -1 ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: timerfd_create: %s\n", NET_ErrorString() );
+			return;
+		}
+	}
+
+	netEpoll.fd = epoll_create1( EPOLL_CLOEXEC );
+	if ( netEpoll.fd == -1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: epoll_create1: %s\n", NET_ErrorString() );
+		return;
+	}
+
+	if ( !NET_EpollAdd( netEpoll.timerfd, EPOLLIN ) ) {
+		close( netEpoll.fd );
+		netEpoll.fd = -1;
+		return;
+	}
+
+	if ( ip_socket != INVALID_SOCKET && NET_EpollAdd( ip_socket, EPOLLIN ) )
+		netEpoll.sockets++;
+#ifdef USE_IPV6
+	if ( ip6_socket != INVALID_SOCKET && NET_EpollAdd( ip6_socket, EPOLLIN ) )
+		netEpoll.sockets++;
+	if ( multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && NET_EpollAdd( multicast6_socket, EPOLLIN ) )
+		netEpoll.sockets++;
 #endif
+	if ( usingSocks && socks_socket != INVALID_SOCKET && socks_socket != ip_socket && NET_EpollAdd( socks_socket, EPOLLIN ) )
+		netEpoll.sockets++;
+}
+
+
+/*
+====================
+NET_EpollWait
+
+epoll counterpart of the select() path in NET_Sleep,
+timeout is armed on a timerfd to keep microsecond precision
+====================
+*/
+static qboolean NET_EpollWait( int timeout )
+{
+	struct epoll_event events[ NET_EPOLL_EVENTS ];
+	struct itimerspec its;
+	uint64_t expirations;
+	qboolean network, console;
+	fd_set fdr;
+	int i, n;
+
+	// console input only matters for dedicated servers and may go away at any time
+	console = ( stdin_active && com_dedicated->integer ) ? qtrue : qfalse;
+	if ( console != netEpoll.console ) {
+		if ( console ) {
+			// edge-triggered so that unread input does not keep waking us until the next frame
+			netEpoll.console = NET_EpollAdd( STDIN_FILENO, EPOLLIN | EPOLLET );
+		} else {
+			epoll_ctl( netEpoll.fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL );
+			netEpoll.console = qfalse;
 		}
-		else
-			break;
 	}
+
+	if ( timeout > 0 ) {
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = timeout / 1000000;
+		its.it_value.tv_nsec = ( timeout % 1000000 ) * 1000;
+		timerfd_settime( netEpoll.timerfd, 0, &its, NULL );
+	}
+
+	n = epoll_wait( netEpoll.fd, events, ARRAY_LEN( events ), timeout > 0 ? -1 : 0 );
+
+	if ( n == SOCKET_ERROR ) {
+		if ( socketError != EINTR )
+			Com_Printf( S_COLOR_YELLOW "Warning: epoll_wait() syscall failed: %s\n", NET_ErrorString() );
+		return qtrue;
+	}
+
+	FD_ZERO( &fdr );
+	network = qfalse;
+	console = qfalse;
+
+	for ( i = 0; i < n; i++ ) {
+		if ( events[i].data.fd == netEpoll.timerfd ) {
+			// a newer timerfd_settime() resets the counter anyway
+			if ( read( netEpoll.timerfd, &expirations, sizeof( expirations ) ) != sizeof( expirations ) )
+				continue;
+		} else if ( events[i].data.fd == STDIN_FILENO ) {
+			console = qtrue;
+		} else {
+			FD_SET( events[i].data.fd, &fdr );
+			network = qtrue;
+		}
+	}
+
+	if ( network ) {
+		NET_Event( &fdr );
+		return qfalse;
+	}
+
+	return console ? qfalse : qtrue;
 }
+#endif // USE_EPOLL
 
 
 /*
@@ -2059,6 +2542,11 @@ qboolean NET_Sleep( int timeout )
   }
 #endif
 
+#ifdef USE_EPOLL
+	if ( netEpoll.fd != -1 && netEpoll.sockets )
+		return NET_EpollWait( timeout );
+#endif
+
 	if ( highestfd == INVALID_SOCKET )
 	{
 #ifdef _WIN32
@@ -2113,6 +2601,30 @@ static void NET_Restart_f( void )
 	NET_Config( qtrue );
 }
 
+
+/*
+====================
+NET_Stats_f
+====================
+*/
+static void NET_Stats_f( void )
+{
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &netStats, 0, sizeof( netStats ) );
+		return;
+	}
+
+	Com_Printf( "recv: %lli packets in %lli syscalls (%.2f per call)\n",
+		(long long)netStats.recvPackets, (long long)netStats.recvCalls,
+		netStats.recvCalls ? (double)netStats.recvPackets / netStats.recvCalls : 0.0 );
+	Com_Printf( "send: %lli packets in %lli syscalls (%.2f per call)\n",
+		(long long)netStats.sendPackets, (long long)netStats.sendCalls,
+		netStats.sendCalls ? (double)netStats.sendPackets / netStats.sendCalls : 0.0 );
+#ifdef USE_MMSG
+	Com_Printf( "batching: %s\n", net_mmsg->integer && !usingSocks ? "on" : "off" );
+#endif
+}
+
 #ifdef EMSCRIPTEN
 void SOCKS_Frame_Callback(void (*cb)( void ), void (*af)( void )) {
 	invokeSOCKSAfter = qfalse;
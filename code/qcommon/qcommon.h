@@ -149,6 +149,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitSlice( msg_t *msg, const byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -180,6 +181,8 @@ void MSG_WriteDeltaUsercmdKey( msg_t *msg, int key, const usercmd_t *from, const
 void MSG_ReadDeltaUsercmdKey( msg_t *msg, int key, const usercmd_t *from, usercmd_t *to );
 
 void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entityState_t *to, qboolean force );
+void MSG_WriteDeltaEntityMask( msg_t *msg, const entityState_t *to, uint64_t changeMask, qboolean force );
+uint64_t MSG_EntityChangeMask( const entityState_t *from, const entityState_t *to );
 void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *to, int number );
 
 void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const playerState_t *to );
@@ -191,6 +194,8 @@ void MSG_ReadDeltaSharedEntity( msg_t *msg, void *from, void *to,
 								 int number );
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_HuffBench_f( void );
+void MSG_Check_f( void );
 
 
 //============================================================================
@@ -516,7 +521,8 @@ typedef struct vm_s vm_t;
 typedef enum {
 	VMI_NATIVE,
 	VMI_BYTECODE,
-	VMI_COMPILED
+	VMI_COMPILED,
+	VMI_WASM
 } vmInterpret_t;
 
 typedef enum {
@@ -541,10 +547,13 @@ typedef enum {
 
 void	VM_Init( void );
 vm_t	*VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscalls, vmInterpret_t interpret );
+vm_t	*VM_CreateInstance( vmIndex_t index, syscall_t systemCalls, vmInterpret_t interpret );
 
 // module should be bare: "cgame", not "cgame.dll" or "vm/cgame.qvm"
 
 void	VM_Free( vm_t *vm );
+void	VM_FreeInstance( vm_t *vm );
+int		VM_DllEntryTable( vm_t *vm, int version, const void *table );
 void	VM_Clear(void);
 void	VM_Forced_Unload_Start(void);
 void	VM_Forced_Unload_Done(void);
@@ -893,6 +902,7 @@ qboolean FS_SV_FileExists( const char *file );
 fileHandle_t FS_SV_FOpenFileWrite( const char *filename );
 int		FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp );
 void	FS_SV_Rename( const char *from, const char *to );
+void	FS_SV_Remove( const char *file );
 int		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 void Spy_CursorPosition(float x, float y);
 void Spy_Banner(float x, float y);
@@ -1188,6 +1198,11 @@ extern	cvar_t	*com_yieldCPU;
 #endif
 
 extern	cvar_t	*vm_rtChecks;
+extern	cvar_t	*vm_optimize;
+extern	cvar_t	*vm_verify;
+extern	cvar_t	*vm_tiered;
+extern	cvar_t	*vm_tierThreshold;
+extern	cvar_t	*vm_cache;
 #ifdef USE_AFFINITY_MASK
 extern	cvar_t	*com_affinityMask;
 #endif
@@ -1270,6 +1285,8 @@ void Hunk_Clear( void );
 void Hunk_ClearToMark( void );
 void Hunk_SetMark( void );
 qboolean Hunk_CheckMark( void );
+void Hunk_GetPermanent( int *low, int *high );
+qboolean Hunk_Rewind( int low, int high );
 void Hunk_ClearTempMemory( void );
 void *Hunk_AllocateTempMemory( int size );
 void Hunk_FreeTempMemory( void *buf );
@@ -1371,6 +1388,7 @@ void SV_Shutdown( const char *finalmsg );
 void SV_Frame( int msec );
 void SV_TrackCvarChanges( void );
 void SV_PacketEvent( const netadr_t *from, msg_t *msg );
+void SV_AbortWorldPass( void );
 int SV_FrameMsec( void );
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets( void );
@@ -1451,6 +1469,16 @@ void	QDECL Sys_SetStatus( const char *format, ...) __attribute__ ((format (print
 void	Sys_SetAffinityMask( int mask );
 #endif
 
+// calls func( data, index ) for every index in [0, count) from up to numThreads
+// threads including the calling one, returns when all calls are done, not reentrant
+typedef void (*jobFunc_t)( void *data, int index );
+void	Sys_RunJobs( jobFunc_t func, void *data, int count, int numThreads );
+
+// calls func( data, 0 ) on a separate thread and sets *done when it returns,
+// runs it synchronously and returns qfalse if no thread can be started
+qboolean Sys_StartJob( jobFunc_t func, void *data, volatile int *done );
+qboolean Sys_JobDone( volatile int *done );
+
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds( void );
@@ -1467,6 +1495,8 @@ void	Sys_ShowConsole( int level, qboolean quitOnClose );
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, const netadr_t *to );
+void	Sys_BeginPacketBatch( void );
+void	Sys_EndPacketBatch( void );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
@@ -1506,10 +1536,43 @@ void Huff_Compress( msg_t *buf, int offset );
 void Huff_Decompress( msg_t *buf, int offset );
 
 // static huffman functions
+extern const uint16_t HuffmanEncoderTable[ 256 ];	// code << 4 | length
+extern const uint16_t HuffmanDecoderTable[ 2048 ];	// length << 8 | symbol
 void HuffmanPutBit( byte* fout, int32_t bitIndex, int bit );
 int HuffmanPutSymbol( byte* fout, uint32_t offset, int symbol );
 int HuffmanGetBit( const byte* buffer, int bitIndex );
 int HuffmanGetSymbol( unsigned int* symbol, const byte* buffer, int bitIndex );
+void HuffmanPutBits( byte* fout, int bitIndex, uint64_t code, int count );
+int HuffmanPutValue( byte* fout, int bitIndex, uint32_t value, int bits );
+uint64_t HuffmanGetWindow( const byte* buffer, int bitIndex, int bufferSize );
+int HuffmanGetValue( uint32_t* value, const byte* buffer, int bitIndex, int bits, int bufferSize );
+
+// hierarchical timer wheel, millisecond ticks
+#define TIMER_BITS		6
+#define TIMER_SLOTS		(1<<TIMER_BITS)
+#define TIMER_LEVELS	4	// covers 2^24 msec, farther events are cascaded again
+
+typedef void (*timerFunc_t)( void *data );
+
+typedef struct timerEvent_s {
+	struct timerEvent_s *prev, *next;	// NULL if not scheduled
+	timerFunc_t	func;
+	void		*data;
+	int			expire;
+	int			level;
+} timerEvent_t;
+
+typedef struct {
+	int				time;	// last processed tick
+	int				count[ TIMER_LEVELS ];
+	timerEvent_t	slots[ TIMER_LEVELS ][ TIMER_SLOTS ];	// list heads
+} timerWheel_t;
+
+void Timer_Init( timerWheel_t *tw, int time );
+void Timer_Schedule( timerWheel_t *tw, timerEvent_t *ev, int expire );
+void Timer_Cancel( timerWheel_t *tw, timerEvent_t *ev );
+void Timer_Advance( timerWheel_t *tw, int time );
+#define Timer_Pending( ev ) ( (ev)->next != NULL )
 
 #define	SV_ENCODE_START		4
 #define	SV_DECODE_START		12
@@ -0,0 +1,208 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// timers.c -- hierarchical timer wheel
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+Each level has TIMER_SLOTS slots and a slot of level N covers TIMER_SLOTS^N
+milliseconds. Events due within TIMER_SLOTS ms are kept in level 0, farther
+ones in upper levels and are moved down ("cascaded") when the wheel reaches
+their slot, so advancing costs O(1) per tick plus O(1) per fired event.
+Ticks with nothing to do in the lower levels are skipped entirely.
+*/
+
+#define TIMER_MASK	(TIMER_SLOTS-1)
+#define TIMER_RANGE	(1<<(TIMER_BITS*TIMER_LEVELS))
+
+static void Timer_InitList( timerEvent_t *head ) {
+	head->prev = head;
+	head->next = head;
+}
+
+
+static void Timer_Unlink( timerWheel_t *tw, timerEvent_t *ev ) {
+	ev->prev->next = ev->next;
+	ev->next->prev = ev->prev;
+	ev->prev = ev->next = NULL;
+	if ( ev->level >= 0 ) {
+		tw->count[ ev->level ]--;
+	}
+	ev->level = -1;
+}
+
+
+static void Timer_Link( timerWheel_t *tw, timerEvent_t *ev ) {
+	timerEvent_t *head;
+	int delta, level, index;
+
+	delta = ev->expire - tw->time;
+	if ( delta < 0 ) {
+		delta = 0; // cascaded into the tick being processed
+	} else if ( delta >= TIMER_RANGE ) {
+		delta = TIMER_RANGE - 1; // will be cascaded again
+	}
+
+	for ( level = 0; level < TIMER_LEVELS - 1; level++ ) {
+		if ( delta < ( 1 << ( TIMER_BITS * ( level + 1 ) ) ) ) {
+			break;
+		}
+	}
+
+	index = ( (unsigned)( tw->time + delta ) >> ( TIMER_BITS * level ) ) & TIMER_MASK;
+	head = &tw->slots[ level ][ index ];
+
+	ev->next = head;
+	ev->prev = head->prev;
+	head->prev->next = ev;
+	head->prev = ev;
+	ev->level = level;
+	tw->count[ level ]++;
+}
+
+
+/*
+================
+Timer_Init
+================
+*/
+void Timer_Init( timerWheel_t *tw, int time ) {
+	int i, j;
+
+	for ( i = 0; i < TIMER_LEVELS; i++ ) {
+		for ( j = 0; j < TIMER_SLOTS; j++ ) {
+			Timer_InitList( &tw->slots[ i ][ j ] );
+		}
+		tw->count[ i ] = 0;
+	}
+
+	tw->time = time;
+}
+
+
+/*
+================
+Timer_Schedule
+
+(Re)schedules event at the given time, past times fire on the next advance
+================
+*/
+void Timer_Schedule( timerWheel_t *tw, timerEvent_t *ev, int expire ) {
+
+	if ( ev->next ) {
+		Timer_Unlink( tw, ev );
+	}
+
+	if ( expire - tw->time <= 0 ) {
+		expire = tw->time + 1;
+	}
+
+	ev->expire = expire;
+	Timer_Link( tw, ev );
+}
+
+
+/*
+================
+Timer_Cancel
+================
+*/
+void Timer_Cancel( timerWheel_t *tw, timerEvent_t *ev ) {
+	if ( ev->next ) {
+		Timer_Unlink( tw, ev );
+	}
+}
+
+
+/*
+================
+Timer_Advance
+
+Fires all events due up to and including time
+================
+*/
+void Timer_Advance( timerWheel_t *tw, int time ) {
+	timerEvent_t list, *ev, *head;
+	int level, index;
+
+	while ( time - tw->time > 0 ) {
+
+		// skip ticks until the next boundary of the lowest populated level
+		for ( level = 0; level < TIMER_LEVELS; level++ ) {
+			if ( tw->count[ level ] ) {
+				break;
+			}
+		}
+		if ( level == TIMER_LEVELS ) {
+			tw->time = time;
+			return;
+		}
+		if ( level > 0 ) {
+			index = tw->time | ( ( 1 << ( TIMER_BITS * level ) ) - 1 );
+			if ( index - time >= 0 ) {
+				tw->time = time;
+				return;
+			}
+			tw->time = index;
+		}
+
+		tw->time++;
+
+		// move down events from upper levels which slots start at this tick
+		for ( level = 1; level < TIMER_LEVELS; level++ ) {
+			if ( tw->time & ( ( 1 << ( TIMER_BITS * level ) ) - 1 ) ) {
+				break;
+			}
+			index = ( (unsigned)tw->time >> ( TIMER_BITS * level ) ) & TIMER_MASK;
+			head = &tw->slots[ level ][ index ];
+			while ( head->next != head ) {
+				ev = head->next;
+				Timer_Unlink( tw, ev );
+				Timer_Link( tw, ev );
+			}
+		}
+
+		// detach due events so callbacks may freely (re)schedule or cancel
+		head = &tw->slots[ 0 ][ tw->time & TIMER_MASK ];
+		if ( head->next == head ) {
+			continue;
+		}
+
+		list.next = head->next;
+		list.prev = head->prev;
+		list.next->prev = &list;
+		list.prev->next = &list;
+		Timer_InitList( head );
+
+		for ( ev = list.next; ev != &list; ev = ev->next ) {
+			tw->count[ 0 ]--;
+			ev->level = -1;
+		}
+
+		while ( list.next != &list ) {
+			ev = list.next;
+			Timer_Unlink( tw, ev );
+			ev->func( ev->data );
+		}
+	}
+}
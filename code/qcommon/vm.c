@@ -202,6 +202,11 @@ const char *opname[ 256 ] = {
 };
 
 cvar_t	*vm_rtChecks;
+cvar_t	*vm_optimize;
+cvar_t	*vm_verify;
+cvar_t	*vm_tiered;
+cvar_t	*vm_tierThreshold;
+cvar_t	*vm_cache;
 
 #ifdef DEBUG
 int		vm_debugLevel;
@@ -234,6 +239,16 @@ VM_CheckBounds
 */
 void VM_CheckBounds( const vm_t *vm, unsigned int address, unsigned int length )
 {
+	if ( vm->wasm )
+	{
+		// wasm memory ends at its current size, not at the mask
+		if ( (uint64_t)address + length > vm->dataLength )
+		{
+			Com_Error( ERR_DROP, "program tried to bypass data segment bounds" );
+		}
+		return;
+	}
+
 	//if ( !vm->entryPoint )
 	{
 		if ( (address | length) > vm->dataMask || (address + length) > vm->dataMask )
@@ -251,6 +266,13 @@ VM_CheckBounds2
 */
 void VM_CheckBounds2( const vm_t *vm, unsigned int addr1, unsigned int addr2, unsigned int length )
 {
+	if ( vm->wasm )
+	{
+		VM_CheckBounds( vm, addr1, length );
+		VM_CheckBounds( vm, addr2, length );
+		return;
+	}
+
 	//if ( !vm->entryPoint )
 	{
 		if ( (addr1 | addr2 | length) > vm->dataMask || (addr1 + length) > vm->dataMask || (addr2+length) > vm->dataMask )
@@ -645,6 +667,210 @@ static int Load_JTS( vm_t *vm, unsigned int crc32, void *data, int vmPakIndex )
 }
 
 
+/*
+================================================================================
+
+COMPILED CODE CACHE
+
+Native code of compiled modules is kept in
+vmcache/<gamedir>/<module>-<bytecode crc>.vmc below fs_homepath, so modules
+of different mods or versions don't replace each other's cache.  The file is the header followed by the code, the code offset
+of every instruction and the relocations of absolute addresses embedded in
+the code, which the compiler resolves against the new addresses on load.
+The key in the header describes everything code generation depends on:
+engine build, module crc, cpu features and cvars, so any difference simply
+makes the compiler run again and replace the file.
+
+================================================================================
+*/
+
+#define	VM_CACHE_IDENT		(('C'<<24)+('M'<<16)+('V'<<8)+'Q')
+#define	VM_CACHE_VERSION	2
+
+#define	VM_CACHE_BUILD		Q3_VERSION " " ARCH_STRING " " __DATE__ " " __TIME__
+
+typedef struct {
+	int				ident;
+	int				version;
+	char			build[ 64 ];	// engine that generated the code
+	unsigned int	crc32sum;		// of the bytecode the code was generated from
+	char			key[ VM_CACHE_KEY ];
+	int				forceDataMask;
+	int				numInstructions;
+	int				codeLength;
+	int				numRelocs;
+	int				length;			// of the data following the header
+	unsigned int	checksum;		// crc32 of the data following the header
+} vmCacheHeader_t;
+
+
+/*
+==================
+VM_CodeCacheName
+==================
+*/
+static const char *VM_CodeCacheName( const vm_t *vm, const char *ext ) {
+	return va( "vmcache/%s/%s-%08x.%s", FS_GetCurrentGameDir(), vm->name, vm->crc32sum, ext );
+}
+
+
+/*
+==================
+VM_CodeCacheLength
+==================
+*/
+static int VM_CodeCacheLength( int codeLength, int numInstructions, int numRelocs ) {
+	return PAD( codeLength, 8 ) + PAD( numInstructions * sizeof( int ), 8 ) + numRelocs * sizeof( vmReloc_t );
+}
+
+
+/*
+==================
+VM_ValidateCodeCache
+
+Makes sure offsets and relocations of loaded code stay in the code
+==================
+*/
+static qboolean VM_ValidateCodeCache( const vm_t *vm, const vmCodeCache_t *cache ) {
+	const vmReloc_t *r;
+	int i;
+
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		if ( cache->offsets[i] < -1 || cache->offsets[i] >= cache->codeLength ) {
+			return qfalse;
+		}
+	}
+
+	for ( i = 0, r = cache->relocs; i < cache->numRelocs; i++, r++ ) {
+		if ( ( r->size != 4 && r->size != sizeof( intptr_t ) ) || (unsigned)r->base >= VM_RELOC_BASES ) {
+			return qfalse;
+		}
+		if ( r->offset < 0 || r->offset > cache->codeLength - r->size ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+==================
+VM_LoadCodeCache
+
+Fills in cache with the stored code of vm if it was generated with the same
+cache->key, returned buffer must be released with Z_Free, NULL if there is
+no usable cache
+==================
+*/
+void *VM_LoadCodeCache( vm_t *vm, vmCodeCache_t *cache ) {
+	vmCacheHeader_t	header;
+	fileHandle_t	f;
+	byte			*data;
+	int				length;
+
+	length = FS_SV_FOpenFileRead( VM_CodeCacheName( vm, "vmc" ), &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		return NULL;
+	}
+
+	if ( length < sizeof( header ) || FS_Read( &header, sizeof( header ), f ) != sizeof( header )
+		|| header.ident != VM_CACHE_IDENT || header.version != VM_CACHE_VERSION ) {
+		FS_FCloseFile( f );
+		return NULL;
+	}
+
+	// native code is only trusted from the same engine build and the exact bytecode,
+	// the key repeats both but is only as reliable as the backend that made it
+	header.build[ sizeof( header.build ) - 1 ] = '\0';
+	header.key[ sizeof( header.key ) - 1 ] = '\0';
+	if ( strcmp( header.build, VM_CACHE_BUILD ) != 0 || header.crc32sum != vm->crc32sum
+		|| strcmp( header.key, cache->key ) != 0 || header.numInstructions != vm->instructionCount ) {
+		Com_DPrintf( "%s is out of date\n", VM_CodeCacheName( vm, "vmc" ) );
+		FS_FCloseFile( f );
+		return NULL;
+	}
+
+	if ( header.codeLength <= 0 || header.numRelocs < 0 || header.numRelocs > header.codeLength / 4
+		|| header.length != length - (int)sizeof( header )
+		|| header.length != VM_CodeCacheLength( header.codeLength, header.numInstructions, header.numRelocs ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: ignoring broken %s\n", VM_CodeCacheName( vm, "vmc" ) );
+		FS_FCloseFile( f );
+		return NULL;
+	}
+
+	data = Z_Malloc( header.length );
+
+	cache->forceDataMask = header.forceDataMask ? qtrue : qfalse;
+	cache->codeLength = header.codeLength;
+	cache->code = data;
+	cache->offsets = (int *)( data + PAD( header.codeLength, 8 ) );
+	cache->numRelocs = header.numRelocs;
+	cache->relocs = (vmReloc_t *)( (byte *)cache->offsets + PAD( header.numInstructions * sizeof( int ), 8 ) );
+
+	if ( FS_Read( data, header.length, f ) != header.length || crc32_buffer( data, header.length ) != header.checksum
+		|| !VM_ValidateCodeCache( vm, cache ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: ignoring broken %s\n", VM_CodeCacheName( vm, "vmc" ) );
+		FS_FCloseFile( f );
+		Z_Free( data );
+		return NULL;
+	}
+
+	FS_FCloseFile( f );
+
+	return data;
+}
+
+
+/*
+==================
+VM_WriteCodeCache
+==================
+*/
+void VM_WriteCodeCache( vm_t *vm, const vmCodeCache_t *cache ) {
+	vmCacheHeader_t	header;
+	fileHandle_t	f;
+	char			name[MAX_QPATH];
+	byte			*data;
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = VM_CACHE_IDENT;
+	header.version = VM_CACHE_VERSION;
+	Q_strncpyz( header.build, VM_CACHE_BUILD, sizeof( header.build ) );
+	header.crc32sum = vm->crc32sum;
+	Q_strncpyz( header.key, cache->key, sizeof( header.key ) );
+	header.forceDataMask = cache->forceDataMask;
+	header.numInstructions = vm->instructionCount;
+	header.codeLength = cache->codeLength;
+	header.numRelocs = cache->numRelocs;
+	header.length = VM_CodeCacheLength( cache->codeLength, vm->instructionCount, cache->numRelocs );
+
+	// lay out the data as it will be read back
+	data = Z_Malloc( header.length );
+	Com_Memcpy( data, cache->code, cache->codeLength );
+	Com_Memcpy( data + PAD( cache->codeLength, 8 ), cache->offsets, vm->instructionCount * sizeof( int ) );
+	Com_Memcpy( data + header.length - cache->numRelocs * sizeof( vmReloc_t ), cache->relocs, cache->numRelocs * sizeof( vmReloc_t ) );
+	header.checksum = crc32_buffer( data, header.length );
+
+	// write under a temporary name so concurrent loads never see a partial file
+	Q_strncpyz( name, VM_CodeCacheName( vm, "tmp" ), sizeof( name ) );
+	f = FS_SV_FOpenFileWrite( name );
+	if ( f == FS_INVALID_HANDLE ) {
+		Z_Free( data );
+		return;
+	}
+
+	FS_Write( &header, sizeof( header ), f );
+	FS_Write( data, header.length, f );
+	FS_FCloseFile( f );
+
+	Z_Free( data );
+
+	FS_SV_Remove( VM_CodeCacheName( vm, "vmc" ) );
+	FS_SV_Rename( name, VM_CodeCacheName( vm, "vmc" ) );
+}
+
+
 /*
 =================
 VM_ValidateHeader
@@ -1398,19 +1624,21 @@ This allows a server to do a map_restart without changing memory allocation
 vm_t *VM_Restart( vm_t *vm ) {
 	vmHeader_t	*header;
 
-	// DLL's can't be restarted in place
-	if ( vm->dllHandle ) {
+	// DLL's and wasm modules can't be restarted in place
+	if ( vm->dllHandle || vm->wasm ) {
 		syscall_t		systemCall;
 		dllSyscall_t	dllSyscall;
 		vmIndex_t		index;
+		vmInterpret_t	interpret;
 
 		index = vm->index;
 		systemCall = vm->systemCall;
 		dllSyscall = vm->dllSyscall;
+		interpret = vm->dllHandle ? VMI_NATIVE : VMI_WASM;
 
 		VM_Free( vm );
 
-		vm = VM_Create( index, systemCall, dllSyscall, VMI_NATIVE );
+		vm = VM_Create( index, systemCall, dllSyscall, interpret );
 		return vm;
 	}
 
@@ -1476,39 +1704,381 @@ static void * QDECL VM_LoadDll( const char *name, dllSyscall_t *entryPoint, dllS
 
 
 /*
-================
-VM_Create
+=================
+VM_DllEntryTable
 
-If image ends in .qvm it will be interpreted, otherwise
-it will attempt to load as a system dll
-================
+Hands a table of direct engine calls to a shared library module which exports
+dllEntryTable, returns what the module answered or 0 for bytecode and modules
+without that export
+=================
 */
-vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscalls, vmInterpret_t interpret ) {
-	int			remaining;
-	const char	*name;
-	vmHeader_t	*header;
-	vm_t		*vm;
+int VM_DllEntryTable( vm_t *vm, int version, const void *table ) {
+	dllEntryTable_t	dllEntryTable;
 
-	if ( !systemCalls ) {
-		Com_Error( ERR_FATAL, "VM_Create: bad parms" );
+	if ( !vm || !vm->dllHandle ) {
+		return 0;
 	}
 
-	if ( (unsigned)index >= VM_COUNT ) {
-		Com_Error( ERR_DROP, "VM_Create: bad vm index %i", index );	
+	dllEntryTable = /* ( dllEntryTable_t ) */ Sys_LoadFunction( vm->dllHandle, "dllEntryTable" );
+	if ( !dllEntryTable ) {
+		return 0;
 	}
 
-	remaining = Hunk_MemoryRemaining();
+	return dllEntryTable( version, table );
+}
 
-	vm = &vmTable[ index ];
 
-	// see if we already have the VM
-	if ( vm->name ) {
-		if ( vm->index != index ) {
-			Com_Error( ERR_DROP, "VM_Create: bad allocated vm index %i", vm->index );
-			return NULL;
+#ifndef NO_VM_COMPILED
+/*
+=================================================================
+
+COMPILED CODE VERIFICATION (vm_verify)
+
+Every top-level call into a compiled module is executed twice: first by the
+compiled code with all system calls recorded, then by the interpreter on a
+copy of the data segment taken before the call, with system call results and
+data segment writes replayed from the record instead of executing them again.
+Return values, system call sequence and final data segment contents must match.
+
+=================================================================
+*/
+
+#define VERIFY_MAX_CALLS	16384
+#define VERIFY_MAX_WRITES	(4*1024*1024)
+#define VERIFY_MAX_ARGS		8
+#define VERIFY_SYSCALLS		1024
+#define VERIFY_BLOCK		64
+
+typedef enum {
+	VERIFY_IDLE,
+	VERIFY_RECORD,
+	VERIFY_REPLAY
+} verifyState_t;
+
+typedef struct {
+	int			args[ VERIFY_MAX_ARGS + 1 ];	// system call number and arguments
+	intptr_t	result;
+	int			writes;							// offset in writes buffer
+	int			writesLength;
+} verifyCall_t;
+
+typedef struct vmVerify_s {
+	syscall_t		systemCall;		// actual system call handler
+	instruction_t	*code;			// interpreter instructions
+	byte			*base;			// data segment for the interpreter
+	byte			*scratch;		// data segment snapshot around system calls
+	byte			syscallArgs[ VERIFY_SYSCALLS ];	// number of arguments to compare
+
+	// compiled module state while interpreter is running
+	byte			*dataBase;
+	vmFunc_t		codeBase;
+
+	verifyState_t	state;
+	int				depth;			// nested system calls while recording
+	qboolean		overflow;
+
+	verifyCall_t	*calls;
+	int				numCalls;
+	int				replayCall;
+
+	byte			*writes;
+	int				writesLength;
+
+	// statistics
+	int				numVerified;
+	int				numSkipped;
+	int				numErrors;
+} vmVerify_t;
+
+
+static void VM_VerifyRecordWrites( vm_t *vm, vmVerify_t *v, verifyCall_t *c ) {
+	const byte *old, *cur;
+	unsigned int i, n, start, end, size;
+	int len;
+
+	old = v->scratch;
+	cur = vm->dataBase;
+	size = vm->dataMask + 1;
+
+	c->writes = v->writesLength;
+
+	for ( i = 0; i < size; i += VERIFY_BLOCK ) {
+		if ( !memcmp( old + i, cur + i, VERIFY_BLOCK ) ) {
+			continue;
 		}
-		return vm;
+		// exact byte runs within the block
+		for ( n = i; n < i + VERIFY_BLOCK; n++ ) {
+			if ( old[ n ] == cur[ n ] ) {
+				continue;
+			}
+			start = n;
+			while ( n < i + VERIFY_BLOCK && old[ n ] != cur[ n ] ) {
+				n++;
+			}
+			end = n;
+			len = end - start;
+			if ( v->writesLength + 8 + PAD( len, 4 ) > VERIFY_MAX_WRITES ) {
+				v->overflow = qtrue;
+				return;
+			}
+			*(int *)( v->writes + v->writesLength + 0 ) = start;
+			*(int *)( v->writes + v->writesLength + 4 ) = len;
+			Com_Memcpy( v->writes + v->writesLength + 8, cur + start, len );
+			v->writesLength += 8 + PAD( len, 4 );
+		}
+	}
+
+	c->writesLength = v->writesLength - c->writes;
+}
+
+
+static void VM_VerifyApplyWrites( vm_t *vm, const vmVerify_t *v, const verifyCall_t *c ) {
+	const byte *p, *end;
+	int offset, len;
+
+	p = v->writes + c->writes;
+	end = p + c->writesLength;
+	while ( p < end ) {
+		offset = ((const int *)p)[0];
+		len = ((const int *)p)[1];
+		Com_Memcpy( vm->dataBase + offset, p + 8, len );
+		p += 8 + PAD( len, 4 );
 	}
+}
+
+
+static void VM_VerifyFail( vm_t *vm, const char *msg ) {
+	vm->verify->numErrors++;
+	Com_Printf( S_COLOR_YELLOW "VM_Verify(%s): %s\n", vm->name, msg );
+}
+
+
+static void VM_VerifyRestore( vm_t *vm ) {
+	vmVerify_t *v = vm->verify;
+
+	v->state = VERIFY_IDLE;
+	if ( vm->dataBase == v->base ) {
+		vm->dataBase = v->dataBase;
+		vm->codeBase = v->codeBase;
+	}
+}
+
+
+static intptr_t VM_VerifySystemCall( vm_t *vm, intptr_t *args ) {
+	vmVerify_t *v = vm->verify;
+	verifyCall_t *c;
+	intptr_t r;
+	int i, n;
+
+	if ( v->state == VERIFY_RECORD && v->depth == 0 ) {
+		if ( v->overflow || v->numCalls >= VERIFY_MAX_CALLS ) {
+			v->overflow = qtrue;
+			return v->systemCall( args );
+		}
+
+		Com_Memcpy( v->scratch, vm->dataBase, vm->dataMask + 1 );
+
+		v->depth++;
+		r = v->systemCall( args );
+		v->depth--;
+
+		c = &v->calls[ v->numCalls++ ];
+		for ( i = 0; i <= VERIFY_MAX_ARGS; i++ ) {
+			c->args[ i ] = args[ i ];
+		}
+		c->result = r;
+		VM_VerifyRecordWrites( vm, v, c );
+		return r;
+	}
+
+	if ( v->state == VERIFY_REPLAY ) {
+		if ( v->replayCall >= v->numCalls ) {
+			VM_VerifyRestore( vm );
+			Com_Error( ERR_DROP, "VM_Verify(%s): interpreter made extra system call %i", vm->name, (int)args[0] );
+		}
+
+		c = &v->calls[ v->replayCall++ ];
+		n = 0;
+		if ( (unsigned)args[0] < VERIFY_SYSCALLS && v->syscallArgs[ args[0] ] <= VERIFY_MAX_ARGS ) {
+			n = v->syscallArgs[ args[0] ];
+		}
+		for ( i = 0; i <= n; i++ ) {
+			if ( (int)args[ i ] != c->args[ i ] ) {
+				VM_VerifyRestore( vm );
+				Com_Error( ERR_DROP, "VM_Verify(%s): system call %i mismatch, compiled %i(%i), interpreted %i(%i) at arg %i",
+					vm->name, v->replayCall - 1, c->args[0], c->args[i], (int)args[0], (int)args[i], i );
+			}
+		}
+
+		VM_VerifyApplyWrites( vm, v, c );
+		return c->result;
+	}
+
+	return v->systemCall( args );
+}
+
+
+static intptr_t VM_VerifySystemCall0( intptr_t *args ) { return VM_VerifySystemCall( &vmTable[0], args ); }
+#ifndef USE_DEDICATED
+static intptr_t VM_VerifySystemCall1( intptr_t *args ) { return VM_VerifySystemCall( &vmTable[1], args ); }
+static intptr_t VM_VerifySystemCall2( intptr_t *args ) { return VM_VerifySystemCall( &vmTable[2], args ); }
+#endif
+
+static const syscall_t verifySystemCalls[ VM_COUNT ] = {
+	VM_VerifySystemCall0,
+#ifndef USE_DEDICATED
+	VM_VerifySystemCall1,
+	VM_VerifySystemCall2
+#endif
+};
+
+
+/*
+=================
+VM_VerifyInit
+
+Must be called before compilation as system call handler address is embedded into the code
+=================
+*/
+static void VM_VerifyInit( vm_t *vm ) {
+	vmVerify_t *v;
+
+	v = Hunk_Alloc( sizeof( *v ), h_high );
+	v->base = Hunk_Alloc( vm->dataMask + 1, h_high );
+	v->scratch = Hunk_Alloc( vm->dataMask + 1, h_high );
+	v->calls = Hunk_Alloc( VERIFY_MAX_CALLS * sizeof( v->calls[0] ), h_high );
+	v->writes = Hunk_Alloc( VERIFY_MAX_WRITES, h_high );
+
+	v->systemCall = vm->systemCall;
+	vm->systemCall = verifySystemCalls[ vm->index ];
+	vm->verify = v;
+}
+
+
+/*
+=================
+VM_VerifyPrepare
+
+Loads interpreter instructions and counts system call arguments from call sites
+=================
+*/
+static qboolean VM_VerifyPrepare( vm_t *vm, vmHeader_t *header ) {
+	vmVerify_t *v = vm->verify;
+	const instruction_t *ci;
+	vmFunc_t codeBase;
+	qboolean res;
+	int i, n, num;
+
+	codeBase = vm->codeBase;
+	res = VM_PrepareInterpreter2( vm, header );
+	v->code = (instruction_t *)vm->codeBase.ptr;
+	vm->codeBase = codeBase;
+
+	if ( !res ) {
+		return qfalse;
+	}
+
+	// arguments are stored with OP_ARG between previous OP_CALL and the call site
+	// arguments of system calls made only through function pointers are not compared
+	Com_Memset( v->syscallArgs, 0xFF, sizeof( v->syscallArgs ) );
+	for ( i = 0, n = 0; i < vm->instructionCount; i++ ) {
+		ci = &v->code[ i ];
+		if ( ci->op == OP_ARG ) {
+			n = MIN( MAX( n, ( ci->value - 8 ) / 4 + 1 ), VERIFY_MAX_ARGS );
+		} else if ( ci->op == OP_ENTER ) {
+			n = 0;
+		} else if ( ci->op == OP_CALL ) {
+			if ( i > 0 && v->code[ i - 1 ].op == OP_CONST && v->code[ i - 1 ].value < 0 ) {
+				num = ~v->code[ i - 1 ].value;
+				if ( num < VERIFY_SYSCALLS && n < v->syscallArgs[ num ] ) {
+					v->syscallArgs[ num ] = n;
+				}
+			}
+			n = 0;
+		}
+	}
+
+	return qtrue;
+}
+
+
+static void VM_VerifyCancel( vm_t *vm ) {
+	vm->systemCall = vm->verify->systemCall;
+	vm->verify = NULL;
+}
+
+
+
+/*
+=================
+VM_CallVerify
+=================
+*/
+static int VM_CallVerify( vm_t *vm, int nargs, int *args ) {
+	vmVerify_t *v = vm->verify;
+	unsigned int programStack, i;
+	int r, ri;
+
+	programStack = vm->programStack;
+	Com_Memcpy( v->base, vm->dataBase, vm->dataMask + 1 );
+
+	v->numCalls = 0;
+	v->writesLength = 0;
+	v->overflow = qfalse;
+	v->depth = 0;
+
+	v->state = VERIFY_RECORD;
+	r = VM_CallCompiled( vm, nargs, args );
+	v->state = VERIFY_IDLE;
+
+	if ( v->overflow ) {
+		v->numSkipped++;
+		return r;
+	}
+
+	v->dataBase = vm->dataBase;
+	v->codeBase = vm->codeBase;
+	vm->dataBase = v->base;
+	vm->codeBase.ptr = (byte *)v->code;
+	vm->programStack = programStack;
+
+	v->replayCall = 0;
+	v->state = VERIFY_REPLAY;
+	ri = VM_CallInterpreted2( vm, nargs, args );
+	VM_VerifyRestore( vm );
+
+	v->numVerified++;
+
+	if ( r != ri ) {
+		VM_VerifyFail( vm, va( "vmMain(%i) returned %i, interpreter %i", args[0], r, ri ) );
+	} else if ( v->replayCall != v->numCalls ) {
+		VM_VerifyFail( vm, va( "vmMain(%i) made %i system calls, interpreter %i", args[0], v->numCalls, v->replayCall ) );
+	} else if ( memcmp( vm->dataBase, v->base, vm->stackBottom ) ) {
+		for ( i = 0; i < vm->stackBottom && vm->dataBase[i] == v->base[i]; i++ )
+			;
+		i &= ~3;
+		VM_VerifyFail( vm, va( "vmMain(%i) data mismatch at 0x%x, compiled %08x, interpreted %08x",
+			args[0], i, *(int *)( vm->dataBase + i ), *(int *)( v->base + i ) ) );
+	}
+
+	return r;
+}
+#endif // !NO_VM_COMPILED
+
+
+/*
+================
+VM_CreateIn
+
+Loads module index into the cleared vm
+================
+*/
+static vm_t *VM_CreateIn( vm_t *vm, vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscalls, vmInterpret_t interpret ) {
+	int			remaining;
+	const char	*name;
+	vmHeader_t	*header;
+
+	remaining = Hunk_MemoryRemaining();
 
 	name = vmName[ index ];
 
@@ -1541,6 +2111,16 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 		interpret = VMI_COMPILED;
 	}
 
+	if ( interpret == VMI_WASM ) {
+		if ( VM_LoadWasm( vm ) ) {
+			Com_Printf( "%s loaded in %d bytes on the hunk\n", vm->name, remaining - Hunk_MemoryRemaining() );
+			return vm;
+		}
+
+		Com_Printf( "Failed to load wasm, looking for qvm.\n" );
+		interpret = VMI_COMPILED;
+	}
+
 	// load the image
 	if( ( header = VM_LoadQVM( vm, qtrue ) ) == NULL ) {
 		return NULL;
@@ -1567,9 +2147,20 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 	}
 #else
 	if ( interpret >= VMI_COMPILED ) {
+		// the cross-check routes system calls by index, so only the main instance can use it
+		if ( ( vm_verify->integer & ( 1 << index ) ) && vm == &vmTable[ index ] ) {
+			VM_VerifyInit( vm );
+		}
 		if ( VM_Compile( vm, header ) ) {
 			vm->compiled = qtrue;
 		}
+		if ( vm->verify ) {
+			if ( !vm->compiled || !VM_VerifyPrepare( vm, header ) ) {
+				VM_VerifyCancel( vm );
+			} else {
+				Com_Printf( S_COLOR_YELLOW "%s: verifying compiled code against interpreter\n", vm->name );
+			}
+		}
 	}
 #endif
 	// VM_Compile may have reset vm->compiled if compilation failed
@@ -1593,6 +2184,76 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 }
 
 
+/*
+================
+VM_Create
+
+If image ends in .qvm it will be interpreted, otherwise
+it will attempt to load as a system dll
+================
+*/
+vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscalls, vmInterpret_t interpret ) {
+	vm_t		*vm;
+
+	if ( !systemCalls ) {
+		Com_Error( ERR_FATAL, "VM_Create: bad parms" );
+	}
+
+	if ( (unsigned)index >= VM_COUNT ) {
+		Com_Error( ERR_DROP, "VM_Create: bad vm index %i", index );	
+	}
+
+	vm = &vmTable[ index ];
+
+	// see if we already have the VM
+	if ( vm->name ) {
+		if ( vm->index != index ) {
+			Com_Error( ERR_DROP, "VM_Create: bad allocated vm index %i", vm->index );
+			return NULL;
+		}
+		return vm;
+	}
+
+	return VM_CreateIn( vm, index, systemCalls, dllSyscalls, interpret );
+}
+
+
+/*
+================
+VM_CreateInstance
+
+Loads one more copy of a module with its own memory image, it is not
+in vmTable and must be released with VM_FreeInstance. Libraries share
+their globals between loads, so instances always run bytecode.
+================
+*/
+vm_t *VM_CreateInstance( vmIndex_t index, syscall_t systemCalls, vmInterpret_t interpret ) {
+	vm_t		*vm;
+
+	if ( !systemCalls ) {
+		Com_Error( ERR_FATAL, "VM_CreateInstance: bad parms" );
+	}
+
+	if ( (unsigned)index >= VM_COUNT ) {
+		Com_Error( ERR_DROP, "VM_CreateInstance: bad vm index %i", index );
+	}
+
+	if ( interpret == VMI_NATIVE ) {
+		interpret = VMI_COMPILED;
+	}
+
+	vm = Z_Malloc( sizeof( *vm ) );
+	Com_Memset( vm, 0, sizeof( *vm ) );
+
+	if ( !VM_CreateIn( vm, index, systemCalls, NULL, interpret ) ) {
+		Z_Free( vm );
+		return NULL;
+	}
+
+	return vm;
+}
+
+
 /*
 ==============
 VM_Free
@@ -1634,6 +2295,19 @@ void VM_Free( vm_t *vm ) {
 }
 
 
+/*
+==============
+VM_FreeInstance
+==============
+*/
+void VM_FreeInstance( vm_t *vm ) {
+	if ( vm ) {
+		VM_Free( vm );
+		Z_Free( vm );
+	}
+}
+
+
 void VM_Clear( void ) {
 	int i;
 	for ( i = 0; i < VM_COUNT; i++ ) {
@@ -1679,8 +2353,10 @@ locals from sp
 intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 {
 	//vm_t	*oldVM;
+	vmTier_t *tier;
+	int64_t start;
 	intptr_t r;
-	int i;
+	int i, t;
 
 	if ( !vm ) {
 		Com_Error( ERR_FATAL, "VM_Call with NULL vm" );
@@ -1696,6 +2372,18 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 	}
 #endif
 
+	// tiered code may be replaced only while nothing is running
+	tier = NULL;
+	if ( vm->tier && vm->callLevel == 0 ) {
+		tier = vm->tier;
+		tier->update( vm );
+		t = tier->current;
+		start = Sys_Microseconds();
+	} else {
+		t = 0;
+		start = 0;
+	}
+
 	++vm->callLevel;
 	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint ) 
@@ -1711,10 +2399,24 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 
 		// add more agruments if you're changed MAX_VMMAIN_CALL_ARGS:
 		r = vm->entryPoint( callnum, args[0], args[1], args[2] );
+	} else if ( vm->wasm ) {
+		int args[MAX_VMMAIN_CALL_ARGS];
+		va_list ap;
+
+		args[0] = callnum;
+		va_start( ap, callnum );
+		for ( i = 0; i < nargs; i++ ) {
+			args[i+1] = va_arg( ap, int );
+		}
+		va_end(ap);
+
+		r = VM_CallWasm( vm, nargs+1, &args[0] );
 	} else {
 #if id386 && !defined __clang__ // calling convention doesn't need conversion in some cases
 #ifndef NO_VM_COMPILED
-		if ( vm->compiled )
+		if ( vm->verify && vm->callLevel == 1 )
+			r = VM_CallVerify( vm, nargs+1, (int*)&callnum );
+		else if ( vm->compiled )
 			r = VM_CallCompiled( vm, nargs+1, (int*)&callnum );
 		else
 #endif
@@ -1730,7 +2432,9 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 		}
 		va_end(ap);
 #ifndef NO_VM_COMPILED
-		if ( vm->compiled )
+		if ( vm->verify && vm->callLevel == 1 )
+			r = VM_CallVerify( vm, nargs+1, &args[0] );
+		else if ( vm->compiled )
 			r = VM_CallCompiled( vm, nargs+1, &args[0] );
 		else
 #endif
@@ -1739,6 +2443,11 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 	}
 	--vm->callLevel;
 
+	if ( tier && tier == vm->tier ) {
+		tier->time[ t ] += Sys_Microseconds() - start;
+		tier->calls[ t ]++;
+	}
+
 	return r;
 }
 
@@ -1790,6 +2499,77 @@ static vm_t *VM_NameToVM( const char *name )
 }
 
 
+typedef struct {
+	int		blocks;
+	int		calls;
+	int		func;
+} vmFuncProfile_t;
+
+
+static int QDECL VM_FuncProfileSort( const void *a, const void *b ) {
+	return ((const vmFuncProfile_t *)b)->blocks - ((const vmFuncProfile_t *)a)->blocks;
+}
+
+
+/*
+==============
+VM_TierProfile
+
+Time per tier and function counters gathered by the profiling code
+==============
+*/
+#define TIER_PROFILE_FUNCS 32
+
+static void VM_TierProfile( const vm_t *vm ) {
+	const vmTier_t *t = vm->tier;
+	const vmSymbol_t *sym;
+	vmFuncProfile_t *funcs;
+	int i, n, numFuncs;
+	double total;
+
+	for ( i = 0; i < 2; i++ ) {
+		Com_Printf( "tier %i: %9i calls, %9.1f msec, %7.1f usec per call%s\n", i, t->calls[i], t->time[i] / 1000.0,
+			t->calls[i] ? (double)t->time[i] / t->calls[i] : 0.0, ( i == t->current ) ? " (current)" : "" );
+	}
+	if ( t->current ) {
+		Com_Printf( "%i hot functions recompiled\n", t->numHot );
+	}
+
+	funcs = Z_Malloc( vm->instructionCount * sizeof( *funcs ) );
+	numFuncs = 0;
+	total = 0;
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		if ( t->inst[ i ].op == OP_ENTER ) {
+			funcs[ numFuncs ].func = i;
+			funcs[ numFuncs ].calls = t->counters[ i ];
+			funcs[ numFuncs ].blocks = 0;
+			numFuncs++;
+		}
+		if ( numFuncs ) {
+			funcs[ numFuncs - 1 ].blocks += t->counters[ i ];
+			total += t->counters[ i ];
+		}
+	}
+
+	qsort( funcs, numFuncs, sizeof( *funcs ), VM_FuncProfileSort );
+
+	Com_Printf( " %%    blocks     calls function\n" );
+	for ( n = 0; n < numFuncs && n < TIER_PROFILE_FUNCS && funcs[ n ].blocks > 0; n++ ) {
+		for ( sym = vm->symbols; sym; sym = sym->next ) {
+			if ( sym->symValue == funcs[ n ].func ) {
+				break;
+			}
+		}
+		Com_Printf( "%2i%% %9i %9i %s\n", (int)( 100 * funcs[ n ].blocks / total ), funcs[ n ].blocks, funcs[ n ].calls,
+			sym ? sym->symName : va( "func@%i", funcs[ n ].func ) );
+	}
+
+	Com_Printf( "    %9.0f total\n", total );
+
+	Z_Free( funcs );
+}
+
+
 /*
 ==============
 VM_VmProfile_f
@@ -1812,6 +2592,11 @@ static void VM_VmProfile_f( void ) {
 		return;
 	}
 
+	if ( vm->tier ) {
+		VM_TierProfile( vm );
+		return;
+	}
+
 	if ( !vm->numSymbols ) {
 		return;
 	}
@@ -1862,14 +2647,32 @@ static void VM_VmInfo_f( void ) {
 			Com_Printf( "native\n" );
 			continue;
 		}
+		if ( vm->wasm ) {
+			Com_Printf( "wasm, interpreted\n" );
+			Com_Printf( "    code length : %7i\n", vm->codeLength );
+			Com_Printf( "    data length : %7i\n", vm->dataLength );
+			continue;
+		}
 		if ( vm->compiled ) {
-			Com_Printf( "compiled on load\n" );
+			if ( vm->tier ) {
+				Com_Printf( "compiled on load, tier %i\n", vm->tier->current );
+			} else if ( vm_optimize->integer & ( 1 << i ) ) {
+				Com_Printf( "compiled on load, optimized\n" );
+			} else {
+				Com_Printf( "compiled on load\n" );
+			}
 		} else {
 			Com_Printf( "interpreted\n" );
 		}
 		Com_Printf( "    code length : %7i\n", vm->codeLength );
 		Com_Printf( "    table length: %7i\n", vm->instructionCount*4 );
 		Com_Printf( "    data length : %7i\n", vm->dataMask + 1 );
+#ifndef NO_VM_COMPILED
+		if ( vm->verify ) {
+			Com_Printf( "    verified    : %7i calls, %i skipped, %i errors\n",
+				vm->verify->numVerified, vm->verify->numSkipped, vm->verify->numErrors );
+		}
+#endif
 	}
 }
 
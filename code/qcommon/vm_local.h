@@ -144,6 +144,39 @@ typedef struct vmSymbol_s {
 
 //typedef void(*vmfunc_t)(void);
 
+typedef struct vmTier_s {
+	int			current;			// 0 - profiling baseline code, 1 - hot functions recompiled
+	qboolean	finished;			// no further recompilation
+	int			*counters;			// execution counters of jump targets in profiling code
+	instruction_t *inst;			// prepared instructions for recompilation
+	int			numHot;				// functions recompiled with the heavy optimizations
+	int			calls[2];			// top level calls per tier
+	int64_t		time[2];			// microseconds spent per tier
+	void		(*update)( struct vm_s *vm );	// polled between top level calls
+} vmTier_t;
+
+#define VM_RELOC_BASES	16			// address bases known to the compiler
+
+typedef struct {
+	int			offset;				// of the patched address in code
+	int			size;				// 4 or 8 bytes
+	int			base;				// index of address base, defined by the compiler
+	int			pad;
+	int64_t		delta;				// from the base address
+} vmReloc_t;
+
+#define VM_CACHE_KEY	256
+
+typedef struct {
+	char		key[ VM_CACHE_KEY ];	// everything code generation depends on
+	qboolean	forceDataMask;
+	int			codeLength;
+	byte		*code;
+	int			*offsets;			// code offset of every instruction, -1 for no jump target
+	int			numRelocs;
+	vmReloc_t	*relocs;
+} vmCodeCache_t;
+
 typedef union vmFunc_u {
 	byte		*ptr;
 	void (*func)(void);
@@ -170,6 +203,9 @@ struct vm_s {
 	dllSyscall_t dllSyscall;
 	void (*destroy)(vm_t* self);
 
+	// for WebAssembly modules
+	struct wasmModule_s *wasm;
+
 	// for interpreted modules
 	//qboolean	currentlyInterpreting;
 
@@ -202,6 +238,9 @@ struct vm_s {
 	qboolean	forceDataMask;
 
 	int			privateFlag;
+
+	struct vmVerify_s *verify;		// vm_verify state
+	vmTier_t	*tier;				// vm_tiered state
 };
 
 extern	vm_t			*gvm;				// game virtual machine
@@ -214,6 +253,9 @@ int	VM_CallCompiled( vm_t *vm, int nargs, int *args );
 qboolean VM_PrepareInterpreter2( vm_t *vm, vmHeader_t *header );
 int	VM_CallInterpreted2( vm_t *vm, int nargs, int *args );
 
+qboolean VM_LoadWasm( vm_t *vm );
+int	VM_CallWasm( vm_t *vm, int nargs, int *args );
+
 vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
@@ -225,6 +267,9 @@ const char *VM_CheckInstructions( instruction_t *buf, int instructionCount,
 								 int numJumpTableTargets, 
 								 int dataLength );
 
+void *VM_LoadCodeCache( vm_t *vm, vmCodeCache_t *cache );
+void VM_WriteCodeCache( vm_t *vm, const vmCodeCache_t *cache );
+
 void VM_IgnoreInstructions( instruction_t *buf, int count );
 void VM_ReplaceInstructions( vm_t *vm, instruction_t *buf );
 
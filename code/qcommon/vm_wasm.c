@@ -0,0 +1,2508 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_wasm.c -- WebAssembly modules
+//
+// A .wasm module is translated on load into a register-free instruction list
+// with resolved branch targets and stack heights, then interpreted. There is
+// no compiler yet: clang -O2 code runs about as fast here as lcc code does in
+// the qvm interpreter and 5-10 times slower than under the qvm compiler, so a
+// wasm module is for mods that need a modern toolchain, not for speed.
+//
+// Module interface:
+//  - imports "env" "syscall" with up to 14 i32/f32 parameters, the first one is
+//    the trap number, the same numbers a native module passes to dllSyscall;
+//    it may be imported several times with different signatures
+//  - optionally imports "env" "memory" and "env" "__indirect_function_table"
+//  - exports "vmMain", called like the vmMain of a qvm
+//  - optionally exports "_initialize", called once after loading
+//
+// Pointers are offsets into linear memory just like qvm data addresses, so
+// the system call handlers work unchanged, except that VM_CheckBounds and the
+// pointer arguments are checked against the current memory size instead of
+// the data mask. Every load and store is checked against it too.
+
+#include "vm_local.h"
+
+#define WASM_MAGIC			0x6d736100	// "\0asm"
+#define WASM_VERSION		1
+#define WASM_PAGE_SIZE		65536
+#define WASM_MAX_MEMORY		( 256 * 1024 * 1024 )	// upper limit for memory.grow
+#define WASM_HEAP_RESERVE	( 4 * 1024 * 1024 )		// room for memory.grow reserved on the hunk
+#define WASM_MAX_SYSCALL_ARGS	14		// trap number included
+#define WASM_MAX_LOCALS		50000
+#define WASM_MAX_DEPTH		1024		// nested blocks in a function
+#define WASM_STACK_SLOTS	( 128 * 1024 )
+#define WASM_MAX_FRAMES		4096
+
+// value types
+#define WASM_I32			0x7F
+#define WASM_I64			0x7E
+#define WASM_F32			0x7D
+#define WASM_F64			0x7C
+#define WASM_FUNCREF		0x70
+#define WASM_BLOCK_EMPTY	0x40
+
+typedef enum {
+	WSEC_CUSTOM,
+	WSEC_TYPE,
+	WSEC_IMPORT,
+	WSEC_FUNCTION,
+	WSEC_TABLE,
+	WSEC_MEMORY,
+	WSEC_GLOBAL,
+	WSEC_EXPORT,
+	WSEC_START,
+	WSEC_ELEMENT,
+	WSEC_CODE,
+	WSEC_DATA,
+	WSEC_DATACOUNT,
+	WSEC_COUNT
+} wasmSection_t;
+
+// opcodes, numeric ones and memory access are executed by their wasm encoding
+typedef enum {
+	WOP_UNREACHABLE		= 0x00,
+	WOP_NOP				= 0x01,
+	WOP_BLOCK			= 0x02,
+	WOP_LOOP			= 0x03,
+	WOP_IF				= 0x04,
+	WOP_ELSE			= 0x05,
+	WOP_END				= 0x0B,
+	WOP_BR				= 0x0C,
+	WOP_BR_IF			= 0x0D,
+	WOP_BR_TABLE		= 0x0E,
+	WOP_RETURN			= 0x0F,
+	WOP_CALL			= 0x10,
+	WOP_CALL_INDIRECT	= 0x11,
+	WOP_DROP			= 0x1A,
+	WOP_SELECT			= 0x1B,
+	WOP_SELECT_T		= 0x1C,
+	WOP_LOCAL_GET		= 0x20,
+	WOP_LOCAL_SET		= 0x21,
+	WOP_LOCAL_TEE		= 0x22,
+	WOP_GLOBAL_GET		= 0x23,
+	WOP_GLOBAL_SET		= 0x24,
+	WOP_I32_LOAD		= 0x28,
+	WOP_I64_LOAD,
+	WOP_F32_LOAD,
+	WOP_F64_LOAD,
+	WOP_I32_LOAD8_S,
+	WOP_I32_LOAD8_U,
+	WOP_I32_LOAD16_S,
+	WOP_I32_LOAD16_U,
+	WOP_I64_LOAD8_S,
+	WOP_I64_LOAD8_U,
+	WOP_I64_LOAD16_S,
+	WOP_I64_LOAD16_U,
+	WOP_I64_LOAD32_S,
+	WOP_I64_LOAD32_U,
+	WOP_I32_STORE,
+	WOP_I64_STORE,
+	WOP_F32_STORE,
+	WOP_F64_STORE,
+	WOP_I32_STORE8,
+	WOP_I32_STORE16,
+	WOP_I64_STORE8,
+	WOP_I64_STORE16,
+	WOP_I64_STORE32,
+	WOP_MEMORY_SIZE		= 0x3F,
+	WOP_MEMORY_GROW,
+	WOP_I32_CONST,
+	WOP_I64_CONST,
+	WOP_F32_CONST,
+	WOP_F64_CONST,
+
+	WOP_I32_EQZ			= 0x45,
+	WOP_I32_EQ,
+	WOP_I32_NE,
+	WOP_I32_LT_S,
+	WOP_I32_LT_U,
+	WOP_I32_GT_S,
+	WOP_I32_GT_U,
+	WOP_I32_LE_S,
+	WOP_I32_LE_U,
+	WOP_I32_GE_S,
+	WOP_I32_GE_U,
+	WOP_I64_EQZ,
+	WOP_I64_EQ,
+	WOP_I64_NE,
+	WOP_I64_LT_S,
+	WOP_I64_LT_U,
+	WOP_I64_GT_S,
+	WOP_I64_GT_U,
+	WOP_I64_LE_S,
+	WOP_I64_LE_U,
+	WOP_I64_GE_S,
+	WOP_I64_GE_U,
+	WOP_F32_EQ,
+	WOP_F32_NE,
+	WOP_F32_LT,
+	WOP_F32_GT,
+	WOP_F32_LE,
+	WOP_F32_GE,
+	WOP_F64_EQ,
+	WOP_F64_NE,
+	WOP_F64_LT,
+	WOP_F64_GT,
+	WOP_F64_LE,
+	WOP_F64_GE,
+
+	WOP_I32_CLZ			= 0x67,
+	WOP_I32_CTZ,
+	WOP_I32_POPCNT,
+	WOP_I32_ADD,
+	WOP_I32_SUB,
+	WOP_I32_MUL,
+	WOP_I32_DIV_S,
+	WOP_I32_DIV_U,
+	WOP_I32_REM_S,
+	WOP_I32_REM_U,
+	WOP_I32_AND,
+	WOP_I32_OR,
+	WOP_I32_XOR,
+	WOP_I32_SHL,
+	WOP_I32_SHR_S,
+	WOP_I32_SHR_U,
+	WOP_I32_ROTL,
+	WOP_I32_ROTR,
+	WOP_I64_CLZ,
+	WOP_I64_CTZ,
+	WOP_I64_POPCNT,
+	WOP_I64_ADD,
+	WOP_I64_SUB,
+	WOP_I64_MUL,
+	WOP_I64_DIV_S,
+	WOP_I64_DIV_U,
+	WOP_I64_REM_S,
+	WOP_I64_REM_U,
+	WOP_I64_AND,
+	WOP_I64_OR,
+	WOP_I64_XOR,
+	WOP_I64_SHL,
+	WOP_I64_SHR_S,
+	WOP_I64_SHR_U,
+	WOP_I64_ROTL,
+	WOP_I64_ROTR,
+	WOP_F32_ABS,
+	WOP_F32_NEG,
+	WOP_F32_CEIL,
+	WOP_F32_FLOOR,
+	WOP_F32_TRUNC,
+	WOP_F32_NEAREST,
+	WOP_F32_SQRT,
+	WOP_F32_ADD,
+	WOP_F32_SUB,
+	WOP_F32_MUL,
+	WOP_F32_DIV,
+	WOP_F32_MIN,
+	WOP_F32_MAX,
+	WOP_F32_COPYSIGN,
+	WOP_F64_ABS,
+	WOP_F64_NEG,
+	WOP_F64_CEIL,
+	WOP_F64_FLOOR,
+	WOP_F64_TRUNC,
+	WOP_F64_NEAREST,
+	WOP_F64_SQRT,
+	WOP_F64_ADD,
+	WOP_F64_SUB,
+	WOP_F64_MUL,
+	WOP_F64_DIV,
+	WOP_F64_MIN,
+	WOP_F64_MAX,
+	WOP_F64_COPYSIGN,
+
+	WOP_I32_WRAP_I64	= 0xA7,
+	WOP_I32_TRUNC_F32_S,
+	WOP_I32_TRUNC_F32_U,
+	WOP_I32_TRUNC_F64_S,
+	WOP_I32_TRUNC_F64_U,
+	WOP_I64_EXTEND_I32_S,
+	WOP_I64_EXTEND_I32_U,
+	WOP_I64_TRUNC_F32_S,
+	WOP_I64_TRUNC_F32_U,
+	WOP_I64_TRUNC_F64_S,
+	WOP_I64_TRUNC_F64_U,
+	WOP_F32_CONVERT_I32_S,
+	WOP_F32_CONVERT_I32_U,
+	WOP_F32_CONVERT_I64_S,
+	WOP_F32_CONVERT_I64_U,
+	WOP_F32_DEMOTE_F64,
+	WOP_F64_CONVERT_I32_S,
+	WOP_F64_CONVERT_I32_U,
+	WOP_F64_CONVERT_I64_S,
+	WOP_F64_CONVERT_I64_U,
+	WOP_F64_PROMOTE_F32,
+	WOP_I32_REINTERPRET_F32,
+	WOP_I64_REINTERPRET_F64,
+	WOP_F32_REINTERPRET_I32,
+	WOP_F64_REINTERPRET_I64,
+	WOP_I32_EXTEND8_S,
+	WOP_I32_EXTEND16_S,
+	WOP_I64_EXTEND8_S,
+	WOP_I64_EXTEND16_S,
+	WOP_I64_EXTEND32_S,
+
+	WOP_PREFIX_FC		= 0xFC,
+
+	// translated code only
+	WOP_JUMP			= 0x100,	// a: target
+	WOP_JUMP_IF,					// a: target, pops the condition
+	WOP_JUMP_UNLESS,				// a: target, pops the condition
+	WOP_BRANCH,						// a: target, b: results to keep << 32 | frame slot to keep them at
+	WOP_BRANCH_IF,					// same as WOP_BRANCH, pops the condition
+	WOP_BRANCH_TABLE,				// a: number of labels, followed by a+1 jumps or branches
+	WOP_LEAVE,						// a: number of results
+	WOP_CALL_HOST,					// a: function
+	WOP_CALL_TABLE,					// a: canonical type
+
+	WOP_I32_TRUNC_SAT_F32_S,		// 0xFC 0x00..0x07
+	WOP_I32_TRUNC_SAT_F32_U,
+	WOP_I32_TRUNC_SAT_F64_S,
+	WOP_I32_TRUNC_SAT_F64_U,
+	WOP_I64_TRUNC_SAT_F32_S,
+	WOP_I64_TRUNC_SAT_F32_U,
+	WOP_I64_TRUNC_SAT_F64_S,
+	WOP_I64_TRUNC_SAT_F64_U,
+	WOP_MEMORY_COPY,
+	WOP_MEMORY_FILL
+} wasmOpcode_t;
+
+typedef union {
+	int32_t		i32;
+	uint32_t	u32;
+	int64_t		i64;
+	uint64_t	u64;
+	float		f32;
+	double		f64;
+} wasmValue_t;
+
+typedef struct {
+	int			numParams;
+	int			numResults;
+	const byte	*params;
+	const byte	*results;
+	int			canon;				// first type with the same signature
+} wasmType_t;
+
+typedef struct {
+	int			type;
+	qboolean	host;				// imported system call
+	int			numLocals;			// parameters included
+	int			frameSize;			// locals and the deepest operand stack
+	int			code;				// first translated instruction
+} wasmFunc_t;
+
+typedef struct {
+	int			op;
+	int			a;
+	int64_t		b;
+} wasmInstr_t;
+
+typedef struct {
+	const wasmInstr_t *ip;			// where to continue in the caller
+	wasmValue_t	*fp;				// locals of the caller
+} wasmFrame_t;
+
+typedef struct wasmModule_s {
+	int			numTypes;
+	wasmType_t	*types;
+
+	int			numImports;			// imported functions come first
+	int			numFuncs;
+	wasmFunc_t	*funcs;
+
+	int			numGlobals;
+	wasmValue_t	*globals;
+
+	int			tableSize;
+	int			*table;				// function index or -1
+
+	uint32_t	memorySize;			// current size in bytes
+	uint32_t	memoryMax;			// allowed to grow up to this size
+
+	int			entry;				// vmMain
+
+	int			codeLength;
+	wasmInstr_t	*code;
+
+	wasmValue_t	*stack;
+	wasmValue_t	*stackEnd;
+	wasmValue_t	*sp;				// first free slot when calling back into the module
+
+	wasmFrame_t	*frames;
+	int			numFrames;
+} wasmModule_t;
+
+
+static qboolean WASM_CallFunction( vm_t *vm, int func );
+
+
+/*
+=================================================================
+
+BINARY READER
+
+=================================================================
+*/
+
+typedef struct {
+	const byte	*p;
+	const byte	*end;
+	const char	*error;
+} wasmReader_t;
+
+
+static void WASM_ReadError( wasmReader_t *r, const char *error ) {
+	if ( !r->error ) {
+		r->error = error;
+	}
+	r->p = r->end;
+}
+
+
+static int WASM_ReadByte( wasmReader_t *r ) {
+	if ( r->p >= r->end ) {
+		WASM_ReadError( r, "unexpected end of data" );
+		return 0;
+	}
+	return *r->p++;
+}
+
+
+static uint32_t WASM_ReadU32( wasmReader_t *r ) {
+	uint32_t	value;
+	int			shift, b;
+
+	value = 0;
+	for ( shift = 0; shift < 35; shift += 7 ) {
+		b = WASM_ReadByte( r );
+		value |= (uint32_t)( b & 0x7F ) << shift;
+		if ( !( b & 0x80 ) ) {
+			return value;
+		}
+	}
+
+	WASM_ReadError( r, "integer too long" );
+	return 0;
+}
+
+
+static int64_t WASM_ReadS64( wasmReader_t *r, int bits ) {
+	uint64_t	value;
+	int			shift, b;
+
+	value = 0;
+	for ( shift = 0; shift < ( bits + 6 ) / 7 * 7; shift += 7 ) {
+		b = WASM_ReadByte( r );
+		value |= (uint64_t)( b & 0x7F ) << shift;
+		if ( !( b & 0x80 ) ) {
+			shift += 7;
+			if ( shift < 64 && ( b & 0x40 ) ) {
+				value |= ~(uint64_t)0 << shift;
+			}
+			return (int64_t)value;
+		}
+	}
+
+	WASM_ReadError( r, "integer too long" );
+	return 0;
+}
+
+
+static const byte *WASM_ReadBytes( wasmReader_t *r, uint32_t length ) {
+	const byte *p;
+
+	if ( length > (uint32_t)( r->end - r->p ) ) {
+		WASM_ReadError( r, "unexpected end of data" );
+		return NULL;
+	}
+	p = r->p;
+	r->p += length;
+	return p;
+}
+
+
+static qboolean WASM_ReadName( wasmReader_t *r, char *name, int size ) {
+	const byte	*p;
+	uint32_t	length;
+
+	length = WASM_ReadU32( r );
+	p = WASM_ReadBytes( r, length );
+	if ( !p ) {
+		name[0] = '\0';
+		return qfalse;
+	}
+	if ( length >= (uint32_t)size ) {
+		length = size - 1;
+	}
+	Com_Memcpy( name, p, length );
+	name[ length ] = '\0';
+	return qtrue;
+}
+
+
+static void WASM_ReadLimits( wasmReader_t *r, uint32_t *min, uint32_t *max ) {
+	int flags;
+
+	flags = WASM_ReadByte( r );
+	*min = WASM_ReadU32( r );
+	if ( flags & 1 ) {
+		*max = WASM_ReadU32( r );
+	} else {
+		*max = ~0U;
+	}
+}
+
+
+/*
+=================
+WASM_ReadConstExpr
+
+Initializers of globals and segment offsets
+=================
+*/
+static wasmValue_t WASM_ReadConstExpr( wasmReader_t *r, const wasmModule_t *m ) {
+	wasmValue_t	v;
+	uint32_t	index;
+	const byte	*p;
+
+	v.u64 = 0;
+
+	switch ( WASM_ReadByte( r ) ) {
+	case WOP_I32_CONST:
+		v.i32 = (int32_t)WASM_ReadS64( r, 32 );
+		break;
+	case WOP_I64_CONST:
+		v.i64 = WASM_ReadS64( r, 64 );
+		break;
+	case WOP_F32_CONST:
+		if ( ( p = WASM_ReadBytes( r, 4 ) ) != NULL ) {
+			Com_Memcpy( &v.f32, p, 4 );
+		}
+		break;
+	case WOP_F64_CONST:
+		if ( ( p = WASM_ReadBytes( r, 8 ) ) != NULL ) {
+			Com_Memcpy( &v.f64, p, 8 );
+		}
+		break;
+	case WOP_GLOBAL_GET:
+		index = WASM_ReadU32( r );
+		if ( index >= (uint32_t)m->numGlobals ) {
+			WASM_ReadError( r, "bad global in constant expression" );
+			break;
+		}
+		v = m->globals[ index ];
+		break;
+	default:
+		WASM_ReadError( r, "unsupported constant expression" );
+		break;
+	}
+
+	if ( WASM_ReadByte( r ) != WOP_END ) {
+		WASM_ReadError( r, "unterminated constant expression" );
+	}
+
+	return v;
+}
+
+
+/*
+=================================================================
+
+TRANSLATION
+
+Branches get their target and the stack slots they have to move resolved,
+so the interpreter never has to search for the end of a block.
+
+=================================================================
+*/
+
+typedef enum {
+	WCTL_FUNC,
+	WCTL_BLOCK,
+	WCTL_LOOP,
+	WCTL_IF
+} wasmControlKind_t;
+
+typedef struct {
+	wasmControlKind_t	kind;
+	int			height;				// operand stack height below the block parameters
+	int			numParams;
+	int			numResults;
+	int			start;				// loop: first instruction
+	int			patch;				// chain of branches waiting for the end
+	int			elsePatch;			// if: conditional jump to the else part
+	qboolean	dead;				// the code after the block is unreachable too
+} wasmControl_t;
+
+typedef struct {
+	wasmModule_t	*m;
+	wasmReader_t	r;
+	const wasmFunc_t *func;
+	wasmInstr_t		*code;
+	int				codeLength;
+	int				maxCode;
+	int				height;
+	int				maxHeight;
+	qboolean		dead;
+	int				depth;
+	wasmControl_t	control[ WASM_MAX_DEPTH ];
+	const char		*error;
+} wasmCompiler_t;
+
+
+static void WASM_CompileError( wasmCompiler_t *c, const char *error ) {
+	if ( !c->error ) {
+		c->error = error;
+	}
+	c->r.p = c->r.end;
+}
+
+
+static wasmInstr_t *WASM_Emit( wasmCompiler_t *c, int op, int a, int64_t b ) {
+	static wasmInstr_t dummy;
+	wasmInstr_t *ins;
+
+	if ( c->dead ) {
+		return &dummy;
+	}
+
+	if ( c->codeLength >= c->maxCode ) {
+		WASM_CompileError( c, "code buffer overflow" );
+		return &dummy;
+	}
+
+	ins = &c->code[ c->codeLength++ ];
+	ins->op = op;
+	ins->a = a;
+	ins->b = b;
+
+	return ins;
+}
+
+
+static void WASM_Pop( wasmCompiler_t *c, int count ) {
+	int base;
+
+	base = c->depth ? c->control[ c->depth - 1 ].height : 0;
+	if ( !c->dead && c->height - count < base ) {
+		WASM_CompileError( c, "operand stack underflow" );
+	}
+	c->height -= count;
+}
+
+
+static void WASM_Push( wasmCompiler_t *c, int count ) {
+	c->height += count;
+	if ( !c->dead && c->height > c->maxHeight ) {
+		c->maxHeight = c->height;
+	}
+}
+
+
+static void WASM_ReadBlockType( wasmCompiler_t *c, int *numParams, int *numResults ) {
+	int64_t	index;
+	int		b;
+
+	if ( c->r.p >= c->r.end ) {
+		WASM_CompileError( c, "unexpected end of code" );
+		return;
+	}
+
+	b = *c->r.p;
+	if ( b == WASM_BLOCK_EMPTY ) {
+		c->r.p++;
+		*numParams = 0;
+		*numResults = 0;
+	} else if ( b == WASM_I32 || b == WASM_I64 || b == WASM_F32 || b == WASM_F64 ) {
+		c->r.p++;
+		*numParams = 0;
+		*numResults = 1;
+	} else {
+		index = WASM_ReadS64( &c->r, 33 );
+		if ( index < 0 || index >= c->m->numTypes ) {
+			WASM_CompileError( c, "bad block type" );
+			return;
+		}
+		*numParams = c->m->types[ index ].numParams;
+		*numResults = c->m->types[ index ].numResults;
+	}
+}
+
+
+static void WASM_PushControl( wasmCompiler_t *c, wasmControlKind_t kind, int numParams, int numResults ) {
+	wasmControl_t *ctl;
+
+	if ( c->depth >= WASM_MAX_DEPTH ) {
+		WASM_CompileError( c, "blocks nested too deep" );
+		return;
+	}
+
+	WASM_Pop( c, numParams );
+
+	ctl = &c->control[ c->depth++ ];
+	ctl->kind = kind;
+	ctl->height = c->height;
+	ctl->numParams = numParams;
+	ctl->numResults = numResults;
+	ctl->start = c->codeLength;
+	ctl->patch = -1;
+	ctl->elsePatch = -1;
+	ctl->dead = c->dead;
+
+	WASM_Push( c, numParams );
+}
+
+
+static void WASM_Patch( wasmCompiler_t *c, int chain, int target ) {
+	int next;
+
+	while ( chain >= 0 ) {
+		next = c->code[ chain ].a;
+		c->code[ chain ].a = target;
+		chain = next;
+	}
+}
+
+
+/*
+=================
+WASM_EmitBranch
+
+Emits a branch to the label at relative depth, op is WOP_JUMP or WOP_JUMP_IF
+=================
+*/
+static void WASM_EmitBranch( wasmCompiler_t *c, int op, uint32_t label ) {
+	wasmControl_t	*ctl;
+	wasmInstr_t		*ins;
+	int				arity, base;
+
+	if ( label >= (uint32_t)c->depth ) {
+		WASM_CompileError( c, "bad branch depth" );
+		return;
+	}
+
+	if ( c->dead ) {
+		return;
+	}
+
+	ctl = &c->control[ c->depth - 1 - label ];
+	arity = ( ctl->kind == WCTL_LOOP ) ? ctl->numParams : ctl->numResults;
+
+	if ( c->height - arity < ctl->height ) {
+		WASM_CompileError( c, "operand stack underflow" );
+		return;
+	}
+
+	base = c->func->numLocals + ctl->height;
+	if ( c->height == ctl->height + arity ) {
+		ins = WASM_Emit( c, op, -1, 0 );
+	} else {
+		ins = WASM_Emit( c, op == WOP_JUMP ? WOP_BRANCH : WOP_BRANCH_IF, -1, ( (int64_t)arity << 32 ) | base );
+	}
+
+	if ( ctl->kind == WCTL_LOOP ) {
+		ins->a = ctl->start;
+	} else {
+		ins->a = ctl->patch;
+		ctl->patch = ins - c->code;
+	}
+}
+
+
+static void WASM_EmitCall( wasmCompiler_t *c, int op, int a, const wasmType_t *type ) {
+	WASM_Pop( c, type->numParams );
+	WASM_Emit( c, op, a, 0 );
+	WASM_Push( c, type->numResults );
+}
+
+
+/*
+=================
+WASM_CompileFunction
+
+Translates the body of func, returns qfalse on malformed code
+=================
+*/
+static qboolean WASM_CompileFunction( wasmCompiler_t *c, wasmFunc_t *func, const byte *body, uint32_t length ) {
+	wasmModule_t		*m;
+	const wasmType_t	*type;
+	wasmControl_t		*ctl;
+	uint32_t			count, n, i, index;
+	int64_t				numLocals;
+	int					op, numParams, numResults;
+	const byte			*p;
+
+	m = c->m;
+	type = &m->types[ func->type ];
+
+	c->r.p = body;
+	c->r.end = body + length;
+	c->r.error = NULL;
+	c->func = func;
+	c->height = 0;
+	c->maxHeight = 0;
+	c->dead = qfalse;
+	c->depth = 0;
+
+	// local declarations
+	numLocals = type->numParams;
+	count = WASM_ReadU32( &c->r );
+	for ( i = 0; i < count && !c->r.error; i++ ) {
+		n = WASM_ReadU32( &c->r );
+		WASM_ReadByte( &c->r );
+		numLocals += n;
+		if ( numLocals > WASM_MAX_LOCALS ) {
+			WASM_CompileError( c, "too many locals" );
+			return qfalse;
+		}
+	}
+
+	func->numLocals = (int)numLocals;
+	func->code = c->codeLength;
+
+	WASM_PushControl( c, WCTL_FUNC, 0, type->numResults );
+
+	while ( c->depth > 0 && !c->error && !c->r.error ) {
+		op = WASM_ReadByte( &c->r );
+		switch ( op ) {
+
+		case WOP_UNREACHABLE:
+			WASM_Emit( c, WOP_UNREACHABLE, 0, 0 );
+			c->dead = qtrue;
+			break;
+
+		case WOP_NOP:
+			break;
+
+		case WOP_BLOCK:
+			WASM_ReadBlockType( c, &numParams, &numResults );
+			WASM_PushControl( c, WCTL_BLOCK, numParams, numResults );
+			break;
+
+		case WOP_LOOP:
+			WASM_ReadBlockType( c, &numParams, &numResults );
+			WASM_PushControl( c, WCTL_LOOP, numParams, numResults );
+			break;
+
+		case WOP_IF:
+			WASM_ReadBlockType( c, &numParams, &numResults );
+			WASM_Pop( c, 1 );
+			WASM_PushControl( c, WCTL_IF, numParams, numResults );
+			if ( !c->dead ) {
+				c->control[ c->depth - 1 ].elsePatch = c->codeLength;
+				WASM_Emit( c, WOP_JUMP_UNLESS, -1, 0 );
+			}
+			break;
+
+		case WOP_ELSE:
+			ctl = &c->control[ c->depth - 1 ];
+			if ( ctl->kind != WCTL_IF || ctl->elsePatch == -2 ) {
+				WASM_CompileError( c, "else without if" );
+				break;
+			}
+			if ( !c->dead ) {
+				if ( c->height != ctl->height + ctl->numResults ) {
+					WASM_CompileError( c, "operand stack mismatch at else" );
+					break;
+				}
+				WASM_Emit( c, WOP_JUMP, ctl->patch, 0 );
+				ctl->patch = c->codeLength - 1;
+			}
+			if ( ctl->elsePatch >= 0 ) {
+				c->code[ ctl->elsePatch ].a = c->codeLength;
+			}
+			ctl->elsePatch = -2;
+			c->dead = ctl->dead;
+			c->height = ctl->height + ctl->numParams;
+			break;
+
+		case WOP_END:
+			ctl = &c->control[ c->depth - 1 ];
+			if ( !c->dead && c->height != ctl->height + ctl->numResults ) {
+				WASM_CompileError( c, "operand stack mismatch at end" );
+				break;
+			}
+			if ( ctl->kind == WCTL_IF && ctl->elsePatch >= 0 ) {
+				if ( ctl->numParams != ctl->numResults ) {
+					WASM_CompileError( c, "if without else must not change the stack" );
+					break;
+				}
+				c->code[ ctl->elsePatch ].a = c->codeLength;
+			}
+			if ( ctl->kind == WCTL_FUNC ) {
+				// branches to the function label return from it
+				c->dead = qfalse;
+				WASM_Patch( c, ctl->patch, c->codeLength );
+				c->height = ctl->height + ctl->numResults;
+				WASM_Emit( c, WOP_LEAVE, ctl->numResults, 0 );
+				c->depth--;
+				break;
+			}
+			WASM_Patch( c, ctl->patch, c->codeLength );
+			c->dead = ctl->dead;
+			c->height = ctl->height + ctl->numResults;
+			c->depth--;
+			break;
+
+		case WOP_BR:
+			WASM_EmitBranch( c, WOP_JUMP, WASM_ReadU32( &c->r ) );
+			c->dead = qtrue;
+			break;
+
+		case WOP_BR_IF:
+			index = WASM_ReadU32( &c->r );
+			WASM_Pop( c, 1 );
+			WASM_EmitBranch( c, WOP_JUMP_IF, index );
+			break;
+
+		case WOP_BR_TABLE:
+			count = WASM_ReadU32( &c->r );
+			WASM_Pop( c, 1 );
+			if ( count > (uint32_t)c->maxCode ) {
+				WASM_CompileError( c, "branch table too large" );
+				break;
+			}
+			WASM_Emit( c, WOP_BRANCH_TABLE, count, 0 );
+			for ( i = 0; i <= count && !c->error && !c->r.error; i++ ) {
+				WASM_EmitBranch( c, WOP_JUMP, WASM_ReadU32( &c->r ) );
+			}
+			c->dead = qtrue;
+			break;
+
+		case WOP_RETURN:
+			WASM_Pop( c, type->numResults );
+			WASM_Emit( c, WOP_LEAVE, type->numResults, 0 );
+			c->dead = qtrue;
+			break;
+
+		case WOP_CALL:
+			index = WASM_ReadU32( &c->r );
+			if ( index >= (uint32_t)m->numFuncs ) {
+				WASM_CompileError( c, "bad function index" );
+				break;
+			}
+			WASM_EmitCall( c, m->funcs[ index ].host ? WOP_CALL_HOST : WOP_CALL, index, &m->types[ m->funcs[ index ].type ] );
+			break;
+
+		case WOP_CALL_INDIRECT:
+			index = WASM_ReadU32( &c->r );
+			if ( WASM_ReadU32( &c->r ) != 0 || index >= (uint32_t)m->numTypes ) {
+				WASM_CompileError( c, "bad indirect call" );
+				break;
+			}
+			WASM_Pop( c, 1 );
+			WASM_EmitCall( c, WOP_CALL_TABLE, m->types[ index ].canon, &m->types[ index ] );
+			break;
+
+		case WOP_DROP:
+			WASM_Pop( c, 1 );
+			WASM_Emit( c, WOP_DROP, 0, 0 );
+			break;
+
+		case WOP_SELECT_T:
+			count = WASM_ReadU32( &c->r );
+			WASM_ReadBytes( &c->r, count );
+			// fall through
+		case WOP_SELECT:
+			WASM_Pop( c, 3 );
+			WASM_Emit( c, WOP_SELECT, 0, 0 );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_LOCAL_GET:
+		case WOP_LOCAL_SET:
+		case WOP_LOCAL_TEE:
+			index = WASM_ReadU32( &c->r );
+			if ( index >= (uint32_t)func->numLocals ) {
+				WASM_CompileError( c, "bad local index" );
+				break;
+			}
+			WASM_Pop( c, op == WOP_LOCAL_GET ? 0 : 1 );
+			WASM_Emit( c, op, index, 0 );
+			WASM_Push( c, op == WOP_LOCAL_SET ? 0 : 1 );
+			break;
+
+		case WOP_GLOBAL_GET:
+		case WOP_GLOBAL_SET:
+			index = WASM_ReadU32( &c->r );
+			if ( index >= (uint32_t)m->numGlobals ) {
+				WASM_CompileError( c, "bad global index" );
+				break;
+			}
+			WASM_Pop( c, op == WOP_GLOBAL_GET ? 0 : 1 );
+			WASM_Emit( c, op, index, 0 );
+			WASM_Push( c, op == WOP_GLOBAL_GET ? 1 : 0 );
+			break;
+
+		case WOP_I32_LOAD: case WOP_I64_LOAD: case WOP_F32_LOAD: case WOP_F64_LOAD:
+		case WOP_I32_LOAD8_S: case WOP_I32_LOAD8_U: case WOP_I32_LOAD16_S: case WOP_I32_LOAD16_U:
+		case WOP_I64_LOAD8_S: case WOP_I64_LOAD8_U: case WOP_I64_LOAD16_S: case WOP_I64_LOAD16_U:
+		case WOP_I64_LOAD32_S: case WOP_I64_LOAD32_U:
+			WASM_ReadU32( &c->r );	// alignment hint
+			WASM_Pop( c, 1 );
+			WASM_Emit( c, op, 0, WASM_ReadU32( &c->r ) );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_I32_STORE: case WOP_I64_STORE: case WOP_F32_STORE: case WOP_F64_STORE:
+		case WOP_I32_STORE8: case WOP_I32_STORE16:
+		case WOP_I64_STORE8: case WOP_I64_STORE16: case WOP_I64_STORE32:
+			WASM_ReadU32( &c->r );
+			WASM_Pop( c, 2 );
+			WASM_Emit( c, op, 0, WASM_ReadU32( &c->r ) );
+			break;
+
+		case WOP_MEMORY_SIZE:
+			WASM_ReadByte( &c->r );
+			WASM_Emit( c, op, 0, 0 );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_MEMORY_GROW:
+			WASM_ReadByte( &c->r );
+			WASM_Pop( c, 1 );
+			WASM_Emit( c, op, 0, 0 );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_I32_CONST:
+			WASM_Emit( c, op, 0, (int32_t)WASM_ReadS64( &c->r, 32 ) );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_I64_CONST:
+			WASM_Emit( c, op, 0, WASM_ReadS64( &c->r, 64 ) );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_F32_CONST:
+			if ( ( p = WASM_ReadBytes( &c->r, 4 ) ) != NULL ) {
+				wasmValue_t v;
+				v.u64 = 0;
+				Com_Memcpy( &v.f32, p, 4 );
+				WASM_Emit( c, op, 0, v.i64 );
+				WASM_Push( c, 1 );
+			}
+			break;
+
+		case WOP_F64_CONST:
+			if ( ( p = WASM_ReadBytes( &c->r, 8 ) ) != NULL ) {
+				wasmValue_t v;
+				Com_Memcpy( &v.f64, p, 8 );
+				WASM_Emit( c, op, 0, v.i64 );
+				WASM_Push( c, 1 );
+			}
+			break;
+
+		case WOP_I32_REINTERPRET_F32:
+		case WOP_I64_REINTERPRET_F64:
+		case WOP_F32_REINTERPRET_I32:
+		case WOP_F64_REINTERPRET_I64:
+			// the same bits in the same slot
+			WASM_Pop( c, 1 );
+			WASM_Push( c, 1 );
+			break;
+
+		case WOP_PREFIX_FC:
+			index = WASM_ReadU32( &c->r );
+			if ( index <= 7 ) {
+				WASM_Pop( c, 1 );
+				WASM_Emit( c, WOP_I32_TRUNC_SAT_F32_S + index, 0, 0 );
+				WASM_Push( c, 1 );
+			} else if ( index == 9 ) {
+				WASM_ReadU32( &c->r );	// data.drop, segments are not kept
+			} else if ( index == 10 ) {
+				WASM_ReadByte( &c->r );
+				WASM_ReadByte( &c->r );
+				WASM_Pop( c, 3 );
+				WASM_Emit( c, WOP_MEMORY_COPY, 0, 0 );
+			} else if ( index == 11 ) {
+				WASM_ReadByte( &c->r );
+				WASM_Pop( c, 3 );
+				WASM_Emit( c, WOP_MEMORY_FILL, 0, 0 );
+			} else {
+				WASM_CompileError( c, "unsupported 0xFC instruction" );
+			}
+			break;
+
+		default:
+			if ( op >= WOP_I32_EQZ && op <= WOP_I64_EXTEND32_S ) {
+				// numeric instructions are unary or binary
+				if ( ( op >= WOP_I32_EQ && op <= WOP_I32_GE_U ) || ( op >= WOP_I64_EQ && op <= WOP_F64_GE )
+					|| ( op >= WOP_I32_ADD && op <= WOP_I32_ROTR ) || ( op >= WOP_I64_ADD && op <= WOP_I64_ROTR )
+					|| ( op >= WOP_F32_ADD && op <= WOP_F32_COPYSIGN ) || ( op >= WOP_F64_ADD && op <= WOP_F64_COPYSIGN ) ) {
+					WASM_Pop( c, 2 );
+				} else {
+					WASM_Pop( c, 1 );
+				}
+				WASM_Emit( c, op, 0, 0 );
+				WASM_Push( c, 1 );
+				break;
+			}
+			WASM_CompileError( c, va( "unsupported instruction 0x%02x", op ) );
+			break;
+		}
+	}
+
+	if ( c->r.error ) {
+		WASM_CompileError( c, c->r.error );
+	}
+
+	if ( !c->error && ( c->depth != 0 || c->r.p != c->r.end ) ) {
+		WASM_CompileError( c, "function body does not end with its last block" );
+	}
+
+	func->frameSize = func->numLocals + c->maxHeight;
+
+	return c->error == NULL;
+}
+
+
+/*
+=================================================================
+
+LOADING
+
+=================================================================
+*/
+
+static int WASM_CanonicalType( const wasmModule_t *m, int index ) {
+	const wasmType_t *t, *s;
+	int i;
+
+	t = &m->types[ index ];
+	for ( i = 0; i < index; i++ ) {
+		s = &m->types[ i ];
+		if ( s->numParams == t->numParams && s->numResults == t->numResults
+			&& !memcmp( s->params, t->params, t->numParams )
+			&& !memcmp( s->results, t->results, t->numResults ) ) {
+			return i;
+		}
+	}
+
+	return index;
+}
+
+
+static qboolean WASM_IsSyscallType( const wasmType_t *type ) {
+	int i;
+
+	if ( type->numParams < 1 || type->numParams > WASM_MAX_SYSCALL_ARGS || type->numResults > 1 ) {
+		return qfalse;
+	}
+	for ( i = 0; i < type->numParams; i++ ) {
+		if ( type->params[i] != WASM_I32 && type->params[i] != WASM_F32 ) {
+			return qfalse;
+		}
+	}
+	if ( type->numResults && type->results[0] != WASM_I32 && type->results[0] != WASM_F32 ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+static void WASM_InitMemory( vm_t *vm, wasmModule_t *m, uint32_t minPages, uint32_t maxPages ) {
+	uint64_t	size, limit;
+	int			i;
+
+	if ( minPages > WASM_MAX_MEMORY / WASM_PAGE_SIZE ) {
+		minPages = WASM_MAX_MEMORY / WASM_PAGE_SIZE;
+	}
+	if ( maxPages > WASM_MAX_MEMORY / WASM_PAGE_SIZE ) {
+		maxPages = WASM_MAX_MEMORY / WASM_PAGE_SIZE;
+	}
+	if ( maxPages < minPages ) {
+		maxPages = minPages;
+	}
+
+	m->memorySize = minPages * WASM_PAGE_SIZE;
+
+	// the whole reservation is allocated up front, so memory.grow is
+	// limited to the declared maximum or the heap reserve, whichever
+	// is smaller, rounded to the power of two pointers are masked with
+	limit = (uint64_t)maxPages * WASM_PAGE_SIZE;
+	size = m->memorySize + WASM_HEAP_RESERVE;
+	if ( size > limit ) {
+		size = limit;
+	}
+	if ( size < WASM_PAGE_SIZE ) {
+		size = WASM_PAGE_SIZE;
+	}
+	for ( i = 0 ; size > ( 1ULL << i ) ; i++ )
+		;
+	if ( limit > ( 1ULL << i ) ) {
+		limit = 1ULL << i;
+	}
+	m->memoryMax = (uint32_t)limit;
+
+	vm->dataMask = ( 1U << i ) - 1;
+	vm->dataLength = m->memorySize;
+	vm->exactDataLength = m->memorySize;
+	vm->dataAlloc = vm->dataMask + 1 + 1024;
+	vm->dataBase = Hunk_Alloc( vm->dataAlloc, h_high );
+}
+
+
+/*
+=================
+WASM_Parse
+
+Reads the module in buf and translates its code, returns an error message or NULL
+=================
+*/
+static const char *WASM_Parse( vm_t *vm, wasmModule_t *m, const byte *buf, int length ) {
+	wasmReader_t	sections[ WSEC_COUNT ];
+	wasmReader_t	r, *s;
+	wasmCompiler_t	*c;
+	wasmType_t		*type;
+	char			module[ 64 ], name[ 64 ];
+	uint32_t		count, i, j, n, index, offset, flags, min, max;
+	const byte		*p;
+	byte			*bytes;
+	int				id, numDefined, start, init;
+	wasmValue_t		v;
+	qboolean		hasMemory;
+
+	r.p = buf;
+	r.end = buf + length;
+	r.error = NULL;
+
+	p = WASM_ReadBytes( &r, 8 );
+	if ( !p || LittleLong( *(const int *)p ) != WASM_MAGIC || LittleLong( *(const int *)( p + 4 ) ) != WASM_VERSION ) {
+		return "not a WebAssembly module";
+	}
+
+	// find the sections first, they are needed in a different order
+	Com_Memset( sections, 0, sizeof( sections ) );
+	while ( r.p < r.end && !r.error ) {
+		id = WASM_ReadByte( &r );
+		n = WASM_ReadU32( &r );
+		p = WASM_ReadBytes( &r, n );
+		if ( !p ) {
+			break;
+		}
+		if ( id == WSEC_CUSTOM ) {
+			continue;
+		}
+		if ( id >= WSEC_COUNT || sections[ id ].p ) {
+			return "bad section";
+		}
+		sections[ id ].p = p;
+		sections[ id ].end = p + n;
+	}
+	if ( r.error ) {
+		return r.error;
+	}
+
+	// types
+	s = &sections[ WSEC_TYPE ];
+	m->numTypes = s->p ? WASM_ReadU32( s ) : 0;
+	if ( m->numTypes > 0x10000 ) {
+		return "too many types";
+	}
+	m->types = Hunk_Alloc( ( m->numTypes + 1 ) * sizeof( *m->types ), h_high );
+	// value types are kept after the file is freed, they take less than the section
+	bytes = Hunk_Alloc( s->p ? s->end - s->p : 1, h_high );
+	for ( i = 0; i < (uint32_t)m->numTypes && !s->error; i++ ) {
+		type = &m->types[ i ];
+		if ( WASM_ReadByte( s ) != 0x60 ) {
+			return "bad function type";
+		}
+		type->numParams = WASM_ReadU32( s );
+		if ( ( p = WASM_ReadBytes( s, type->numParams ) ) == NULL ) {
+			return s->error;
+		}
+		Com_Memcpy( bytes, p, type->numParams );
+		type->params = bytes;
+		bytes += type->numParams;
+		type->numResults = WASM_ReadU32( s );
+		if ( ( p = WASM_ReadBytes( s, type->numResults ) ) == NULL ) {
+			return s->error;
+		}
+		Com_Memcpy( bytes, p, type->numResults );
+		type->results = bytes;
+		bytes += type->numResults;
+		type->canon = WASM_CanonicalType( m, i );
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// count the functions
+	s = &sections[ WSEC_FUNCTION ];
+	numDefined = s->p ? WASM_ReadU32( s ) : 0;
+
+	m->numImports = 0;
+	s = &sections[ WSEC_IMPORT ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	r = *s;
+	for ( i = 0; i < count && !r.error; i++ ) {
+		WASM_ReadName( &r, module, sizeof( module ) );
+		WASM_ReadName( &r, name, sizeof( name ) );
+		switch ( WASM_ReadByte( &r ) ) {
+		case 0:		WASM_ReadU32( &r ); m->numImports++; break;
+		case 1:		WASM_ReadByte( &r ); WASM_ReadLimits( &r, &min, &max ); break;
+		case 2:		WASM_ReadLimits( &r, &min, &max ); break;
+		default:	WASM_ReadByte( &r ); WASM_ReadByte( &r ); break;
+		}
+	}
+	if ( r.error ) {
+		return r.error;
+	}
+
+	if ( numDefined < 0 || numDefined > 0x100000 ) {
+		return "too many functions";
+	}
+	m->numFuncs = m->numImports + numDefined;
+	m->funcs = Hunk_Alloc( ( m->numFuncs + 1 ) * sizeof( *m->funcs ), h_high );
+
+	// imports
+	hasMemory = qfalse;
+	m->tableSize = 0;
+	n = 0;
+	for ( i = 0; i < count && !s->error; i++ ) {
+		WASM_ReadName( s, module, sizeof( module ) );
+		WASM_ReadName( s, name, sizeof( name ) );
+		switch ( WASM_ReadByte( s ) ) {
+		case 0:
+			index = WASM_ReadU32( s );
+			if ( index >= (uint32_t)m->numTypes ) {
+				return "bad import type";
+			}
+			if ( Q_stricmp( module, "env" ) || strcmp( name, "syscall" ) || !WASM_IsSyscallType( &m->types[ index ] ) ) {
+				return va( "unknown function import %s.%s", module, name );
+			}
+			m->funcs[ n ].type = index;
+			m->funcs[ n ].host = qtrue;
+			n++;
+			break;
+		case 1:
+			WASM_ReadByte( s );
+			WASM_ReadLimits( s, &min, &max );
+			if ( m->table || min > 0x100000 ) {
+				return "bad table import";
+			}
+			m->tableSize = min;
+			m->table = Hunk_Alloc( ( min + 1 ) * sizeof( int ), h_high );
+			break;
+		case 2:
+			WASM_ReadLimits( s, &min, &max );
+			if ( hasMemory ) {
+				return "more than one memory";
+			}
+			WASM_InitMemory( vm, m, min, max );
+			hasMemory = qtrue;
+			break;
+		default:
+			return va( "unsupported global import %s.%s", module, name );
+		}
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// function types
+	s = &sections[ WSEC_FUNCTION ];
+	for ( i = 0; i < (uint32_t)numDefined && !s->error; i++ ) {
+		index = WASM_ReadU32( s );
+		if ( index >= (uint32_t)m->numTypes ) {
+			return "bad function type";
+		}
+		m->funcs[ m->numImports + i ].type = index;
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// table
+	s = &sections[ WSEC_TABLE ];
+	if ( s->p ) {
+		count = WASM_ReadU32( s );
+		if ( count > 1 || ( count && m->table ) ) {
+			return "more than one table";
+		}
+		if ( count ) {
+			WASM_ReadByte( s );
+			WASM_ReadLimits( s, &min, &max );
+			if ( min > 0x100000 ) {
+				return "table too large";
+			}
+			m->tableSize = min;
+			m->table = Hunk_Alloc( ( min + 1 ) * sizeof( int ), h_high );
+		}
+	}
+	for ( i = 0; i < (uint32_t)m->tableSize; i++ ) {
+		m->table[ i ] = -1;
+	}
+
+	// memory
+	s = &sections[ WSEC_MEMORY ];
+	if ( s->p ) {
+		count = WASM_ReadU32( s );
+		if ( count > 1 || ( count && hasMemory ) ) {
+			return "more than one memory";
+		}
+		if ( count ) {
+			WASM_ReadLimits( s, &min, &max );
+			WASM_InitMemory( vm, m, min, max );
+			hasMemory = qtrue;
+		}
+	}
+	if ( !hasMemory ) {
+		WASM_InitMemory( vm, m, 0, 0 );
+	}
+
+	// globals
+	s = &sections[ WSEC_GLOBAL ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	if ( count > 0x10000 ) {
+		return "too many globals";
+	}
+	m->globals = Hunk_Alloc( ( count + 1 ) * sizeof( *m->globals ), h_high );
+	for ( i = 0; i < count && !s->error; i++ ) {
+		WASM_ReadByte( s );		// type
+		WASM_ReadByte( s );		// mutability
+		v = WASM_ReadConstExpr( s, m );
+		m->globals[ m->numGlobals++ ] = v;
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// exports
+	m->entry = -1;
+	init = -1;
+	s = &sections[ WSEC_EXPORT ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	for ( i = 0; i < count && !s->error; i++ ) {
+		WASM_ReadName( s, name, sizeof( name ) );
+		id = WASM_ReadByte( s );
+		index = WASM_ReadU32( s );
+		if ( id != 0 ) {
+			continue;
+		}
+		if ( index >= (uint32_t)m->numFuncs ) {
+			return "bad export";
+		}
+		if ( !strcmp( name, "vmMain" ) ) {
+			m->entry = index;
+		} else if ( !strcmp( name, "_initialize" ) ) {
+			init = index;
+		}
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+	if ( m->entry < 0 || m->funcs[ m->entry ].host ) {
+		return "vmMain is not exported";
+	}
+	type = &m->types[ m->funcs[ m->entry ].type ];
+	if ( type->numResults > 1 || type->numParams > MAX_VMMAIN_CALL_ARGS ) {
+		return "vmMain has a bad signature";
+	}
+	for ( i = 0; i < (uint32_t)type->numParams; i++ ) {
+		if ( type->params[i] != WASM_I32 ) {
+			return "vmMain has a bad signature";
+		}
+	}
+
+	// start
+	s = &sections[ WSEC_START ];
+	start = -1;
+	if ( s->p ) {
+		start = WASM_ReadU32( s );
+		if ( (unsigned)start >= (unsigned)m->numFuncs ) {
+			return "bad start function";
+		}
+	}
+
+	// elements
+	s = &sections[ WSEC_ELEMENT ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	for ( i = 0; i < count && !s->error; i++ ) {
+		flags = WASM_ReadU32( s );
+		if ( flags > 3 ) {
+			return "unsupported element segment";
+		}
+		if ( flags & 2 ) {
+			if ( !( flags & 1 ) && WASM_ReadU32( s ) != 0 ) {
+				return "bad element table";
+			}
+		}
+		offset = 0;
+		if ( !( flags & 1 ) ) {
+			offset = WASM_ReadConstExpr( s, m ).u32;
+		}
+		if ( flags & 3 ) {
+			WASM_ReadByte( s );	// element kind
+		}
+		n = WASM_ReadU32( s );
+		if ( !( flags & 1 ) && ( offset > (uint32_t)m->tableSize || n > (uint32_t)m->tableSize - offset ) ) {
+			return "element segment out of bounds";
+		}
+		for ( j = 0; j < n && !s->error; j++ ) {
+			index = WASM_ReadU32( s );
+			if ( index >= (uint32_t)m->numFuncs ) {
+				return "bad element function";
+			}
+			// passive and declarative segments are not used
+			if ( !( flags & 1 ) ) {
+				m->table[ offset + j ] = index;
+			}
+		}
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// data
+	s = &sections[ WSEC_DATA ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	for ( i = 0; i < count && !s->error; i++ ) {
+		flags = WASM_ReadU32( s );
+		if ( flags > 2 ) {
+			return "unsupported data segment";
+		}
+		if ( flags == 2 && WASM_ReadU32( s ) != 0 ) {
+			return "bad data memory";
+		}
+		offset = 0;
+		if ( flags != 1 ) {
+			offset = WASM_ReadConstExpr( s, m ).u32;
+		}
+		n = WASM_ReadU32( s );
+		p = WASM_ReadBytes( s, n );
+		if ( flags == 1 || !p ) {
+			continue;
+		}
+		if ( offset > m->memorySize || n > m->memorySize - offset ) {
+			return "data segment out of bounds";
+		}
+		Com_Memcpy( vm->dataBase + offset, p, n );
+	}
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// code
+	s = &sections[ WSEC_CODE ];
+	count = s->p ? WASM_ReadU32( s ) : 0;
+	if ( count != (uint32_t)numDefined ) {
+		return "function and code sections do not match";
+	}
+
+	c = Hunk_AllocateTempMemory( sizeof( *c ) );
+	Com_Memset( c, 0, sizeof( *c ) );
+	c->m = m;
+	// every instruction takes at least a byte and emits at most one,
+	// function ends add the return
+	c->maxCode = ( s->p ? s->end - s->p : 0 ) + numDefined + 1;
+	c->code = Hunk_AllocateTempMemory( c->maxCode * sizeof( *c->code ) );
+
+	for ( i = 0; i < count && !s->error; i++ ) {
+		n = WASM_ReadU32( s );
+		p = WASM_ReadBytes( s, n );
+		if ( !p ) {
+			break;
+		}
+		if ( !WASM_CompileFunction( c, &m->funcs[ m->numImports + i ], p, n ) ) {
+			const char *error = va( "function %i: %s", m->numImports + i, c->error );
+			Hunk_FreeTempMemory( c->code );
+			Hunk_FreeTempMemory( c );
+			return error;
+		}
+	}
+
+	m->codeLength = c->codeLength;
+	m->code = Hunk_Alloc( ( m->codeLength + 1 ) * sizeof( *m->code ), h_high );
+	Com_Memcpy( m->code, c->code, m->codeLength * sizeof( *m->code ) );
+
+	Hunk_FreeTempMemory( c->code );
+	Hunk_FreeTempMemory( c );
+
+	if ( s->error ) {
+		return s->error;
+	}
+
+	// the function call stack
+	m->stack = Hunk_Alloc( WASM_STACK_SLOTS * sizeof( *m->stack ), h_high );
+	m->stackEnd = m->stack + WASM_STACK_SLOTS;
+	m->sp = m->stack;
+	m->frames = Hunk_Alloc( WASM_MAX_FRAMES * sizeof( *m->frames ), h_high );
+	m->numFrames = 0;
+
+	vm->wasm = m;
+	vm->codeLength = m->codeLength * sizeof( *m->code );
+	vm->instructionCount = m->codeLength;
+
+	if ( start >= 0 && !WASM_CallFunction( vm, start ) ) {
+		return "bad start function";
+	}
+	if ( init >= 0 && !WASM_CallFunction( vm, init ) ) {
+		return "bad _initialize function";
+	}
+
+	return NULL;
+}
+
+
+/*
+=================================================================
+
+EXECUTION
+
+=================================================================
+*/
+
+static void WASM_Trap( const vm_t *vm, const char *error ) {
+	Com_Error( ERR_DROP, "VM_CallWasm(%s): %s", vm->name, error );
+}
+
+
+static uint32_t WASM_Clz32( uint32_t x ) {
+	uint32_t n;
+
+	if ( !x ) {
+		return 32;
+	}
+	for ( n = 0; !( x & 0x80000000U ); n++ ) {
+		x <<= 1;
+	}
+	return n;
+}
+
+
+static uint32_t WASM_Ctz32( uint32_t x ) {
+	uint32_t n;
+
+	if ( !x ) {
+		return 32;
+	}
+	for ( n = 0; !( x & 1 ); n++ ) {
+		x >>= 1;
+	}
+	return n;
+}
+
+
+static uint32_t WASM_Popcnt32( uint32_t x ) {
+	x = x - ( ( x >> 1 ) & 0x55555555U );
+	x = ( x & 0x33333333U ) + ( ( x >> 2 ) & 0x33333333U );
+	x = ( x + ( x >> 4 ) ) & 0x0F0F0F0FU;
+	return ( x * 0x01010101U ) >> 24;
+}
+
+
+static uint64_t WASM_Clz64( uint64_t x ) {
+	if ( x >> 32 ) {
+		return WASM_Clz32( (uint32_t)( x >> 32 ) );
+	}
+	return 32 + WASM_Clz32( (uint32_t)x );
+}
+
+
+static uint64_t WASM_Ctz64( uint64_t x ) {
+	if ( (uint32_t)x ) {
+		return WASM_Ctz32( (uint32_t)x );
+	}
+	return 32 + WASM_Ctz32( (uint32_t)( x >> 32 ) );
+}
+
+
+// min and max propagate NaN and order -0 below +0
+static float WASM_MinF32( float a, float b ) {
+	if ( a != a || b != b ) {
+		return a + b;
+	}
+	if ( a == b ) {
+		return signbit( a ) ? a : b;
+	}
+	return a < b ? a : b;
+}
+
+
+static float WASM_MaxF32( float a, float b ) {
+	if ( a != a || b != b ) {
+		return a + b;
+	}
+	if ( a == b ) {
+		return signbit( a ) ? b : a;
+	}
+	return a > b ? a : b;
+}
+
+
+static double WASM_MinF64( double a, double b ) {
+	if ( a != a || b != b ) {
+		return a + b;
+	}
+	if ( a == b ) {
+		return signbit( a ) ? a : b;
+	}
+	return a < b ? a : b;
+}
+
+
+static double WASM_MaxF64( double a, double b ) {
+	if ( a != a || b != b ) {
+		return a + b;
+	}
+	if ( a == b ) {
+		return signbit( a ) ? b : a;
+	}
+	return a > b ? a : b;
+}
+
+
+// saturating conversions, every float converts to double exactly
+static int32_t WASM_SatI32( double d ) {
+	if ( d != d ) {
+		return 0;
+	}
+	if ( d <= -2147483648.0 ) {
+		return (int32_t)0x80000000U;
+	}
+	if ( d >= 2147483647.0 ) {
+		return 0x7FFFFFFF;
+	}
+	return (int32_t)d;
+}
+
+
+static uint32_t WASM_SatU32( double d ) {
+	if ( !( d > 0.0 ) ) {
+		return 0;
+	}
+	if ( d >= 4294967295.0 ) {
+		return 0xFFFFFFFFU;
+	}
+	return (uint32_t)d;
+}
+
+
+static int64_t WASM_SatI64( double d ) {
+	if ( d != d ) {
+		return 0;
+	}
+	if ( d <= -9223372036854775808.0 ) {
+		return (int64_t)0x8000000000000000ULL;
+	}
+	if ( d >= 9223372036854775808.0 ) {
+		return 0x7FFFFFFFFFFFFFFFLL;
+	}
+	return (int64_t)d;
+}
+
+
+static uint64_t WASM_SatU64( double d ) {
+	if ( !( d > 0.0 ) ) {
+		return 0;
+	}
+	if ( d >= 18446744073709551616.0 ) {
+		return 0xFFFFFFFFFFFFFFFFULL;
+	}
+	return (uint64_t)d;
+}
+
+
+/*
+=================
+WASM_CallHost
+
+Passes the arguments on top of the stack to the system call handler,
+returns the new stack top
+=================
+*/
+static wasmValue_t *WASM_CallHost( vm_t *vm, wasmModule_t *m, const wasmType_t *type, wasmValue_t *sp ) {
+	intptr_t	args[ WASM_MAX_SYSCALL_ARGS ];
+	intptr_t	r;
+	int			i;
+
+	// calls back into the module start above the arguments
+	m->sp = sp;
+
+	sp -= type->numParams;
+	for ( i = 0; i < type->numParams; i++ ) {
+		args[i] = sp[i].i32;
+	}
+	for ( ; i < WASM_MAX_SYSCALL_ARGS; i++ ) {
+		args[i] = 0;
+	}
+
+	r = vm->systemCall( args );
+
+	if ( type->numResults ) {
+		sp->u64 = 0;
+		sp->i32 = (int32_t)r;
+		sp++;
+	}
+
+	return sp;
+}
+
+
+#define WASM_LOAD_ADDR( size ) \
+	ea = (uint64_t)sp[-1].u32 + (uint64_t)ip->b; \
+	if ( ea + (size) > memSize ) goto out_of_bounds
+
+#define WASM_STORE_ADDR( size ) \
+	sp -= 2; \
+	ea = (uint64_t)sp[0].u32 + (uint64_t)ip->b; \
+	if ( ea + (size) > memSize ) goto out_of_bounds
+
+/*
+=================
+WASM_Execute
+
+Runs func with its arguments on top of the module stack, the results
+replace the arguments
+=================
+*/
+static void WASM_Execute( vm_t *vm, int func ) {
+	wasmModule_t		*m;
+	const wasmInstr_t	*code, *ip;
+	const wasmFunc_t	*f;
+	wasmValue_t			*sp, *fp, *dst;
+	byte				*mem;
+	uint64_t			ea, memSize;
+	uint32_t			index, n, len;
+	int					baseFrame;
+	float				f32;
+	double				f64;
+	int16_t				i16;
+	int32_t				i32;
+
+	m = vm->wasm;
+	code = m->code;
+	mem = vm->dataBase;
+	memSize = m->memorySize;
+	baseFrame = m->numFrames;
+
+	f = &m->funcs[ func ];
+	sp = m->sp;
+	fp = sp - m->types[ f->type ].numParams;
+	if ( fp + f->frameSize > m->stackEnd ) {
+		WASM_Trap( vm, "stack overflow" );
+	}
+	for ( ; sp < fp + f->numLocals; sp++ ) {
+		sp->u64 = 0;
+	}
+	ip = code + f->code;
+
+	for ( ;; ) {
+		switch ( ip->op ) {
+
+		case WOP_UNREACHABLE:
+			WASM_Trap( vm, "unreachable executed" );
+			break;
+
+		// control
+
+		case WOP_JUMP:
+			ip = code + ip->a;
+			continue;
+
+		case WOP_JUMP_IF:
+			if ( (--sp)->i32 ) {
+				ip = code + ip->a;
+				continue;
+			}
+			break;
+
+		case WOP_JUMP_UNLESS:
+			if ( !(--sp)->i32 ) {
+				ip = code + ip->a;
+				continue;
+			}
+			break;
+
+		case WOP_BRANCH_IF:
+			if ( !(--sp)->i32 ) {
+				break;
+			}
+			// fall through
+		case WOP_BRANCH:
+			n = (uint32_t)( ip->b >> 32 );
+			dst = fp + (int32_t)( ip->b & 0xFFFFFFFF );
+			for ( index = 0; index < n; index++ ) {
+				dst[ index ] = sp[ (int)index - (int)n ];
+			}
+			sp = dst + n;
+			ip = code + ip->a;
+			continue;
+
+		case WOP_BRANCH_TABLE:
+			index = (--sp)->u32;
+			if ( index > (uint32_t)ip->a ) {
+				index = ip->a;
+			}
+			ip += 1 + index;
+			continue;
+
+		case WOP_LEAVE:
+			n = ip->a;
+			for ( index = 0; index < n; index++ ) {
+				fp[ index ] = sp[ (int)index - (int)n ];
+			}
+			sp = fp + n;
+			if ( m->numFrames == baseFrame ) {
+				m->sp = sp;
+				return;
+			}
+			m->numFrames--;
+			ip = m->frames[ m->numFrames ].ip;
+			fp = m->frames[ m->numFrames ].fp;
+			continue;
+
+		case WOP_CALL_TABLE:
+			index = (--sp)->u32;
+			if ( index >= (uint32_t)m->tableSize || ( func = m->table[ index ] ) < 0 ) {
+				WASM_Trap( vm, "undefined table element" );
+			}
+			if ( m->types[ m->funcs[ func ].type ].canon != ip->a ) {
+				WASM_Trap( vm, "indirect call signature mismatch" );
+			}
+			if ( m->funcs[ func ].host ) {
+				goto call_host;
+			}
+			goto call;
+
+		case WOP_CALL:
+			func = ip->a;
+call:
+			f = &m->funcs[ func ];
+			if ( m->numFrames >= WASM_MAX_FRAMES ) {
+				WASM_Trap( vm, "call stack overflow" );
+			}
+			m->frames[ m->numFrames ].ip = ip + 1;
+			m->frames[ m->numFrames ].fp = fp;
+			m->numFrames++;
+			fp = sp - m->types[ f->type ].numParams;
+			if ( fp + f->frameSize > m->stackEnd ) {
+				WASM_Trap( vm, "stack overflow" );
+			}
+			for ( ; sp < fp + f->numLocals; sp++ ) {
+				sp->u64 = 0;
+			}
+			ip = code + f->code;
+			continue;
+
+		case WOP_CALL_HOST:
+			func = ip->a;
+call_host:
+			sp = WASM_CallHost( vm, m, &m->types[ m->funcs[ func ].type ], sp );
+			// the module may have been called again and grown its memory
+			memSize = m->memorySize;
+			break;
+
+		// parametric
+
+		case WOP_DROP:
+			sp--;
+			break;
+
+		case WOP_SELECT:
+			sp -= 2;
+			if ( !sp[1].i32 ) {
+				sp[-1] = sp[0];
+			}
+			break;
+
+		// variables
+
+		case WOP_LOCAL_GET:
+			*sp++ = fp[ ip->a ];
+			break;
+
+		case WOP_LOCAL_SET:
+			fp[ ip->a ] = *--sp;
+			break;
+
+		case WOP_LOCAL_TEE:
+			fp[ ip->a ] = sp[-1];
+			break;
+
+		case WOP_GLOBAL_GET:
+			*sp++ = m->globals[ ip->a ];
+			break;
+
+		case WOP_GLOBAL_SET:
+			m->globals[ ip->a ] = *--sp;
+			break;
+
+		// memory
+
+		case WOP_I32_LOAD:
+			WASM_LOAD_ADDR( 4 );
+			Com_Memcpy( &sp[-1].i32, mem + ea, 4 );
+			break;
+		case WOP_I64_LOAD:
+			WASM_LOAD_ADDR( 8 );
+			Com_Memcpy( &sp[-1].i64, mem + ea, 8 );
+			break;
+		case WOP_F32_LOAD:
+			WASM_LOAD_ADDR( 4 );
+			Com_Memcpy( &sp[-1].f32, mem + ea, 4 );
+			break;
+		case WOP_F64_LOAD:
+			WASM_LOAD_ADDR( 8 );
+			Com_Memcpy( &sp[-1].f64, mem + ea, 8 );
+			break;
+		case WOP_I32_LOAD8_S:
+			WASM_LOAD_ADDR( 1 );
+			sp[-1].i32 = (int8_t)mem[ ea ];
+			break;
+		case WOP_I32_LOAD8_U:
+			WASM_LOAD_ADDR( 1 );
+			sp[-1].i32 = mem[ ea ];
+			break;
+		case WOP_I32_LOAD16_S:
+			WASM_LOAD_ADDR( 2 );
+			Com_Memcpy( &i16, mem + ea, 2 );
+			sp[-1].i32 = i16;
+			break;
+		case WOP_I32_LOAD16_U:
+			WASM_LOAD_ADDR( 2 );
+			Com_Memcpy( &i16, mem + ea, 2 );
+			sp[-1].i32 = (uint16_t)i16;
+			break;
+		case WOP_I64_LOAD8_S:
+			WASM_LOAD_ADDR( 1 );
+			sp[-1].i64 = (int8_t)mem[ ea ];
+			break;
+		case WOP_I64_LOAD8_U:
+			WASM_LOAD_ADDR( 1 );
+			sp[-1].i64 = mem[ ea ];
+			break;
+		case WOP_I64_LOAD16_S:
+			WASM_LOAD_ADDR( 2 );
+			Com_Memcpy( &i16, mem + ea, 2 );
+			sp[-1].i64 = i16;
+			break;
+		case WOP_I64_LOAD16_U:
+			WASM_LOAD_ADDR( 2 );
+			Com_Memcpy( &i16, mem + ea, 2 );
+			sp[-1].i64 = (uint16_t)i16;
+			break;
+		case WOP_I64_LOAD32_S:
+			WASM_LOAD_ADDR( 4 );
+			Com_Memcpy( &i32, mem + ea, 4 );
+			sp[-1].i64 = i32;
+			break;
+		case WOP_I64_LOAD32_U:
+			WASM_LOAD_ADDR( 4 );
+			Com_Memcpy( &i32, mem + ea, 4 );
+			sp[-1].i64 = (uint32_t)i32;
+			break;
+
+		case WOP_I32_STORE:
+		case WOP_F32_STORE:
+		case WOP_I64_STORE32:
+			WASM_STORE_ADDR( 4 );
+			Com_Memcpy( mem + ea, &sp[1].i32, 4 );
+			break;
+		case WOP_I64_STORE:
+		case WOP_F64_STORE:
+			WASM_STORE_ADDR( 8 );
+			Com_Memcpy( mem + ea, &sp[1].i64, 8 );
+			break;
+		case WOP_I32_STORE8:
+		case WOP_I64_STORE8:
+			WASM_STORE_ADDR( 1 );
+			mem[ ea ] = (byte)sp[1].u32;
+			break;
+		case WOP_I32_STORE16:
+		case WOP_I64_STORE16:
+			WASM_STORE_ADDR( 2 );
+			i16 = (int16_t)sp[1].u32;
+			Com_Memcpy( mem + ea, &i16, 2 );
+			break;
+
+		case WOP_MEMORY_SIZE:
+			sp->u64 = 0;
+			sp->u32 = m->memorySize / WASM_PAGE_SIZE;
+			sp++;
+			break;
+
+		case WOP_MEMORY_GROW:
+			n = sp[-1].u32;
+			if ( n <= ( m->memoryMax - m->memorySize ) / WASM_PAGE_SIZE ) {
+				sp[-1].u32 = m->memorySize / WASM_PAGE_SIZE;
+				// system calls may have left data in the reserve
+				Com_Memset( mem + m->memorySize, 0, n * WASM_PAGE_SIZE );
+				m->memorySize += n * WASM_PAGE_SIZE;
+				vm->dataLength = m->memorySize;
+				memSize = m->memorySize;
+			} else {
+				sp[-1].i32 = -1;
+			}
+			break;
+
+		case WOP_MEMORY_COPY:
+			sp -= 3;
+			len = sp[2].u32;
+			if ( (uint64_t)sp[0].u32 + len > memSize || (uint64_t)sp[1].u32 + len > memSize ) {
+				goto out_of_bounds;
+			}
+			memmove( mem + sp[0].u32, mem + sp[1].u32, len );
+			break;
+
+		case WOP_MEMORY_FILL:
+			sp -= 3;
+			len = sp[2].u32;
+			if ( (uint64_t)sp[0].u32 + len > memSize ) {
+				goto out_of_bounds;
+			}
+			Com_Memset( mem + sp[0].u32, sp[1].u32 & 255, len );
+			break;
+
+		// constants keep their bits in b
+
+		case WOP_I32_CONST:
+		case WOP_I64_CONST:
+		case WOP_F32_CONST:
+		case WOP_F64_CONST:
+			sp->i64 = ip->b;
+			sp++;
+			break;
+
+		// comparisons
+
+		case WOP_I32_EQZ:	sp[-1].i32 = ( sp[-1].i32 == 0 ); break;
+		case WOP_I32_EQ:	sp--; sp[-1].i32 = ( sp[-1].i32 == sp[0].i32 ); break;
+		case WOP_I32_NE:	sp--; sp[-1].i32 = ( sp[-1].i32 != sp[0].i32 ); break;
+		case WOP_I32_LT_S:	sp--; sp[-1].i32 = ( sp[-1].i32 < sp[0].i32 ); break;
+		case WOP_I32_LT_U:	sp--; sp[-1].i32 = ( sp[-1].u32 < sp[0].u32 ); break;
+		case WOP_I32_GT_S:	sp--; sp[-1].i32 = ( sp[-1].i32 > sp[0].i32 ); break;
+		case WOP_I32_GT_U:	sp--; sp[-1].i32 = ( sp[-1].u32 > sp[0].u32 ); break;
+		case WOP_I32_LE_S:	sp--; sp[-1].i32 = ( sp[-1].i32 <= sp[0].i32 ); break;
+		case WOP_I32_LE_U:	sp--; sp[-1].i32 = ( sp[-1].u32 <= sp[0].u32 ); break;
+		case WOP_I32_GE_S:	sp--; sp[-1].i32 = ( sp[-1].i32 >= sp[0].i32 ); break;
+		case WOP_I32_GE_U:	sp--; sp[-1].i32 = ( sp[-1].u32 >= sp[0].u32 ); break;
+
+		case WOP_I64_EQZ:	sp[-1].i32 = ( sp[-1].i64 == 0 ); break;
+		case WOP_I64_EQ:	sp--; sp[-1].i32 = ( sp[-1].i64 == sp[0].i64 ); break;
+		case WOP_I64_NE:	sp--; sp[-1].i32 = ( sp[-1].i64 != sp[0].i64 ); break;
+		case WOP_I64_LT_S:	sp--; sp[-1].i32 = ( sp[-1].i64 < sp[0].i64 ); break;
+		case WOP_I64_LT_U:	sp--; sp[-1].i32 = ( sp[-1].u64 < sp[0].u64 ); break;
+		case WOP_I64_GT_S:	sp--; sp[-1].i32 = ( sp[-1].i64 > sp[0].i64 ); break;
+		case WOP_I64_GT_U:	sp--; sp[-1].i32 = ( sp[-1].u64 > sp[0].u64 ); break;
+		case WOP_I64_LE_S:	sp--; sp[-1].i32 = ( sp[-1].i64 <= sp[0].i64 ); break;
+		case WOP_I64_LE_U:	sp--; sp[-1].i32 = ( sp[-1].u64 <= sp[0].u64 ); break;
+		case WOP_I64_GE_S:	sp--; sp[-1].i32 = ( sp[-1].i64 >= sp[0].i64 ); break;
+		case WOP_I64_GE_U:	sp--; sp[-1].i32 = ( sp[-1].u64 >= sp[0].u64 ); break;
+
+		case WOP_F32_EQ:	sp--; sp[-1].i32 = ( sp[-1].f32 == sp[0].f32 ); break;
+		case WOP_F32_NE:	sp--; sp[-1].i32 = ( sp[-1].f32 != sp[0].f32 ); break;
+		case WOP_F32_LT:	sp--; sp[-1].i32 = ( sp[-1].f32 < sp[0].f32 ); break;
+		case WOP_F32_GT:	sp--; sp[-1].i32 = ( sp[-1].f32 > sp[0].f32 ); break;
+		case WOP_F32_LE:	sp--; sp[-1].i32 = ( sp[-1].f32 <= sp[0].f32 ); break;
+		case WOP_F32_GE:	sp--; sp[-1].i32 = ( sp[-1].f32 >= sp[0].f32 ); break;
+
+		case WOP_F64_EQ:	sp--; sp[-1].i32 = ( sp[-1].f64 == sp[0].f64 ); break;
+		case WOP_F64_NE:	sp--; sp[-1].i32 = ( sp[-1].f64 != sp[0].f64 ); break;
+		case WOP_F64_LT:	sp--; sp[-1].i32 = ( sp[-1].f64 < sp[0].f64 ); break;
+		case WOP_F64_GT:	sp--; sp[-1].i32 = ( sp[-1].f64 > sp[0].f64 ); break;
+		case WOP_F64_LE:	sp--; sp[-1].i32 = ( sp[-1].f64 <= sp[0].f64 ); break;
+		case WOP_F64_GE:	sp--; sp[-1].i32 = ( sp[-1].f64 >= sp[0].f64 ); break;
+
+		// 32 bit integer arithmetic
+
+		case WOP_I32_CLZ:		sp[-1].u32 = WASM_Clz32( sp[-1].u32 ); break;
+		case WOP_I32_CTZ:		sp[-1].u32 = WASM_Ctz32( sp[-1].u32 ); break;
+		case WOP_I32_POPCNT:	sp[-1].u32 = WASM_Popcnt32( sp[-1].u32 ); break;
+		case WOP_I32_ADD:	sp--; sp[-1].u32 += sp[0].u32; break;
+		case WOP_I32_SUB:	sp--; sp[-1].u32 -= sp[0].u32; break;
+		case WOP_I32_MUL:	sp--; sp[-1].u32 *= sp[0].u32; break;
+		case WOP_I32_DIV_S:
+			sp--;
+			if ( sp[0].i32 == 0 ) {
+				goto divide_by_zero;
+			}
+			if ( sp[0].i32 == -1 && sp[-1].u32 == 0x80000000U ) {
+				goto overflow;
+			}
+			sp[-1].i32 /= sp[0].i32;
+			break;
+		case WOP_I32_DIV_U:
+			sp--;
+			if ( sp[0].u32 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].u32 /= sp[0].u32;
+			break;
+		case WOP_I32_REM_S:
+			sp--;
+			if ( sp[0].i32 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].i32 = ( sp[0].i32 == -1 ) ? 0 : sp[-1].i32 % sp[0].i32;
+			break;
+		case WOP_I32_REM_U:
+			sp--;
+			if ( sp[0].u32 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].u32 %= sp[0].u32;
+			break;
+		case WOP_I32_AND:	sp--; sp[-1].u32 &= sp[0].u32; break;
+		case WOP_I32_OR:	sp--; sp[-1].u32 |= sp[0].u32; break;
+		case WOP_I32_XOR:	sp--; sp[-1].u32 ^= sp[0].u32; break;
+		case WOP_I32_SHL:	sp--; sp[-1].u32 <<= ( sp[0].u32 & 31 ); break;
+		case WOP_I32_SHR_S:	sp--; sp[-1].i32 >>= ( sp[0].u32 & 31 ); break;
+		case WOP_I32_SHR_U:	sp--; sp[-1].u32 >>= ( sp[0].u32 & 31 ); break;
+		case WOP_I32_ROTL:
+			sp--;
+			n = sp[0].u32 & 31;
+			sp[-1].u32 = ( sp[-1].u32 << n ) | ( sp[-1].u32 >> ( ( 32 - n ) & 31 ) );
+			break;
+		case WOP_I32_ROTR:
+			sp--;
+			n = sp[0].u32 & 31;
+			sp[-1].u32 = ( sp[-1].u32 >> n ) | ( sp[-1].u32 << ( ( 32 - n ) & 31 ) );
+			break;
+
+		// 64 bit integer arithmetic
+
+		case WOP_I64_CLZ:		sp[-1].u64 = WASM_Clz64( sp[-1].u64 ); break;
+		case WOP_I64_CTZ:		sp[-1].u64 = WASM_Ctz64( sp[-1].u64 ); break;
+		case WOP_I64_POPCNT:	sp[-1].u64 = WASM_Popcnt32( (uint32_t)sp[-1].u64 ) + WASM_Popcnt32( (uint32_t)( sp[-1].u64 >> 32 ) ); break;
+		case WOP_I64_ADD:	sp--; sp[-1].u64 += sp[0].u64; break;
+		case WOP_I64_SUB:	sp--; sp[-1].u64 -= sp[0].u64; break;
+		case WOP_I64_MUL:	sp--; sp[-1].u64 *= sp[0].u64; break;
+		case WOP_I64_DIV_S:
+			sp--;
+			if ( sp[0].i64 == 0 ) {
+				goto divide_by_zero;
+			}
+			if ( sp[0].i64 == -1 && sp[-1].u64 == 0x8000000000000000ULL ) {
+				goto overflow;
+			}
+			sp[-1].i64 /= sp[0].i64;
+			break;
+		case WOP_I64_DIV_U:
+			sp--;
+			if ( sp[0].u64 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].u64 /= sp[0].u64;
+			break;
+		case WOP_I64_REM_S:
+			sp--;
+			if ( sp[0].i64 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].i64 = ( sp[0].i64 == -1 ) ? 0 : sp[-1].i64 % sp[0].i64;
+			break;
+		case WOP_I64_REM_U:
+			sp--;
+			if ( sp[0].u64 == 0 ) {
+				goto divide_by_zero;
+			}
+			sp[-1].u64 %= sp[0].u64;
+			break;
+		case WOP_I64_AND:	sp--; sp[-1].u64 &= sp[0].u64; break;
+		case WOP_I64_OR:	sp--; sp[-1].u64 |= sp[0].u64; break;
+		case WOP_I64_XOR:	sp--; sp[-1].u64 ^= sp[0].u64; break;
+		case WOP_I64_SHL:	sp--; sp[-1].u64 <<= ( sp[0].u64 & 63 ); break;
+		case WOP_I64_SHR_S:	sp--; sp[-1].i64 >>= ( sp[0].u64 & 63 ); break;
+		case WOP_I64_SHR_U:	sp--; sp[-1].u64 >>= ( sp[0].u64 & 63 ); break;
+		case WOP_I64_ROTL:
+			sp--;
+			n = sp[0].u64 & 63;
+			sp[-1].u64 = ( sp[-1].u64 << n ) | ( sp[-1].u64 >> ( ( 64 - n ) & 63 ) );
+			break;
+		case WOP_I64_ROTR:
+			sp--;
+			n = sp[0].u64 & 63;
+			sp[-1].u64 = ( sp[-1].u64 >> n ) | ( sp[-1].u64 << ( ( 64 - n ) & 63 ) );
+			break;
+
+		// floating point, sign operations only touch the sign bit
+
+		case WOP_F32_ABS:		sp[-1].u32 &= 0x7FFFFFFFU; break;
+		case WOP_F32_NEG:		sp[-1].u32 ^= 0x80000000U; break;
+		case WOP_F32_CEIL:		sp[-1].f32 = ceilf( sp[-1].f32 ); break;
+		case WOP_F32_FLOOR:		sp[-1].f32 = floorf( sp[-1].f32 ); break;
+		case WOP_F32_TRUNC:		sp[-1].f32 = truncf( sp[-1].f32 ); break;
+		case WOP_F32_NEAREST:	sp[-1].f32 = rintf( sp[-1].f32 ); break;
+		case WOP_F32_SQRT:		sp[-1].f32 = sqrtf( sp[-1].f32 ); break;
+		case WOP_F32_ADD:	sp--; sp[-1].f32 += sp[0].f32; break;
+		case WOP_F32_SUB:	sp--; sp[-1].f32 -= sp[0].f32; break;
+		case WOP_F32_MUL:	sp--; sp[-1].f32 *= sp[0].f32; break;
+		case WOP_F32_DIV:	sp--; sp[-1].f32 /= sp[0].f32; break;
+		case WOP_F32_MIN:	sp--; sp[-1].f32 = WASM_MinF32( sp[-1].f32, sp[0].f32 ); break;
+		case WOP_F32_MAX:	sp--; sp[-1].f32 = WASM_MaxF32( sp[-1].f32, sp[0].f32 ); break;
+		case WOP_F32_COPYSIGN:
+			sp--;
+			sp[-1].u32 = ( sp[-1].u32 & 0x7FFFFFFFU ) | ( sp[0].u32 & 0x80000000U );
+			break;
+
+		case WOP_F64_ABS:		sp[-1].u64 &= 0x7FFFFFFFFFFFFFFFULL; break;
+		case WOP_F64_NEG:		sp[-1].u64 ^= 0x8000000000000000ULL; break;
+		case WOP_F64_CEIL:		sp[-1].f64 = ceil( sp[-1].f64 ); break;
+		case WOP_F64_FLOOR:		sp[-1].f64 = floor( sp[-1].f64 ); break;
+		case WOP_F64_TRUNC:		sp[-1].f64 = trunc( sp[-1].f64 ); break;
+		case WOP_F64_NEAREST:	sp[-1].f64 = rint( sp[-1].f64 ); break;
+		case WOP_F64_SQRT:		sp[-1].f64 = sqrt( sp[-1].f64 ); break;
+		case WOP_F64_ADD:	sp--; sp[-1].f64 += sp[0].f64; break;
+		case WOP_F64_SUB:	sp--; sp[-1].f64 -= sp[0].f64; break;
+		case WOP_F64_MUL:	sp--; sp[-1].f64 *= sp[0].f64; break;
+		case WOP_F64_DIV:	sp--; sp[-1].f64 /= sp[0].f64; break;
+		case WOP_F64_MIN:	sp--; sp[-1].f64 = WASM_MinF64( sp[-1].f64, sp[0].f64 ); break;
+		case WOP_F64_MAX:	sp--; sp[-1].f64 = WASM_MaxF64( sp[-1].f64, sp[0].f64 ); break;
+		case WOP_F64_COPYSIGN:
+			sp--;
+			sp[-1].u64 = ( sp[-1].u64 & 0x7FFFFFFFFFFFFFFFULL ) | ( sp[0].u64 & 0x8000000000000000ULL );
+			break;
+
+		// conversions
+
+		case WOP_I32_WRAP_I64:
+			sp[-1].u32 = (uint32_t)sp[-1].u64;
+			break;
+		case WOP_I32_TRUNC_F32_S:
+			f32 = sp[-1].f32;
+			if ( !( f32 >= -2147483648.0f && f32 < 2147483648.0f ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].i32 = (int32_t)f32;
+			break;
+		case WOP_I32_TRUNC_F32_U:
+			f32 = sp[-1].f32;
+			if ( !( f32 > -1.0f && f32 < 4294967296.0f ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].u32 = (uint32_t)f32;
+			break;
+		case WOP_I32_TRUNC_F64_S:
+			f64 = sp[-1].f64;
+			if ( !( f64 > -2147483649.0 && f64 < 2147483648.0 ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].i32 = (int32_t)f64;
+			break;
+		case WOP_I32_TRUNC_F64_U:
+			f64 = sp[-1].f64;
+			if ( !( f64 > -1.0 && f64 < 4294967296.0 ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].u32 = (uint32_t)f64;
+			break;
+		case WOP_I64_EXTEND_I32_S:
+			sp[-1].i64 = sp[-1].i32;
+			break;
+		case WOP_I64_EXTEND_I32_U:
+			sp[-1].u64 = sp[-1].u32;
+			break;
+		case WOP_I64_TRUNC_F32_S:
+			f32 = sp[-1].f32;
+			if ( !( f32 >= -9223372036854775808.0f && f32 < 9223372036854775808.0f ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].i64 = (int64_t)f32;
+			break;
+		case WOP_I64_TRUNC_F32_U:
+			f32 = sp[-1].f32;
+			if ( !( f32 > -1.0f && f32 < 18446744073709551616.0f ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].u64 = (uint64_t)f32;
+			break;
+		case WOP_I64_TRUNC_F64_S:
+			f64 = sp[-1].f64;
+			if ( !( f64 >= -9223372036854775808.0 && f64 < 9223372036854775808.0 ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].i64 = (int64_t)f64;
+			break;
+		case WOP_I64_TRUNC_F64_U:
+			f64 = sp[-1].f64;
+			if ( !( f64 > -1.0 && f64 < 18446744073709551616.0 ) ) {
+				goto bad_conversion;
+			}
+			sp[-1].u64 = (uint64_t)f64;
+			break;
+		case WOP_F32_CONVERT_I32_S:	sp[-1].f32 = (float)sp[-1].i32; break;
+		case WOP_F32_CONVERT_I32_U:	sp[-1].f32 = (float)sp[-1].u32; break;
+		case WOP_F32_CONVERT_I64_S:	sp[-1].f32 = (float)sp[-1].i64; break;
+		case WOP_F32_CONVERT_I64_U:	sp[-1].f32 = (float)sp[-1].u64; break;
+		case WOP_F32_DEMOTE_F64:	sp[-1].f32 = (float)sp[-1].f64; break;
+		case WOP_F64_CONVERT_I32_S:	sp[-1].f64 = (double)sp[-1].i32; break;
+		case WOP_F64_CONVERT_I32_U:	sp[-1].f64 = (double)sp[-1].u32; break;
+		case WOP_F64_CONVERT_I64_S:	sp[-1].f64 = (double)sp[-1].i64; break;
+		case WOP_F64_CONVERT_I64_U:	sp[-1].f64 = (double)sp[-1].u64; break;
+		case WOP_F64_PROMOTE_F32:	sp[-1].f64 = (double)sp[-1].f32; break;
+		case WOP_I32_EXTEND8_S:		sp[-1].i32 = (int8_t)sp[-1].u32; break;
+		case WOP_I32_EXTEND16_S:	sp[-1].i32 = (int16_t)sp[-1].u32; break;
+		case WOP_I64_EXTEND8_S:		sp[-1].i64 = (int8_t)sp[-1].u64; break;
+		case WOP_I64_EXTEND16_S:	sp[-1].i64 = (int16_t)sp[-1].u64; break;
+		case WOP_I64_EXTEND32_S:	sp[-1].i64 = (int32_t)sp[-1].u64; break;
+
+		case WOP_I32_TRUNC_SAT_F32_S:	sp[-1].i32 = WASM_SatI32( sp[-1].f32 ); break;
+		case WOP_I32_TRUNC_SAT_F32_U:	sp[-1].u32 = WASM_SatU32( sp[-1].f32 ); break;
+		case WOP_I32_TRUNC_SAT_F64_S:	sp[-1].i32 = WASM_SatI32( sp[-1].f64 ); break;
+		case WOP_I32_TRUNC_SAT_F64_U:	sp[-1].u32 = WASM_SatU32( sp[-1].f64 ); break;
+		case WOP_I64_TRUNC_SAT_F32_S:	sp[-1].i64 = WASM_SatI64( sp[-1].f32 ); break;
+		case WOP_I64_TRUNC_SAT_F32_U:	sp[-1].u64 = WASM_SatU64( sp[-1].f32 ); break;
+		case WOP_I64_TRUNC_SAT_F64_S:	sp[-1].i64 = WASM_SatI64( sp[-1].f64 ); break;
+		case WOP_I64_TRUNC_SAT_F64_U:	sp[-1].u64 = WASM_SatU64( sp[-1].f64 ); break;
+
+		default:
+			WASM_Trap( vm, va( "bad opcode %i", ip->op ) );
+			break;
+		}
+		ip++;
+	}
+
+out_of_bounds:
+	WASM_Trap( vm, "out of bounds memory access" );
+divide_by_zero:
+	WASM_Trap( vm, "integer divide by zero" );
+overflow:
+	WASM_Trap( vm, "integer overflow" );
+bad_conversion:
+	WASM_Trap( vm, "invalid conversion to integer" );
+}
+
+
+/*
+=================
+WASM_CallFunction
+
+Runs a function without parameters or results, for initialization
+=================
+*/
+static qboolean WASM_CallFunction( vm_t *vm, int func ) {
+	wasmModule_t		*m;
+	const wasmType_t	*type;
+	wasmValue_t			*sp;
+
+	m = vm->wasm;
+	type = &m->types[ m->funcs[ func ].type ];
+	if ( m->funcs[ func ].host || type->numParams || type->numResults ) {
+		return qfalse;
+	}
+
+	sp = m->sp;
+	WASM_Execute( vm, func );
+	m->sp = sp;
+
+	return qtrue;
+}
+
+
+/*
+=================
+VM_CallWasm
+
+Calls vmMain of the module, args[0] is the command
+=================
+*/
+int VM_CallWasm( vm_t *vm, int nargs, int *args ) {
+	wasmModule_t		*m;
+	const wasmType_t	*type;
+	wasmValue_t			*sp;
+	int					i, r;
+
+	m = vm->wasm;
+	type = &m->types[ m->funcs[ m->entry ].type ];
+
+	// a previous call may have been left by an error
+	if ( vm->callLevel <= 1 ) {
+		m->sp = m->stack;
+		m->numFrames = 0;
+	}
+
+	sp = m->sp;
+	if ( sp + type->numParams > m->stackEnd ) {
+		WASM_Trap( vm, "stack overflow" );
+	}
+	for ( i = 0; i < type->numParams; i++ ) {
+		sp[i].u64 = 0;
+		sp[i].i32 = ( i < nargs ) ? args[i] : 0;
+	}
+	m->sp = sp + type->numParams;
+
+	WASM_Execute( vm, m->entry );
+
+	r = type->numResults ? sp[0].i32 : 0;
+	m->sp = sp;
+
+	return r;
+}
+
+
+/*
+=================
+VM_LoadWasm
+
+Loads vm/<name>.wasm, returns qfalse if there is none or it can't be used
+=================
+*/
+qboolean VM_LoadWasm( vm_t *vm ) {
+	char			filename[ MAX_QPATH ];
+	wasmModule_t	*m;
+	const char		*error;
+	void			*buf;
+	int				length;
+	int				hunkLow, hunkHigh;
+
+	Com_sprintf( filename, sizeof( filename ), "vm/%s.wasm", vm->name );
+	Com_Printf( "Loading wasm file %s...\n", filename );
+	length = FS_ReadFile( filename, &buf );
+	if ( !buf ) {
+		Com_Printf( "Failed.\n" );
+		return qfalse;
+	}
+
+	vm->crc32sum = crc32_buffer( (const byte *)buf, length );
+
+	Hunk_GetPermanent( &hunkLow, &hunkHigh );
+
+	m = Hunk_Alloc( sizeof( *m ), h_high );
+	error = WASM_Parse( vm, m, (const byte *)buf, length );
+
+	FS_FreeFile( buf );
+
+	if ( error ) {
+		Com_Printf( S_COLOR_RED "%s: %s\n", filename, error );
+		// give back the module and memory parsed so far
+		if ( !Hunk_Rewind( hunkLow, hunkHigh ) ) {
+			Com_DPrintf( S_COLOR_YELLOW "%s: couldn't release hunk memory\n", filename );
+		}
+		vm->wasm = NULL;
+		vm->dataBase = NULL;
+		vm->dataMask = 0;
+		vm->dataLength = 0;
+		vm->dataAlloc = 0;
+		vm->codeLength = 0;
+		vm->instructionCount = 0;
+		return qfalse;
+	}
+
+	return qtrue;
+}
@@ -54,7 +54,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #endif
 
 
-static void *VM_Alloc_Compiled( vm_t *vm, int codeLength, int tableLength );
+static byte *VM_Alloc_Code( int length );
+static void VM_Free_Code( byte *ptr, int length );
 static void VM_Destroy_Compiled( vm_t *vm );
 
 /*
@@ -194,6 +195,19 @@ static	ELastCommand	LastCommand;
 
 int		funcOffset[FUNC_LAST];
 
+static	const char	*compileError;
+#if idx64
+static	int		optLevel;		// 0 - baseline, 1 - optimizing tier, 2 - plus inlining and local constants
+static	int		optBase;		// level of functions not listed in hotFunctions
+static	const byte	*hotFunctions;	// per instruction, set at OP_ENTER of functions to optimize at level 2
+static	int		*profileCounters;	// incremented at every jump target when not NULL
+#endif
+
+static	qboolean	recordRelocs;	// for vm_cache, main thread only
+static	vmReloc_t	*relocs;		// absolute addresses emitted in the final pass
+static	int			numRelocs;
+static	int			maxRelocs;
+
 #ifdef DEBUG_VM
 static int	errParam = 0;
 #endif
@@ -302,8 +316,20 @@ static void Emit8( int64_t v )
 #endif
 
 
+static void EmitReloc( int size )
+{
+	if ( relocs && code && numRelocs < maxRelocs )
+	{
+		relocs[ numRelocs ].offset = compiledOfs;
+		relocs[ numRelocs ].size = size;
+	}
+	numRelocs++;
+}
+
+
 static void EmitPtr( const void *ptr )
 {
+	EmitReloc( sizeof( intptr_t ) );
 #if idx64
 	Emit8( (intptr_t)ptr );
 #else
@@ -312,6 +338,15 @@ static void EmitPtr( const void *ptr )
 }
 
 
+#if idx64
+static void EmitPtr4( const void *ptr )
+{
+	EmitReloc( 4 );
+	Emit4( (intptr_t)ptr );
+}
+#endif
+
+
 static int Hex( int c )
 {
 	if ( c >= '0' && c <= '9' ) {
@@ -914,7 +949,7 @@ funcOffset[FUNC_SYSC] = compiledOfs;
 		EmitPtr( &vm->programStack );
 	} else {
 		EmitString( "BA" );					// mov edx, &vm->programStack
-		Emit4( (intptr_t)&vm->programStack );
+		EmitPtr4( &vm->programStack );
 	}
 	//EmitString( "8D 46 FC" );				// lea eax, [esi-4]
 	EmitString( "8D 46 F8" );				// lea eax, [esi-8]
@@ -1901,963 +1936,2723 @@ static qboolean EmitMOPs( vm_t *vm, int op )
 }
 
 
+#if idx64
 /*
-=================
-VM_Compile
-=================
-*/
-qboolean VM_Compile( vm_t *vm, vmHeader_t *header ) {
-	const char	*errMsg;
-	int		instructionCount;
-	int		proc_base;
-	int		proc_len;
-	int		i, n, v;
-	qboolean	wantres;
+=================================================================
 
-	inst = (instruction_t*)Z_Malloc( (header->instructionCount + 8 ) * sizeof( instruction_t ) );
-	instructionOffsets = (int*)Z_Malloc( header->instructionCount * sizeof( int ) );
+OPTIMIZING TIER (vm_optimize)
 
-	errMsg = VM_LoadInstructions( (byte *) header + header->codeOffset, header->codeLength, header->instructionCount, inst );
-	if ( !errMsg ) {
-		errMsg = VM_CheckInstructions( inst, vm->instructionCount, vm->jumpTableTargets, vm->numJumpTableTargets, vm->exactDataLength );
-	}
-	if ( errMsg ) {
-		VM_FreeBuffers();
-		Com_Printf( "VM_CompileX86 error: %s\n", errMsg );
-		return qfalse;
-	}
+Values pushed inside a basic block are tracked on a compile-time stack of
+constants, local addresses, not yet loaded locals and registers instead of
+going through opStack memory, so operations work on registers and floats
+stay in xmm registers between float operations. Pending values are written
+to the opStack only before instructions this tier does not handle, before
+jump labels and before branches, so at those points opStack layout is
+exactly what the baseline code expects.
 
-	VM_ReplaceInstructions( vm, inst );
+Hot functions of tiered modules (vm_tiered) are compiled at level 2 which
+also remembers constants stored to locals until the end of the basic block
+and expands calls to small leaf functions without branches in place.
 
-	VM_FindMOps( inst, vm->instructionCount );
+=================================================================
+*/
 
-	code = NULL; // we will allocate memory later, after last defined pass
-	instructionPointers = NULL;
+#define OPT_MAX_ITEMS	4
+#define OPT_MAX_KNOWN	8
+#define OPT_INLINE_MAX	32	// instructions in body of inlined function
 
-	memset( funcOffset, 0, sizeof( funcOffset ) );
+typedef enum {
+	IT_CONST,		// immediate value
+	IT_LOCAL,		// programStack + value
+	IT_LOCALVAL,	// dword ptr [ebp + value], not loaded yet
+	IT_REG,			// general purpose register
+	IT_XMM			// sse register
+} itemType_t;
+
+typedef struct {
+	itemType_t	type;
+	int			value;
+} optItem_t;
 
-	instructionCount = header->instructionCount;
+typedef enum {
+	RM_REG,			// register
+	RM_LOCAL,		// [rbp + disp]
+	RM_PSTACK,		// [rsi + disp]
+	RM_OPSTACK,		// [rdi + disp]
+	RM_DATA,		// [rbx + disp]
+	RM_INDEX		// [rbx + reg]
+} rmType_t;
+
+// eax, ecx, edx, r10d, r11d, r15d - everything else is reserved by the baseline code
+static const int rxPool[] = { 0, 1, 2, 10, 11, 15 };
+// xmm6 and above are callee-saved in win64 ABI
+static const int sxPool[] = { 0, 1, 2, 3, 4, 5 };
+
+static optItem_t	optStack[ OPT_MAX_ITEMS + 1 ];
+static int			optDepth;	// number of tracked items
+static int			optDelta;	// pending edi adjustment, in bytes
+
+static struct {
+	int		offset;
+	int		value;
+} optKnown[ OPT_MAX_KNOWN ];	// locals holding known constants
+static int			optNumKnown;
+
+static int			optInlineEnter;		// OP_ENTER of function being inlined
+static int			optInlineLeave;		// its OP_LEAVE, -1 when not inlining
+static int			optInlineReturn;	// instruction after the call
+static int			optInlineOffsets[ OPT_INLINE_MAX + 2 ];
 
-	for( pass = 0; pass < NUM_PASSES; pass++ )
-	{
-__compile:
-	pop1 = OP_UNDEF;
-	lastConst = 0;
 
-	// translate all instructions
-	ip = 0;
-	compiledOfs = 0;
-	LastCommand = LAST_COMMAND_NONE;
+/*
+=================
+EmitRM
 
-	proc_base = -1;
-	proc_len = 0;
+[prefix] [rex] opcode modrm [sib] [disp], reg may be an opcode extension
+=================
+*/
+static void EmitRM( const char *prefix, const char *opcode, int reg, rmType_t type, int rm )
+{
+	int rex, base;
+
+	if ( prefix )
+		EmitString( prefix );
+
+	rex = 0;
+	if ( reg & 8 )
+		rex |= 4; // REX.R
+	if ( type == RM_REG && ( rm & 8 ) )
+		rex |= 1; // REX.B
+	if ( type == RM_INDEX && ( rm & 8 ) )
+		rex |= 2; // REX.X
+	if ( rex )
+		Emit1( 0x40 | rex );
+
+	EmitString( opcode );
+
+	reg = ( reg & 7 ) << 3;
+	switch ( type ) {
+		case RM_REG:
+			Emit1( 0xC0 | reg | ( rm & 7 ) );
+			break;
+		case RM_INDEX:
+			Emit1( 0x04 | reg );					// SIB follows
+			Emit1( ( ( rm & 7 ) << 3 ) | 3 );		// [rbx + index]
+			break;
+		default:
+			switch ( type ) {
+				case RM_LOCAL:	base = 5; break;	// rbp
+				case RM_PSTACK:	base = 6; break;	// rsi
+				case RM_OPSTACK:base = 7; break;	// rdi
+				default:		base = 3; break;	// rbx
+			}
+			// always with displacement as [rbp] encodes rip-relative addressing
+			if ( ISS8( rm ) ) {
+				Emit1( 0x40 | reg | base );
+				Emit1( rm );
+			} else {
+				Emit1( 0x80 | reg | base );
+				Emit4( rm );
+			}
+			break;
+	}
+}
 
-#if idx64
 
-	EmitString( "53" );				// push rbx
-	EmitString( "56" );				// push rsi
-	EmitString( "57" );				// push rdi
-	EmitString( "55" );				// push rbp
-	EmitString( "41 54" );			// push r12
-	EmitString( "41 55" );			// push r13
-	EmitString( "41 56" );			// push r14
-	EmitString( "41 57" );			// push r15
+static void EmitMovRxImm( int r, int v )
+{
+	if ( v == 0 ) {
+		EmitRM( NULL, "31", r, RM_REG, r );		// xor r, r
+		return;
+	}
+	if ( r & 8 )
+		Emit1( 0x41 );
+	Emit1( 0xB8 + ( r & 7 ) );					// mov r, 0x12345678
+	Emit4( v );
+}
 
-	if ( above4G( vm->dataBase ) ) {
-		EmitString( "48 BB" );		// mov rbx, vm->dataBase
-		EmitPtr( vm->dataBase );
+
+// group 1 arithmetic with immediate operand, ext: 0 - add, 1 - or, 4 - and, 5 - sub, 6 - xor, 7 - cmp
+static void EmitGroup1Imm( int ext, rmType_t type, int rm, int v )
+{
+	if ( ISS8( v ) ) {
+		EmitRM( NULL, "83", ext, type, rm );
+		Emit1( v );
 	} else {
-		EmitString( "BB" );			// mov ebx, vm->dataBase
-		Emit4( (intptr_t)vm->dataBase );
+		EmitRM( NULL, "81", ext, type, rm );
+		Emit4( v );
 	}
+}
 
-	EmitString( "49 B8" );			// mov r8, vm->instructionPointers
-	EmitPtr( instructionPointers );
 
-	EmitString( "41 B9" );			// mov r9d, vm->dataMask
-	Emit4( vm->dataMask );
+static void EmitOpStackAdjust( int n )
+{
+	switch ( n ) {
+		case 0: break;
+		case -4: EmitCommand( LAST_COMMAND_SUB_DI_4 ); break;	// sub edi, 4
+		case -8: EmitCommand( LAST_COMMAND_SUB_DI_8 ); break;	// sub edi, 8
+		case -12: EmitCommand( LAST_COMMAND_SUB_DI_12 ); break;	// sub edi, 12
+		default:
+			if ( ISS8( n ) ) {
+				EmitRexString( "83 C7" );	// add edi, 0x7F
+				Emit1( n );
+			} else {
+				EmitRexString( "81 C7" );	// add edi, 0x12345678
+				Emit4( n );
+			}
+			break;
+	}
+}
 
-	EmitString( "41 BD" );			// mov r13d, vm->stackBottom
-	Emit4( vm->stackBottom );
 
-	if ( above4G( &vm->opStack ) ) {
-		EmitString( "48 B8" );		// mov rax, &vm->opStack
-		EmitPtr( &vm->opStack );
-	} else {
-		EmitString( "B8" );			// mov eax, &vm->opStack
-		Emit4( (intptr_t)&vm->opStack );
-	}
-	EmitRexString( "8B 38" );		// mov rdi, [rax]
+static int OptAllocRx( void )
+{
+	int i, used;
 
-	if ( above4G( vm->systemCall ) ) {
-		EmitString( "49 BC" );		// mov r12, &vm->systemCall
-		EmitPtr( vm->systemCall );
-	} else {
-		EmitString( "41 BC" );		// mov r12d, &vm->systemCall
-		Emit4( (intptr_t)vm->systemCall );
+	used = 0;
+	for ( i = 0; i < optDepth; i++ ) {
+		if ( optStack[ i ].type == IT_REG ) {
+			used |= 1 << optStack[ i ].value;
+		}
 	}
 
-	if ( above4G( &vm->programStack ) ) {
-		EmitString( "48 B8" );		// mov rax, &vm->programStack
-		EmitPtr( &vm->programStack );
-	} else {
-		EmitString( "B8" );			// mov eax, &vm->programStack
-		Emit4( (intptr_t)&vm->programStack );
+	for ( i = 0; i < ARRAY_LEN( rxPool ); i++ ) {
+		if ( !( used & ( 1 << rxPool[ i ] ) ) ) {
+			return rxPool[ i ];
+		}
 	}
-	EmitString( "8B 30" );			// mov esi, dword ptr [rax]
 
-	//EmitString( "48 B8" );		// mov rax, &vm->opStackTop
-	//EmitPtr( &vm->opStackTop );
-	//EmitString( "4C 8B 30" );		// mov r14, [rax]
+	Com_Error( ERR_FATAL, "VM_CompileX86: out of registers at %i", ip-1 );
+	return -1;
+}
 
-	EmitString( "4C 8D B7" );		// lea r14, [opStack + opStackSize - 1]
-	Emit4( sizeof( int ) * MAX_OPSTACK_SIZE - 1 );
 
-#else  // id386
+static int OptAllocSx( void )
+{
+	int i, used;
 
-	EmitString( "60" );				// pushad
+	used = 0;
+	for ( i = 0; i < optDepth; i++ ) {
+		if ( optStack[ i ].type == IT_XMM ) {
+			used |= 1 << optStack[ i ].value;
+		}
+	}
 
-	EmitString( "BB" );				// mov ebx, vm->dataBase
-	EmitPtr( vm->dataBase );
+	for ( i = 0; i < ARRAY_LEN( sxPool ); i++ ) {
+		if ( !( used & ( 1 << sxPool[ i ] ) ) ) {
+			return sxPool[ i ];
+		}
+	}
 
-	EmitString( "8B 35" );			// mov esi, [vm->programStack]
-	EmitPtr( &vm->programStack );
+	Com_Error( ERR_FATAL, "VM_CompileX86: out of xmm registers at %i", ip-1 );
+	return -1;
+}
 
-	EmitString( "8B 3D" );			// mov edi, [vm->opStack]
-	EmitPtr( &vm->opStack );
 
-#endif
+/*
+=================
+OptLoadRx
 
-	EmitCallOffset( FUNC_ENTR );
+Converts item into general purpose register
+=================
+*/
+static int OptLoadRx( int n )
+{
+	optItem_t *it = &optStack[ n ];
+	int r;
 
-#if idx64
+	if ( it->type == IT_REG )
+		return it->value;
 
-#ifdef DEBUG_VM
-	EmitRexString( "B8" );			// mov rax, &vm->programStack
-	EmitPtr( &vm->programStack );
-	EmitString( "89 30" );			// mov [rax], esi
-#endif
+	r = OptAllocRx();
+	switch ( it->type ) {
+		case IT_CONST:
+			EmitMovRxImm( r, it->value );					// mov r, 0x12345678
+			break;
+		case IT_LOCAL:
+			EmitRM( NULL, "8D", r, RM_PSTACK, it->value );	// lea r, [esi + 0x12345678]
+			break;
+		case IT_LOCALVAL:
+			EmitRM( NULL, "8B", r, RM_LOCAL, it->value );	// mov r, dword ptr [ebp + 0x12345678]
+			break;
+		default: // IT_XMM
+			EmitRM( "66", "0F 7E", it->value, RM_REG, r );	// movd r, xmm
+			break;
+	}
 
-	if ( above4G( &vm->opStack ) ) {
-		EmitString( "48 B8" );		// mov rax, &vm->opStack
-		EmitPtr( &vm->opStack );
+	it->type = IT_REG;
+	it->value = r;
+	return r;
+}
+
+
+/*
+=================
+OptLoadSx
+
+Converts item into xmm register
+=================
+*/
+static int OptLoadSx( int n )
+{
+	optItem_t *it = &optStack[ n ];
+	int x;
+
+	if ( it->type == IT_XMM )
+		return it->value;
+
+	if ( it->type == IT_LOCALVAL ) {
+		x = OptAllocSx();
+		EmitRM( "F3", "0F 10", x, RM_LOCAL, it->value );	// movss xmm, dword ptr [ebp + 0x12345678]
+	} else if ( it->type == IT_CONST && it->value == 0 ) {
+		x = OptAllocSx();
+		EmitRM( NULL, "0F 57", x, RM_REG, x );				// xorps xmm, xmm
 	} else {
-		EmitString( "B8" );			// mov eax, &vm->opStack
-		Emit4( (intptr_t)&vm->opStack );
+		OptLoadRx( n );
+		x = OptAllocSx();
+		EmitRM( "66", "0F 6E", x, RM_REG, it->value );		// movd xmm, r
 	}
-	EmitRexString( "89 38" );		// mov [rax], rdi
-
-	EmitString( "41 5F" );			// pop r15
-	EmitString( "41 5E" );			// pop r14
-	EmitString( "41 5D" );			// pop r13
-	EmitString( "41 5C" );			// pop r12
-	EmitString( "5D" );				// pop rbp
-	EmitString( "5F" );				// pop rdi
-	EmitString( "5E" );				// pop rsi
-	EmitString( "5B" );				// pop rbx
 
-#else // id386
+	it->type = IT_XMM;
+	it->value = x;
+	return x;
+}
 
-#ifdef DEBUG_VM
-	EmitString( "89 35" );			// [vm->programStack], esi
-	EmitPtr( &vm->programStack );
-#endif
 
-	EmitString( "89 3D" );			// [vm->opStack], edi
-	EmitPtr( &vm->opStack );
+/*
+=================
+OptOperand
 
-	EmitString( "61" );				// popad
-#endif
+Returns memory operand for not yet loaded locals, register otherwise
+=================
+*/
+static rmType_t OptOperand( int n, int *rm )
+{
+	if ( optStack[ n ].type == IT_LOCALVAL ) {
+		*rm = optStack[ n ].value;
+		return RM_LOCAL;
+	}
+	*rm = OptLoadRx( n );
+	return RM_REG;
+}
 
-	EmitString( "C3" );				// ret
 
-	EmitAlign( 4 );
+static rmType_t OptOperandSx( int n, int *rm )
+{
+	if ( optStack[ n ].type == IT_LOCALVAL ) {
+		*rm = optStack[ n ].value;
+		return RM_LOCAL;
+	}
+	*rm = OptLoadSx( n );
+	return RM_REG;
+}
 
-	// main function entry offset
-	funcOffset[FUNC_ENTR] = compiledOfs;
 
-	while ( ip < instructionCount )
-	{
-		instructionOffsets[ ip ] = compiledOfs;
+/*
+=================
+OptSpillLocals
 
-		ci = &inst[ ip ];
-		ni = &inst[ ip + 1 ];
-		ip++;
+Loads pending locals below n before anything is written to memory
+=================
+*/
+static void OptSpillLocals( int n )
+{
+	int i;
 
-		if ( ci->jused ) {
-			LastCommand = LAST_COMMAND_NONE;
-			pop1 = OP_UNDEF;
+	for ( i = 0; i < n; i++ ) {
+		if ( optStack[ i ].type == IT_LOCALVAL ) {
+			OptLoadRx( i );
 		}
+	}
+}
 
-		switch ( ci->op ) {
 
-		case OP_UNDEF:
-			break;
+/*
+=================
+OptStore
 
-		case OP_IGNORE:
-			ip += ci->value;
-			break;
+Writes item to dword ptr [edi + disp]
+=================
+*/
+static void OptStore( int n, int disp )
+{
+	optItem_t *it = &optStack[ n ];
 
-		case OP_BREAK:
-			EmitString( "CC" );		// int 3
+	switch ( it->type ) {
+		case IT_CONST:
+			EmitRM( NULL, "C7", 0, RM_OPSTACK, disp );		// mov dword ptr [edi + 0x7F], 0x12345678
+			Emit4( it->value );
+			break;
+		case IT_XMM:
+			EmitRM( "F3", "0F 11", it->value, RM_OPSTACK, disp ); // movss dword ptr [edi + 0x7F], xmm
 			break;
+		default:
+			OptLoadRx( n );
+			EmitRM( NULL, "89", it->value, RM_OPSTACK, disp );	// mov dword ptr [edi + 0x7F], r
+			break;
+	}
+}
 
-		case OP_ENTER:
-			v = ci->value;
-			if ( ISU8( v ) ) {
-				EmitString( "83 EE" );		// sub	esi, 0x12
-				Emit1( v );
-			} else {
-				EmitString( "81 EE" );		// sub	esi, 0x12345678
-				Emit4( v );
-			}
 
-			// locate endproc
-			for ( n = -1, i = ip + 1; i < instructionCount; i++ ) {
-				if ( inst[ i ].op == OP_PUSH && inst[ i + 1 ].op == OP_LEAVE ) {
-					n = i;
-					break;
-				}
-			}
+/*
+=================
+OptFlushBelow
 
-			// should never happen because equal check in VM_LoadInstructions() but anyway
-			if ( n == -1 ) {
-				VM_FreeBuffers();
-				Com_Printf( "VM_CompileX86 error: %s\n", "missing proc end" );
-				return qfalse;
-			}
+Writes all but top keep items to opStack memory
+=================
+*/
+static void OptFlushBelow( int keep )
+{
+	int i, n;
 
-			proc_base = ip + 1;
-			proc_len = n - proc_base + 1 ;
+	n = optDepth - keep;
+	if ( n <= 0 )
+		return;
 
-			// programStack overflow check
-			if ( vm_rtChecks->integer & 1 ) {
-#if idx64
-				//EmitString( "4C 39 EE" );		// cmp	rsi, r13
-				EmitString( "44 39 EE" );		// cmp	esi, r13d
-#else
-				EmitString( "81 FE" );			// cmp	esi, vm->stackBottom
-				Emit4( vm->stackBottom );
-#endif
-				EmitString( "0F 82" );			// jb +funcOffset[FUNC_PSOF]
-				n = funcOffset[FUNC_PSOF] - compiledOfs;
-				Emit4( n - 6 );
-			}
+	for ( i = 0; i < n; i++ ) {
+		OptStore( i, optDelta + ( i + 1 ) * 4 );
+	}
 
-			// opStack overflow check
-			if ( vm_rtChecks->integer & 2 ) {
-				if ( ISU8( ci->opStack ) ) {
-					EmitRexString( "8D 47" );		// lea eax, [edi+0x7F]
-					Emit1( ci->opStack );
-				} else {
-					EmitRexString( "8D 87" );		// lea eax, [edi+0x12345678]
-					Emit4( ci->opStack );
-				}
-#if idx64
-				EmitString( "4C 39 F0" );		// cmp rax, r14
-#else
-				EmitString( "3B 05" );			// cmp eax, [&vm->opStackTop]
-				EmitPtr( &vm->opStackTop );
-#endif
-				EmitString( "0F 87" );			// ja +funcOffset[FUNC_OSOF]
-				n = funcOffset[FUNC_OSOF] - compiledOfs;
-				Emit4( n - 6 );
-			}
+	optDelta += n * 4;
+	optDepth = keep;
+	memmove( optStack, optStack + n, keep * sizeof( optStack[0] ) );
+}
 
-			EmitRexString( "8D 2C 33" );		// lea ebp, [ebx+esi]
-			break;
 
-		case OP_CONST:
+/*
+=================
+OptFlush
 
-			// we can safely perform optimizations only in case if
-			// we are 100% sure that next instruction is not a jump label
-			if ( !ni->jused && ConstOptimize( vm ) )
-				break;
+Puts everything back into opStack memory, leaving the top value
+in eax/xmm0 so the baseline peephole can pick it up again
+=================
+*/
+static void OptFlush( void )
+{
+	optItem_t *it;
 
-			EmitAddEDI4( vm );					// add edi, 4
-			EmitString( "C7 07" );				// mov dword ptr [edi], 0x12345678
-			lastConst = ci->value;
+	pop1 = OP_UNDEF;
+	optNumKnown = 0;
+
+	if ( optDepth == 0 ) {
+		EmitOpStackAdjust( optDelta );
+		optDelta = 0;
+		return;
+	}
+
+	OptFlushBelow( 1 );
+	EmitOpStackAdjust( optDelta + 4 );
+	optDelta = 0;
+	optDepth = 0;
+
+	it = &optStack[ 0 ];
+	switch ( it->type ) {
+		case IT_CONST:
+			EmitString( "C7 07" );		// mov dword ptr [edi], 0x12345678
+			lastConst = it->value;
 			Emit4( lastConst );
 			LastCommand = LAST_COMMAND_MOV_EDI_CONST;
 			break;
-
-		case OP_LOCAL:
-			// optimization: merge OP_LOCAL + OP_LOAD4
-			if ( ni->op == OP_LOAD4 ) {
-				EmitAddEDI4( vm );				// add edi, 4
-				v = ci->value;
-				if ( ISU8( v ) ) {
-					EmitString( "8B 45" );		// mov eax, dword ptr [ebp + 0x7F]
-					Emit1( v );
-				} else {
-					EmitString( "8B 85" );		// mov eax, dword ptr [ebp + 0x12345678]
-					Emit4( v );
-				}
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
-				ip++;
-				break;
+		case IT_XMM:
+			if ( it->value != 0 ) {
+				EmitRM( NULL, "0F 28", 0, RM_REG, it->value );	// movaps xmm0, xmm
 			}
-
-			// optimization: merge OP_LOCAL + OP_LOAD2
-			if ( ni->op == OP_LOAD2 ) {
-				EmitAddEDI4( vm );				// add edi, 4
-				v = ci->value;
-				if ( ISU8( v ) ) {
-					EmitString( "0F B7 45" );	// movzx eax, word ptr [ebp + 0x7F]
-					Emit1( v );
-				} else {
-					EmitString( "0F B7 85" );	// movzx eax, word ptr [ebp + 0x12345678]
-					Emit4( v );
-				} 
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
-				ip++;
-				break;
+			EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI_SSE );	// movss dword ptr [edi], xmm0
+			break;
+		case IT_REG:
+			if ( it->value != 0 ) {
+				EmitRM( NULL, "89", it->value, RM_REG, 0 );		// mov eax, r
 			}
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );			// mov dword ptr [edi], eax
+			break;
+		case IT_LOCAL:
+			EmitRM( NULL, "8D", 0, RM_PSTACK, it->value );		// lea eax, [esi + 0x12345678]
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );			// mov dword ptr [edi], eax
+			break;
+		case IT_LOCALVAL:
+			EmitRM( NULL, "8B", 0, RM_LOCAL, it->value );		// mov eax, dword ptr [ebp + 0x12345678]
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );			// mov dword ptr [edi], eax
+			break;
+	}
+}
 
-			// optimization: merge OP_LOCAL + OP_LOAD1
-			if ( ni->op == OP_LOAD1 ) {
-				EmitAddEDI4( vm );				// add edi, 4
-				v = ci->value;
-				if ( ISU8( v ) ) {
-					EmitString( "0F B6 45" );	// movzx eax, byte ptr [ebp + 0x7F]
-					Emit1( v );
-				} else {
-					EmitString( "0F B6 85" );	// movzx eax, byte ptr [ebp + 0x12345678]
-					Emit4( v );
-				}
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
-				ip++;
-				break;
-			}
 
-			// TODO: i = j + k;
-			// TODO: i = j - k;
+/*
+=================
+OptNeed
 
-			EmitAddEDI4( vm );					// add edi, 4
-			v = ci->value;
-			if ( ISU8( v ) ) {
-				EmitString( "8D 46" );			// lea eax, [esi + 0x7F]
-				Emit1( v );
-			} else {
-				EmitString( "8D 86" );			// lea eax, [esi + 0x12345678]
-				Emit4( v );
-			}
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			break;
+Makes sure that at least n items are tracked, loading missing ones from opStack memory
+=================
+*/
+static void OptNeed( int n )
+{
+	int i, k, top;
 
-		case OP_ARG:
-			if ( LastCommand == LAST_COMMAND_STORE_FLOAT_EDI_SSE ) {
-				REWIND(4);
-				v = ci->value;
-				if ( ISU8( v ) ) {
-					EmitString( "F3 0F 11 45" ); // movss dword ptr [ebp + 0x7F], xmm0
-					Emit1( v );
-				} else {
-					EmitString( "F3 0F 11 85" ); // movss dword ptr [ebp + 0x12345678], xmm0
-					Emit4( v );
-				}
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+	if ( optDepth >= n )
+		return;
+
+	k = n - optDepth;
+	memmove( optStack + k, optStack, optDepth * sizeof( optStack[0] ) );
+	for ( i = 0; i < k; i++ ) {
+		optStack[ i ].type = IT_CONST;
+		optStack[ i ].value = 0;
+	}
+	optDepth = n;
+
+	// value stored to the opStack by previous instruction may be still in register
+	top = k - 1;
+	if ( optDelta == 0 ) {
+		switch ( LastCommand ) {
+			case LAST_COMMAND_MOV_EDI_EAX:
+				REWIND( 2 );
+			case LAST_COMMAND_MOV_EAX_EDI:
+			case LAST_COMMAND_MOV_EAX_EDI_CALL:
+				optStack[ top ].type = IT_REG;
+				optStack[ top ].value = 0; // eax
+				top--;
 				break;
-			}
-			EmitMovEAXEDI( vm );					// mov	eax, dword ptr [edi]
-			if ( (ci+1)->op == MOP_NCPY && !(ci+1)->jused ) {
-				// we will read counter from eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			case LAST_COMMAND_MOV_EDI_CONST:
+				REWIND( 6 );
+				optStack[ top ].value = lastConst;
+				top--;
 				break;
-			}
-			v = ci->value;
-			if ( ISU8( v ) ) {
-				EmitString( "89 45" );				// mov	dword ptr [ebp + 0x7F], eax
-				Emit1( v );
-			} else {
-				EmitString( "89 85" );				// mov	dword ptr [ebp + 0x12345678], eax
-				Emit4( v );
-			}
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
+			case LAST_COMMAND_STORE_FLOAT_EDI_SSE:
+				REWIND( 4 );
+				optStack[ top ].type = IT_XMM;
+				optStack[ top ].value = 0; // xmm0
+				top--;
+				break;
+			default:
+				break;
+		}
+	}
+	LastCommand = LAST_COMMAND_NONE;
 
-		case OP_CALL:
-#ifdef VM_LOG_SYSCALLS
-			// [dataBase + programStack + 0] = ip-1;
-			EmitString( "C7 45 00" );				// mov dword ptr [ebp], 0x12345678
-			Emit4( ip-1 );
-#endif
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitCallOffset( FUNC_CALL );			// call +FUNC_CALL
-			break;
+	for ( i = top; i >= 0; i-- ) {
+		optStack[ i ].value = OptAllocRx();
+		optStack[ i ].type = IT_REG;
+		EmitRM( NULL, "8B", optStack[ i ].value, RM_OPSTACK, optDelta - ( k - 1 - i ) * 4 ); // mov r, dword ptr [edi - 0x7F]
+	}
 
-		case OP_PUSH:
-			EmitAddEDI4( vm );						// add edi, 4
-			break;
+	optDelta -= k * 4;
+}
 
-		case OP_POP:
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_LEAVE:
-#ifdef DEBUG_VM
-			v = ci->value;
-			if ( ISU8( v ) ) {
-				EmitString( "83 C6" );		// add	esi, 0x12
-				Emit1( v );
-			} else {
-				EmitString( "81 C6" );		// add	esi, 0x12345678
-				Emit4( v );
-			}
-#endif
-			EmitString( "C3" );							// ret
-			break;
+static void OptPush( itemType_t type, int value )
+{
+	if ( optDepth == OPT_MAX_ITEMS ) {
+		OptFlushBelow( 0 );
+	}
+	optStack[ optDepth ].type = type;
+	optStack[ optDepth ].value = value;
+	optDepth++;
+}
 
-		case OP_LOAD4:
-			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
-				REWIND( 2 );
-				EmitCheckReg( vm, REG_EAX, 4 );			// range check eax
-				EmitString( "8B 04 03" );				// mov	eax, dword ptr [ebx + eax]
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-				break;
-			}
-			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]		
-			EmitCheckReg( vm, REG_ECX, 4 );				// range check ecx
-			EmitString( "8B 04 0B" );					// mov	eax, dword ptr [ebx + ecx]
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
-			break;
 
-		case OP_LOAD2:
-			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
-				REWIND( 2 );
-				EmitCheckReg( vm, REG_EAX, 2 );			// range check eax
-				if ( ni->op == OP_SEX16 ) {
-					EmitString( "0F BF 04 03" );		// movsx eax, word ptr [ebx + eax]
-					ip++;
-				} else {
-					EmitString( "0F B7 04 03" );		// movzx eax, word ptr [ebx + eax]
-				}
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-				break;
-			}
-			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]
-			EmitCheckReg( vm, REG_ECX, 2 );				// range check ecx
-			if ( ni->op == OP_SEX16 ) {
-				EmitString( "0F BF 04 0B" );			// movsx eax, word ptr [ebx + ecx]
-				ip++;
-			} else {
-				EmitString( "0F B7 04 0B" );			// movzx eax, word ptr [ebx + ecx]
-			}
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
-			break;
+static void OptCheckRx( vm_t *vm, int r )
+{
+	int n;
 
-		case OP_LOAD1:
-			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
-				REWIND( 2 );
-				EmitCheckReg( vm, REG_EAX, 1 );			// range check eax
-				if ( ni->op == OP_SEX8 ) {
-					EmitString( "0F BE 04 03" );		// movsx eax, byte ptr [ebx + eax]
-					ip++;
-				} else {
-					EmitString( "0F B6 04 03" );		// movzx eax, byte ptr [ebx + eax]
-				}
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-				break;
-			}
-			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]
-			EmitCheckReg( vm, REG_ECX, 1 );				// range check ecx
-			if ( ni->op == OP_SEX8 ) {
-				EmitString( "0F BE 04 0B" );			// movsx eax, byte ptr [ebx + ecx]
-				ip++;
-			} else {
-				EmitString( "0F B6 04 0B" );			// movzx eax, byte ptr [ebx + ecx]
-			}
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
-			break;
+	if ( vm->forceDataMask ) {
+		EmitRM( NULL, "81", 4, RM_REG, r );		// and r, vm->dataMask
+		Emit4( vm->dataMask );
+		return;
+	}
 
-		case OP_STORE4:
-			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
-			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
-			EmitCheckReg( vm, REG_ECX, 4 );				// range check
-			EmitString( "89 04 0B" );					// mov dword ptr [ebx + ecx], eax
-			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
-			break;
+	if ( !( vm_rtChecks->integer & 8 ) )
+		return;
 
-		case OP_STORE2:
-			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]	
-			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
-			EmitCheckReg( vm, REG_ECX, 2 );				// range check
-			EmitString( "66 89 04 0B" );				// mov word ptr [ebx + ecx], ax
-			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
-			break;
+	EmitRM( NULL, "39", 9, RM_REG, r );		// cmp r, r9d // vm->dataMask
+	EmitString( "0F 87" );					// ja +errorFunction
+	n = funcOffset[FUNC_DATA] - compiledOfs;
+	Emit4( n - 6 );
+}
 
-		case OP_STORE1:
-			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]	
-			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
-			EmitCheckReg( vm, REG_ECX, 1 );				// range check
-			EmitString( "88 04 0B" );					// mov byte ptr [ebx + ecx], al
-			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
-			break;
 
-		case OP_EQ:
-		case OP_NE:
-		case OP_LTI:
-		case OP_LEI:
-		case OP_GTI:
-		case OP_GEI:
-		case OP_LTU:
-		case OP_LEU:
-		case OP_GTU:
-		case OP_GEU:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
-			EmitString( "39 47 04" );				// cmp dword ptr [edi+4], eax
-			EmitJump( vm, ci, ci->op, ci->value );
-			break;
+// constant addresses are resolved at compile time
+static qboolean OptDataAddr( vm_t *vm, const optItem_t *it, int *addr )
+{
+	if ( it->type != IT_CONST )
+		return qfalse;
 
-		case OP_EQF:
-		case OP_NEF:
-		case OP_LTF:
-		case OP_LEF:
-		case OP_GTF:
-		case OP_GEF:
-			if ( HasFCOM() ) {
-				EmitLoadFloatEDI( vm );
-				if ( HasSSEFP() ) {
-					EmitString( "F3 0F 10 4F FC" );			// movss xmm1, dword ptr [edi-4]
-					EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
-					EmitString( "0F 2F C8" );				// comiss xmm1, xmm0
-				} else {
-					EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
-					//EmitString( "D9 47 08" );				// fld dword ptr [edi+8]
-					EmitString( "D9 47 04" );				// fld dword ptr [edi+4]
-					EmitString( "DF E9" );					// fucomip
-					EmitString( "DD D8" );					// fstp st(0)
-				}
-				EmitJump( vm, ci, ci->op, ci->value );
-			} else {
-				EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
-				EmitString( "D9 47 04" );				// fld dword ptr [edi+4]
-				EmitString( "D8 5F 08" );				// fcomp dword ptr [edi+8]
-				EmitString( "DF E0" );					// fnstsw ax
-				EmitFloatJump( vm, ci, ci->op, ci->value );
-			}
-			pop1 = OP_UNDEF;
-			break;
+	if ( vm->forceDataMask ) {
+		*addr = it->value & vm->dataMask;
+		return qtrue;
+	}
 
-		case OP_NEGI:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitString( "F7 D8" );					// neg eax
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			break;
+	if ( ( vm_rtChecks->integer & 8 ) && (unsigned)it->value > vm->dataMask )
+		return qfalse; // let it fail at runtime
 
-		case OP_ADD:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
-			if ( wantres ) {
-				EmitString( "03 47 FC" );				// add eax, dword ptr [edi-4]
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else {
-				EmitString( "01 47 FC" );				// add dword ptr [edi-4],eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			}
-			break;
+	*addr = it->value;
+	return qtrue;
+}
 
-		case OP_SUB:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			if ( wantres ) {
-				EmitMovECXEDI( vm );					// mov ecx,dword ptr [edi]
-				EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-				EmitString( "29 C8" );					// sub eax, ecx
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else {
-				EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-				EmitString( "29 47 FC" );				// sub dword ptr [edi-4],eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			}
-			break;
 
-		case OP_DIVI:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			EmitMovECXEDI( vm );					// mov ecx,dword ptr [edi]
-			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-			if ( wantres ) {
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-				EmitString( "99" );						// cdq
-				EmitString( "F7 F9" );					// idiv ecx
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else{
-				EmitString( "99" );						// cdq
-				EmitString( "F7 F9" );					// idiv ecx
-				EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			}
-			break;
+static int OptFoldInt( int op, int a, int b )
+{
+	switch ( op ) {
+		case OP_ADD:	return (unsigned)a + (unsigned)b;
+		case OP_SUB:	return (unsigned)a - (unsigned)b;
+		case OP_BAND:	return a & b;
+		case OP_BOR:	return a | b;
+		case OP_BXOR:	return a ^ b;
+		case OP_LSH:	return (unsigned)a << b;
+		case OP_RSHI:	return a >> b;
+		case OP_RSHU:	return (unsigned)a >> b;
+		default:		return (unsigned)a * (unsigned)b; // OP_MULI, OP_MULU
+	}
+}
 
-		case OP_DIVU:
-			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-			EmitString( "33 D2" );					// xor edx, edx
-			EmitString( "F7 37" );					// div dword ptr [edi]
-			EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_MODI:
-			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-			EmitString( "99" );						// cdq
-			EmitString( "F7 3F" );					// idiv dword ptr [edi]
-			EmitString( "89 57 FC" );				// mov dword ptr [edi-4],edx
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
+static qboolean OptIsNaN( int v )
+{
+	return ( v & 0x7F800000 ) == 0x7F800000 && ( v & 0x007FFFFF ) != 0;
+}
 
-		case OP_MODU:
-			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-			EmitString( "33 D2" );					// xor edx, edx
-			EmitString( "F7 37" );					// div dword ptr [edi]
-			EmitString( "89 57 FC" );				// mov dword ptr [edi-4],edx
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_MULI:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitString( "F7 6F FC" );				// imul eax, dword ptr [edi-4]
-			if ( wantres ) {
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else {
-				EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			}
-			break;
+static int OptSwapCond( int op )
+{
+	switch ( op ) {
+		case OP_LTI: return OP_GTI;
+		case OP_LEI: return OP_GEI;
+		case OP_GTI: return OP_LTI;
+		case OP_GEI: return OP_LEI;
+		case OP_LTU: return OP_GTU;
+		case OP_LEU: return OP_GEU;
+		case OP_GTU: return OP_LTU;
+		case OP_GEU: return OP_LEU;
+		default: return op;
+	}
+}
 
-		case OP_MULU:
-			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
-			EmitString( "F7 27" );					// mul dword ptr [edi]
-			EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_BAND:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
-			if ( wantres ) {
-				EmitString( "23 47 FC" );				// and eax, dword ptr [edi-4]
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else {
-				EmitString( "21 47 FC" );				// and dword ptr [edi-4],eax
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			}
-			break;
+static void EmitParityJump( int addr )
+{
+	int v;
+	v = instructionOffsets[ addr ] - compiledOfs;
+	EmitString( "0F 8A" );			// jp +addr
+	Emit4( v - 6 );
+}
 
-		case OP_BOR:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitString( "09 47 FC" );				// or dword ptr [edi-4],eax
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_BXOR:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitString( "31 47 FC" );				// xor dword ptr [edi-4],eax
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
+static void OptForgetLocal( int offset, int size )
+{
+	int i;
 
-		case OP_BCOM:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitString( "F7 D0" );					// not eax
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			break;
+	for ( i = 0; i < optNumKnown; ) {
+		if ( optKnown[ i ].offset < offset + size && offset < optKnown[ i ].offset + 4 ) {
+			optKnown[ i ] = optKnown[ --optNumKnown ];
+		} else {
+			i++;
+		}
+	}
+}
 
-		case OP_LSH:
-			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
-			EmitString( "D3 67 FC" );				// shl dword ptr [edi-4], cl
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
 
-		case OP_RSHI:
-			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
-			EmitString( "D3 7F FC" );				// sar dword ptr [edi-4], cl
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
+static void OptSetLocal( int offset, int value )
+{
+	OptForgetLocal( offset, 4 );
 
-		case OP_RSHU:
-			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
-			EmitString( "D3 6F FC" );				// shr dword ptr [edi-4], cl
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
-			break;
+	if ( optNumKnown == OPT_MAX_KNOWN ) {
+		optNumKnown--;
+	}
 
-		case OP_NEGF:
-			//if ( !ci->fpu )
-			EmitLoadFloatEDI( vm );					// fld dword ptr [edi] | movss xmm0, dword ptr [edi]
-			if ( HasSSEFP() ) {
-				EmitString( "0F 57 C9" );			// xorps xmm1, xmm1
-				EmitString( "0F 5C C8" );			// subps xmm1, xmm0
-				EmitString( "0F 28 C1" );			// movaps xmm0, xmm1
+	optKnown[ optNumKnown ].offset = offset;
+	optKnown[ optNumKnown ].value = value;
+	optNumKnown++;
+}
+
+
+static qboolean OptGetLocal( int offset, int *value )
+{
+	int i;
+
+	for ( i = 0; i < optNumKnown; i++ ) {
+		if ( optKnown[ i ].offset == offset ) {
+			*value = optKnown[ i ].value;
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+
+/*
+=================
+OptInlineEnd
+
+Returns OP_LEAVE index if function can be expanded in place, -1 otherwise
+=================
+*/
+static int OptInlineEnd( const vm_t *vm, int callee )
+{
+	const instruction_t *in;
+	int i;
+
+	if ( callee < 0 || callee >= vm->instructionCount || inst[ callee ].op != OP_ENTER )
+		return -1;
+
+	for ( i = callee + 1; i < vm->instructionCount && i <= callee + OPT_INLINE_MAX; i++ ) {
+		in = &inst[ i ];
+		if ( in->jused )
+			return -1;
+		if ( in->op == OP_LEAVE )
+			return i;
+		if ( in->op == OP_CALL || in->op == OP_ENTER || in->op == OP_JUMP || in->op == OP_IGNORE || in->op == OP_BREAK )
+			return -1;
+		if ( in->op >= OP_EQ && in->op <= OP_GEF )
+			return -1;
+	}
+
+	return -1;
+}
+
+
+/*
+=================
+OptBeginInline
+
+Sets up callee frame and continues translation from its first instruction
+=================
+*/
+static qboolean OptBeginInline( vm_t *vm )
+{
+	int leave, v, n;
+
+	leave = OptInlineEnd( vm, ci->value );
+	if ( leave < 0 || optInlineLeave >= 0 )
+		return qfalse;
+
+	OptFlush();
+
+	optInlineEnter = ci->value;
+	optInlineLeave = leave;
+	optInlineReturn = ip + 1; // skip OP_CALL
+
+	EmitGroup1Imm( 5, RM_REG, 6, inst[ optInlineEnter ].value );	// sub esi, 0x12345678
+
+	// same checks as in OP_ENTER
+	if ( vm_rtChecks->integer & 1 ) {
+		EmitString( "44 39 EE" );		// cmp	esi, r13d
+		EmitString( "0F 82" );			// jb +funcOffset[FUNC_PSOF]
+		n = funcOffset[FUNC_PSOF] - compiledOfs;
+		Emit4( n - 6 );
+	}
+	if ( vm_rtChecks->integer & 2 ) {
+		v = inst[ optInlineEnter ].opStack;
+		if ( ISU8( v ) ) {
+			EmitRexString( "8D 47" );	// lea eax, [edi+0x7F]
+			Emit1( v );
+		} else {
+			EmitRexString( "8D 87" );	// lea eax, [edi+0x12345678]
+			Emit4( v );
+		}
+		EmitString( "4C 39 F0" );		// cmp rax, r14
+		EmitString( "0F 87" );			// ja +funcOffset[FUNC_OSOF]
+		n = funcOffset[FUNC_OSOF] - compiledOfs;
+		Emit4( n - 6 );
+	}
+
+	EmitRexString( "8D 2C 33" );		// lea ebp, [ebx+esi]
+
+	// callee instructions will be translated again for its own body
+	Com_Memcpy( optInlineOffsets, instructionOffsets + optInlineEnter, ( leave - optInlineEnter + 1 ) * sizeof( int ) );
+
+	ip = optInlineEnter + 1;
+
+	return qtrue;
+}
+
+
+/*
+=================
+OptEndInline
+
+Replaces callee OP_LEAVE, return value stays tracked
+=================
+*/
+static void OptEndInline( void )
+{
+	int i;
+
+	// anything frame relative must be loaded before frame is restored
+	for ( i = 0; i < optDepth; i++ ) {
+		if ( optStack[ i ].type == IT_LOCAL || optStack[ i ].type == IT_LOCALVAL ) {
+			OptLoadRx( i );
+		}
+	}
+	optNumKnown = 0;
+
+	EmitGroup1Imm( 0, RM_REG, 6, inst[ optInlineEnter ].value );	// add esi, 0x12345678
+	EmitRexString( "8D 2C 33" );		// lea ebp, [ebx+esi]
+
+	Com_Memcpy( instructionOffsets + optInlineEnter, optInlineOffsets, ( optInlineLeave - optInlineEnter + 1 ) * sizeof( int ) );
+
+	ip = optInlineReturn;
+	optInlineLeave = -1;
+}
+
+
+/*
+=================
+EmitOptimized
+
+Returns qfalse without emitting anything if instruction should be left to the baseline code
+=================
+*/
+static qboolean EmitOptimized( vm_t *vm )
+{
+	optItem_t *a, *b, t;
+	floatint_t f;
+	rmType_t type;
+	int op, ra, rm, n, v;
+
+	op = ci->op;
+
+	switch ( op ) {
+
+	case OP_UNDEF:
+		return qtrue;
+
+	case OP_IGNORE:
+		ip += ci->value;
+		return qtrue;
+
+	case OP_CONST:
+		if ( optLevel > 1 && ni->op == OP_CALL && !ni->jused && OptBeginInline( vm ) )
+			return qtrue;
+		// leave direct calls and jumps to ConstOptimize()
+		if ( ni->op == OP_CALL || ni->op == OP_JUMP )
+			return qfalse;
+		OptPush( IT_CONST, ci->value );
+		return qtrue;
+
+	case OP_LOCAL:
+		OptPush( IT_LOCAL, ci->value );
+		return qtrue;
+
+	case OP_POP:
+		if ( optDepth ) {
+			optDepth--;
+		} else {
+			optDelta -= 4;
+		}
+		return qtrue;
+
+	case OP_LOAD4:
+	case OP_LOAD2:
+	case OP_LOAD1:
+		OptNeed( 1 );
+		a = &optStack[ optDepth - 1 ];
+		if ( op == OP_LOAD4 && a->type == IT_LOCAL ) {
+			if ( optLevel > 1 && OptGetLocal( a->value, &v ) ) {
+				a->type = IT_CONST;
+				a->value = v;
 			} else {
-				EmitString( "D9 E0" );				// fchs
+				a->type = IT_LOCALVAL;
 			}
-			//if ( !ci->fpu || ci->store )
-			EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI ); // fstp dword ptr [edi]
-			break;
-
-		case OP_ADDF:
-		case OP_SUBF:
-		case OP_DIVF:
-		case OP_MULF:
-			wantres = ( ops[ ni->op ].stack <= 0 );
-			if ( HasSSEFP() ) {
-				if ( LastCommand == LAST_COMMAND_STORE_FLOAT_EDI_SSE ) {
-					REWIND(4);
-					EmitString( "0F 28 C8" );		// movaps xmm1, xmm0
+			return qtrue;
+		}
+		{
+			const char *opcode;
+			if ( op == OP_LOAD4 ) {
+				opcode = "8B";							// mov r, dword ptr [...]
+			} else if ( op == OP_LOAD2 ) {
+				if ( ni->op == OP_SEX16 && !ni->jused ) {
+					opcode = "0F BF";					// movsx r, word ptr [...]
+					ip++;
 				} else {
-					EmitString( "F3 0F 10 0F" );	// movss xmm1, dword ptr [edi]
-				}
-				EmitString( "F3 0F 10 47 FC" );		// movss xmm0, dword ptr [edi-4]
-				if ( wantres ) {
-					if ( ni->op == OP_STORE4 ) {
-						 EmitString( "8B 47 F8" );	// mov eax, dword ptr [edi-8]
-						 EmitCheckReg( vm, REG_EAX, 4 );
-					} else if ( ni->op == OP_ARG ) {
-						//
-					} else {
-						EmitCommand( LAST_COMMAND_SUB_DI_4 );
-					}
-				}
-				switch( ci->op ) {
-					case OP_ADDF: EmitString( "0F 58 C1" ); break;	// addps xmm0, xmm1
-					case OP_SUBF: EmitString( "0F 5C C1" ); break;	// subps xmm0, xmm1
-					case OP_MULF: EmitString( "0F 59 C1" ); break;	// mulps xmm0, xmm1
-					case OP_DIVF: EmitString( "0F 5E C1" ); break;	// divps xmm0, xmm1
+					opcode = "0F B7";					// movzx r, word ptr [...]
 				}
-				if ( wantres ) {
-					if ( ni->op == OP_STORE4 ) {
-						EmitString( "F3 0F 11 04 03" );		// movss dword ptr [ebx + eax], xmm0
-						EmitCommand( LAST_COMMAND_SUB_DI_12 );
-						pop1 = OP_UNDEF;
-						ip++; // OP_STORE4
-					} else if ( ni->op == OP_ARG ) {
-						v = ni->value;
-						if ( ISU8( v ) ) {
-							EmitString( "F3 0F 11 45" ); // movss dword ptr [ebp + 0x7F], xmm0
-							Emit1( v );
-						} else {
-							EmitString( "F3 0F 11 85" ); // movss dword ptr [ebp + 0x12345678], xmm0
-							Emit4( v );
-						}
-						EmitCommand( LAST_COMMAND_SUB_DI_8 );
-						pop1 = OP_UNDEF;
-						ip++; // OP_ARG
-					} else {
-						EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI );
-					}
+			} else {
+				if ( ni->op == OP_SEX8 && !ni->jused ) {
+					opcode = "0F BE";					// movsx r, byte ptr [...]
+					ip++;
 				} else {
-					EmitString( "F3 0F 11 47 FC" );			// movss dword ptr [edi-4], xmm0
-					EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+					opcode = "0F B6";					// movzx r, byte ptr [...]
 				}
+			}
+			if ( a->type == IT_LOCAL ) {
+				ra = OptAllocRx();
+				EmitRM( NULL, opcode, ra, RM_LOCAL, a->value );
+			} else if ( OptDataAddr( vm, a, &rm ) ) {
+				ra = OptAllocRx();
+				EmitRM( NULL, opcode, ra, RM_DATA, rm );
 			} else {
-				EmitString( "D9 47 FC" );			// fld dword ptr [edi-4]
-				EmitFCalcEDI( ci->op );				// fadd|fsub|fmul|fdiv dword ptr [edi]
-				EmitString( "D9 5F FC" );			// fstp dword ptr [edi-4]
-				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				rm = OptLoadRx( optDepth - 1 );
+				OptCheckRx( vm, rm );
+				ra = rm;
+				EmitRM( NULL, opcode, ra, RM_INDEX, rm );
 			}
-			break;
+		}
+		a->type = IT_REG;
+		a->value = ra;
+		return qtrue;
 
-		case OP_CVIF:
-			if ( HasSSEFP() ) {
-				if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
-					REWIND(2);
-					EmitString( "F3 0F 2A C0" );	// cvtsi2ss xmm0, eax
-				} else {
-					EmitString( "F3 0F 2A 07" );	// cvtsi2ss xmm0, dword ptr [edi]
-				}
+	case OP_STORE4:
+	case OP_STORE2:
+	case OP_STORE1:
+		OptNeed( 2 );
+		a = &optStack[ optDepth - 2 ]; // address
+		b = &optStack[ optDepth - 1 ]; // value
+		if ( b->type == IT_LOCAL || b->type == IT_LOCALVAL || ( b->type == IT_XMM && op != OP_STORE4 ) ) {
+			OptLoadRx( optDepth - 1 );
+		}
+		if ( a->type == IT_LOCAL ) {
+			type = RM_LOCAL;
+			rm = a->value;
+		} else if ( OptDataAddr( vm, a, &rm ) ) {
+			type = RM_DATA;
+		} else {
+			rm = OptLoadRx( optDepth - 2 );
+			OptCheckRx( vm, rm );
+			type = RM_INDEX;
+		}
+		OptSpillLocals( optDepth - 2 );
+		n = ( op == OP_STORE4 ) ? 4 : ( op == OP_STORE2 ) ? 2 : 1;
+		if ( type == RM_LOCAL ) {
+			if ( optLevel > 1 && b->type == IT_CONST && n == 4 ) {
+				OptSetLocal( rm, b->value );
 			} else {
-				EmitString( "DB 07" );				// fild dword ptr [edi]
+				OptForgetLocal( rm, n );
 			}
-			//if ( !ci->fpu ) 
-			EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI );
-			break;
+		} else if ( type == RM_INDEX || (unsigned)rm >= vm->stackBottom ) {
+			optNumKnown = 0; // may point to locals
+		}
+		if ( b->type == IT_CONST ) {
+			v = b->value;
+			if ( op == OP_STORE4 ) {
+				EmitRM( NULL, "C7", 0, type, rm );			// mov dword ptr [...], 0x12345678
+				Emit4( v );
+			} else if ( op == OP_STORE2 ) {
+				EmitRM( "66", "C7", 0, type, rm );			// mov word ptr [...], 0x1234
+				Emit1( v );
+				Emit1( v >> 8 );
+			} else {
+				EmitRM( NULL, "C6", 0, type, rm );			// mov byte ptr [...], 0x12
+				Emit1( v );
+			}
+		} else if ( b->type == IT_XMM ) {
+			EmitRM( "F3", "0F 11", b->value, type, rm );	// movss dword ptr [...], xmm
+		} else {
+			if ( op == OP_STORE4 ) {
+				EmitRM( NULL, "89", b->value, type, rm );	// mov dword ptr [...], r
+			} else if ( op == OP_STORE2 ) {
+				EmitRM( "66", "89", b->value, type, rm );	// mov word ptr [...], r
+			} else {
+				EmitRM( NULL, "88", b->value, type, rm );	// mov byte ptr [...], r
+			}
+		}
+		optDepth -= 2;
+		return qtrue;
+
+	case OP_ARG:
+		if ( ni->op == MOP_NCPY && !ni->jused )
+			return qfalse; // counter is expected in eax
+		OptNeed( 1 );
+		b = &optStack[ optDepth - 1 ];
+		if ( b->type == IT_LOCAL || b->type == IT_LOCALVAL ) {
+			OptLoadRx( optDepth - 1 );
+		}
+		OptSpillLocals( optDepth - 1 );
+		OptForgetLocal( ci->value, 4 );
+		switch ( b->type ) {
+			case IT_CONST:
+				EmitRM( NULL, "C7", 0, RM_LOCAL, ci->value );	// mov dword ptr [ebp + 0x7F], 0x12345678
+				Emit4( b->value );
+				break;
+			case IT_XMM:
+				EmitRM( "F3", "0F 11", b->value, RM_LOCAL, ci->value ); // movss dword ptr [ebp + 0x7F], xmm
+				break;
+			default:
+				EmitRM( NULL, "89", b->value, RM_LOCAL, ci->value );	// mov dword ptr [ebp + 0x7F], r
+				break;
+		}
+		optDepth--;
+		return qtrue;
+
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		// only constant shifts, variable ones need cl
+		if ( optDepth == 0 || optStack[ optDepth - 1 ].type != IT_CONST || (unsigned)optStack[ optDepth - 1 ].value > 31 )
+			return qfalse;
+		// fall through
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_MULI:
+	case OP_MULU:
+		OptNeed( 2 );
+		a = &optStack[ optDepth - 2 ];
+		b = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST && b->type == IT_CONST ) {
+			a->value = OptFoldInt( op, a->value, b->value );
+			optDepth--;
+			return qtrue;
+		}
+		if ( b->type == IT_CONST && a->type == IT_LOCAL && ( op == OP_ADD || op == OP_SUB ) ) {
+			a->value = OptFoldInt( op, a->value, b->value );
+			optDepth--;
+			return qtrue;
+		}
+		if ( a->type == IT_CONST && op != OP_SUB && op != OP_LSH && op != OP_RSHI && op != OP_RSHU ) {
+			t = *a; *a = *b; *b = t;
+		}
+		ra = OptLoadRx( optDepth - 2 );
+		if ( b->type == IT_CONST ) {
+			v = b->value;
+			switch ( op ) {
+				case OP_ADD:  EmitGroup1Imm( 0, RM_REG, ra, v ); break;	// add r, 0x12345678
+				case OP_BOR:  EmitGroup1Imm( 1, RM_REG, ra, v ); break;	// or r, 0x12345678
+				case OP_BAND: EmitGroup1Imm( 4, RM_REG, ra, v ); break;	// and r, 0x12345678
+				case OP_SUB:  EmitGroup1Imm( 5, RM_REG, ra, v ); break;	// sub r, 0x12345678
+				case OP_BXOR: EmitGroup1Imm( 6, RM_REG, ra, v ); break;	// xor r, 0x12345678
+				case OP_LSH:  EmitRM( NULL, "C1", 4, RM_REG, ra ); Emit1( v ); break;	// shl r, 0x12
+				case OP_RSHI: EmitRM( NULL, "C1", 7, RM_REG, ra ); Emit1( v ); break;	// sar r, 0x12
+				case OP_RSHU: EmitRM( NULL, "C1", 5, RM_REG, ra ); Emit1( v ); break;	// shr r, 0x12
+				default:
+					if ( ISS8( v ) ) {
+						EmitRM( NULL, "6B", ra, RM_REG, ra );	// imul r, r, 0x7F
+						Emit1( v );
+					} else {
+						EmitRM( NULL, "69", ra, RM_REG, ra );	// imul r, r, 0x12345678
+						Emit4( v );
+					}
+					break;
+			}
+		} else {
+			type = OptOperand( optDepth - 1, &rm );
+			switch ( op ) {
+				case OP_ADD:  EmitRM( NULL, "03", ra, type, rm ); break;	// add r, r/m
+				case OP_SUB:  EmitRM( NULL, "2B", ra, type, rm ); break;	// sub r, r/m
+				case OP_BAND: EmitRM( NULL, "23", ra, type, rm ); break;	// and r, r/m
+				case OP_BOR:  EmitRM( NULL, "0B", ra, type, rm ); break;	// or r, r/m
+				case OP_BXOR: EmitRM( NULL, "33", ra, type, rm ); break;	// xor r, r/m
+				default:      EmitRM( NULL, "0F AF", ra, type, rm ); break; // imul r, r/m
+			}
+		}
+		optDepth--;
+		return qtrue;
+
+	case OP_NEGI:
+	case OP_BCOM:
+	case OP_SEX8:
+	case OP_SEX16:
+		OptNeed( 1 );
+		a = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST ) {
+			switch ( op ) {
+				case OP_NEGI:	a->value = -(unsigned)a->value; break;
+				case OP_BCOM:	a->value = ~a->value; break;
+				case OP_SEX8:	a->value = (signed char)a->value; break;
+				default:		a->value = (short)a->value; break;
+			}
+			return qtrue;
+		}
+		ra = OptLoadRx( optDepth - 1 );
+		switch ( op ) {
+			case OP_NEGI:	EmitRM( NULL, "F7", 3, RM_REG, ra ); break;		// neg r
+			case OP_BCOM:	EmitRM( NULL, "F7", 2, RM_REG, ra ); break;		// not r
+			case OP_SEX8:	EmitRM( NULL, "0F BE", ra, RM_REG, ra ); break;	// movsx r, r8
+			default:		EmitRM( NULL, "0F BF", ra, RM_REG, ra ); break;	// movsx r, r16
+		}
+		return qtrue;
+
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+		OptNeed( 2 );
+		a = &optStack[ optDepth - 2 ];
+		b = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST && b->type != IT_CONST ) {
+			t = *a; *a = *b; *b = t;
+			op = OptSwapCond( op );
+		}
+		if ( a->type == IT_LOCALVAL && ( b->type == IT_CONST || b->type == IT_REG ) ) {
+			type = RM_LOCAL;
+			rm = a->value;
+		} else {
+			type = RM_REG;
+			rm = OptLoadRx( optDepth - 2 );
+		}
+		if ( b->type != IT_CONST && !( b->type == IT_LOCALVAL && type == RM_REG ) ) {
+			OptLoadRx( optDepth - 1 );
+		}
+		t = *b;
+		// branch targets expect everything in opStack memory
+		OptFlushBelow( 2 );
+		optDepth = 0;
+		EmitOpStackAdjust( optDelta );
+		optDelta = 0;
+		if ( t.type == IT_CONST ) {
+			if ( t.value == 0 && type == RM_REG && ( op == OP_EQ || op == OP_NE ) ) {
+				EmitRM( NULL, "85", rm, RM_REG, rm );			// test r, r
+			} else {
+				EmitGroup1Imm( 7, type, rm, t.value );			// cmp r/m, 0x12345678
+			}
+		} else if ( t.type == IT_LOCALVAL ) {
+			EmitRM( NULL, "3B", rm, RM_LOCAL, t.value );		// cmp r, dword ptr [ebp + 0x7F]
+		} else {
+			EmitRM( NULL, "39", t.value, type, rm );			// cmp r/m, r
+		}
+		EmitJump( vm, ci, op, ci->value );
+		return qtrue;
+
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+		OptNeed( 2 );
+		// unordered results must not branch except for OP_NEF, same as the interpreter
+		if ( op == OP_LTF || op == OP_LEF ) {
+			// b > a, b >= a
+			ra = OptLoadSx( optDepth - 1 );
+			type = OptOperandSx( optDepth - 2, &rm );
+		} else {
+			ra = OptLoadSx( optDepth - 2 );
+			type = OptOperandSx( optDepth - 1, &rm );
+		}
+		OptFlushBelow( 2 );
+		optDepth = 0;
+		EmitOpStackAdjust( optDelta );
+		optDelta = 0;
+		EmitRM( NULL, "0F 2F", ra, type, rm );					// comiss xmm, xmm/m32
+		switch ( op ) {
+			case OP_EQF:
+				EmitString( "7A 06" );							// jp +6
+				EmitJump( vm, ci, OP_EQ, ci->value );			// je +addr
+				break;
+			case OP_NEF:
+				EmitJump( vm, ci, OP_NE, ci->value );			// jne +addr
+				EmitParityJump( ci->value );					// jp +addr
+				break;
+			case OP_LTF:
+			case OP_GTF:
+				EmitJump( vm, ci, OP_GTU, ci->value );			// ja +addr
+				break;
+			default:
+				EmitJump( vm, ci, OP_GEU, ci->value );			// jae +addr
+				break;
+		}
+		return qtrue;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_MULF:
+	case OP_DIVF:
+		OptNeed( 2 );
+		a = &optStack[ optDepth - 2 ];
+		b = &optStack[ optDepth - 1 ];
+		// operands are never swapped and NaNs are never folded because
+		// resulting NaN payload depends on operand order
+		if ( a->type == IT_CONST && b->type == IT_CONST && !OptIsNaN( a->value ) && !OptIsNaN( b->value ) ) {
+			floatint_t fa, fb;
+			fa.i = a->value;
+			fb.i = b->value;
+			switch ( op ) {
+				case OP_ADDF: f.f = fa.f + fb.f; break;
+				case OP_SUBF: f.f = fa.f - fb.f; break;
+				case OP_MULF: f.f = fa.f * fb.f; break;
+				default:      f.f = fa.f / fb.f; break;
+			}
+			a->value = f.i;
+			optDepth--;
+			return qtrue;
+		}
+		ra = OptLoadSx( optDepth - 2 );
+		type = OptOperandSx( optDepth - 1, &rm );
+		switch ( op ) {
+			case OP_ADDF: EmitRM( "F3", "0F 58", ra, type, rm ); break;	// addss xmm, xmm/m32
+			case OP_SUBF: EmitRM( "F3", "0F 5C", ra, type, rm ); break;	// subss xmm, xmm/m32
+			case OP_MULF: EmitRM( "F3", "0F 59", ra, type, rm ); break;	// mulss xmm, xmm/m32
+			default:      EmitRM( "F3", "0F 5E", ra, type, rm ); break;	// divss xmm, xmm/m32
+		}
+		optDepth--;
+		return qtrue;
+
+	case OP_NEGF:
+		OptNeed( 1 );
+		a = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST ) {
+			a->value ^= 0x80000000;
+			return qtrue;
+		}
+		// flip the sign bit, so -(0.0) gives -0.0 like in the interpreter
+		ra = OptLoadRx( optDepth - 1 );
+		EmitRM( NULL, "81", 6, RM_REG, ra );		// xor r, 0x80000000
+		Emit4( 0x80000000 );
+		return qtrue;
+
+	case OP_CVIF:
+		OptNeed( 1 );
+		a = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST ) {
+			f.f = (float)a->value;
+			a->value = f.i;
+			return qtrue;
+		}
+		type = OptOperand( optDepth - 1, &rm );
+		n = OptAllocSx();
+		EmitRM( NULL, "0F 57", n, RM_REG, n );		// xorps xmm, xmm
+		EmitRM( "F3", "0F 2A", n, type, rm );		// cvtsi2ss xmm, r/m32
+		a->type = IT_XMM;
+		a->value = n;
+		return qtrue;
+
+	case OP_CVFI:
+		OptNeed( 1 );
+		a = &optStack[ optDepth - 1 ];
+		if ( a->type == IT_CONST ) {
+			f.i = a->value;
+			if ( f.f > -2147483648.0f && f.f < 2147483648.0f ) {
+				a->value = (int)f.f;
+				return qtrue;
+			}
+		}
+		type = OptOperandSx( optDepth - 1, &rm );
+		n = OptAllocRx();
+		EmitRM( "F3", "0F 2C", n, type, rm );		// cvttss2si r, xmm/m32
+		a->type = IT_REG;
+		a->value = n;
+		return qtrue;
+
+	default:
+		break;
+	}
+
+	return qfalse;
+}
+#endif // idx64
+
+
+/*
+=================
+VM_GenerateCode
+
+Translates prepared inst[] into newly allocated code buffer, touches
+only static compiler state so may run on a background thread
+=================
+*/
+static qboolean VM_GenerateCode( vm_t *vm ) {
+	int		instructionCount;
+	int		proc_base;
+	int		proc_len;
+	int		i, n, v;
+	qboolean	wantres;
+
+	code = NULL; // we will allocate memory later, after last defined pass
+	instructionPointers = NULL;
+
+	memset( funcOffset, 0, sizeof( funcOffset ) );
+
+	instructionCount = vm->instructionCount;
+
+	for( pass = 0; pass < NUM_PASSES; pass++ )
+	{
+__compile:
+	pop1 = OP_UNDEF;
+	lastConst = 0;
+
+	// translate all instructions
+	ip = 0;
+	compiledOfs = 0;
+	LastCommand = LAST_COMMAND_NONE;
+
+	proc_base = -1;
+	proc_len = 0;
+
+	numRelocs = 0;
+
+#if idx64
+	optDepth = 0;
+	optDelta = 0;
+	optNumKnown = 0;
+	optInlineLeave = -1;
+	optLevel = optBase;
+#endif
+
+#if idx64
+
+	EmitString( "53" );				// push rbx
+	EmitString( "56" );				// push rsi
+	EmitString( "57" );				// push rdi
+	EmitString( "55" );				// push rbp
+	EmitString( "41 54" );			// push r12
+	EmitString( "41 55" );			// push r13
+	EmitString( "41 56" );			// push r14
+	EmitString( "41 57" );			// push r15
+
+	if ( above4G( vm->dataBase ) ) {
+		EmitString( "48 BB" );		// mov rbx, vm->dataBase
+		EmitPtr( vm->dataBase );
+	} else {
+		EmitString( "BB" );			// mov ebx, vm->dataBase
+		EmitPtr4( vm->dataBase );
+	}
+
+	EmitString( "49 B8" );			// mov r8, vm->instructionPointers
+	EmitPtr( instructionPointers );
+
+	EmitString( "41 B9" );			// mov r9d, vm->dataMask
+	Emit4( vm->dataMask );
+
+	EmitString( "41 BD" );			// mov r13d, vm->stackBottom
+	Emit4( vm->stackBottom );
+
+	if ( above4G( &vm->opStack ) ) {
+		EmitString( "48 B8" );		// mov rax, &vm->opStack
+		EmitPtr( &vm->opStack );
+	} else {
+		EmitString( "B8" );			// mov eax, &vm->opStack
+		EmitPtr4( &vm->opStack );
+	}
+	EmitRexString( "8B 38" );		// mov rdi, [rax]
+
+	if ( above4G( vm->systemCall ) ) {
+		EmitString( "49 BC" );		// mov r12, &vm->systemCall
+		EmitPtr( vm->systemCall );
+	} else {
+		EmitString( "41 BC" );		// mov r12d, &vm->systemCall
+		EmitPtr4( vm->systemCall );
+	}
+
+	if ( above4G( &vm->programStack ) ) {
+		EmitString( "48 B8" );		// mov rax, &vm->programStack
+		EmitPtr( &vm->programStack );
+	} else {
+		EmitString( "B8" );			// mov eax, &vm->programStack
+		EmitPtr4( &vm->programStack );
+	}
+	EmitString( "8B 30" );			// mov esi, dword ptr [rax]
+
+	//EmitString( "48 B8" );		// mov rax, &vm->opStackTop
+	//EmitPtr( &vm->opStackTop );
+	//EmitString( "4C 8B 30" );		// mov r14, [rax]
+
+	EmitString( "4C 8D B7" );		// lea r14, [opStack + opStackSize - 1]
+	Emit4( sizeof( int ) * MAX_OPSTACK_SIZE - 1 );
+
+	if ( profileCounters ) {
+		EmitString( "49 BF" );		// mov r15, profileCounters
+		EmitPtr( profileCounters );
+	}
+
+#else  // id386
+
+	EmitString( "60" );				// pushad
+
+	EmitString( "BB" );				// mov ebx, vm->dataBase
+	EmitPtr( vm->dataBase );
+
+	EmitString( "8B 35" );			// mov esi, [vm->programStack]
+	EmitPtr( &vm->programStack );
+
+	EmitString( "8B 3D" );			// mov edi, [vm->opStack]
+	EmitPtr( &vm->opStack );
+
+#endif
+
+	EmitCallOffset( FUNC_ENTR );
+
+#if idx64
+
+#ifdef DEBUG_VM
+	EmitRexString( "B8" );			// mov rax, &vm->programStack
+	EmitPtr( &vm->programStack );
+	EmitString( "89 30" );			// mov [rax], esi
+#endif
+
+	if ( above4G( &vm->opStack ) ) {
+		EmitString( "48 B8" );		// mov rax, &vm->opStack
+		EmitPtr( &vm->opStack );
+	} else {
+		EmitString( "B8" );			// mov eax, &vm->opStack
+		EmitPtr4( &vm->opStack );
+	}
+	EmitRexString( "89 38" );		// mov [rax], rdi
+
+	EmitString( "41 5F" );			// pop r15
+	EmitString( "41 5E" );			// pop r14
+	EmitString( "41 5D" );			// pop r13
+	EmitString( "41 5C" );			// pop r12
+	EmitString( "5D" );				// pop rbp
+	EmitString( "5F" );				// pop rdi
+	EmitString( "5E" );				// pop rsi
+	EmitString( "5B" );				// pop rbx
+
+#else // id386
+
+#ifdef DEBUG_VM
+	EmitString( "89 35" );			// [vm->programStack], esi
+	EmitPtr( &vm->programStack );
+#endif
+
+	EmitString( "89 3D" );			// [vm->opStack], edi
+	EmitPtr( &vm->opStack );
+
+	EmitString( "61" );				// popad
+#endif
+
+	EmitString( "C3" );				// ret
+
+	EmitAlign( 4 );
+
+	// main function entry offset
+	funcOffset[FUNC_ENTR] = compiledOfs;
+
+	while ( ip < instructionCount )
+	{
+#if idx64
+		// jump targets expect all values in opStack memory
+		if ( optLevel && inst[ ip ].jused ) {
+			OptFlush();
+		}
+#endif
+
+		instructionOffsets[ ip ] = compiledOfs;
+
+		ci = &inst[ ip ];
+		ni = &inst[ ip + 1 ];
+		ip++;
+
+		if ( ci->jused ) {
+			LastCommand = LAST_COMMAND_NONE;
+			pop1 = OP_UNDEF;
+		}
+
+#if idx64
+		if ( profileCounters && ci->jused ) {
+			EmitString( "41 FF 87" );		// inc dword ptr [r15 + 0x12345678]
+			Emit4( ( ip - 1 ) * sizeof( int ) );
+		}
+
+		if ( ci->op == OP_ENTER ) {
+			optLevel = ( hotFunctions && hotFunctions[ ip - 1 ] ) ? 2 : optBase;
+		} else if ( ip - 1 == optInlineLeave ) {
+			OptEndInline();
+			continue;
+		}
+
+		if ( optLevel ) {
+			if ( EmitOptimized( vm ) ) {
+				pop1 = OP_UNDEF;
+				continue;
+			}
+			OptFlush();
+		}
+#endif
+
+		switch ( ci->op ) {
+
+		case OP_UNDEF:
+			break;
+
+		case OP_IGNORE:
+			ip += ci->value;
+			break;
+
+		case OP_BREAK:
+			EmitString( "CC" );		// int 3
+			break;
+
+		case OP_ENTER:
+			v = ci->value;
+			if ( ISU8( v ) ) {
+				EmitString( "83 EE" );		// sub	esi, 0x12
+				Emit1( v );
+			} else {
+				EmitString( "81 EE" );		// sub	esi, 0x12345678
+				Emit4( v );
+			}
+
+			// locate endproc
+			for ( n = -1, i = ip + 1; i < instructionCount; i++ ) {
+				if ( inst[ i ].op == OP_PUSH && inst[ i + 1 ].op == OP_LEAVE ) {
+					n = i;
+					break;
+				}
+			}
+
+			// should never happen because equal check in VM_LoadInstructions() but anyway
+			if ( n == -1 ) {
+				compileError = "missing proc end";
+				return qfalse;
+			}
+
+			proc_base = ip + 1;
+			proc_len = n - proc_base + 1 ;
+
+			// programStack overflow check
+			if ( vm_rtChecks->integer & 1 ) {
+#if idx64
+				//EmitString( "4C 39 EE" );		// cmp	rsi, r13
+				EmitString( "44 39 EE" );		// cmp	esi, r13d
+#else
+				EmitString( "81 FE" );			// cmp	esi, vm->stackBottom
+				Emit4( vm->stackBottom );
+#endif
+				EmitString( "0F 82" );			// jb +funcOffset[FUNC_PSOF]
+				n = funcOffset[FUNC_PSOF] - compiledOfs;
+				Emit4( n - 6 );
+			}
+
+			// opStack overflow check
+			if ( vm_rtChecks->integer & 2 ) {
+				if ( ISU8( ci->opStack ) ) {
+					EmitRexString( "8D 47" );		// lea eax, [edi+0x7F]
+					Emit1( ci->opStack );
+				} else {
+					EmitRexString( "8D 87" );		// lea eax, [edi+0x12345678]
+					Emit4( ci->opStack );
+				}
+#if idx64
+				EmitString( "4C 39 F0" );		// cmp rax, r14
+#else
+				EmitString( "3B 05" );			// cmp eax, [&vm->opStackTop]
+				EmitPtr( &vm->opStackTop );
+#endif
+				EmitString( "0F 87" );			// ja +funcOffset[FUNC_OSOF]
+				n = funcOffset[FUNC_OSOF] - compiledOfs;
+				Emit4( n - 6 );
+			}
+
+			EmitRexString( "8D 2C 33" );		// lea ebp, [ebx+esi]
+			break;
+
+		case OP_CONST:
+
+			// we can safely perform optimizations only in case if
+			// we are 100% sure that next instruction is not a jump label
+			if ( !ni->jused && ConstOptimize( vm ) )
+				break;
+
+			EmitAddEDI4( vm );					// add edi, 4
+			EmitString( "C7 07" );				// mov dword ptr [edi], 0x12345678
+			lastConst = ci->value;
+			Emit4( lastConst );
+			LastCommand = LAST_COMMAND_MOV_EDI_CONST;
+			break;
+
+		case OP_LOCAL:
+			// optimization: merge OP_LOCAL + OP_LOAD4
+			if ( ni->op == OP_LOAD4 ) {
+				EmitAddEDI4( vm );				// add edi, 4
+				v = ci->value;
+				if ( ISU8( v ) ) {
+					EmitString( "8B 45" );		// mov eax, dword ptr [ebp + 0x7F]
+					Emit1( v );
+				} else {
+					EmitString( "8B 85" );		// mov eax, dword ptr [ebp + 0x12345678]
+					Emit4( v );
+				}
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
+				ip++;
+				break;
+			}
+
+			// optimization: merge OP_LOCAL + OP_LOAD2
+			if ( ni->op == OP_LOAD2 ) {
+				EmitAddEDI4( vm );				// add edi, 4
+				v = ci->value;
+				if ( ISU8( v ) ) {
+					EmitString( "0F B7 45" );	// movzx eax, word ptr [ebp + 0x7F]
+					Emit1( v );
+				} else {
+					EmitString( "0F B7 85" );	// movzx eax, word ptr [ebp + 0x12345678]
+					Emit4( v );
+				} 
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
+				ip++;
+				break;
+			}
+
+			// optimization: merge OP_LOCAL + OP_LOAD1
+			if ( ni->op == OP_LOAD1 ) {
+				EmitAddEDI4( vm );				// add edi, 4
+				v = ci->value;
+				if ( ISU8( v ) ) {
+					EmitString( "0F B6 45" );	// movzx eax, byte ptr [ebp + 0x7F]
+					Emit1( v );
+				} else {
+					EmitString( "0F B6 85" );	// movzx eax, byte ptr [ebp + 0x12345678]
+					Emit4( v );
+				}
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX ); // mov dword ptr [edi], eax
+				ip++;
+				break;
+			}
+
+			// TODO: i = j + k;
+			// TODO: i = j - k;
+
+			EmitAddEDI4( vm );					// add edi, 4
+			v = ci->value;
+			if ( ISU8( v ) ) {
+				EmitString( "8D 46" );			// lea eax, [esi + 0x7F]
+				Emit1( v );
+			} else {
+				EmitString( "8D 86" );			// lea eax, [esi + 0x12345678]
+				Emit4( v );
+			}
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			break;
+
+		case OP_ARG:
+			if ( LastCommand == LAST_COMMAND_STORE_FLOAT_EDI_SSE ) {
+				REWIND(4);
+				v = ci->value;
+				if ( ISU8( v ) ) {
+					EmitString( "F3 0F 11 45" ); // movss dword ptr [ebp + 0x7F], xmm0
+					Emit1( v );
+				} else {
+					EmitString( "F3 0F 11 85" ); // movss dword ptr [ebp + 0x12345678], xmm0
+					Emit4( v );
+				}
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				break;
+			}
+			EmitMovEAXEDI( vm );					// mov	eax, dword ptr [edi]
+			if ( (ci+1)->op == MOP_NCPY && !(ci+1)->jused ) {
+				// we will read counter from eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				break;
+			}
+			v = ci->value;
+			if ( ISU8( v ) ) {
+				EmitString( "89 45" );				// mov	dword ptr [ebp + 0x7F], eax
+				Emit1( v );
+			} else {
+				EmitString( "89 85" );				// mov	dword ptr [ebp + 0x12345678], eax
+				Emit4( v );
+			}
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_CALL:
+#ifdef VM_LOG_SYSCALLS
+			// [dataBase + programStack + 0] = ip-1;
+			EmitString( "C7 45 00" );				// mov dword ptr [ebp], 0x12345678
+			Emit4( ip-1 );
+#endif
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitCallOffset( FUNC_CALL );			// call +FUNC_CALL
+			break;
+
+		case OP_PUSH:
+			EmitAddEDI4( vm );						// add edi, 4
+			break;
+
+		case OP_POP:
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_LEAVE:
+#ifdef DEBUG_VM
+			v = ci->value;
+			if ( ISU8( v ) ) {
+				EmitString( "83 C6" );		// add	esi, 0x12
+				Emit1( v );
+			} else {
+				EmitString( "81 C6" );		// add	esi, 0x12345678
+				Emit4( v );
+			}
+#endif
+			EmitString( "C3" );							// ret
+			break;
+
+		case OP_LOAD4:
+			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
+				REWIND( 2 );
+				EmitCheckReg( vm, REG_EAX, 4 );			// range check eax
+				EmitString( "8B 04 03" );				// mov	eax, dword ptr [ebx + eax]
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+				break;
+			}
+			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]		
+			EmitCheckReg( vm, REG_ECX, 4 );				// range check ecx
+			EmitString( "8B 04 0B" );					// mov	eax, dword ptr [ebx + ecx]
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
+			break;
+
+		case OP_LOAD2:
+			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
+				REWIND( 2 );
+				EmitCheckReg( vm, REG_EAX, 2 );			// range check eax
+				if ( ni->op == OP_SEX16 ) {
+					EmitString( "0F BF 04 03" );		// movsx eax, word ptr [ebx + eax]
+					ip++;
+				} else {
+					EmitString( "0F B7 04 03" );		// movzx eax, word ptr [ebx + eax]
+				}
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+				break;
+			}
+			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]
+			EmitCheckReg( vm, REG_ECX, 2 );				// range check ecx
+			if ( ni->op == OP_SEX16 ) {
+				EmitString( "0F BF 04 0B" );			// movsx eax, word ptr [ebx + ecx]
+				ip++;
+			} else {
+				EmitString( "0F B7 04 0B" );			// movzx eax, word ptr [ebx + ecx]
+			}
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
+			break;
+
+		case OP_LOAD1:
+			if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
+				REWIND( 2 );
+				EmitCheckReg( vm, REG_EAX, 1 );			// range check eax
+				if ( ni->op == OP_SEX8 ) {
+					EmitString( "0F BE 04 03" );		// movsx eax, byte ptr [ebx + eax]
+					ip++;
+				} else {
+					EmitString( "0F B6 04 03" );		// movzx eax, byte ptr [ebx + eax]
+				}
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+				break;
+			}
+			EmitMovECXEDI( vm );						// mov ecx, dword ptr [edi]
+			EmitCheckReg( vm, REG_ECX, 1 );				// range check ecx
+			if ( ni->op == OP_SEX8 ) {
+				EmitString( "0F BE 04 0B" );			// movsx eax, byte ptr [ebx + ecx]
+				ip++;
+			} else {
+				EmitString( "0F B6 04 0B" );			// movzx eax, byte ptr [ebx + ecx]
+			}
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );	// mov dword ptr [edi], eax
+			break;
+
+		case OP_STORE4:
+			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
+			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
+			EmitCheckReg( vm, REG_ECX, 4 );				// range check
+			EmitString( "89 04 0B" );					// mov dword ptr [ebx + ecx], eax
+			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
+			break;
+
+		case OP_STORE2:
+			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]	
+			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
+			EmitCheckReg( vm, REG_ECX, 2 );				// range check
+			EmitString( "66 89 04 0B" );				// mov word ptr [ebx + ecx], ax
+			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
+			break;
+
+		case OP_STORE1:
+			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]	
+			EmitString( "8B 4F FC" );					// mov ecx, dword ptr [edi-4]
+			EmitCheckReg( vm, REG_ECX, 1 );				// range check
+			EmitString( "88 04 0B" );					// mov byte ptr [ebx + ecx], al
+			EmitCommand( LAST_COMMAND_SUB_DI_8 );		// sub edi, 8
+			break;
+
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
+			EmitString( "39 47 04" );				// cmp dword ptr [edi+4], eax
+			EmitJump( vm, ci, ci->op, ci->value );
+			break;
+
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			if ( HasFCOM() ) {
+				EmitLoadFloatEDI( vm );
+				if ( HasSSEFP() ) {
+					EmitString( "F3 0F 10 4F FC" );			// movss xmm1, dword ptr [edi-4]
+					EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
+					EmitString( "0F 2F C8" );				// comiss xmm1, xmm0
+				} else {
+					EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
+					//EmitString( "D9 47 08" );				// fld dword ptr [edi+8]
+					EmitString( "D9 47 04" );				// fld dword ptr [edi+4]
+					EmitString( "DF E9" );					// fucomip
+					EmitString( "DD D8" );					// fstp st(0)
+				}
+				EmitJump( vm, ci, ci->op, ci->value );
+			} else {
+				EmitCommand( LAST_COMMAND_SUB_DI_8 );	// sub edi, 8
+				EmitString( "D9 47 04" );				// fld dword ptr [edi+4]
+				EmitString( "D8 5F 08" );				// fcomp dword ptr [edi+8]
+				EmitString( "DF E0" );					// fnstsw ax
+				EmitFloatJump( vm, ci, ci->op, ci->value );
+			}
+			pop1 = OP_UNDEF;
+			break;
+
+		case OP_NEGI:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitString( "F7 D8" );					// neg eax
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			break;
+
+		case OP_ADD:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
+			if ( wantres ) {
+				EmitString( "03 47 FC" );				// add eax, dword ptr [edi-4]
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else {
+				EmitString( "01 47 FC" );				// add dword ptr [edi-4],eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_SUB:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			if ( wantres ) {
+				EmitMovECXEDI( vm );					// mov ecx,dword ptr [edi]
+				EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				EmitString( "29 C8" );					// sub eax, ecx
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else {
+				EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+				EmitString( "29 47 FC" );				// sub dword ptr [edi-4],eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_DIVI:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			EmitMovECXEDI( vm );					// mov ecx,dword ptr [edi]
+			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+			if ( wantres ) {
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				EmitString( "99" );						// cdq
+				EmitString( "F7 F9" );					// idiv ecx
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else{
+				EmitString( "99" );						// cdq
+				EmitString( "F7 F9" );					// idiv ecx
+				EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_DIVU:
+			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+			EmitString( "33 D2" );					// xor edx, edx
+			EmitString( "F7 37" );					// div dword ptr [edi]
+			EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_MODI:
+			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+			EmitString( "99" );						// cdq
+			EmitString( "F7 3F" );					// idiv dword ptr [edi]
+			EmitString( "89 57 FC" );				// mov dword ptr [edi-4],edx
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_MODU:
+			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+			EmitString( "33 D2" );					// xor edx, edx
+			EmitString( "F7 37" );					// div dword ptr [edi]
+			EmitString( "89 57 FC" );				// mov dword ptr [edi-4],edx
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_MULI:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitString( "F7 6F FC" );				// imul eax, dword ptr [edi-4]
+			if ( wantres ) {
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else {
+				EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_MULU:
+			EmitString( "8B 47 FC" );				// mov eax,dword ptr [edi-4]
+			EmitString( "F7 27" );					// mul dword ptr [edi]
+			EmitString( "89 47 FC" );				// mov dword ptr [edi-4],eax
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_BAND:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			EmitMovEAXEDI( vm );						// mov eax, dword ptr [edi]
+			if ( wantres ) {
+				EmitString( "23 47 FC" );				// and eax, dword ptr [edi-4]
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else {
+				EmitString( "21 47 FC" );				// and dword ptr [edi-4],eax
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_BOR:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitString( "09 47 FC" );				// or dword ptr [edi-4],eax
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_BXOR:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitString( "31 47 FC" );				// xor dword ptr [edi-4],eax
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_BCOM:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitString( "F7 D0" );					// not eax
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			break;
+
+		case OP_LSH:
+			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
+			EmitString( "D3 67 FC" );				// shl dword ptr [edi-4], cl
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_RSHI:
+			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
+			EmitString( "D3 7F FC" );				// sar dword ptr [edi-4], cl
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_RSHU:
+			EmitMovECXEDI( vm );					// mov ecx, dword ptr [edi]
+			EmitString( "D3 6F FC" );				// shr dword ptr [edi-4], cl
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			break;
+
+		case OP_NEGF:
+			//if ( !ci->fpu )
+			EmitLoadFloatEDI( vm );					// fld dword ptr [edi] | movss xmm0, dword ptr [edi]
+			if ( HasSSEFP() ) {
+				EmitString( "0F 57 C9" );			// xorps xmm1, xmm1
+				EmitString( "0F 5C C8" );			// subps xmm1, xmm0
+				EmitString( "0F 28 C1" );			// movaps xmm0, xmm1
+			} else {
+				EmitString( "D9 E0" );				// fchs
+			}
+			//if ( !ci->fpu || ci->store )
+			EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI ); // fstp dword ptr [edi]
+			break;
+
+		case OP_ADDF:
+		case OP_SUBF:
+		case OP_DIVF:
+		case OP_MULF:
+			wantres = ( ops[ ni->op ].stack <= 0 );
+			if ( HasSSEFP() ) {
+				if ( LastCommand == LAST_COMMAND_STORE_FLOAT_EDI_SSE ) {
+					REWIND(4);
+					EmitString( "0F 28 C8" );		// movaps xmm1, xmm0
+				} else {
+					EmitString( "F3 0F 10 0F" );	// movss xmm1, dword ptr [edi]
+				}
+				EmitString( "F3 0F 10 47 FC" );		// movss xmm0, dword ptr [edi-4]
+				if ( wantres ) {
+					if ( ni->op == OP_STORE4 ) {
+						 EmitString( "8B 47 F8" );	// mov eax, dword ptr [edi-8]
+						 EmitCheckReg( vm, REG_EAX, 4 );
+					} else if ( ni->op == OP_ARG ) {
+						//
+					} else {
+						EmitCommand( LAST_COMMAND_SUB_DI_4 );
+					}
+				}
+				switch( ci->op ) {
+					case OP_ADDF: EmitString( "0F 58 C1" ); break;	// addps xmm0, xmm1
+					case OP_SUBF: EmitString( "0F 5C C1" ); break;	// subps xmm0, xmm1
+					case OP_MULF: EmitString( "0F 59 C1" ); break;	// mulps xmm0, xmm1
+					case OP_DIVF: EmitString( "0F 5E C1" ); break;	// divps xmm0, xmm1
+				}
+				if ( wantres ) {
+					if ( ni->op == OP_STORE4 ) {
+						EmitString( "F3 0F 11 04 03" );		// movss dword ptr [ebx + eax], xmm0
+						EmitCommand( LAST_COMMAND_SUB_DI_12 );
+						pop1 = OP_UNDEF;
+						ip++; // OP_STORE4
+					} else if ( ni->op == OP_ARG ) {
+						v = ni->value;
+						if ( ISU8( v ) ) {
+							EmitString( "F3 0F 11 45" ); // movss dword ptr [ebp + 0x7F], xmm0
+							Emit1( v );
+						} else {
+							EmitString( "F3 0F 11 85" ); // movss dword ptr [ebp + 0x12345678], xmm0
+							Emit4( v );
+						}
+						EmitCommand( LAST_COMMAND_SUB_DI_8 );
+						pop1 = OP_UNDEF;
+						ip++; // OP_ARG
+					} else {
+						EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI );
+					}
+				} else {
+					EmitString( "F3 0F 11 47 FC" );			// movss dword ptr [edi-4], xmm0
+					EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+				}
+			} else {
+				EmitString( "D9 47 FC" );			// fld dword ptr [edi-4]
+				EmitFCalcEDI( ci->op );				// fadd|fsub|fmul|fdiv dword ptr [edi]
+				EmitString( "D9 5F FC" );			// fstp dword ptr [edi-4]
+				EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+			}
+			break;
+
+		case OP_CVIF:
+			if ( HasSSEFP() ) {
+				if ( LastCommand == LAST_COMMAND_MOV_EDI_EAX ) {
+					REWIND(2);
+					EmitString( "F3 0F 2A C0" );	// cvtsi2ss xmm0, eax
+				} else {
+					EmitString( "F3 0F 2A 07" );	// cvtsi2ss xmm0, dword ptr [edi]
+				}
+			} else {
+				EmitString( "DB 07" );				// fild dword ptr [edi]
+			}
+			//if ( !ci->fpu ) 
+			EmitCommand( LAST_COMMAND_STORE_FLOAT_EDI );
+			break;
+
+		case OP_CVFI:
+			if ( HasSSEFP() ) {
+				// assume that rounding mode in MXCSR is correctly set in 64-bit environment
+				EmitLoadFloatEDI_SSE( vm );				// movss xmm0, dword ptr [edi]
+				EmitString( "F3 0F 2C C0" );			// cvttss2si eax, xmm0
+				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			} else {
+				EmitLoadFloatEDI_X87( vm );			// fld dword ptr [edi]
+				// call the library conversion function
+				EmitCallOffset( FUNC_FTOL );	// call +FUNC_FTOL
+			}
+			break;
+
+		case OP_SEX8:
+			EmitString( "0F BE 07" );				// movsx eax, byte ptr [edi]
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			break;
+
+		case OP_SEX16:
+			EmitString( "0F BF 07" );				// movsx eax, word ptr [edi]
+			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
+			break;
+
+		case OP_BLOCK_COPY:
+			EmitString( "B9" );						// mov ecx, 0x12345678
+			Emit4( ci->value >> 2 );
+			EmitCallOffset( FUNC_BCPY );
+			break;
+
+		case OP_JUMP:
+			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
+			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
+
+			// jump target range check
+			if ( vm_rtChecks->integer & 4 ) {
+				if ( proc_base != -1 ) {
+					// allow jump within local function scope only
+					EmitString( "89 C2" );			// mov edx, eax
+					if ( ISU8( proc_base ) ) {
+						EmitString( "83 EA" );		// sub edx, 0x7F
+						Emit1( proc_base );
+					} else {
+						EmitString( "81 EA" );		// sub edx, 0x12345678
+						Emit4( proc_base );
+					}
+					if ( ISU8( proc_len ) ) {
+						EmitString( "83 FA" );		// cmp edx, 0x7F
+						Emit1( proc_len );
+					} else {
+						EmitString( "81 FA" );		// cmp edx, 0x12345678
+						Emit4( proc_len );
+					}
+				} else {
+					EmitString( "3D" );				// cmp eax, 0x12345678
+					Emit4( vm->instructionCount );
+				}
+				EmitString( "0F 83" );				// jae +funcOffset[FUNC_BADJ]
+				n = funcOffset[FUNC_BADJ] - compiledOfs;
+				Emit4( n - 6 );
+			}
+#if idx64
+			EmitString( "41 FF 24 C0" );			// jmp dword ptr [r8 + rax*8]
+#else
+			EmitString( "FF 24 85" );				// jmp dword ptr [instructionPointers + eax * 4]
+			EmitPtr( instructionPointers );
+#endif
+			break;
+
+		case MOP_ADD4:
+		case MOP_SUB4:
+		case MOP_BAND4:
+		case MOP_BOR4:
+		case MOP_NCPY:
+			if ( !EmitMOPs( vm, ci->op ) )
+				Com_Error( ERR_FATAL, "VM_CompileX86: bad opcode %02X", ci->op );
+			break;
+
+		default:
+			Com_Error( ERR_FATAL, "VM_CompileX86: bad opcode %02X", ci->op );
+			return qfalse;
+		}
+
+		pop1 = (opcode_t)ci->op;
+	} // while( ip < header->instructionCount )
+
+#if idx64
+	if ( optLevel ) {
+		OptFlush();
+	}
+#endif
+
+		// ****************
+		// system functions
+		// ****************
+		EmitAlign( 8 );
+		funcOffset[FUNC_CALL] = compiledOfs;
+		EmitCallFunc( vm );
+
+		EmitAlign( 8 );
+		funcOffset[FUNC_FTOL] = compiledOfs;
+		EmitFTOLFunc( vm );
+
+		EmitAlign( 8 );
+		funcOffset[FUNC_BCPY] = compiledOfs;
+		EmitBCPYFunc( vm );
+
+		EmitAlign( 8 );
+		funcOffset[FUNC_NCPY] = compiledOfs;
+		EmitNCPYFunc( vm );
+
+		// ***************
+		// error functions
+		// ***************
+
+		// bad jump
+		EmitAlign( 8 );
+		funcOffset[FUNC_BADJ] = compiledOfs;
+		EmitBADJFunc( vm );
+
+		// error jump
+		EmitAlign( 8 );
+		funcOffset[FUNC_ERRJ] = compiledOfs;
+		EmitERRJFunc( vm );
+
+		// programStack overflow
+		EmitAlign( 8 );
+		funcOffset[FUNC_PSOF] = compiledOfs;
+		EmitPSOFFunc( vm );
+
+		// opStack overflow
+		EmitAlign( 8 );
+		funcOffset[FUNC_OSOF] = compiledOfs;
+		EmitOSOFFunc( vm );
+
+		// read/write access violation
+		EmitAlign( 8 );
+		funcOffset[FUNC_DATA] = compiledOfs;
+		EmitDATAFunc( vm );
+
+		EmitAlign( sizeof( intptr_t ) ); // for instructionPointers
+
+	} // for( pass = 0; pass < n; pass++ )
+
+	n = instructionCount * sizeof( intptr_t );
+
+	if ( code == NULL ) {
+		code = VM_Alloc_Code( PAD(compiledOfs,8) + n );
+		if ( code == NULL ) {
+			compileError = "failed to allocate code memory";
+			return qfalse;
+		}
+		instructionPointers = (intptr_t*)(byte*)(code + PAD(compiledOfs,8));
+		if ( recordRelocs ) {
+			maxRelocs = numRelocs;
+			relocs = Z_Malloc( maxRelocs * sizeof( *relocs ) );
+		}
+		//vm->instructionPointers = instructionPointers; // for debug purposes?
+		pass = NUM_PASSES-1; // repeat last pass
+		goto __compile;
+	}
+
+	// offset all the instruction pointers for the new location
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		if ( !inst[i].jused ) {
+			instructionPointers[ i ] = (intptr_t)badJumpPtr;
+			continue;
+		}
+		instructionPointers[ i ] = (intptr_t)code + instructionOffsets[ i ];
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+VM_Protect_Code
+=================
+*/
+static qboolean VM_Protect_Code( byte *ptr, int length )
+{
+#ifdef VM_X86_MMAP
+	if ( mprotect( ptr, length, PROT_READ|PROT_EXEC ) ) {
+		Com_Printf( S_COLOR_YELLOW "VM_CompileX86: mprotect failed\n" );
+		return qfalse;
+	}
+#elif _WIN32
+	DWORD oldProtect = 0;
+
+	// remove write permissions.
+	if ( !VirtualProtect( ptr, length, PAGE_EXECUTE_READ, &oldProtect ) ) {
+		Com_Printf( S_COLOR_YELLOW "VM_CompileX86: VirtualProtect failed\n" );
+		return qfalse;
+	}
+#endif
+	return qtrue;
+}
+
+
+#if idx64
+/*
+=================================================================
+
+TIERED COMPILATION (vm_tiered)
+
+Module is first compiled with baseline code which increments a counter
+at every jump target. After vm_tierThreshold top level calls functions
+taking most of executed blocks are selected and the whole module is
+translated again on a background thread, hot functions at optimization
+level 2, everything else as without vm_tiered. New code replaces the
+profiling one between top level calls. Only one module is recompiled at
+a time because the compiler state is static.
+
+=================================================================
+*/
+
+#define TIER_MAX_HOT	64		// recompiled functions at most
+#define TIER_COVERAGE	0.9		// of executed blocks
+
+typedef struct {
+	vm_t			*vm;		// not NULL while pending
+	instruction_t	*inst;
+	int				*instructionOffsets;
+	byte			*hot;
+	byte			*code;
+	int				codeLength;
+	int				codeSize;
+	qboolean		result;
+	const char		*error;
+	volatile int	done;
+} tierJob_t;
+
+static tierJob_t tierJob;
+
+typedef struct {
+	int		weight;
+	int		func;
+} tierFunc_t;
+
+
+static int QDECL VM_TierSort( const void *a, const void *b ) {
+	return ((const tierFunc_t *)b)->weight - ((const tierFunc_t *)a)->weight;
+}
+
+
+static void VM_TierJob( void *data, int index )
+{
+	tierJob_t *job = (tierJob_t *)data;
+
+	inst = job->inst;
+	instructionOffsets = job->instructionOffsets;
+	hotFunctions = job->hot;
+	profileCounters = NULL;
+	optBase = ( vm_optimize->integer & ( 1 << job->vm->index ) ) ? 1 : 0;
+
+	compileError = NULL;
+	job->result = VM_GenerateCode( job->vm );
+	job->error = compileError;
+	job->code = code;
+	job->codeLength = compiledOfs;
+	job->codeSize = PAD( compiledOfs, 8 ) + job->vm->instructionCount * sizeof( intptr_t );
+
+	inst = NULL;
+	instructionOffsets = NULL;
+	hotFunctions = NULL;
+}
+
+
+/*
+=================
+VM_TierStart
+
+Selects hot functions from profile counters and starts background recompilation
+=================
+*/
+static void VM_TierStart( vm_t *vm )
+{
+	vmTier_t *t = vm->tier;
+	tierFunc_t *funcs;
+	int i, n, numFuncs;
+	double total, sum;
+
+	funcs = Z_Malloc( vm->instructionCount * sizeof( *funcs ) );
+
+	// weight of function is number of executed blocks in it
+	numFuncs = 0;
+	total = 0;
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		if ( t->inst[ i ].op == OP_ENTER ) {
+			funcs[ numFuncs ].func = i;
+			funcs[ numFuncs ].weight = 0;
+			numFuncs++;
+		}
+		if ( numFuncs && t->counters[ i ] > 0 ) {
+			funcs[ numFuncs - 1 ].weight += t->counters[ i ];
+			total += t->counters[ i ];
+		}
+	}
+
+	qsort( funcs, numFuncs, sizeof( *funcs ), VM_TierSort );
+
+	tierJob.inst = Z_Malloc( ( vm->instructionCount + 8 ) * sizeof( instruction_t ) );
+	tierJob.instructionOffsets = Z_Malloc( vm->instructionCount * sizeof( int ) );
+	tierJob.hot = Z_Malloc( vm->instructionCount );
+
+	sum = 0;
+	for ( n = 0; n < numFuncs && n < TIER_MAX_HOT && funcs[ n ].weight > 0 && sum < total * TIER_COVERAGE; n++ ) {
+		tierJob.hot[ funcs[ n ].func ] = 1;
+		sum += funcs[ n ].weight;
+	}
+
+	Z_Free( funcs );
+
+	t->numHot = n;
+
+	Com_Memcpy( tierJob.inst, t->inst, ( vm->instructionCount + 8 ) * sizeof( instruction_t ) );
+
+	Com_DPrintf( "%s: recompiling %i hot functions\n", vm->name, n );
+
+	tierJob.vm = vm;
+	Sys_StartJob( VM_TierJob, &tierJob, &tierJob.done );
+}
+
+
+/*
+=================
+VM_TierFinish
+
+Replaces profiling code with recompiled one, vm must not be running
+=================
+*/
+static void VM_TierFinish( qboolean install )
+{
+	vm_t *vm = tierJob.vm;
+
+	if ( !tierJob.result ) {
+		Com_Printf( S_COLOR_YELLOW "%s: recompilation failed: %s\n", vm->name, tierJob.error ? tierJob.error : "unknown error" );
+		install = qfalse;
+	}
+
+	if ( install && VM_Protect_Code( tierJob.code, tierJob.codeSize ) ) {
+		VM_Free_Code( vm->codeBase.ptr, vm->codeSize );
+		vm->codeBase.ptr = tierJob.code;
+		vm->codeLength = tierJob.codeLength;
+		vm->codeSize = tierJob.codeSize;
+		vm->tier->current = 1;
+		Com_Printf( "VM file %s recompiled to %i bytes of code, %i hot functions\n", vm->name, vm->codeLength, vm->tier->numHot );
+	} else if ( tierJob.code ) {
+		VM_Free_Code( tierJob.code, tierJob.codeSize );
+	}
+
+	vm->tier->finished = qtrue;
+
+	Z_Free( tierJob.hot );
+	Z_Free( tierJob.instructionOffsets );
+	Z_Free( tierJob.inst );
+
+	Com_Memset( &tierJob, 0, sizeof( tierJob ) );
+}
+
+
+/*
+=================
+VM_TierWait
+
+Completes pending recompilation before compiler state can be used again
+=================
+*/
+static void VM_TierWait( void )
+{
+	if ( !tierJob.vm )
+		return;
+
+	while ( !Sys_JobDone( &tierJob.done ) ) {
+		Sys_Sleep( 1 );
+	}
+
+	VM_TierFinish( tierJob.vm->callLevel == 0 && tierJob.vm->codeBase.ptr != NULL );
+}
+
+
+static void VM_TierUpdate( vm_t *vm )
+{
+	vmTier_t *t = vm->tier;
+
+	if ( t->finished )
+		return;
+
+	if ( tierJob.vm == vm ) {
+		if ( Sys_JobDone( &tierJob.done ) ) {
+			VM_TierFinish( qtrue );
+		}
+		return;
+	}
+
+	if ( tierJob.vm || t->calls[0] < vm_tierThreshold->integer )
+		return;
+
+	VM_TierStart( vm );
+}
+#endif // idx64
+
+
+/*
+=================================================================
+
+CODE CACHE (vm_cache)
+
+Every absolute address emitted in the final pass is recorded and stored
+relative to one of the bases below, so cached code can be moved to any
+address. Key covers engine build, module and everything else affecting
+generated code. Tiered modules are never cached because their code
+depends on the profile.
+
+=================================================================
+*/
 
-		case OP_CVFI:
-			if ( HasSSEFP() ) {
-				// assume that rounding mode in MXCSR is correctly set in 64-bit environment
-				EmitLoadFloatEDI_SSE( vm );				// movss xmm0, dword ptr [edi]
-				EmitString( "F3 0F 2C C0" );			// cvttss2si eax, xmm0
-				EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			} else {
-				EmitLoadFloatEDI_X87( vm );			// fld dword ptr [edi]
-				// call the library conversion function
-				EmitCallOffset( FUNC_FTOL );	// call +FUNC_FTOL
-			}
-			break;
+#define RELOC_DATA		0		// ranges
+#define RELOC_CODE		1
+#define RELOC_VM		2
+#define RELOC_RANGES	3
 
-		case OP_SEX8:
-			EmitString( "0F BE 07" );				// movsx eax, byte ptr [edi]
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			break;
 
-		case OP_SEX16:
-			EmitString( "0F BF 07" );				// movsx eax, word ptr [edi]
-			EmitCommand( LAST_COMMAND_MOV_EDI_EAX );// mov dword ptr [edi], eax
-			break;
+static int VM_RelocBases( vm_t *vm, const byte *codeBase, intptr_t *bases )
+{
+	int n = 0;
+
+	bases[ n++ ] = (intptr_t)vm->dataBase;
+	bases[ n++ ] = (intptr_t)codeBase;
+	bases[ n++ ] = (intptr_t)vm;
+	bases[ n++ ] = (intptr_t)vm->systemCall;
+	bases[ n++ ] = (intptr_t)&fp_cw[0];
+	bases[ n++ ] = (intptr_t)&errJumpPtr;
+	bases[ n++ ] = (intptr_t)&badJumpPtr;
+	bases[ n++ ] = (intptr_t)&badStackPtr;
+	bases[ n++ ] = (intptr_t)&badOpStackPtr;
+	bases[ n++ ] = (intptr_t)&badDataPtr;
+#ifdef DEBUG_VM
+	bases[ n++ ] = (intptr_t)&errParam;
+#endif
 
-		case OP_BLOCK_COPY:
-			EmitString( "B9" );						// mov ecx, 0x12345678
-			Emit4( ci->value >> 2 );
-			EmitCallOffset( FUNC_BCPY );
-			break;
+	return n;
+}
 
-		case OP_JUMP:
-			EmitMovEAXEDI( vm );					// mov eax, dword ptr [edi]
-			EmitCommand( LAST_COMMAND_SUB_DI_4 );	// sub edi, 4
 
-			// jump target range check
-			if ( vm_rtChecks->integer & 4 ) {
-				if ( proc_base != -1 ) {
-					// allow jump within local function scope only
-					EmitString( "89 C2" );			// mov edx, eax
-					if ( ISU8( proc_base ) ) {
-						EmitString( "83 EA" );		// sub edx, 0x7F
-						Emit1( proc_base );
-					} else {
-						EmitString( "81 EA" );		// sub edx, 0x12345678
-						Emit4( proc_base );
-					}
-					if ( ISU8( proc_len ) ) {
-						EmitString( "83 FA" );		// cmp edx, 0x7F
-						Emit1( proc_len );
-					} else {
-						EmitString( "81 FA" );		// cmp edx, 0x12345678
-						Emit4( proc_len );
-					}
-				} else {
-					EmitString( "3D" );				// cmp eax, 0x12345678
-					Emit4( vm->instructionCount );
-				}
-				EmitString( "0F 83" );				// jae +funcOffset[FUNC_BADJ]
-				n = funcOffset[FUNC_BADJ] - compiledOfs;
-				Emit4( n - 6 );
-			}
+static void VM_CodeCacheKey( const vm_t *vm, char *key, int size )
+{
+	unsigned int jts = 0;
+	int addr = 0;
+
 #if idx64
-			EmitString( "41 FF 24 C0" );			// jmp dword ptr [r8 + rax*8]
-#else
-			EmitString( "FF 24 85" );				// jmp dword ptr [instructionPointers + eax * 4]
-			EmitPtr( instructionPointers );
+	addr = above4G( vm->dataBase ) | above4G( &vm->opStack ) << 1 | above4G( vm->systemCall ) << 2 | above4G( &vm->programStack ) << 3;
 #endif
-			break;
 
-		case MOP_ADD4:
-		case MOP_SUB4:
-		case MOP_BAND4:
-		case MOP_BOR4:
-		case MOP_NCPY:
-			if ( !EmitMOPs( vm, ci->op ) )
-				Com_Error( ERR_FATAL, "VM_CompileX86: bad opcode %02X", ci->op );
+	if ( vm->jumpTableTargets ) {
+		jts = crc32_buffer( vm->jumpTableTargets, vm->numJumpTableTargets * sizeof( int ) );
+	}
+
+	Com_sprintf( key, size, "%s %s %s %s %i|%08x %i %08x %08x %i|%i %i %08x %i",
+		Q3_VERSION, ARCH_STRING, __DATE__, __TIME__, (int)sizeof( vm_t ),
+		vm->crc32sum, vm->instructionCount, jts, vm->dataMask, vm->exactDataLength,
+		vm_rtChecks->integer, ( vm_optimize->integer >> vm->index ) & 1, CPU_Flags, addr );
+}
+
+
+/*
+=================
+VM_LoadCompiled
+
+Installs cached code of the module if there is one generated with the same key
+=================
+*/
+static qboolean VM_LoadCompiled( vm_t *vm, const char *key )
+{
+	vmCodeCache_t	cache;
+	intptr_t		bases[ VM_RELOC_BASES ], value, *table;
+	const vmReloc_t	*r;
+	void			*data;
+	byte			*ptr;
+	int				i, v, numBases, size;
+
+	Q_strncpyz( cache.key, key, sizeof( cache.key ) );
+	data = VM_LoadCodeCache( vm, &cache );
+	if ( !data ) {
+		return qfalse;
+	}
+
+	size = PAD( cache.codeLength, 8 ) + vm->instructionCount * sizeof( intptr_t );
+	ptr = VM_Alloc_Code( size );
+	if ( ptr == NULL ) {
+		Z_Free( data );
+		return qfalse;
+	}
+
+	Com_Memcpy( ptr, cache.code, cache.codeLength );
+
+	numBases = VM_RelocBases( vm, ptr, bases );
+	for ( i = 0, r = cache.relocs; i < cache.numRelocs; i++, r++ ) {
+		if ( r->base >= numBases )
 			break;
+		value = bases[ r->base ] + (intptr_t)r->delta;
+		if ( r->size == 4 ) {
+			if ( (uint64_t)(uintptr_t)value > 0xFFFFFFFFu )
+				break;
+			v = (int)value;
+			Com_Memcpy( ptr + r->offset, &v, 4 );
+		} else {
+			Com_Memcpy( ptr + r->offset, &value, sizeof( value ) );
+		}
+	}
 
-		default:
-			Com_Error( ERR_FATAL, "VM_CompileX86: bad opcode %02X", ci->op );
-			VM_FreeBuffers();
-			return qfalse;
+	if ( i < cache.numRelocs ) {
+		Com_DPrintf( "%s: cached code can not be relocated\n", vm->name );
+		VM_Free_Code( ptr, size );
+		Z_Free( data );
+		return qfalse;
+	}
+
+	table = (intptr_t *)( ptr + PAD( cache.codeLength, 8 ) );
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		if ( cache.offsets[ i ] < 0 ) {
+			table[ i ] = (intptr_t)badJumpPtr;
+		} else {
+			table[ i ] = (intptr_t)ptr + cache.offsets[ i ];
 		}
+	}
 
-		pop1 = (opcode_t)ci->op;
-	} // while( ip < header->instructionCount )
+	Z_Free( data );
 
-		// ****************
-		// system functions
-		// ****************
-		EmitAlign( 8 );
-		funcOffset[FUNC_CALL] = compiledOfs;
-		EmitCallFunc( vm );
+	vm->codeBase.ptr = ptr;
+	vm->codeLength = cache.codeLength;
+	vm->codeSize = size;
+	vm->forceDataMask = cache.forceDataMask;
 
-		EmitAlign( 8 );
-		funcOffset[FUNC_FTOL] = compiledOfs;
-		EmitFTOLFunc( vm );
+	if ( !VM_Protect_Code( vm->codeBase.ptr, vm->codeSize ) ) {
+		VM_Destroy_Compiled( vm );
+		return qfalse;
+	}
 
-		EmitAlign( 8 );
-		funcOffset[FUNC_BCPY] = compiledOfs;
-		EmitBCPYFunc( vm );
+	vm->destroy = VM_Destroy_Compiled;
 
-		EmitAlign( 8 );
-		funcOffset[FUNC_NCPY] = compiledOfs;
-		EmitNCPYFunc( vm );
+	Com_Printf( "VM file %s loaded from cache, %i bytes of code\n", vm->name, vm->codeLength );
 
-		// ***************
-		// error functions
-		// ***************
+	return qtrue;
+}
 
-		// bad jump
-		EmitAlign( 8 );
-		funcOffset[FUNC_BADJ] = compiledOfs;
-		EmitBADJFunc( vm );
 
-		// error jump
-		EmitAlign( 8 );
-		funcOffset[FUNC_ERRJ] = compiledOfs;
-		EmitERRJFunc( vm );
+/*
+=================
+VM_SaveCompiled
 
-		// programStack overflow
-		EmitAlign( 8 );
-		funcOffset[FUNC_PSOF] = compiledOfs;
-		EmitPSOFFunc( vm );
+Stores just generated code with recorded relocations
+=================
+*/
+static void VM_SaveCompiled( vm_t *vm, const char *key )
+{
+	vmCodeCache_t	cache;
+	intptr_t		bases[ VM_RELOC_BASES ], ranges[ RELOC_RANGES ], value;
+	vmReloc_t		*r;
+	unsigned int	v;
+	int				i, j, numBases;
 
-		// opStack overflow
-		EmitAlign( 8 );
-		funcOffset[FUNC_OSOF] = compiledOfs;
-		EmitOSOFFunc( vm );
+	if ( numRelocs > maxRelocs )
+		return;
 
-		// read/write access violation
-		EmitAlign( 8 );
-		funcOffset[FUNC_DATA] = compiledOfs;
-		EmitDATAFunc( vm );
+	ranges[ RELOC_DATA ] = vm->dataAlloc;
+	ranges[ RELOC_CODE ] = PAD( compiledOfs, 8 ) + vm->instructionCount * sizeof( intptr_t );
+	ranges[ RELOC_VM ] = sizeof( *vm );
 
-		EmitAlign( sizeof( intptr_t ) ); // for instructionPointers
+	numBases = VM_RelocBases( vm, code, bases );
+	for ( i = 0, r = relocs; i < numRelocs; i++, r++ ) {
+		if ( r->size == 4 ) {
+			Com_Memcpy( &v, code + r->offset, 4 );
+			value = (intptr_t)v;
+		} else {
+			Com_Memcpy( &value, code + r->offset, sizeof( value ) );
+		}
+		for ( j = 0; j < numBases; j++ ) {
+			if ( j < RELOC_RANGES ? ( value >= bases[ j ] && value - bases[ j ] < ranges[ j ] ) : value == bases[ j ] )
+				break;
+		}
+		if ( j == numBases ) {
+			Com_DPrintf( "%s: unknown address in code at %i, not cached\n", vm->name, r->offset );
+			return;
+		}
+		r->base = j;
+		r->pad = 0;
+		r->delta = value - bases[ j ];
+	}
 
-	} // for( pass = 0; pass < n; pass++ )
+	Q_strncpyz( cache.key, key, sizeof( cache.key ) );
+	cache.forceDataMask = vm->forceDataMask;
+	cache.code = code;
+	cache.codeLength = compiledOfs;
+	cache.relocs = relocs;
+	cache.numRelocs = numRelocs;
+	cache.offsets = Z_Malloc( vm->instructionCount * sizeof( int ) );
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		cache.offsets[ i ] = inst[ i ].jused ? instructionOffsets[ i ] : -1;
+	}
 
-	n = header->instructionCount * sizeof( intptr_t );
+	VM_WriteCodeCache( vm, &cache );
 
-	if ( code == NULL ) {
-		code = (byte*)VM_Alloc_Compiled( vm, PAD(compiledOfs,8), n );
-		if ( code == NULL ) {
-			return qfalse;
+	Z_Free( cache.offsets );
+}
+
+
+/*
+=================
+VM_Compile
+=================
+*/
+qboolean VM_Compile( vm_t *vm, vmHeader_t *header ) {
+	const char	*errMsg;
+	char		key[ VM_CACHE_KEY ];
+	qboolean	res, cache;
+#if idx64
+	vmTier_t	*tier;
+#endif
+
+#if idx64
+	VM_TierWait();
+#endif
+
+	cache = vm_cache->integer ? qtrue : qfalse;
+#if idx64
+	if ( vm_tiered->integer & ( 1 << vm->index ) )
+		cache = qfalse;
+#endif
+
+	if ( cache ) {
+		VM_CodeCacheKey( vm, key, sizeof( key ) );
+		if ( VM_LoadCompiled( vm, key ) ) {
+			return qtrue;
 		}
-		instructionPointers = (intptr_t*)(byte*)(code + PAD(compiledOfs,8));
-		//vm->instructionPointers = instructionPointers; // for debug purposes?
-		pass = NUM_PASSES-1; // repeat last pass
-		goto __compile;
 	}
 
-	// offset all the instruction pointers for the new location
-	for ( i = 0 ; i < header->instructionCount ; i++ ) {
-		if ( !inst[i].jused ) {
-			instructionPointers[ i ] = (intptr_t)badJumpPtr;
-			continue;
+	inst = (instruction_t*)Z_Malloc( (header->instructionCount + 8 ) * sizeof( instruction_t ) );
+	instructionOffsets = (int*)Z_Malloc( header->instructionCount * sizeof( int ) );
+
+	errMsg = VM_LoadInstructions( (byte *) header + header->codeOffset, header->codeLength, header->instructionCount, inst );
+	if ( !errMsg ) {
+		errMsg = VM_CheckInstructions( inst, vm->instructionCount, vm->jumpTableTargets, vm->numJumpTableTargets, vm->exactDataLength );
+	}
+	if ( errMsg ) {
+		VM_FreeBuffers();
+		Com_Printf( "VM_CompileX86 error: %s\n", errMsg );
+		return qfalse;
+	}
+
+	VM_ReplaceInstructions( vm, inst );
+
+	VM_FindMOps( inst, vm->instructionCount );
+
+#if idx64
+	tier = NULL;
+	hotFunctions = NULL;
+	profileCounters = NULL;
+	optBase = ( vm_optimize->integer & ( 1 << vm->index ) ) ? 1 : 0;
+
+	if ( vm_tiered->integer & ( 1 << vm->index ) ) {
+		tier = Hunk_Alloc( sizeof( *tier ), h_high );
+		tier->counters = Hunk_Alloc( vm->instructionCount * sizeof( int ), h_high );
+		tier->inst = Hunk_Alloc( ( vm->instructionCount + 8 ) * sizeof( instruction_t ), h_high );
+		Com_Memcpy( tier->inst, inst, ( vm->instructionCount + 8 ) * sizeof( instruction_t ) );
+		tier->update = VM_TierUpdate;
+		profileCounters = tier->counters;
+		optBase = 0; // keep profiling code fast to generate
+	}
+#endif
+
+	compileError = NULL;
+	recordRelocs = cache;
+	res = VM_GenerateCode( vm );
+	recordRelocs = qfalse;
+
+	if ( relocs ) {
+		if ( res ) {
+			VM_SaveCompiled( vm, key );
 		}
-		instructionPointers[ i ] = (intptr_t)vm->codeBase.ptr + instructionOffsets[ i ];
+		Z_Free( relocs );
+		relocs = NULL;
 	}
 
 	VM_FreeBuffers();
 
-#ifdef VM_X86_MMAP
-	if ( mprotect( vm->codeBase.ptr, vm->codeSize, PROT_READ|PROT_EXEC ) ) {
-		VM_Destroy_Compiled( vm );
-		Com_Printf( S_COLOR_YELLOW "VM_CompileX86: mprotect failed\n" );
+#if idx64
+	profileCounters = NULL;
+#endif
+
+	if ( !res ) {
+		if ( code ) {
+			VM_Free_Code( code, PAD(compiledOfs,8) + vm->instructionCount * sizeof( intptr_t ) );
+		}
+		Com_Printf( "VM_CompileX86 error: %s\n", compileError ? compileError : "unknown error" );
 		return qfalse;
 	}
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-		
-		// remove write permissions.
-		if ( !VirtualProtect( vm->codeBase.ptr, vm->codeSize, PAGE_EXECUTE_READ, &oldProtect ) ) {
-			VM_Destroy_Compiled( vm );
-			Com_Printf( S_COLOR_YELLOW "VM_CompileX86: VirtualProtect failed\n" );
-			return qfalse;
-		}
+
+	vm->codeBase.ptr = code;
+	vm->codeLength = compiledOfs;
+	vm->codeSize = PAD(compiledOfs,8) + vm->instructionCount * sizeof( intptr_t );
+
+	if ( !VM_Protect_Code( vm->codeBase.ptr, vm->codeSize ) ) {
+		VM_Destroy_Compiled( vm );
+		return qfalse;
 	}
-#endif
 
 	vm->destroy = VM_Destroy_Compiled;
 
+#if idx64
+	vm->tier = tier;
+#endif
+
 	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
 
 	return qtrue;
@@ -2866,40 +4661,37 @@ __compile:
 
 /*
 =================
-VM_Alloc_Compiled
+VM_Alloc_Code
 =================
 */
-static void *VM_Alloc_Compiled( vm_t *vm, int codeLength, int tableLength )
+static byte *VM_Alloc_Code( int length )
 {
 	void	*ptr;
-	int		length;
 
-	length = codeLength + tableLength;
 #ifdef VM_X86_MMAP
 	ptr = mmap( NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
 	if ( ptr == MAP_FAILED ) {
-		Com_Error( ERR_FATAL, "VM_CompileX86: mmap failed" );
 		return NULL;
 	}
 #elif _WIN32
 	// allocate memory with EXECUTE permissions under windows.
 	ptr = VirtualAlloc( NULL, length, MEM_COMMIT, PAGE_EXECUTE_READWRITE );
-	if ( !ptr ) {
-		Com_Error( ERR_FATAL, "VM_CompileX86: VirtualAlloc failed" );
-		return NULL;
-	}
 #else
 	ptr = malloc( length );
-	if ( !ptr ) {
-		Com_Error( ERR_FATAL, "VM_CompileX86: malloc failed" );
-		return NULL;
-	}
 #endif
-	vm->codeBase.ptr = (byte*)ptr;
-	vm->codeLength = codeLength;
-	vm->codeSize = length;
+	return (byte*)ptr;
+}
 
-	return vm->codeBase.ptr;
+
+static void VM_Free_Code( byte *ptr, int length )
+{
+#ifdef VM_X86_MMAP
+	munmap( ptr, length );
+#elif _WIN32
+	VirtualFree( ptr, 0, MEM_RELEASE );
+#else
+	free( ptr );
+#endif
 }
 
 
@@ -2910,13 +4702,15 @@ VM_Destroy_Compiled
 */
 static void VM_Destroy_Compiled( vm_t* vm )
 {
-#ifdef VM_X86_MMAP
-	munmap( vm->codeBase.ptr, vm->codeSize );
-#elif _WIN32
-	VirtualFree( vm->codeBase.ptr, 0, MEM_RELEASE );
-#else
-	free( vm->codeBase.ptr );
+	byte *ptr = vm->codeBase.ptr;
+
+#if idx64
+	if ( tierJob.vm == vm ) {
+		vm->codeBase.ptr = NULL; // discard result
+		VM_TierWait();
+	}
 #endif
+	VM_Free_Code( ptr, vm->codeSize );
 	vm->codeBase.ptr = NULL;
 }
 
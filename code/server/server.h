@@ -50,15 +50,36 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
+	int			worldNode;			// leaf in the entity tree, 0 if not linked there
+	uint64_t	worldOrder;			// where world sectors would list it, sorts tree results
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
+typedef struct worldSector_s {
+	int		axis;		// -1 = leaf node
+	float	dist;
+	struct worldSector_s	*children[2];
+	svEntity_t	*entities;
+} worldSector_t;
+
+#define	AREA_DEPTH	4
+#define	AREA_NODES	64
+
+#define	WORLD_NODES			(MAX_GENTITIES*2)	// node 0 is the null node
+
+typedef struct {
+	vec3_t	mins, maxs;
+	int		parent;			// next free node when not in use
+	int		children[2];	// 0 for leafs
+	int		height;			// 0 for leafs
+	int		entityNum;
+} worldNode_t;
+
 typedef enum {
 	SS_DEAD,			// no map loaded
 	SS_LOADING,			// spawning level entities
@@ -85,7 +106,6 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int				checksumFeedServerId;
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -105,6 +125,26 @@ typedef struct {
 	int				time;
 
 	byte			baselineUsed[ MAX_GENTITIES ];
+
+	// entity links, see sv_world.c
+	worldSector_t	worldSectors[AREA_NODES];
+	int				numworldSectors;
+	worldNode_t		worldNodes[WORLD_NODES];
+	int				worldRoot;
+	int				worldFreeNodes;
+	qboolean		useWorldTree;
+	qboolean		checkWorldTree;		// sectors are linked as well and every query is compared
+	uint64_t		worldLinkSequence;
+
+	// common snapshot storage
+	entityState_t	*snapshotEntities;		// [svs.numSnapshotEntities]
+	int				freeStorageEntities;
+	int				currentStoragePosition;	// next snapshotEntities to use
+	int				snapshotFrame;			// incremented with each common snapshot built
+	int				currentSnapshotFrame;	// for initializing empty frames
+	int				lastValidFrame;			// updated with each snapshot built
+	snapshotFrame_t	snapFrames[ NUM_SNAPSHOT_FRAMES ];
+	snapshotFrame_t	*currFrame; // current frame that clients can refer
 	
 	// serverside demo recording
 	fileHandle_t		demoFile;
@@ -198,6 +238,10 @@ struct leakyBucket_s {
 	int			toxic;
 
 	leakyBucket_t *prev, *next;
+
+	timerEvent_t	expire;			// becomes reclaimable when fired
+	qboolean	reclaimable;
+	qboolean	queued;			// in the reclaim queue
 };
 
 
@@ -206,6 +250,7 @@ typedef struct client_s {
 	char			userinfo[MAX_INFO_STRING];		// name, etc
 
 	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
+	int				reliableBroadcast[MAX_RELIABLE_COMMANDS];	// svs.broadcastCommands sequence, 0 for targeted commands
 	int				reliableSequence;		// last added reliable message, not necesarily sent or acknowledged yet
 	int				reliableAcknowledge;	// last acknowledged reliable message
 	int				reliableSent;			// last sent reliable message, not necesarily acknowledged yet
@@ -220,6 +265,7 @@ typedef struct client_s {
 	char			lastClientCommandString[MAX_STRING_CHARS];
 	sharedEntity_t	*gentity;			// SV_GentityNum(clientnum)
 	char			name[MAX_NAME_LENGTH];			// extracted from userinfo, high bits masked
+	int				world;				// sv_worlds index of the game the client is in
 
 	// serverside demo information
 	qboolean  demoClient; // is this a demoClient?
@@ -306,6 +352,16 @@ typedef struct client_s {
 //=============================================================================
 
 
+// clients that don't receive every broadcast can still refer to old entries,
+// these are copied into the client ring before the entry is reused
+#define MAX_BROADCAST_COMMANDS	(MAX_RELIABLE_COMMANDS*2)
+
+typedef struct {
+	int			sequence;
+	int			refs;						// client ring slots that may still refer to it, never too low
+	char		text[MAX_STRING_CHARS];
+} broadcastCommand_t;
+
 // this structure will be cleared only when the game dll changes
 typedef struct {
 	qboolean	initialized;				// sv_init has completed
@@ -317,20 +373,14 @@ typedef struct {
 
 	client_t	*clients;					// [sv_maxclients->integer];
 	int			numSnapshotEntities;		// PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
-	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
 	int			nextHeartbeatTime;
 
 	netadr_t	authorizeAddress;			// for rcon return messages
 	int			masterResolveTime[MAX_MASTER_SERVERS]; // next svs.time that server should do dns lookup for master server
 
-	// common snapshot storage
-	int			freeStorageEntities;
-	int			currentStoragePosition;	// next snapshotEntities to use
-	int			snapshotFrame;			// incremented with each common snapshot built
-	int			currentSnapshotFrame;	// for initializing empty frames
-	int			lastValidFrame;			// updated with each snapshot built
-	snapshotFrame_t	snapFrames[ NUM_SNAPSHOT_FRAMES ];
-	snapshotFrame_t	*currFrame; // current frame that clients can refer
+	// shared log of broadcast server commands
+	int			broadcastSequence;
+	broadcastCommand_t	broadcastCommands[ MAX_BROADCAST_COMMANDS ];
 
 #ifdef USE_MV	
 	int			numSnapshotPSF;				// sv_democlients->integer*PACKET_BACKUP*MAX_CLIENTS
@@ -357,8 +407,32 @@ typedef struct
 
 //=============================================================================
 
+// several game worlds can run side by side in one server process, each with
+// its own map, game module, entity links and snapshot storage, world 0 is the
+// one started by the map command and the only one running bots
+#define	MAX_WORLDS		4
+
+typedef struct {
+	qboolean		active;				// secondary world is running, always false for world 0
+	server_t		*server;
+	vm_t			*gvm;				// saved while another world is current
+	cmWorld_t		*cm;				// saved clip map while another world is current
+	char			mapname[MAX_QPATH];
+	qboolean		spawned;			// hunk memory between hunkLow/High and hunkEndLow/High is in use
+	int				hunkLow, hunkHigh;	// permanent hunk use before the world was spawned
+	int				hunkEndLow, hunkEndHigh;
+} svWorld_t;
+
 extern	serverStatic_t	svs;				// persistant server info across maps
-extern	server_t		sv;					// cleared each map
+extern	server_t		*sv_server;			// per-map state of the current world
+extern	svWorld_t		sv_worlds[MAX_WORLDS];
+extern	int				sv_worldNum;		// sv_worlds index of the current world
+
+// every "sv." in the server means the current world, not a single global, it is
+// world 0 outside of world specific passes; sv_server, sv_worldNum and gvm are
+// only ever switched together by SV_SetWorld, errors go back to world 0 through
+// SV_AbortWorldPass
+#define	sv				(*sv_server)		// cleared each map
 
 extern	cvar_t	*sv_fps;
 extern	cvar_t	*sv_timeout;
@@ -394,6 +468,9 @@ extern	cvar_t	*sv_hostname;
 extern	cvar_t	*sv_master[MAX_MASTER_SERVERS];
 extern	cvar_t	*sv_reconnectlimit;
 extern	cvar_t	*sv_padPackets;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_worldTree;
+extern	cvar_t	*sv_worldTreeCheck;
 extern	cvar_t	*sv_killserver;
 extern	cvar_t	*sv_mapname;
 extern	cvar_t	*sv_mapChecksum;
@@ -507,8 +584,13 @@ void SV_AddOperatorCommands( void );
 void SV_RemoveOperatorCommands( void );
 
 void SV_MasterShutdown( void );
+void SV_ScheduleHeartbeat( void );
+void SV_InitTimers( void );
+void SV_ScheduleClientTimeout( const client_t *client );
 int SV_RateMsec( const client_t *client );
 void SV_FlushRedirect( const char *outputbuf );
+void SV_SetWorld( int index );
+void SV_SetInfoConfigstrings( int flags );
 
 //
 // sv_init.c
@@ -525,6 +607,11 @@ void SV_SpawnServer( const char *mapname, qboolean killBots );
 void SV_BoundMaxClients( int minimum );
 void SV_SetSnapshotParams( void );
 
+qboolean SV_SpawnWorld( int index, const char *mapname );
+void SV_KillWorld( int index );
+void SV_ShutdownWorlds( void );
+void SV_MoveClient( client_t *cl, int index );
+
 
 //
 // sv_client.c
@@ -586,6 +673,8 @@ void SV_QueryClientScore( client_t *client );
 // sv_snapshot.c
 //
 void SV_AddServerCommand( client_t *client, const char *cmd );
+const char *SV_GetServerCommand( const client_t *client, int sequence );
+char *SV_GetServerCommandBuffer( client_t *client, int sequence );
 void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg );
 void SV_WriteFrameToClient( client_t *client, msg_t *msg );
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
@@ -594,6 +683,7 @@ void SV_SendClientSnapshot( client_t *client );
 
 void SV_InitSnapshotStorage( void );
 void SV_IssueNewSnapshot( void );
+void SV_CheckSnapshotWorld( void );
 
 int SV_RemainingGameState( void );
 
@@ -608,6 +698,8 @@ sharedEntity_t *SV_GEntityForSvEntity( svEntity_t *svEnt );
 void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
+void		SV_InitWorldGameProgs( void );
+void		SV_ShutdownWorldGameProgs( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
 void SV_GameSendServerCommand( int clientNum, const char *text );
 
@@ -724,6 +816,7 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_WorldBench_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -735,6 +828,18 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 // The world entity is never returned in this list.
 
 
+typedef struct {
+	int		entityNum;
+	float	fraction;		// where the moving box enters the entity bounds
+} sweepEntity_t;
+
+int SV_SweepEntities( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, float maxFraction, sweepEntity_t *list, int maxcount );
+// fills in a table of entities with bounding boxes touched by the mins / maxs
+// box moving from start to end before maxFraction, sorted by the fraction at
+// which they are entered.  Like SV_AreaEntities, this doesn't mean they are
+// actually hit.
+
+
 int SV_PointContents( const vec3_t p, int passEntityNum );
 // returns the CONTENTS_* value from the world and all entities at the given point.
 
@@ -754,6 +859,9 @@ void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const ve
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, qboolean capsule );
 // clip to a specific entity
 
+void SV_TraceBatch( trace_t *results, const traceRay_t *rays, int count, int passEntityNum, int contentmask, qboolean capsule );
+// SV_Trace for several boxes at once
+
 //
 // sv_net_chan.c
 //
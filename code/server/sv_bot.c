@@ -63,6 +63,7 @@ int SV_BotAllocateClient( void ) {
 	cl->gentity->s.number = i;
 	cl->state = CS_ACTIVE;
 	cl->lastPacketTime = svs.time;
+	SV_ScheduleClientTimeout( cl );
 	cl->snapshotMsec = 1000 / sv_fps->integer;
 	cl->netchan.remoteAddress.type = NA_BOT;
 	cl->rate = 0;
@@ -460,6 +461,10 @@ int SV_BotLibSetup( void ) {
 		return -1;
 	}
 
+	botlib_export->BotLibVarSet( "routingwarmup", Cvar_VariableString( "bot_routingwarmup" ) );
+	botlib_export->BotLibVarSet( "fiforouting", Cvar_VariableString( "bot_fiforouting" ) );
+	botlib_export->BotLibVarSet( "goalthreads", Cvar_VariableString( "bot_goalthreads" ) );
+
 	return botlib_export->BotLibSetup();
 }
 
@@ -499,6 +504,9 @@ void SV_BotInitCvars(void) {
 	Cvar_Get("bot_forcewrite", "0", 0);					//force writing aas file
 	Cvar_Get("bot_aasoptimize", "0", 0);				//no aas file optimisation
 	Cvar_Get("bot_saveroutingcache", "0", 0);			//save routing cache
+	Cvar_Get("bot_routingwarmup", "0", 0);				//threads filling the routing cache at map load
+	Cvar_Get("bot_fiforouting", "0", 0);				//use the old FIFO routing updates
+	Cvar_Get("bot_goalthreads", "1", 0);				//threads choosing item goals for a batch of bots
 	Cvar_Get("bot_thinktime", "100", 0);				//msec the bots thinks
 	Cvar_Get("bot_reloadcharacters", "0", 0);			//reload the bot characters each time
 	Cvar_Get("bot_testichat", "0", 0);					//test ichats
@@ -519,6 +527,20 @@ void SV_BotInitCvars(void) {
 	Cvar_Get("bot_interbreedwrite", "", CVAR_CHEAT);	//write interbreeded bots to this file
 }
 
+/*
+==================
+SV_BotCacheStats_f
+==================
+*/
+static void SV_BotCacheStats_f( void ) {
+	if ( !botlib_export ) {
+		Com_Printf( "Bot library is not loaded.\n" );
+		return;
+	}
+
+	botlib_export->aas.AAS_RoutingCacheStats();
+}
+
 /*
 ==================
 SV_BotInitBotLib
@@ -563,9 +585,12 @@ void SV_BotInitBotLib(void) {
 	botlib_import.DebugPolygonDelete = BotImport_DebugPolygonDelete;
 
 	botlib_import.Sys_Milliseconds = Sys_Milliseconds;
+	botlib_import.RunJobs = Sys_RunJobs;
 
 	botlib_export = (botlib_export_t *)GetBotLibAPI( BOTLIB_API_VERSION, &botlib_import );
 	assert(botlib_export); 	// somehow we end up with a zero import.
+
+	Cmd_AddCommand( "aas_cachestats", SV_BotCacheStats_f );
 }
 
 
@@ -581,7 +606,7 @@ SV_BotGetConsoleMessage
 int SV_BotGetConsoleMessage( int client, char *buf, int size )
 {
 	client_t	*cl;
-	int			index;
+	const char	*cmd;
 
 	cl = &svs.clients[client];
 	cl->lastPacketTime = svs.time;
@@ -591,13 +616,13 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
 	}
 
 	cl->reliableAcknowledge++;
-	index = cl->reliableAcknowledge & ( MAX_RELIABLE_COMMANDS - 1 );
+	cmd = SV_GetServerCommand( cl, cl->reliableAcknowledge );
 
-	if ( !cl->reliableCommands[index][0] ) {
+	if ( !cmd[0] ) {
 		return qfalse;
 	}
 
-	Q_strncpyz( buf, cl->reliableCommands[index], size );
+	Q_strncpyz( buf, cmd, size );
 	return qtrue;
 }
 
@@ -616,7 +641,7 @@ int EntityInPVS( int client, int entityNum ) {
 	cl = &svs.clients[client];
 	frame = &cl->frames[cl->netchan.outgoingSequence & PACKET_MASK];
 	for ( i = 0; i < frame->num_entities; i++ )	{
-		if ( svs.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities].number == entityNum ) {
+		if ( sv.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities].number == entityNum ) {
 			return qtrue;
 		}
 	}
@@ -330,7 +330,7 @@ static void SV_MapRestart_f( void ) {
 	// to give them the correct time so that when they finish loading
 	// they don't violate the backwards time check in cl_cgame.c
 	for (i=0 ; i<sv_maxclients->integer ; i++) {
-		if (svs.clients[i].state == CS_PRIMED) {
+		if (svs.clients[i].state == CS_PRIMED && svs.clients[i].world == 0) {
 			svs.clients[i].oldServerTime = sv.restartTime;
 		}
 	}
@@ -362,7 +362,8 @@ static void SV_MapRestart_f( void ) {
 		client = &svs.clients[i];
 
 		// send the new gamestate to all connected clients
-		if ( client->state < CS_CONNECTED ) {
+		// of the main world, the other worlds keep running
+		if ( client->state < CS_CONNECTED || client->world != 0 ) {
 			continue;
 		}
 
@@ -1250,8 +1251,10 @@ static void SV_Status_f( void ) {
 			continue;
 
 		Com_Printf( "%2i ", i ); // id
+		SV_SetWorld( cl->world );
 		ps = SV_GameClientNum( i );
 		Com_Printf( "%5i ", ps->persistant[PERS_SCORE] );
+		SV_SetWorld( 0 );
 
 		// ping/status
 		if ( cl->state == CS_PRIMED )
@@ -1376,6 +1379,7 @@ Also called by SV_DropClient, SV_DirectConnect, and SV_SpawnServer
 */
 void SV_Heartbeat_f( void ) {
 	svs.nextHeartbeatTime = svs.time;
+	SV_ScheduleHeartbeat();
 }
 
 
@@ -1490,6 +1494,129 @@ static void SV_Locations_f( void ) {
 
 //===========================================================
 
+/*
+==================
+SV_WorldSpawn_f
+
+Starts a map in a secondary game world next to the running one
+==================
+*/
+static void SV_WorldSpawn_f( void ) {
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !com_dedicated->integer ) {
+		Com_Printf( "Game worlds are only available on dedicated servers.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() != 3 ) {
+		Com_Printf( "Usage: world_spawn <world number> <mapname>\n" );
+		return;
+	}
+
+	SV_SpawnWorld( atoi( Cmd_Argv( 1 ) ), Cmd_Argv( 2 ) );
+}
+
+
+/*
+==================
+SV_WorldKill_f
+==================
+*/
+static void SV_WorldKill_f( void ) {
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "Usage: world_kill <world number>\n" );
+		return;
+	}
+
+	SV_KillWorld( atoi( Cmd_Argv( 1 ) ) );
+}
+
+
+/*
+==================
+SV_WorldList_f
+==================
+*/
+static void SV_WorldList_f( void ) {
+	const client_t *cl;
+	int i, j, count;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	Com_Printf( "world map                 clients\n" );
+	Com_Printf( "----- ------------------- -------\n" );
+
+	for ( i = 0; i < MAX_WORLDS; i++ ) {
+		if ( i != 0 && !sv_worlds[ i ].active ) {
+			continue;
+		}
+		count = 0;
+		for ( j = 0, cl = svs.clients; j < sv_maxclients->integer; j++, cl++ ) {
+			if ( cl->state >= CS_CONNECTED && cl->world == i ) {
+				count++;
+			}
+		}
+		Com_Printf( "%5i %-19s %7i\n", i, i ? sv_worlds[ i ].mapname : sv_mapname->string, count );
+	}
+}
+
+
+/*
+==================
+SV_WorldMove_f
+
+Moves a player to another game world
+==================
+*/
+static void SV_WorldMove_f( void ) {
+	client_t	*cl;
+	int			index;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() != 3 ) {
+		Com_Printf( "Usage: world_move <client number> <world number>\n" );
+		return;
+	}
+
+	cl = SV_GetPlayerByNum();
+	if ( !cl ) {
+		return;
+	}
+
+	if ( cl->state < CS_CONNECTED || cl->netchan.remoteAddress.type == NA_BOT ) {
+		Com_Printf( "Client %i can't change worlds\n", (int)( cl - svs.clients ) );
+		return;
+	}
+
+	index = atoi( Cmd_Argv( 2 ) );
+	if ( index < 0 || index >= MAX_WORLDS || ( index != 0 && !sv_worlds[ index ].active ) ) {
+		Com_Printf( "World %i is not running\n", index );
+		return;
+	}
+
+	SV_MoveClient( cl, index );
+}
+
+//===========================================================
+
 /*
 ==================
 SV_CompleteMapName
@@ -1535,6 +1662,11 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("worldbench", SV_WorldBench_f);
+	Cmd_AddCommand ("world_spawn", SV_WorldSpawn_f);
+	Cmd_AddCommand ("world_kill", SV_WorldKill_f);
+	Cmd_AddCommand ("world_list", SV_WorldList_f);
+	Cmd_AddCommand ("world_move", SV_WorldMove_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -1590,6 +1722,7 @@ void SV_RemoveOperatorCommands( void ) {
 	Cmd_RemoveCommand ("dumpuser");
 	Cmd_RemoveCommand ("map_restart");
 	Cmd_RemoveCommand ("sectorlist");
+	Cmd_RemoveCommand ("worldbench");
 #endif
 }
 
@@ -404,14 +404,17 @@ static void SV_SaveSequences( void ) {
 
 
 static void SV_InjectLocation( const char *tld, const char *country ) {
-	char *cmd, *str;
+	const char *cmd;
+	char *str;
 	int i, n;
 	for ( i = 0; i < sv_maxclients->integer; i++ ) {
 		if ( seqs[i] != svs.clients[i].reliableSequence ) {
 			for ( n = seqs[i]; n != svs.clients[i].reliableSequence + 1; n++ ) {
-				cmd = svs.clients[i].reliableCommands[n & (MAX_RELIABLE_COMMANDS-1)];
+				cmd = SV_GetServerCommand( &svs.clients[i], n );
 				str = strstr( cmd, "connected\n\"" );
 				if ( str && str[11] == '\0' && str < cmd + 512 ) {
+					// the print is usually a shared broadcast, edit this client's own copy
+					str = SV_GetServerCommandBuffer( &svs.clients[i], n ) + ( str - cmd );
 					if ( *tld == '\0' )
 						sprintf( str, S_COLOR_WHITE "connected (%s)\n\"", country );
 					else
@@ -990,6 +993,13 @@ void SV_DirectConnect( const netadr_t *from ) {
 
 gotnewcl:
 
+	// a reconnecting client starts over in world 0
+	if ( newcl->state >= CS_CONNECTED && newcl->world != 0 ) {
+		SV_SetWorld( newcl->world );
+		VM_Call( gvm, 1, GAME_CLIENT_DISCONNECT, newcl - svs.clients );
+		SV_SetWorld( 0 );
+	}
+
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
@@ -1069,6 +1079,7 @@ gotnewcl:
 	newcl->lastPacketTime = svs.time;
 	newcl->lastConnectTime = svs.time;
 	newcl->lastDisconnectTime = svs.time;
+	SV_ScheduleClientTimeout( newcl );
 
 	SVC_RateRestoreToxicAddress( &newcl->netchan.remoteAddress, 10, 1000 );
 	newcl->justConnected = qtrue;
@@ -1118,7 +1129,7 @@ or crashing -- SV_FinalMessage() will handle that
 void SV_DropClient( client_t *drop, const char *reason ) {
 	char	name[ MAX_NAME_LENGTH ];
 	qboolean isBot;
-	int		i;
+	int		i, world;
 	
 	if(drop->demorecording) {
 		SV_StopRecord(drop);
@@ -1132,6 +1143,10 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 
 	Q_strncpyz( name, drop->name, sizeof( name ) );	// for further DPrintf() because drop->name will be nuked in SV_SetUserinfo()
 
+	// the game and the clients told about it are those of the client's world
+	world = sv_worldNum;
+	SV_SetWorld( drop->world );
+
 	// Free all allocated data on the client structure
 	SV_FreeClient( drop );
 
@@ -1170,8 +1185,11 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 	} else {
 		Com_DPrintf( "Going to CS_ZOMBIE for %s\n", name );
 		drop->state = CS_ZOMBIE;		// become free in a few seconds
+		SV_ScheduleClientTimeout( drop );
 	}
 
+	SV_SetWorld( world );
+
 	if ( !reason ) {
 		return;
 	}
@@ -2471,7 +2489,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 	// also use the message acknowledge
 	key ^= cl->messageAcknowledge;
 	// also use the last acknowledged server command in the key
-	key ^= MSG_HashKey(cl->reliableCommands[ cl->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ], 32);
+	key ^= MSG_HashKey( SV_GetServerCommand( cl, cl->reliableAcknowledge ), 32 );
 
 	oldcmd = &nullcmd;
 	for ( i = 0 ; i < cmdCount ; i++ ) {
@@ -274,7 +274,6 @@ void SV_ForwardServerCommands( client_t *recorder /*, const client_t *client */
 {
 	const client_t *client;
 	const char *cmd;
-	int src_index;
 	int	dst_index;
 	int i;
 
@@ -294,12 +293,12 @@ void SV_ForwardServerCommands( client_t *recorder /*, const client_t *client */
 
 	//for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
 	for ( i = sv_lastAck + 1 ; i <= client->reliableSequence ; i++ ) {
-		src_index = i & ( MAX_RELIABLE_COMMANDS - 1 );
-		cmd = client->reliableCommands[ src_index ];
+		cmd = SV_GetServerCommand( client, i );
 		// filter commands here:
 		if ( strncmp( cmd, "tell ", 5 ) == 0 ) // TODO: other commands
 			continue;
 		dst_index = ++recorder->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
+		recorder->reliableBroadcast[ dst_index ] = 0;
 		Q_strncpyz( recorder->reliableCommands[ dst_index ], cmd, sizeof( recorder->reliableCommands[ dst_index ] ) );
 	}
 
@@ -621,11 +620,11 @@ int SV_GetMergeMaskEntities( clientSnapshot_t *snap )
 	skipMask = 0;
 	psf = NULL;
 
-	if ( !svs.currFrame )
+	if ( !sv.currFrame )
 		return skipMask;
 	
 	for ( i = 0; i < sv_maxclients->integer; i++ ) {
-		ent = svs.currFrame->ents[ i ];
+		ent = sv.currFrame->ents[ i ];
 		if ( ent->number >= sv_maxclients->integer )
 			break;
 		for ( /*n = 0 */; n < snap->num_psf; n++ ) {
@@ -804,7 +803,7 @@ static qboolean SV_BuildCompressedBuffer( client_t *client, int reliableSequence
 
 	//Com_DPrintf( S_COLOR_YELLOW "zcmd: compressing %i.%i\n", reliableSequence, client->multiview.z.deltaSeq );
 
-	cmd = client->reliableCommands[ index ];
+	cmd = SV_GetServerCommand( client, reliableSequence );
 	cmdLen = strlen( cmd );
 
 	if ( client->multiview.z.deltaSeq == 0 ) {
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "server.h"
 
 #include "../botlib/botlib.h"
+#include "../botlib/be_ai_goal.h"
 
 botlib_export_t	*botlib_export;
 
@@ -225,7 +226,7 @@ static void SV_AdjustAreaPortalState( sharedEntity_t *ent, qboolean open ) {
 SV_EntityContact
 ==================
 */
-static qboolean SV_EntityContact( vec3_t mins, vec3_t maxs, const sharedEntity_t *gEnt, int capsule ) {
+static qboolean SV_EntityContact( const vec3_t mins, const vec3_t maxs, const sharedEntity_t *gEnt, qboolean capsule ) {
 	const float	*origin, *angles;
 	clipHandle_t	ch;
 	trace_t			trace;
@@ -330,8 +331,11 @@ static void *VM_ArgPtr( intptr_t intValue ) {
 
 	if ( gvm->entryPoint )
 		return (void *)(intValue);
-	else
-		return (void *)(gvm->dataBase + (intValue & gvm->dataMask));
+
+	if ( gvm->wasm )
+		VM_CheckBounds( gvm, intValue, 1 );
+
+	return (void *)(gvm->dataBase + (intValue & gvm->dataMask));
 }
 
 
@@ -356,6 +360,18 @@ static qboolean SV_GetValue( char* value, int valueSize, const char* key )
 		return qtrue;
 	}
 
+	if ( !Q_stricmp( key, "trap_TraceBatch_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_TRACE_BATCH );
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( key, "trap_BotChooseItemGoals_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_BOT_CHOOSE_ITEM_GOALS );
+		return qtrue;
+	}
+
 	return qfalse;
 }
 
@@ -368,6 +384,23 @@ The module is making a system call
 ====================
 */
 static intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	// the bot library and the server console only serve the main world
+	if ( sv_worldNum != 0 ) {
+		if ( args[0] >= BOTLIB_SETUP && args[0] <= BOTLIB_AI_GENETIC_PARENTS_AND_CHILD_SELECTION ) {
+			return ( args[0] == BOTLIB_SETUP ) ? BLERR_LIBRARYNOTSETUP : 0;
+		}
+		if ( args[0] == G_BOT_ALLOCATE_CLIENT ) {
+			return -1;
+		}
+		if ( args[0] == G_BOT_CHOOSE_ITEM_GOALS ) {
+			return 0;
+		}
+		if ( args[0] == G_SEND_CONSOLE_COMMAND ) {
+			Com_DPrintf( "world %i: ignored console command %s", sv_worldNum, (const char *)VMA(2) );
+			return 0;
+		}
+	}
+
 	switch( args[0] ) {
 	case G_PRINT:
 		Com_Printf( "%s", (const char*)VMA(1) );
@@ -967,6 +1000,22 @@ static intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TESTPRINTFLOAT:
 		return sprintf( VMA(1), "%f", VMF(2) );
 
+	case G_TRACE_BATCH:
+		if ( (unsigned)args[3] > MAX_GENTITIES ) {
+			Com_Error( ERR_DROP, "G_TRACE_BATCH: bad count %i", (int)args[3] );
+		}
+		VM_CHECKBOUNDS( gvm, args[1], args[3] * sizeof( trace_t ) );
+		VM_CHECKBOUNDS( gvm, args[2], args[3] * sizeof( traceRay_t ) );
+		SV_TraceBatch( VMA(1), VMA(2), args[3], args[4], args[5], args[6] ? qtrue : qfalse );
+		return 0;
+
+	case G_BOT_CHOOSE_ITEM_GOALS:
+		if ( (unsigned)args[2] > MAX_CLIENTS ) {
+			Com_Error( ERR_DROP, "G_BOT_CHOOSE_ITEM_GOALS: bad count %i", (int)args[2] );
+		}
+		VM_CHECKBOUNDS( gvm, args[1], args[2] * sizeof( bot_goalchoice_t ) );
+		return botlib_export->ai.BotChooseItemGoals( VMA(1), args[2] );
+
 	case G_TRAP_GETVALUE:
 		VM_CHECKBOUNDS( gvm, args[1], args[2] );
 		return SV_GetValue( VMA(1), args[2], VMA(3) );
@@ -1002,6 +1051,29 @@ static intptr_t QDECL SV_DllSyscall( intptr_t arg, ... ) {
 }
 
 
+/*
+====================
+sv_gameTable
+
+Direct calls for native game modules, see gameTable_t
+====================
+*/
+static const gameTable_t sv_gameTable = {
+	GAME_TABLE_VERSION,
+	sizeof( gameTable_t ),
+
+	SV_LinkEntity,
+	SV_UnlinkEntity,
+	SV_AreaEntities,
+	SV_EntityContact,
+	SV_Trace,
+	SV_TraceBatch,
+	SV_PointContents,
+	SV_inPVS,
+	SV_inPVSIgnorePortals
+};
+
+
 /*
 ===============
 SV_ShutdownGameProgs
@@ -1038,9 +1110,17 @@ static void SV_InitGameVM( qboolean restart ) {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=522
 	// now done before GAME_INIT call
 	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
-		svs.clients[i].gentity = NULL;
+		if ( svs.clients[i].world == sv_worldNum ) {
+			svs.clients[i].gentity = NULL;
+		}
 	}
 	
+	// a native module gets the direct call table before it runs any code,
+	// it is handed over again after map_restart because the library is reloaded
+	if ( VM_DllEntryTable( gvm, GAME_TABLE_VERSION, &sv_gameTable ) == GAME_TABLE_VERSION ) {
+		Com_Printf( "Game module uses direct call table version %i\n", GAME_TABLE_VERSION );
+	}
+
 	// use the current msec count for a random seed
 	// init for this gamestate
 	VM_Call( gvm, 3, GAME_INIT, sv.time, Com_Milliseconds(), restart );
@@ -1110,6 +1190,40 @@ void SV_InitGameProgs( void ) {
 }
 
 
+/*
+===============
+SV_InitWorldGameProgs
+
+Loads a separate game module instance for the current secondary world
+===============
+*/
+void SV_InitWorldGameProgs( void ) {
+	gvm = VM_CreateInstance( VM_GAME, SV_GameSystemCalls, Cvar_VariableIntegerValue( "vm_game" ) );
+	if ( !gvm ) {
+		Com_Error( ERR_DROP, "VM_CreateInstance on game failed" );
+	}
+
+	SV_InitGameVM( qfalse );
+}
+
+
+/*
+===============
+SV_ShutdownWorldGameProgs
+
+Files opened by the game are kept until the main module shuts down
+===============
+*/
+void SV_ShutdownWorldGameProgs( void ) {
+	if ( !gvm ) {
+		return;
+	}
+	VM_Call( gvm, 1, GAME_SHUTDOWN, qfalse );
+	VM_FreeInstance( gvm );
+	gvm = NULL;
+}
+
+
 /*
 ====================
 SV_GameCommand
@@ -136,6 +136,9 @@ void SV_SetConfigstring (int index, const char *val) {
 
 		// send the data to all relevent clients
 		for (i = 0, client = svs.clients; i < sv_maxclients->integer ; i++, client++) {
+			if ( client->world != sv_worldNum ) {
+				continue;
+			}
 			if ( client->state < CS_ACTIVE ) {
 				if ( client->state == CS_PRIMED )
 					client->csUpdated[ index ] = qtrue;
@@ -309,6 +312,7 @@ static void SV_Startup( void ) {
 #endif
 	SV_SetSnapshotParams();
 	svs.initialized = qtrue;
+	SV_InitTimers();
 
 	// Don't respect sv_killserver unless a server is actually running
 	if ( sv_killserver->integer ) {
@@ -444,7 +448,8 @@ void SV_SpawnServer( const char *mapname, qboolean kb ) {
 	startingServer = qtrue;
 	killBots = kb;
 
-	// shut down the existing game if it is running
+	// shut down the existing games if they are running
+	SV_ShutdownWorlds();
 	SV_ShutdownGameProgs();
 
 	Com_Printf( "------ Server Initialization ------\n" );
@@ -510,12 +515,6 @@ void SV_SpawnServer( const char *mapname, qboolean kb ) {
 	// clear pak references
 	FS_ClearPakReferences( 0 );
 
-	// allocate the snapshot entities on the hunk
-	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
-
-	// initialize snapshot storage
-	SV_InitSnapshotStorage();
-
 #ifdef USE_MV
 	// MV protocol support
 	if ( svs.numSnapshotPSF ) // can be zero?
@@ -567,6 +566,12 @@ void SV_SpawnServer( const char *mapname, qboolean kb ) {
 		sv.configstrings[i] = CopyString("");
 	}
 
+	// allocate the snapshot entities on the hunk
+	sv.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
+
+	// initialize snapshot storage
+	SV_InitSnapshotStorage();
+
 	// make sure we are not paused
 #ifndef DEDICATED
 	Cvar_Set( "cl_paused", "0" );
@@ -803,6 +808,311 @@ void SV_SpawnServer_After_Startup( void ) {
 }
 
 
+/*
+==============================================================================
+
+GAME WORLDS
+
+Secondary worlds load their map and game module next to world 0 without
+clearing the hunk or restarting the file system, their memory is reclaimed
+with the next map change of world 0, so each world can be spawned only once
+per map of world 0.
+
+==============================================================================
+*/
+
+/*
+================
+SV_NewWorldServerId
+
+Clients are matched to a gamestate by server id, so no two worlds can share one
+================
+*/
+static int SV_NewWorldServerId( void ) {
+	int id, i;
+
+	id = com_frameTime;
+	for ( i = 0; i < MAX_WORLDS; i++ ) {
+		if ( i != 0 && !sv_worlds[ i ].active ) {
+			continue;
+		}
+		if ( sv_worlds[ i ].server->serverId >= id ) {
+			id = sv_worlds[ i ].server->serverId + 1;
+		}
+	}
+
+	return id;
+}
+
+
+/*
+================
+SV_SpawnWorld
+
+Starts mapname in secondary world index, clients are moved in with SV_MoveClient
+================
+*/
+qboolean SV_SpawnWorld( int index, const char *mapname ) {
+	char		expanded[ MAX_QPATH ];
+	svWorld_t	*w;
+	int			checksumFeed, serverId;
+	int			world, checksum, i;
+
+	if ( index <= 0 || index >= MAX_WORLDS ) {
+		Com_Printf( "Bad world number %i\n", index );
+		return qfalse;
+	}
+
+	w = &sv_worlds[ index ];
+	if ( w->active ) {
+		Com_Printf( "World %i is already running\n", index );
+		return qfalse;
+	}
+
+	if ( w->spawned ) {
+		Com_Printf( "World %i still holds hunk memory, it can be spawned again when the worlds started after it are stopped or world 0 changes map\n", index );
+		return qfalse;
+	}
+
+	Com_sprintf( expanded, sizeof( expanded ), "maps/%s.bsp", mapname );
+	if ( FS_FOpenFileRead( expanded, NULL, qfalse ) == -1 ) {
+		Com_Printf( "Can't find map %s\n", expanded );
+		return qfalse;
+	}
+
+	Com_Printf( "------ World %i Initialization ------\n", index );
+	Com_Printf( "Server: %s\n", mapname );
+
+	// the clip map, game module and snapshot storage go on the hunk,
+	// SV_ReclaimWorldHunk hands them back if nothing is allocated after them
+	w->spawned = qtrue;
+	Hunk_GetPermanent( &w->hunkLow, &w->hunkHigh );
+
+	if ( !w->server ) {
+		w->server = Hunk_Alloc( sizeof( *w->server ), h_high );
+	}
+	Com_Memset( w->server, 0, sizeof( *w->server ) );
+	if ( !w->cm ) {
+		w->cm = CM_AllocWorld();
+	}
+	w->gvm = NULL;
+	Q_strncpyz( w->mapname, mapname, sizeof( w->mapname ) );
+
+	// the file system was restarted with the feed of world 0
+	checksumFeed = sv.checksumFeed;
+	serverId = SV_NewWorldServerId();
+
+	world = sv_worldNum;
+	SV_SetWorld( index );
+
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		sv.configstrings[i] = CopyString("");
+	}
+
+	sv.checksumFeed = checksumFeed;
+	sv.serverId = serverId;
+	sv.restartedServerId = serverId;
+	sv.checksumFeedServerId = serverId;
+
+	sv.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
+	SV_InitSnapshotStorage();
+
+	CM_LoadMap( expanded, qfalse, &checksum );
+
+	// clear physics interaction links
+	SV_ClearWorld();
+
+	sv.state = SS_LOADING;
+	sv.time = 8;
+
+	SV_InitWorldGameProgs();
+
+	// run a few frames to allow everything to settle
+	for ( i = 0; i < 3; i++ ) {
+		sv.time += 100;
+		VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
+	}
+
+	SV_CreateBaseline();
+
+	sv.time += 100;
+	VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
+
+	w->active = qtrue;
+	SV_SetInfoConfigstrings( CVAR_SERVERINFO | CVAR_SYSTEMINFO );
+	sv.state = SS_GAME;
+
+	SV_SetWorld( world );
+
+	Hunk_GetPermanent( &w->hunkEndLow, &w->hunkEndHigh );
+
+	Com_Printf( "-----------------------------------\n" );
+
+	return qtrue;
+}
+
+
+/*
+================
+SV_FreeWorld
+================
+*/
+static void SV_FreeWorld( int index ) {
+	int i;
+
+	SV_SetWorld( index );
+
+	SV_ShutdownWorldGameProgs();
+
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		if ( sv.configstrings[i] ) {
+			Z_Free( sv.configstrings[i] );
+			sv.configstrings[i] = NULL;
+		}
+	}
+	sv.state = SS_DEAD;
+
+	SV_SetWorld( 0 );
+
+	sv_worlds[ index ].active = qfalse;
+}
+
+
+/*
+================
+SV_ReclaimWorldHunk
+
+Releases the hunk memory of stopped worlds that nothing was allocated after,
+so worlds stopped in the reverse order of spawning always get it back
+================
+*/
+static void SV_ReclaimWorldHunk( void ) {
+	svWorld_t	*w;
+	int			low, high, i;
+
+	for ( ;; ) {
+		Hunk_GetPermanent( &low, &high );
+		for ( i = 1, w = &sv_worlds[ 1 ]; i < MAX_WORLDS; i++, w++ ) {
+			if ( !w->active && w->spawned && w->hunkEndLow == low && w->hunkEndHigh == high ) {
+				break;
+			}
+		}
+		if ( i == MAX_WORLDS || !Hunk_Rewind( w->hunkLow, w->hunkHigh ) ) {
+			return;
+		}
+		w->server = NULL;
+		w->spawned = qfalse;
+		CM_FreeWorld( w->cm );
+		w->cm = NULL;
+	}
+}
+
+
+/*
+================
+SV_KillWorld
+
+Stops secondary world index, its players are moved to world 0
+================
+*/
+void SV_KillWorld( int index ) {
+	client_t	*cl;
+	int			i;
+
+	if ( index <= 0 || index >= MAX_WORLDS || !sv_worlds[ index ].active ) {
+		Com_Printf( "World %i is not running\n", index );
+		return;
+	}
+
+	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ ) {
+		if ( cl->world != index ) {
+			continue;
+		}
+		if ( cl->state >= CS_CONNECTED ) {
+			SV_MoveClient( cl, 0 );
+		} else {
+			cl->world = 0;
+		}
+	}
+
+	SV_FreeWorld( index );
+	SV_ReclaimWorldHunk();
+
+	Com_Printf( "World %i shut down\n", index );
+}
+
+
+/*
+================
+SV_ShutdownWorlds
+
+Stops all secondary worlds, called before world 0 changes map or shuts down
+================
+*/
+void SV_ShutdownWorlds( void ) {
+	int i;
+
+	SV_SetWorld( 0 );
+
+	for ( i = 1; i < MAX_WORLDS; i++ ) {
+		if ( sv_worlds[ i ].active || sv_worlds[ i ].gvm ) {
+			SV_FreeWorld( i );
+		}
+		// storage on the hunk is about to be cleared
+		sv_worlds[ i ].server = NULL;
+		sv_worlds[ i ].spawned = qfalse;
+		CM_FreeWorld( sv_worlds[ i ].cm );
+		sv_worlds[ i ].cm = NULL;
+	}
+
+	if ( svs.clients ) {
+		for ( i = 0; i < sv_maxclients->integer; i++ ) {
+			svs.clients[ i ].world = 0;
+		}
+	}
+}
+
+
+/*
+================
+SV_MoveClient
+
+Takes a connected client out of its game and into the game of world index,
+the client then loads the new map just like on a map change
+================
+*/
+void SV_MoveClient( client_t *cl, int index ) {
+	const char	*denied;
+	int			world, clientNum;
+
+	if ( cl->world == index ) {
+		return;
+	}
+
+	clientNum = cl - svs.clients;
+	world = sv_worldNum;
+
+	SV_SetWorld( cl->world );
+	VM_Call( gvm, 1, GAME_CLIENT_DISCONNECT, clientNum );
+	cl->gentity = NULL;
+
+	cl->world = index;
+	SV_SetWorld( index );
+
+	denied = GVM_ArgPtr( VM_Call( gvm, 3, GAME_CLIENT_CONNECT, clientNum, qtrue, qfalse ) );	// firstTime = qtrue
+	if ( denied ) {
+		SV_DropClient( cl, denied );
+	} else {
+		// when we get the next packet from the client,
+		// the gamestate of the new world will be sent
+		cl->state = CS_CONNECTED;
+		cl->oldServerTime = 0;
+	}
+
+	SV_SetWorld( world );
+}
+
+
 /*
 ===============
 SV_Init
@@ -935,6 +1245,15 @@ void SV_Init( void )
 	Cvar_CheckRange( sv_reconnectlimit, "0", "12", CV_INTEGER );
 
 	sv_padPackets = Cvar_Get ("sv_padPackets", "0", 0);
+	sv_snapshotThreads = Cvar_Get( "sv_snapshotThreads", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_snapshotThreads, "1", "32", CV_INTEGER );
+	Cvar_SetDescription( sv_snapshotThreads, "Number of threads used to build and encode client snapshots" );
+	sv_worldTree = Cvar_Get( "sv_worldTree", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_worldTree, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_worldTree, "Keep linked entities in a dynamic bounding volume tree instead of fixed world sectors, applied on map load" );
+	sv_worldTreeCheck = Cvar_Get( "sv_worldTreeCheck", "0", 0 );
+	Cvar_CheckRange( sv_worldTreeCheck, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_worldTreeCheck, "Also keep world sectors with sv_worldTree and warn about every area query or trace where the two differ, applied on map load" );
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE_ND );
@@ -1059,6 +1378,8 @@ void SV_Shutdown( const char *finalmsg ) {
 
 	Com_Printf( "----- Server Shutdown (%s) -----\n", finalmsg );
 
+	SV_ShutdownWorlds();
+
 	// stop any demos
 	if (sv.demoState == DS_RECORDING)
 		SV_DemoStopRecord();
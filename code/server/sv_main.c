@@ -23,8 +23,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "server.h"
 
 serverStatic_t	svs;				// persistant server info
-server_t		sv;					// local server
-vm_t			*gvm = NULL;		// game virtual machine
+static server_t	sv_main;			// local server, world 0
+server_t		*sv_server = &sv_main;
+svWorld_t		sv_worlds[MAX_WORLDS] = { { qfalse, &sv_main } };
+int				sv_worldNum;
+vm_t			*gvm = NULL;		// game virtual machine of the current world
 
 cvar_t	*sv_fps;				// time rate for running non-clients
 cvar_t	*sv_timeout;			// seconds without any message
@@ -58,6 +61,9 @@ cvar_t	*sv_hostname;
 cvar_t	*sv_master[MAX_MASTER_SERVERS];		// master server ip address
 cvar_t	*sv_reconnectlimit;		// minimum seconds between connect messages
 cvar_t	*sv_padPackets;			// add nop bytes to messages
+cvar_t	*sv_snapshotThreads;	// number of threads building client snapshots
+cvar_t	*sv_worldTree;			// dynamic entity tree instead of fixed world sectors
+cvar_t	*sv_worldTreeCheck;		// compare the entity tree with world sectors
 cvar_t	*sv_killserver;			// menu system can set to 1 to shut server down
 cvar_t	*sv_mapname;
 cvar_t	*sv_mapChecksum;
@@ -167,13 +173,83 @@ static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd )
 
 /*
 ======================
-SV_AddServerCommand
+SV_GetServerCommand
 
-The given command will be transmitted to the client, and is guaranteed to
-not have future snapshot_t executed before it is executed
+Returns text of the reliable command, either from the client ring
+or from the shared broadcast log
 ======================
 */
-void SV_AddServerCommand( client_t *client, const char *cmd ) {
+const char *SV_GetServerCommand( const client_t *client, int sequence ) {
+	const broadcastCommand_t *bc;
+	int index, broadcast;
+
+	index = sequence & ( MAX_RELIABLE_COMMANDS - 1 );
+	broadcast = client->reliableBroadcast[ index ];
+	if ( broadcast == 0 ) {
+		return client->reliableCommands[ index ];
+	}
+
+	bc = &svs.broadcastCommands[ broadcast & ( MAX_BROADCAST_COMMANDS - 1 ) ];
+	if ( bc->sequence != broadcast ) {
+		// can't happen, referenced entries are copied out before reuse
+		return "";
+	}
+
+	return bc->text;
+}
+
+
+/*
+======================
+SV_ReleaseBroadcastCommand
+
+Drops the reference of a client ring slot that is about to be reused
+======================
+*/
+static void SV_ReleaseBroadcastCommand( int broadcast ) {
+	broadcastCommand_t *bc;
+
+	if ( broadcast == 0 ) {
+		return;
+	}
+
+	bc = &svs.broadcastCommands[ broadcast & ( MAX_BROADCAST_COMMANDS - 1 ) ];
+	if ( bc->sequence == broadcast && bc->refs > 0 ) {
+		bc->refs--;
+	}
+}
+
+
+/*
+======================
+SV_GetServerCommandBuffer
+
+Same as SV_GetServerCommand but returns the client's own copy of the command,
+a shared broadcast is copied out of the log first so it can be edited in place
+======================
+*/
+char *SV_GetServerCommandBuffer( client_t *client, int sequence ) {
+	int index;
+
+	index = sequence & ( MAX_RELIABLE_COMMANDS - 1 );
+	if ( client->reliableBroadcast[ index ] != 0 ) {
+		Q_strncpyz( client->reliableCommands[ index ], SV_GetServerCommand( client, sequence ), sizeof( client->reliableCommands[ index ] ) );
+		SV_ReleaseBroadcastCommand( client->reliableBroadcast[ index ] );
+		client->reliableBroadcast[ index ] = 0;
+	}
+
+	return client->reliableCommands[ index ];
+}
+
+
+/*
+======================
+SV_AddReliableCommand
+
+Appends a command to the client ring, broadcast commands are stored by reference
+======================
+*/
+static void SV_AddReliableCommand( client_t *client, const char *cmd, int broadcast ) {
 	int		index, i;
 
 	// this is very ugly but it's also a waste to for instance send multiple config string updates
@@ -194,7 +270,7 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 	if ( client->reliableSequence - client->reliableAcknowledge == MAX_RELIABLE_COMMANDS + 1 ) {
 		Com_Printf( "===== pending server commands =====\n" );
 		for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
-			Com_Printf( "cmd %5d: %s\n", i, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+			Com_Printf( "cmd %5d: %s\n", i, SV_GetServerCommand( client, i ) );
 		}
 		Com_Printf( "cmd %5d: %s\n", i, cmd );
 		SV_DropClient( client, "Server command overflow" );
@@ -202,7 +278,77 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 	}
 	index = client->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
 
-	Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+	SV_ReleaseBroadcastCommand( client->reliableBroadcast[ index ] );
+	client->reliableBroadcast[ index ] = broadcast;
+	if ( broadcast == 0 ) {
+		Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+	} else {
+		svs.broadcastCommands[ broadcast & ( MAX_BROADCAST_COMMANDS - 1 ) ].refs++;
+	}
+}
+
+
+/*
+======================
+SV_AddServerCommand
+
+The given command will be transmitted to the client, and is guaranteed to
+not have future snapshot_t executed before it is executed
+======================
+*/
+void SV_AddServerCommand( client_t *client, const char *cmd ) {
+	SV_AddReliableCommand( client, cmd, 0 );
+}
+
+
+/*
+======================
+SV_UnshareBroadcastCommand
+
+Copies the text of a log entry into every client ring slot still referring to it,
+clients that are idle, not primed or in another world can hold on to entries
+for any number of newer broadcasts
+======================
+*/
+static void SV_UnshareBroadcastCommand( broadcastCommand_t *bc ) {
+	client_t	*client;
+	int			i, j;
+
+	for ( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
+		for ( j = 0; j < MAX_RELIABLE_COMMANDS; j++ ) {
+			if ( client->reliableBroadcast[ j ] == bc->sequence ) {
+				client->reliableBroadcast[ j ] = 0;
+				Q_strncpyz( client->reliableCommands[ j ], bc->text, sizeof( client->reliableCommands[ j ] ) );
+			}
+		}
+	}
+
+	bc->refs = 0;
+}
+
+
+/*
+======================
+SV_AddBroadcastCommand
+
+Stores the command once in the shared log, returns its broadcast sequence
+======================
+*/
+static int SV_AddBroadcastCommand( const char *cmd ) {
+	broadcastCommand_t *bc;
+
+	if ( ++svs.broadcastSequence <= 0 ) {
+		svs.broadcastSequence = 1; // zero is reserved for targeted commands
+	}
+
+	bc = &svs.broadcastCommands[ svs.broadcastSequence & ( MAX_BROADCAST_COMMANDS - 1 ) ];
+	if ( bc->refs > 0 ) {
+		SV_UnshareBroadcastCommand( bc );
+	}
+	bc->sequence = svs.broadcastSequence;
+	Q_strncpyz( bc->text, cmd, sizeof( bc->text ) );
+
+	return svs.broadcastSequence;
 }
 
 
@@ -219,7 +365,7 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 	va_list		argptr;
 	char		message[MAX_STRING_CHARS+128]; // slightly larger than allowed, to detect overflows
 	client_t	*client;
-	int			j, len;
+	int			j, len, broadcast;
 	
 	va_start( argptr, fmt );
 	len = Q_vsnprintf( message, sizeof( message ), fmt, argptr );
@@ -246,9 +392,13 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 	}
 
 	// send the data to all relevant clients
+	broadcast = SV_AddBroadcastCommand( message );
 	for ( j = 0, client = svs.clients; j < sv_maxclients->integer ; j++, client++ ) {
+		if ( client->world != sv_worldNum ) {
+			continue;
+		}
 		if ( len <= 1022 || client->longstr ) {
-			SV_AddServerCommand( client, message );
+			SV_AddReliableCommand( client, message, broadcast );
 		}
 	}
 }
@@ -402,6 +552,13 @@ static leakyBucket_t buckets[ MAX_BUCKETS ];
 static leakyBucket_t *bucketHashes[ MAX_HASHES ];
 static rateLimit_t outboundRateLimit;
 
+// expired buckets in the order of expiration, buckets used again are skipped
+static int reclaimQueue[ MAX_BUCKETS ];
+static int reclaimHead;
+static int reclaimCount;
+static timerWheel_t bucketTimers;	// on Sys_Milliseconds()
+static qboolean bucketTimersInitialized;
+
 /*
 ================
 SVC_HashForAddress
@@ -459,6 +616,63 @@ static void SVC_RelinkToHead( leakyBucket_t *bucket, int hash ) {
 }
 
 
+/*
+================
+SVC_ReclaimBucket
+================
+*/
+static void SVC_ReclaimBucket( void *data ) {
+	leakyBucket_t *bucket = (leakyBucket_t *)data;
+
+	bucket->reclaimable = qtrue;
+	if ( !bucket->queued ) {
+		bucket->queued = qtrue;
+		reclaimQueue[ ( reclaimHead + reclaimCount ) & ( MAX_BUCKETS - 1 ) ] = bucket - buckets;
+		reclaimCount++;
+	}
+}
+
+
+/*
+================
+SVC_InitBuckets
+================
+*/
+static void SVC_InitBuckets( void ) {
+	int i;
+
+	Timer_Init( &bucketTimers, Sys_Milliseconds() );
+
+	reclaimHead = 0;
+	reclaimCount = 0;
+
+	for ( i = 0; i < MAX_BUCKETS; i++ ) {
+		buckets[ i ].expire.func = SVC_ReclaimBucket;
+		buckets[ i ].expire.data = &buckets[ i ];
+		SVC_ReclaimBucket( &buckets[ i ] );
+	}
+
+	bucketTimersInitialized = qtrue;
+}
+
+
+/*
+================
+SVC_ScheduleBucket
+
+Bucket can be reclaimed when its burst has fully leaked out
+================
+*/
+static void SVC_ScheduleBucket( leakyBucket_t *bucket, int period ) {
+	if ( bucket == NULL || bucket->type == NA_BAD ) {
+		return; // dummy
+	}
+
+	bucket->reclaimable = qfalse;
+	Timer_Schedule( &bucketTimers, &bucket->expire, bucket->rate.lastTime + bucket->rate.burst * period + 1 );
+}
+
+
 /*
 ================
 SVC_BucketForAddress
@@ -468,11 +682,10 @@ Find or allocate a bucket for an address
 */
 static leakyBucket_t *SVC_BucketForAddress( const netadr_t *address, int burst, int period ) {
 	static leakyBucket_t dummy = { 0 };
-	static int		start = 0;
 	const int		hash = SVC_HashForAddress( address );
 	const int		now = Sys_Milliseconds();
 	leakyBucket_t	*bucket;
-	int				i, n;
+	int				n;
 
 	for ( bucket = bucketHashes[ hash ], n = 0; bucket; bucket = bucket->next, n++ ) {
 		switch ( bucket->type ) {
@@ -499,55 +712,61 @@ static leakyBucket_t *SVC_BucketForAddress( const netadr_t *address, int burst,
 		}
 	}
 
-	for ( i = 0; i < MAX_BUCKETS; i++ ) {
-		int interval;
+	if ( !bucketTimersInitialized ) {
+		SVC_InitBuckets();
+	}
+
+	Timer_Advance( &bucketTimers, now );
+
+	while ( reclaimCount > 0 ) {
+		bucket = &buckets[ reclaimQueue[ reclaimHead ] ];
+		reclaimHead = ( reclaimHead + 1 ) & ( MAX_BUCKETS - 1 );
+		reclaimCount--;
+		bucket->queued = qfalse;
 
-		if ( start >= MAX_BUCKETS )
-			start = 0;
-		bucket = &buckets[ start++ ];
-		interval = now - bucket->rate.lastTime;
+		if ( !bucket->reclaimable ) {
+			continue; // used again after expiration
+		}
 
-		// Reclaim expired buckets
-		if ( bucket->type != NA_BAD && (unsigned)interval > ( bucket->rate.burst * period ) ) {
+		// Reclaim expired bucket
+		if ( bucket->type != NA_BAD ) {
 			if ( bucket->prev != NULL ) {
 				bucket->prev->next = bucket->next;
 			} else {
 				bucketHashes[ bucket->hash ] = bucket->next;
 			}
-			
+
 			if ( bucket->next != NULL ) {
 				bucket->next->prev = bucket->prev;
 			}
-
-			bucket->type = NA_BAD;
 		}
 
-		if ( bucket->type == NA_BAD ) {
-			bucket->type = address->type;
-			switch ( address->type ) {
-				case NA_IP:  Com_Memcpy( bucket->ipv._4, address->ipv._4, 4 );  break;
+		bucket->type = address->type;
+		switch ( address->type ) {
+			case NA_IP:  Com_Memcpy( bucket->ipv._4, address->ipv._4, 4 );  break;
 #ifdef USE_IPV6
-				case NA_IP6: Com_Memcpy( bucket->ipv._6, address->ipv._6, 16 ); break;
+			case NA_IP6: Com_Memcpy( bucket->ipv._6, address->ipv._6, 16 ); break;
 #endif
-				default: break;
-			}
+			default: break;
+		}
 
-			bucket->rate.lastTime = now;
-			bucket->rate.burst = 0;
-			bucket->hash = hash;
-			bucket->toxic = 0;
+		bucket->rate.lastTime = now;
+		bucket->rate.burst = 0;
+		bucket->hash = hash;
+		bucket->toxic = 0;
 
-			// Add to the head of the relevant hash chain
-			bucket->next = bucketHashes[ hash ];
-			if ( bucketHashes[ hash ] != NULL ) {
-				bucketHashes[ hash ]->prev = bucket;
-			}
+		// Add to the head of the relevant hash chain
+		bucket->next = bucketHashes[ hash ];
+		if ( bucketHashes[ hash ] != NULL ) {
+			bucketHashes[ hash ]->prev = bucket;
+		}
 
-			bucket->prev = NULL;
-			bucketHashes[ hash ] = bucket;
+		bucket->prev = NULL;
+		bucketHashes[ hash ] = bucket;
 
-			return bucket;
-		}
+		SVC_ScheduleBucket( bucket, period );
+
+		return bucket;
 	}
 
 	// Couldn't allocate a bucket for this address
@@ -635,8 +854,16 @@ Rate limit for a particular address
 */
 qboolean SVC_RateLimitAddress( const netadr_t *from, int burst, int period ) {
 	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
+	qboolean limited;
 
-	return bucket ? SVC_RateLimit( &bucket->rate, burst, period ) : qtrue;
+	if ( bucket == NULL ) {
+		return qtrue;
+	}
+
+	limited = SVC_RateLimit( &bucket->rate, burst, period );
+	SVC_ScheduleBucket( bucket, period );
+
+	return limited;
 }
 
 
@@ -651,6 +878,7 @@ void SVC_RateRestoreBurstAddress( const netadr_t *from, int burst, int period )
 	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
 
 	SVC_RateRestoreBurst( bucket );
+	SVC_ScheduleBucket( bucket, period );
 }
 
 
@@ -665,6 +893,7 @@ void SVC_RateRestoreToxicAddress( const netadr_t *from, int burst, int period )
 	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
 
 	SVC_RateRestoreToxic( bucket );
+	SVC_ScheduleBucket( bucket, period );
 }
 
 
@@ -677,6 +906,7 @@ void SVC_RateDropAddress( const netadr_t *from, int burst, int period ) {
 	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
 
 	SVC_RateDrop( bucket, burst );
+	SVC_ScheduleBucket( bucket, period );
 }
 
 
@@ -745,6 +975,7 @@ static void SVC_Status( const netadr_t *from ) {
 		cl = &svs.clients[i];
 		if ( cl->state >= CS_CONNECTED ) {
 
+			SV_SetWorld( cl->world );
 			ps = SV_GameClientNum( i );
 			playerLength = Com_sprintf( player, sizeof( player ), "%i %i \"%s\"\n", 
 				ps->persistant[ PERS_SCORE ], cl->ping, cl->name );
@@ -757,6 +988,8 @@ static void SVC_Status( const netadr_t *from ) {
 		}
 	}
 
+	SV_SetWorld( 0 );
+
 	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
 }
 
@@ -1090,7 +1323,9 @@ void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
 			// reliable message, but they don't do any other processing
 			if (cl->state != CS_ZOMBIE) {
 				cl->lastPacketTime = svs.time;	// don't timeout
+				SV_SetWorld( cl->world );
 				SV_ExecuteClientMessage( cl, msg );
+				SV_SetWorld( 0 );
 			}
 			return;
 		}
@@ -1147,14 +1382,30 @@ static void SV_CalcPings( void ) {
 		}
 
 		// let the game dll know about the ping
+		SV_SetWorld( cl->world );
 		ps = SV_GameClientNum( i );
 		ps->ping = cl->ping;
 	}
+
+	SV_SetWorld( 0 );
 }
 
+/*
+==============================================================================
+
+SERVER TIMERS
+
+==============================================================================
+*/
+
+static timerWheel_t svTimers;	// on svs.time
+static timerEvent_t clientTimers[ MAX_CLIENTS ];
+static timerEvent_t heartbeatTimer;
+
+
 /*
 ==================
-SV_CheckTimeouts
+SV_ClientTimeout
 
 If a packet has not been received from a client for timeout->integer 
 seconds, drop the conneciton.  Server time is used instead of
@@ -1163,50 +1414,172 @@ realtime to avoid dropping the local client while debugging.
 When a client is normally dropped, the client_t goes into a zombie state
 for a few seconds to make sure any final reliable message gets resent
 if necessary
+
+Reschedules itself for the nearest time something can happen to the client
 ==================
 */
-static void SV_CheckTimeouts( void ) {
-	int		i;
+static void SV_ClientTimeout( void *data ) {
+	const int	i = (intptr_t)data;
 	client_t	*cl;
-	int			droppoint;
-	int			zombiepoint;
+	int			next;
 
-	droppoint = svs.time - 1000 * sv_timeout->integer;
-	zombiepoint = svs.time - 1000 * sv_zombietime->integer;
+	if ( i >= sv_maxclients->integer ) {
+		return;
+	}
 
-	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
-		if ( cl->state == CS_FREE ) {
-			continue;
-		}
-		// message times may be wrong across a changelevel
-		if ( cl->lastPacketTime - svs.time > 0 ) {
-			cl->lastPacketTime = svs.time;
-		}
+	cl = &svs.clients[ i ];
+	if ( cl->state == CS_FREE ) {
+		return;
+	}
 
-		if ( cl->state == CS_ZOMBIE && cl->lastPacketTime - zombiepoint < 0 ) {
-			// using the client id cause the cl->name is empty at this point
-			Com_DPrintf( "Going from CS_ZOMBIE to CS_FREE for client %d\n", i );
-			cl->state = CS_FREE;	// can now be reused
-			continue;
+	// message times may be wrong across a changelevel
+	if ( cl->lastPacketTime - svs.time > 0 ) {
+		cl->lastPacketTime = svs.time;
+	}
+
+	if ( cl->state == CS_ZOMBIE && svs.time - cl->lastPacketTime > 1000 * sv_zombietime->integer ) {
+		// using the client id cause the cl->name is empty at this point
+		Com_DPrintf( "Going from CS_ZOMBIE to CS_FREE for client %d\n", i );
+		cl->state = CS_FREE;	// can now be reused
+		return;
+	}
+	if ( cl->justConnected && svs.time - cl->lastPacketTime > 4000 ) {
+		// for real client 4 seconds is more than enough to respond
+		SVC_RateDropAddress( &cl->netchan.remoteAddress, 10, 1000 ); // enforce burst with progressive multiplier
+		SV_DropClient( cl, NULL ); // drop silently
+		cl->state = CS_FREE;
+		return;
+	}
+	if ( cl->state >= CS_CONNECTED && svs.time - cl->lastPacketTime > 1000 * sv_timeout->integer ) {
+		// wait several frames so a debugger session doesn't
+		// cause a timeout
+		if ( ++cl->timeoutCount > 5 ) {
+			SV_DropClient( cl, "timed out" );
+			cl->state = CS_FREE;	// don't bother with zombie state
+			return;
 		}
-		if ( cl->justConnected && svs.time - cl->lastPacketTime > 4000 ) {
-			// for real client 4 seconds is more than enough to respond
-			SVC_RateDropAddress( &cl->netchan.remoteAddress, 10, 1000 ); // enforce burst with progressive multiplier
-			SV_DropClient( cl, NULL ); // drop silently
-			cl->state = CS_FREE;
-			continue;
+		// check again on the next frame
+		Timer_Schedule( &svTimers, &clientTimers[ i ], svs.time + 1 );
+		return;
+	}
+
+	cl->timeoutCount = 0;
+
+	if ( cl->state == CS_ZOMBIE ) {
+		next = cl->lastPacketTime + 1000 * sv_zombietime->integer;
+	} else {
+		next = cl->lastPacketTime + 1000 * sv_timeout->integer;
+	}
+	if ( cl->justConnected && next - ( cl->lastPacketTime + 4000 ) > 0 ) {
+		next = cl->lastPacketTime + 4000;
+	}
+
+	Timer_Schedule( &svTimers, &clientTimers[ i ], next + 1 );
+}
+
+
+/*
+==================
+SV_ScheduleClientTimeout
+
+Must be called when the client leaves CS_FREE state or goes zombie
+==================
+*/
+void SV_ScheduleClientTimeout( const client_t *client ) {
+	const int i = client - svs.clients;
+
+	if ( i < 0 || i >= sv_maxclients->integer || i >= MAX_CLIENTS ) {
+		return; // multiview recorder slot
+	}
+
+	Timer_Schedule( &svTimers, &clientTimers[ i ], svs.time );
+}
+
+
+/*
+==================
+SV_HeartbeatTimer
+==================
+*/
+static void SV_HeartbeatTimer( void *data ) {
+
+	SV_MasterHeartbeat( HEARTBEAT_FOR_MASTER );
+
+	if ( svs.nextHeartbeatTime - svs.time > 0 ) {
+		Timer_Schedule( &svTimers, &heartbeatTimer, svs.nextHeartbeatTime );
+	} else {
+		// heartbeats are disabled, check again later
+		Timer_Schedule( &svTimers, &heartbeatTimer, svs.time + 1000 );
+	}
+}
+
+
+/*
+==================
+SV_ScheduleHeartbeat
+
+Sends a heartbeat at svs.nextHeartbeatTime
+==================
+*/
+void SV_ScheduleHeartbeat( void ) {
+	if ( !svs.initialized ) {
+		return;
+	}
+
+	Timer_Schedule( &svTimers, &heartbeatTimer, svs.nextHeartbeatTime );
+}
+
+
+/*
+==================
+SV_InitTimers
+
+Called on server startup and whenever svs.time went backwards
+==================
+*/
+void SV_InitTimers( void ) {
+	int i;
+
+	Timer_Init( &svTimers, svs.time );
+
+	for ( i = 0; i < MAX_CLIENTS; i++ ) {
+		Com_Memset( &clientTimers[ i ], 0, sizeof( clientTimers[ i ] ) );
+		clientTimers[ i ].func = SV_ClientTimeout;
+		clientTimers[ i ].data = (void *)(intptr_t)i;
+		if ( svs.clients && i < sv_maxclients->integer && svs.clients[ i ].state != CS_FREE ) {
+			SV_ScheduleClientTimeout( &svs.clients[ i ] );
 		}
-		if ( cl->state >= CS_CONNECTED && cl->lastPacketTime - droppoint < 0 ) {
-			// wait several frames so a debugger session doesn't
-			// cause a timeout
-			if ( ++cl->timeoutCount > 5 ) {
-				SV_DropClient( cl, "timed out" );
-				cl->state = CS_FREE;	// don't bother with zombie state
+	}
+
+	Com_Memset( &heartbeatTimer, 0, sizeof( heartbeatTimer ) );
+	heartbeatTimer.func = SV_HeartbeatTimer;
+	Timer_Schedule( &svTimers, &heartbeatTimer, svs.nextHeartbeatTime );
+}
+
+
+/*
+==================
+SV_RunTimers
+==================
+*/
+static void SV_RunTimers( void ) {
+	int i;
+
+	if ( svTimers.time - svs.time > 0 ) {
+		SV_InitTimers();
+	}
+
+	if ( sv_timeout->modified || sv_zombietime->modified ) {
+		sv_timeout->modified = qfalse;
+		sv_zombietime->modified = qfalse;
+		for ( i = 0; i < sv_maxclients->integer; i++ ) {
+			if ( svs.clients[ i ].state != CS_FREE ) {
+				SV_ScheduleClientTimeout( &svs.clients[ i ] );
 			}
-		} else {
-			cl->timeoutCount = 0;
 		}
 	}
+
+	Timer_Advance( &svTimers, svs.time );
 }
 
 
@@ -1309,6 +1682,143 @@ void SV_TrackCvarChanges( void )
 }
 
 
+/*
+==============================================================================
+
+GAME WORLDS
+
+==============================================================================
+*/
+
+/*
+==================
+SV_SetWorld
+
+Makes sv, gvm and the clip map refer to world index,
+code outside of world specific passes expects world 0
+==================
+*/
+void SV_SetWorld( int index ) {
+	svWorld_t *w;
+
+	if ( index == sv_worldNum ) {
+		return;
+	}
+
+	w = &sv_worlds[ sv_worldNum ];
+	if ( !w->cm ) {
+		w->cm = CM_AllocWorld();
+	}
+	CM_SaveWorld( w->cm );
+	w->gvm = gvm;
+
+	w = &sv_worlds[ index ];
+	CM_RestoreWorld( w->cm );
+	gvm = w->gvm;
+	sv_server = w->server;
+	sv_worldNum = index;
+
+	SV_CheckSnapshotWorld();
+}
+
+
+/*
+==================
+SV_AbortWorldPass
+
+An error aborted the frame, possibly in the middle of a world specific pass
+==================
+*/
+void SV_AbortWorldPass( void ) {
+	SV_SetWorld( 0 );
+}
+
+
+/*
+==================
+SV_SetInfoConfigstrings
+
+Copies serverinfo or systeminfo cvars to the configstrings of every world,
+secondary worlds report their own map and server id
+==================
+*/
+void SV_SetInfoConfigstrings( int flags ) {
+	char	info[ BIG_INFO_STRING ];
+	int		world, i;
+
+	world = sv_worldNum;
+
+	for ( i = 0; i < MAX_WORLDS; i++ ) {
+		if ( i != 0 && !sv_worlds[ i ].active ) {
+			continue;
+		}
+		SV_SetWorld( i );
+		if ( flags & CVAR_SERVERINFO ) {
+			Q_strncpyz( info, Cvar_InfoString( CVAR_SERVERINFO, NULL ), MAX_INFO_STRING );
+			if ( i != 0 ) {
+				Info_SetValueForKey( info, "mapname", sv_worlds[ i ].mapname );
+			}
+			SV_SetConfigstring( CS_SERVERINFO, info );
+		}
+		if ( flags & CVAR_SYSTEMINFO ) {
+			Q_strncpyz( info, Cvar_InfoString_Big( CVAR_SYSTEMINFO, NULL ), sizeof( info ) );
+			if ( i != 0 ) {
+				Info_SetValueForKey_s( info, sizeof( info ), "sv_serverid", va( "%i", sv.serverId ) );
+			}
+			SV_SetConfigstring( CS_SYSTEMINFO, info );
+		}
+	}
+
+	SV_SetWorld( world );
+}
+
+
+/*
+==================
+SV_RunWorlds
+
+Secondary worlds run their game frames in step with world 0
+==================
+*/
+static void SV_RunWorlds( int frameMsec ) {
+	int i;
+
+	for ( i = 1; i < MAX_WORLDS; i++ ) {
+		if ( !sv_worlds[ i ].active ) {
+			continue;
+		}
+		SV_SetWorld( i );
+		sv.time += frameMsec;
+		VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
+	}
+
+	SV_SetWorld( 0 );
+}
+
+
+/*
+==================
+SV_SendWorldMessages
+
+Sends snapshots to the clients of the secondary worlds
+==================
+*/
+static void SV_SendWorldMessages( void ) {
+	int i;
+
+	for ( i = 1; i < MAX_WORLDS; i++ ) {
+		if ( !sv_worlds[ i ].active ) {
+			continue;
+		}
+		SV_SetWorld( i );
+		SV_IssueNewSnapshot();
+		SV_SendClientMessages();
+	}
+
+	SV_SetWorld( 0 );
+}
+
+
 /*
 ==================
 SV_Restart
@@ -1461,11 +1971,11 @@ void SV_Frame( int msec ) {
 
 	// update infostrings if anything has been changed
 	if ( cvar_modifiedFlags & CVAR_SERVERINFO ) {
-		SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO, NULL ) );
+		SV_SetInfoConfigstrings( CVAR_SERVERINFO );
 		cvar_modifiedFlags &= ~CVAR_SERVERINFO;
 	}
 	if ( cvar_modifiedFlags & CVAR_SYSTEMINFO ) {
-		SV_SetConfigstring( CS_SYSTEMINFO, Cvar_InfoString_Big( CVAR_SYSTEMINFO, NULL ) );
+		SV_SetInfoConfigstrings( CVAR_SYSTEMINFO );
 		cvar_modifiedFlags &= ~CVAR_SYSTEMINFO;
 	}
 
@@ -1503,20 +2013,23 @@ void SV_Frame( int msec ) {
 			SV_DemoRestartPlayback();
 		else if (sv.demoState == DS_PLAYBACK) // Play the next demo frame
 			SV_DemoReadFrame();
+
+		SV_RunWorlds( frameMsec );
 	}
 
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
 
-	// check timeouts
-	SV_CheckTimeouts();
+	// check timeouts and send a heartbeat to the master if needed
+	SV_RunTimers();
 
 	// reset current and build new snapshot on first query
 	SV_IssueNewSnapshot();
 
 	// send messages back to the clients
 	SV_SendClientMessages();
+	SV_SendWorldMessages();
 
 #ifdef USE_MV
 	svs.emptyFrame = qfalse;
@@ -1529,8 +2042,6 @@ void SV_Frame( int msec ) {
 	}
 #endif
 
-	// send a heartbeat to the master if needed
-	SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
 }
 
 
@@ -45,6 +45,176 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Per-frame entity change masks
+
+The fields that changed against the baseline and against each common
+snapshot that clients delta-compress from are computed once for every
+entity of the current common snapshot, all clients using the same source
+reuse the mask instead of comparing all fields again. Sources are added
+on the main thread while delta frames are selected, snapshot workers
+only read them.
+
+=============================================================================
+*/
+
+#define MAX_DELTA_SOURCES 4
+
+typedef struct {
+	const entityState_t	*cur;		// storage of this entity in sv.currFrame
+	const entityState_t	*from[ MAX_DELTA_SOURCES ];	// storage in each source frame, NULL if absent
+	uint64_t			fromMask[ MAX_DELTA_SOURCES ];
+	uint64_t			baselineMask;
+	int					sliceOfs[ MAX_DELTA_SOURCES ];	// encoded delta in deltaSlices
+	int					sliceBits[ MAX_DELTA_SOURCES ];	// -1 if not encoded
+} entityDelta_t;
+
+static entityDelta_t entityDeltas[ MAX_GENTITIES ];	// by entity number
+static int deltaEntities[ MAX_GENTITIES ];			// numbers filled for the current frame
+static int numDeltaEntities;
+
+static int deltaSources[ MAX_DELTA_SOURCES ];		// common snapshot frame numbers
+static int deltaSourceUsers[ MAX_DELTA_SOURCES ];	// clients delta-compressing from each source
+static int numDeltaSources;
+
+#define DELTA_SLICES_SIZE (MAX_MSGLEN*16)
+
+static byte deltaSlices[ DELTA_SLICES_SIZE + 4 ];	// padding for 32-bit reads of the last slice
+static int deltaSlicesUsed;
+
+
+/*
+=============
+SV_EncodeDeltaSource
+
+Encodes entity deltas from source n once so clients sharing it can splice them
+=============
+*/
+static void SV_EncodeDeltaSource( int n ) {
+	const snapshotFrame_t *sf;
+	const entityState_t *es;
+	entityDelta_t *delta;
+	msg_t msg;
+	int i;
+
+	sf = sv.currFrame;
+
+	for ( i = 0; i < sf->count; i++ ) {
+		es = sf->ents[ i ];
+		delta = &entityDeltas[ es->number ];
+		if ( delta->from[ n ] == NULL ) {
+			continue;
+		}
+		if ( delta->fromMask[ n ] == 0 ) {
+			delta->sliceOfs[ n ] = 0;
+			delta->sliceBits[ n ] = 0;
+			continue;
+		}
+		if ( DELTA_SLICES_SIZE - deltaSlicesUsed < MAX_MSGLEN / 16 ) {
+			// out of space, remaining entities will be encoded per client
+			break;
+		}
+		MSG_Init( &msg, deltaSlices + deltaSlicesUsed, DELTA_SLICES_SIZE - deltaSlicesUsed );
+		MSG_WriteDeltaEntityMask( &msg, es, delta->fromMask[ n ], qfalse );
+		if ( msg.overflowed ) {
+			break;
+		}
+		delta->sliceOfs[ n ] = deltaSlicesUsed;
+		delta->sliceBits[ n ] = msg.bit;
+		deltaSlicesUsed += ( msg.bit + 7 ) >> 3;
+	}
+}
+
+
+/*
+=============
+SV_AddDeltaSource
+
+Computes change masks from common snapshot frameNum to the current one
+=============
+*/
+static void SV_AddDeltaSource( int frameNum ) {
+	const snapshotFrame_t *sf, *src;
+	const entityState_t *es;
+	entityDelta_t *delta;
+	int i, j, n;
+
+	sf = sv.currFrame;
+	if ( sf == NULL || frameNum >= sf->frameNum || frameNum < sv.lastValidFrame || frameNum < 0 ) {
+		return;
+	}
+
+	for ( n = 0; n < numDeltaSources; n++ ) {
+		if ( deltaSources[ n ] == frameNum ) {
+			// the second client makes it worth to encode shared deltas
+			if ( ++deltaSourceUsers[ n ] == 2 ) {
+				SV_EncodeDeltaSource( n );
+			}
+			return;
+		}
+	}
+
+	if ( numDeltaSources >= MAX_DELTA_SOURCES ) {
+		return;
+	}
+
+	src = &sv.snapFrames[ frameNum % NUM_SNAPSHOT_FRAMES ];
+	if ( src->frameNum != frameNum ) {
+		return;
+	}
+
+	n = numDeltaSources++;
+	deltaSources[ n ] = frameNum;
+	deltaSourceUsers[ n ] = 1;
+
+	// both frames are sorted by entity number
+	for ( i = 0, j = 0; i < sf->count; i++ ) {
+		es = sf->ents[ i ];
+		delta = &entityDeltas[ es->number ];
+		while ( j < src->count && src->ents[ j ]->number < es->number ) {
+			j++;
+		}
+		delta->sliceBits[ n ] = -1;
+		if ( j < src->count && src->ents[ j ]->number == es->number ) {
+			delta->from[ n ] = src->ents[ j ];
+			delta->fromMask[ n ] = MSG_EntityChangeMask( src->ents[ j ], es );
+		} else {
+			delta->from[ n ] = NULL;
+		}
+	}
+}
+
+
+/*
+=============
+SV_BuildEntityDeltas
+=============
+*/
+static void SV_BuildEntityDeltas( const snapshotFrame_t *sf ) {
+	const entityState_t *es;
+	entityDelta_t *delta;
+	int i;
+
+	// forget entities of the last frame, their storage may be reused now
+	for ( i = 0; i < numDeltaEntities; i++ ) {
+		entityDeltas[ deltaEntities[ i ] ].cur = NULL;
+	}
+	numDeltaEntities = 0;
+	numDeltaSources = 0;
+	deltaSlicesUsed = 0;
+
+	for ( i = 0; i < sf->count; i++ ) {
+		es = sf->ents[ i ];
+		delta = &entityDeltas[ es->number ];
+		deltaEntities[ numDeltaEntities++ ] = es->number;
+		delta->cur = es;
+		delta->baselineMask = MSG_EntityChangeMask( &sv.svEntities[ es->number ].baseline, es );
+	}
+}
+
+
 /*
 =============
 SV_EmitPacketEntities
@@ -57,12 +227,29 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
+	const entityDelta_t *delta;
+	qboolean useDeltas;
+	int		source;
+
+	// masks don't account for fields merged into multiview playerstates
+#ifdef USE_MV
+	useDeltas = ( MSG_entMergeMask == 0 ) ? qtrue : qfalse;
+#else
+	useDeltas = qtrue;
+#endif
 
 	// generate the delta update
+	source = -1;
 	if ( !from ) {
 		from_num_entities = 0;
 	} else {
 		from_num_entities = from->num_entities;
+		for ( oldindex = 0; oldindex < numDeltaSources && useDeltas; oldindex++ ) {
+			if ( deltaSources[ oldindex ] == from->frameNum ) {
+				source = oldindex;
+				break;
+			}
+		}
 	}
 
 	newent = NULL;
@@ -88,7 +275,16 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			delta = &entityDeltas[ newnum ];
+			if ( source >= 0 && delta->cur == newent && delta->from[ source ] == oldent ) {
+				if ( delta->sliceBits[ source ] >= 0 && msg->bit + delta->sliceBits[ source ] <= msg->maxbits ) {
+					MSG_WriteBitSlice( msg, deltaSlices + delta->sliceOfs[ source ], delta->sliceBits[ source ] );
+				} else {
+					MSG_WriteDeltaEntityMask( msg, newent, delta->fromMask[ source ], qfalse );
+				}
+			} else {
+				MSG_WriteDeltaEntity( msg, oldent, newent, qfalse );
+			}
 			oldindex++;
 			newindex++;
 			continue;
@@ -96,7 +292,12 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			delta = &entityDeltas[ newnum ];
+			if ( useDeltas && delta->cur == newent ) {
+				MSG_WriteDeltaEntityMask( msg, newent, delta->baselineMask, qtrue );
+			} else {
+				MSG_WriteDeltaEntity( msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			}
 			newindex++;
 			continue;
 		}
@@ -115,49 +316,67 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SelectDeltaFrame
+
+Try to use a previous frame as the source for delta compressing the snapshot,
+must be called from the main thread after the common snapshot for this frame
+has been built
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
+static const clientSnapshot_t *SV_SelectDeltaFrame( const client_t *client, int *lastframe ) {
 	const clientSnapshot_t	*oldframe;
-	clientSnapshot_t	*frame;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
-	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage 
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf( "%s: Delta request from out of date packet.\n", client->name );
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 		// we may refer on outdated frame
-		if ( svs.lastValidFrame > oldframe->frameNum ) {
+		if ( sv.lastValidFrame > oldframe->frameNum ) {
 			Com_DPrintf( "%s: Delta request from out of date frame.\n", client->name );
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 #ifdef USE_MV
-		else if ( frame->multiview && oldframe->first_psf <= svs.nextSnapshotPSF - svs.numSnapshotPSF ) {
+		else if ( client->multiview.protocol > 0 && oldframe->first_psf <= svs.nextSnapshotPSF - svs.numSnapshotPSF ) {
 			Com_DPrintf( "%s: Delta request from out of date playerstate.\n", client->name );
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 #endif
 	}
 
+	if ( oldframe ) {
+		// share field compares with other clients using the same source
+		SV_AddDeltaSource( oldframe->frameNum );
+	}
+
+	return oldframe;
+}
+
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, const clientSnapshot_t *oldframe, int lastframe ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 #ifdef USE_MV
 	if ( frame->multiview )
 		MSG_WriteByte( msg, svc_multiview );
@@ -313,7 +532,7 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 			if ( i <= client->reliableSent ) {
 				MSG_WriteByte( msg, svc_serverCommand );
 				MSG_WriteLong( msg, i );
-				MSG_WriteString( msg, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+				MSG_WriteString( msg, SV_GetServerCommand( client, i ) );
 			} else{
 				// build new compressed stream or re-send existing
 				SV_BuildCompressedBuffer( client, i );
@@ -323,7 +542,7 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 #else
 			MSG_WriteByte( msg, svc_serverCommand );
 			MSG_WriteLong( msg, i );
-			MSG_WriteString( msg, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+			MSG_WriteString( msg, SV_GetServerCommand( client, i ) );
 #endif
 		}
 
@@ -345,7 +564,7 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 	for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
 		MSG_WriteByte( msg, svc_serverCommand );
 		MSG_WriteLong( msg, i );
-		MSG_WriteString( msg, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+		MSG_WriteString( msg, SV_GetServerCommand( client, i ) );
 	}
 	client->reliableSent = client->reliableSequence;
 
@@ -375,7 +594,8 @@ typedef struct {
 
 
 typedef struct clientPVS_s {
-	int		snapshotFrame; // svs.snapshotFrame
+	int		snapshotFrame; // sv.snapshotFrame
+	int		serverId;		// sv.serverId, frame numbers of different worlds overlap
 
 	int		clientNum;
 	int		areabytes;
@@ -385,11 +605,214 @@ typedef struct clientPVS_s {
 	byte	entMask[MAX_GENTITIES/8];
 	qboolean entMaskBuilt;
 
+	uint32_t entAdded[MAX_GENTITIES/32];	// used to prevent double adding from portal views
+
 } clientPVS_t;
 
 static clientPVS_t client_pvs[ MAX_CLIENTS ];
 
 
+/*
+=============================================================================
+
+Per-frame visibility cache
+
+Everything that decides whether an entity is visible from a point, except
+the per-client svFlags, depends only on the cluster and area of that point.
+The resulting entity masks are built once per common snapshot and shared
+by all viewpoints resolving to the same (cluster, area) pair.
+
+=============================================================================
+*/
+
+#define MAX_PVS_CACHE	(MAX_CLIENTS*2)
+
+#define SVF_PERCLIENT	(SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK | SVF_PORTAL)
+
+typedef struct {
+	int			cluster;
+	int			area;
+	uint32_t	visible[MAX_GENTITIES/32];	// by entity number
+} pvsCacheEntry_t;
+
+typedef struct {
+	int			index[MAX_GENTITIES];		// entity number -> common snapshot index
+	uint32_t	present[MAX_GENTITIES/32];	// entities in the common snapshot
+	uint32_t	special[MAX_GENTITIES/32];	// entities that need per-client checks
+	int			numWords;
+
+	int			numEntries;
+	pvsCacheEntry_t	entries[MAX_PVS_CACHE];
+
+	qboolean	frozen;						// read-only while worker threads build snapshots
+} pvsCache_t;
+
+static pvsCache_t pvsCache;
+
+static const server_t *snapshotCacheWorld;	// world the per-frame caches were built for
+
+
+/*
+===============
+SV_LowestBit
+===============
+*/
+static int SV_LowestBit( uint32_t bits ) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz( bits );
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward( &index, bits );
+	return index;
+#else
+	int n = 0;
+	while ( !( bits & 1 ) ) {
+		bits >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+
+/*
+===============
+SV_ResetPVSCache
+
+Called for each new common snapshot
+===============
+*/
+static void SV_ResetPVSCache( const snapshotFrame_t *sf ) {
+	const sharedEntity_t *ent;
+	int i, num, maxnum;
+
+	memset( pvsCache.present, 0, sizeof( pvsCache.present ) );
+	memset( pvsCache.special, 0, sizeof( pvsCache.special ) );
+	pvsCache.numEntries = 0;
+
+	maxnum = 0;
+	for ( i = 0; i < sf->count; i++ ) {
+		num = sf->ents[ i ]->number;
+		if ( pvsCache.present[ num >> 5 ] & ( 1U << ( num & 31 ) ) ) {
+			continue;
+		}
+		pvsCache.present[ num >> 5 ] |= 1U << ( num & 31 );
+		pvsCache.index[ num ] = i;
+
+		ent = SV_GentityNum( num );
+		if ( ent->r.svFlags & SVF_PERCLIENT ) {
+			pvsCache.special[ num >> 5 ] |= 1U << ( num & 31 );
+		}
+		if ( num > maxnum ) {
+			maxnum = num;
+		}
+	}
+
+	pvsCache.numWords = sf->count ? ( maxnum >> 5 ) + 1 : 0;
+}
+
+
+/*
+===============
+SV_EntityVisibleFromCluster
+===============
+*/
+static qboolean SV_EntityVisibleFromCluster( const svEntity_t *svEnt, int clientarea, const byte *bitvector ) {
+	int i, l;
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+			if ( l == svEnt->lastCluster ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+===============
+SV_VisibleEntities
+
+Returns mask of entities visible from (cluster, area), ignoring per-client flags
+===============
+*/
+static const uint32_t *SV_VisibleEntities( int cluster, int area, uint32_t *scratch ) {
+	const entityState_t *es;
+	const sharedEntity_t *ent;
+	pvsCacheEntry_t *entry;
+	const byte *clientpvs;
+	uint32_t *visible;
+	int e, num;
+
+	for ( e = 0; e < pvsCache.numEntries; e++ ) {
+		entry = &pvsCache.entries[ e ];
+		if ( entry->cluster == cluster && entry->area == area ) {
+			return entry->visible;
+		}
+	}
+
+	if ( !pvsCache.frozen && pvsCache.numEntries < MAX_PVS_CACHE ) {
+		entry = &pvsCache.entries[ pvsCache.numEntries++ ];
+		entry->cluster = cluster;
+		entry->area = area;
+		visible = entry->visible;
+	} else {
+		visible = scratch;
+	}
+
+	memset( visible, 0, pvsCache.numWords * sizeof( uint32_t ) );
+
+	clientpvs = CM_ClusterPVS( cluster );
+
+	for ( e = 0 ; e < sv.currFrame->count; e++ ) {
+		es = sv.currFrame->ents[ e ];
+		num = es->number;
+		ent = SV_GentityNum( num );
+
+		// broadcast entities are always sent
+		if ( ent->r.svFlags & SVF_BROADCAST || SV_EntityVisibleFromCluster( &sv.svEntities[ num ], area, clientpvs ) ) {
+			visible[ num >> 5 ] |= 1U << ( num & 31 );
+		}
+	}
+
+	return visible;
+}
+
+
 /*
 =============
 SV_SortEntityNumbers
@@ -425,9 +848,10 @@ static void SV_SortEntityNumbers( entityNum_t *num, const int size ) {
 SV_AddIndexToSnapshot
 ===============
 */
-static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddIndexToSnapshot( clientPVS_t *pvs, int entityNum, int index ) {
+	snapshotEntityNumbers_t *eNums = &pvs->numbers;
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	pvs->entAdded[ entityNum >> 5 ] |= 1U << ( entityNum & 31 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities >= MAX_SNAPSHOT_ENTITIES ) {
@@ -445,15 +869,13 @@ SV_AddEntitiesVisibleFromPoint
 ===============
 */
 static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientPVS_t *pvs, qboolean portal ) {
-	int		e, i;
+	uint32_t	scratch[MAX_GENTITIES/32];
+	const uint32_t *visible;
+	uint32_t	bits, bit;
 	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	entityState_t  *es;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
+	int		w, num;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -469,100 +891,60 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientPVS_t *pv
 	// calculate the visible areas
 	pvs->areabytes = CM_WriteAreaBits( pvs->areabits, clientarea );
 
-	clientpvs = CM_ClusterPVS (clientcluster);
-
-	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
-		es = svs.currFrame->ents[ e ];
-		ent = SV_GentityNum( es->number );
-
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != pvs->clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == pvs->clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to a given mask of clients
-		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if ( pvs->clientNum >= 32 )
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
-			if ( ~ent->r.singleClient & (1 << pvs->clientNum) )
-				continue;
-		}
-
-		svEnt = &sv.svEntities[ es->number ];
+	visible = SV_VisibleEntities( clientcluster, clientarea, scratch );
 
+	for ( w = 0 ; w < pvsCache.numWords; w++ ) {
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
-
-		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddIndexToSnapshot( svEnt, e, &pvs->numbers );
-			continue;
-		}
-
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
+		bits = visible[ w ] & ~pvs->entAdded[ w ];
+		while ( bits ) {
+			bit = bits & ( ~bits + 1 );
+			bits ^= bit;
+			num = ( w << 5 ) + SV_LowestBit( bit );
+
+			if ( !( pvsCache.special[ w ] & bit ) ) {
+				SV_AddIndexToSnapshot( pvs, num, pvsCache.index[ num ] );
+				continue;
 			}
-		}
-
-		bitvector = clientpvs;
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
-		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
+			ent = SV_GentityNum( num );
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
+			// entities can be flagged to be sent to only one client
+			if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+				if ( ent->r.singleClient != pvs->clientNum ) {
+					continue;
 				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
+			}
+			// entities can be flagged to be sent to everyone but one client
+			if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+				if ( ent->r.singleClient == pvs->clientNum ) {
+					continue;
 				}
-			} else {
-				continue;
 			}
-		}
+			// entities can be flagged to be sent to a given mask of clients
+			if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+				if ( pvs->clientNum >= 32 )
+					Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
+				if ( ~ent->r.singleClient & (1 << pvs->clientNum) )
+					continue;
+			}
 
-		// add it
-		SV_AddIndexToSnapshot( svEnt, e, &pvs->numbers );
+			// add it
+			SV_AddIndexToSnapshot( pvs, num, pvsCache.index[ num ] );
 
-		// if it's a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL && !portal ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
+			// if it's a portal entity, add everything visible from its camera position
+			if ( ent->r.svFlags & SVF_PORTAL && !( ent->r.svFlags & SVF_BROADCAST ) && !portal ) {
+				if ( ent->s.generic1 ) {
+					vec3_t dir;
+					VectorSubtract(ent->s.origin, origin, dir);
+					if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+						continue;
+					}
 				}
+				pvs->numbers.unordered = qtrue;
+				SV_AddEntitiesVisibleFromPoint( ent->s.origin2, pvs, portal );
+				// portal view may have added entities of this word already
+				bits &= ~pvs->entAdded[ w ];
 			}
-			pvs->numbers.unordered = qtrue;
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, pvs, portal );
 		}
 	}
 
@@ -583,17 +965,22 @@ SV_InitSnapshotStorage
 void SV_InitSnapshotStorage( void ) 
 {
 	// initialize snapshot storage
-	Com_Memset( svs.snapFrames, 0, sizeof( svs.snapFrames ) );
-	svs.freeStorageEntities = svs.numSnapshotEntities;
-	svs.currentStoragePosition = 0;
+	Com_Memset( sv.snapFrames, 0, sizeof( sv.snapFrames ) );
+	sv.freeStorageEntities = svs.numSnapshotEntities;
+	sv.currentStoragePosition = 0;
 
-	svs.snapshotFrame = 0;
-	svs.currentSnapshotFrame = 0;
-	svs.lastValidFrame = 0;
+	sv.snapshotFrame = 0;
+	sv.currentSnapshotFrame = 0;
+	sv.lastValidFrame = 0;
 
-	svs.currFrame = NULL;
+	sv.currFrame = NULL;
 
 	Com_Memset( client_pvs, 0, sizeof( client_pvs ) );
+	Com_Memset( &pvsCache, 0, sizeof( pvsCache ) );
+	Com_Memset( entityDeltas, 0, sizeof( entityDeltas ) );
+	numDeltaEntities = 0;
+	deltaSlicesUsed = 0;
+	snapshotCacheWorld = NULL;
 }
 
 
@@ -606,11 +993,27 @@ This should be called before any new client snaphot built
 */
 void SV_IssueNewSnapshot( void ) 
 {
-	svs.currFrame = NULL;
+	sv.currFrame = NULL;
 	
 	// value that clients can use even for their empty frames
 	// as it will not increment on new snapshot built
-	svs.currentSnapshotFrame = svs.snapshotFrame;
+	sv.currentSnapshotFrame = sv.snapshotFrame;
+}
+
+
+/*
+===============
+SV_CheckSnapshotWorld
+
+The per-frame caches only describe the last common snapshot built,
+a world switched to must build its own before clients refer to it
+===============
+*/
+void SV_CheckSnapshotWorld( void )
+{
+	if ( snapshotCacheWorld != sv_server ) {
+		sv.currFrame = NULL;
+	}
 }
 
 
@@ -658,82 +1061,84 @@ static void SV_BuildCommonSnapshot( void )
 			}
 
 			list[ count++ ] = ent;
-			sv.svEntities[ num ].snapshotCounter = -1;
 		}
 	}
 
-	sv.snapshotCounter = -1;
-
-	sf = &svs.snapFrames[ svs.snapshotFrame % NUM_SNAPSHOT_FRAMES ];
+	sf = &sv.snapFrames[ sv.snapshotFrame % NUM_SNAPSHOT_FRAMES ];
 	
 	// track last valid frame
-	if ( svs.snapshotFrame - svs.lastValidFrame > (NUM_SNAPSHOT_FRAMES-1) ) {
-		svs.lastValidFrame = svs.snapshotFrame - (NUM_SNAPSHOT_FRAMES-1);
+	if ( sv.snapshotFrame - sv.lastValidFrame > (NUM_SNAPSHOT_FRAMES-1) ) {
+		sv.lastValidFrame = sv.snapshotFrame - (NUM_SNAPSHOT_FRAMES-1);
 		// release storage
-		svs.freeStorageEntities += sf->count;
+		sv.freeStorageEntities += sf->count;
 		sf->count = 0;
 	}
 
 	// release more frames if needed
-	while ( svs.freeStorageEntities < count && svs.lastValidFrame != svs.snapshotFrame ) {
-		tmp = &svs.snapFrames[ svs.lastValidFrame % NUM_SNAPSHOT_FRAMES ];
-		svs.lastValidFrame++;
+	while ( sv.freeStorageEntities < count && sv.lastValidFrame != sv.snapshotFrame ) {
+		tmp = &sv.snapFrames[ sv.lastValidFrame % NUM_SNAPSHOT_FRAMES ];
+		sv.lastValidFrame++;
 		// release storage
-		svs.freeStorageEntities += tmp->count;
+		sv.freeStorageEntities += tmp->count;
 		tmp->count = 0;
 	}
 
 	// should never happen but anyway
-	if ( svs.freeStorageEntities < count ) {
-		Com_Error( ERR_DROP, "Not enough snapshot storage: %i < %i", svs.freeStorageEntities, count );
+	if ( sv.freeStorageEntities < count ) {
+		Com_Error( ERR_DROP, "Not enough snapshot storage: %i < %i", sv.freeStorageEntities, count );
 	}
 
 	// allocate storage
 	sf->count = count;
-	svs.freeStorageEntities -= count;
+	sv.freeStorageEntities -= count;
 
-	sf->start = svs.currentStoragePosition; 
-	svs.currentStoragePosition = ( svs.currentStoragePosition + count ) % svs.numSnapshotEntities;
+	sf->start = sv.currentStoragePosition; 
+	sv.currentStoragePosition = ( sv.currentStoragePosition + count ) % svs.numSnapshotEntities;
 
-	sf->frameNum = svs.snapshotFrame;
-	svs.snapshotFrame++;
+	sf->frameNum = sv.snapshotFrame;
+	sv.snapshotFrame++;
 
-	svs.currFrame = sf; // clients can refer to this
+	sv.currFrame = sf; // clients can refer to this
 
 	// setup start index
 	index = sf->start;
 	for ( i = 0 ; i < count ; i++, index = (index+1) % svs.numSnapshotEntities ) {
 		//index %= svs.numSnapshotEntities;
-		svs.snapshotEntities[ index ] = list[ i ]->s;
-		sf->ents[ i ] = &svs.snapshotEntities[ index ];
+		sv.snapshotEntities[ index ] = list[ i ]->s;
+		sf->ents[ i ] = &sv.snapshotEntities[ index ];
 	}
+
+	SV_ResetPVSCache( sf );
+
+	SV_BuildEntityDeltas( sf );
+
+	snapshotCacheWorld = sv_server;
 }
 
 
 
 static clientPVS_t *SV_BuildClientPVS( int clientSlot, const playerState_t *ps, qboolean buildEntityMask ) 
 {
-	svEntity_t	*svEnt;
 	clientPVS_t	*pvs;
 	vec3_t	org;
 	int i;
 	
 	pvs = &client_pvs[ clientSlot ];
 
-	if ( pvs->snapshotFrame != svs.snapshotFrame /*|| pvs->clientNum != ps->clientNum*/ ) {
-		pvs->snapshotFrame = svs.snapshotFrame;
+	if ( pvs->snapshotFrame != sv.snapshotFrame || pvs->serverId != sv.serverId /*|| pvs->clientNum != ps->clientNum*/ ) {
+		pvs->snapshotFrame = sv.snapshotFrame;
+		pvs->serverId = sv.serverId;
 
 		// find the client's viewpoint
 		VectorCopy( ps->origin, org );
 		org[2] += ps->viewheight;
 
-		// bump the counter used to prevent double adding
-		sv.snapshotCounter++;
+		// reset the mask used to prevent double adding
+		memset( pvs->entAdded, 0, sizeof( pvs->entAdded ) );
 
 		// never send client's own entity, because it can
 		// be regenerated from the playerstate
-		svEnt = &sv.svEntities[ ps->clientNum ];
-		svEnt->snapshotCounter = sv.snapshotCounter;
+		pvs->entAdded[ ps->clientNum >> 5 ] |= 1U << ( ps->clientNum & 31 );
 
 		// add all the entities directly visible to the eye, which
 		// may include portal entities that merge other viewpoints
@@ -765,7 +1170,7 @@ static clientPVS_t *SV_BuildClientPVS( int clientSlot, const playerState_t *ps,
 		pvs->entMaskBuilt = qtrue;
 		memset( pvs->entMask, 0, sizeof ( pvs->entMask ) );
 		for ( i = 0; i < pvs->numbers.numSnapshotEntities ; i++ ) {
-			SET_ABIT( pvs->entMask, svs.currFrame->ents[ pvs->numbers.snapshotEntities[ i ] ]->number );
+			SET_ABIT( pvs->entMask, sv.currFrame->ents[ pvs->numbers.snapshotEntities[ i ] ]->number );
 		}
 	}
 
@@ -803,7 +1208,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
 	frame->num_entities = 0;
-	frame->frameNum = svs.currentSnapshotFrame;
+	frame->frameNum = sv.currentSnapshotFrame;
 
 #ifdef USE_MV
 	if ( client->multiview.protocol > 0 ) {
@@ -843,12 +1248,12 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		return;
 	}
 
-	if ( svs.currFrame == NULL ) {
+	if ( sv.currFrame == NULL ) {
 		// this will always success and setup current frame
 		SV_BuildCommonSnapshot();
 	}
 
-	frame->frameNum = svs.currFrame->frameNum;
+	frame->frameNum = sv.currFrame->frameNum;
 
 #ifdef USE_MV
 	if ( frame->multiview ) {
@@ -892,9 +1297,9 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		}
 
 		// get ALL pointers from common snapshot
-		frame->num_entities = svs.currFrame->count;
+		frame->num_entities = sv.currFrame->count;
 		for ( i = 0 ; i < frame->num_entities ; i++ ) {
-			frame->ents[ i ] = svs.currFrame->ents[ i ];
+			frame->ents[ i ] = sv.currFrame->ents[ i ];
 		}
 
 #ifdef USE_MV_ZCMD
@@ -919,7 +1324,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		frame->num_entities = pvs->numbers.numSnapshotEntities;
 		// get pointers from common snapshot
 		for ( i = 0 ; i < pvs->numbers.numSnapshotEntities ; i++ )	{
-			frame->ents[ i ] = svs.currFrame->ents[ pvs->numbers.snapshotEntities[ i ] ];
+			frame->ents[ i ] = sv.currFrame->ents[ pvs->numbers.snapshotEntities[ i ] ];
 		}
 	}
 }
@@ -973,39 +1378,38 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client )
 
 /*
 =======================
-SV_SendClientSnapshot
-
-Also called by SV_FinalMessage
+SV_WriteClientMessage
 
+Writes acknowledge, pending reliable commands and the
+delta compressed snapshot, touches only this client
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[ MAX_MSGLEN_BUF ];
-	msg_t		msg;
-	int     headerBytes;
-	playerState_t	*ps;
-
-	// build the snapshot
-	SV_BuildClientSnapshot( client );
-
-	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
-	msg.allowoverflow = qtrue;
-	headerBytes = msg.cursize;
+static void SV_WriteClientMessage( client_t *client, msg_t *msg, const clientSnapshot_t *oldframe, int lastframe ) {
 
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	MSG_WriteLong( msg, client->lastClientCommand );
 
 	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_UpdateServerCommandsToClient( client, msg );
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	SV_WriteSnapshotToClient( client, msg, oldframe, lastframe );
+}
+
+
+/*
+=======================
+SV_TransmitClientMessage
+=======================
+*/
+static void SV_TransmitClientMessage( client_t *client, msg_t *msg, int headerBytes ) {
+	playerState_t	*ps;
 
  	if ( client->demorecording ) {
 		msg_t copyMsg;
-		Com_Memcpy(&copyMsg, &msg, sizeof(copyMsg));
+		Com_Memcpy(&copyMsg, msg, sizeof(copyMsg));
  		SV_WriteDemoMessage( client, &copyMsg, headerBytes );
  		ps = SV_GameClientNum( client - svs.clients);
  		if (ps->pm_type == PM_INTERMISSION) {
@@ -1020,12 +1424,209 @@ void SV_SendClientSnapshot( client_t *client ) {
 	}
 
 	// check for overflow
-	if ( msg.overflowed ) {
+	if ( msg->overflowed ) {
 		Com_Printf( "WARNING: msg overflowed for %s\n", client->name );
-		MSG_Clear( &msg );
+		MSG_Clear( msg );
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	byte		msg_buf[ MAX_MSGLEN_BUF ];
+	msg_t		msg;
+	int     headerBytes;
+	const clientSnapshot_t *oldframe;
+	int			lastframe;
+
+	// build the snapshot
+	SV_BuildClientSnapshot( client );
+
+	oldframe = SV_SelectDeltaFrame( client, &lastframe );
+
+	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
+	msg.allowoverflow = qtrue;
+	headerBytes = msg.cursize;
+
+	SV_WriteClientMessage( client, &msg, oldframe, lastframe );
+
+	SV_TransmitClientMessage( client, &msg, headerBytes );
+}
+
+
+/*
+=============================================================================
+
+Parallel snapshot building
+
+Clients that only read the common snapshot frame get their snapshot built
+and encoded on worker threads, the resulting messages are sent from the
+main thread afterwards. Anything with side effects on shared state
+(multiview, recording, netchan) stays on the main thread.
+
+=============================================================================
+*/
+
+typedef struct {
+	client_t	*client;
+	const clientSnapshot_t *oldframe;
+	int			lastframe;
+	msg_t		msg;
+	byte		msg_buf[ MAX_MSGLEN_BUF ];
+} snapshotJob_t;
+
+static snapshotJob_t snapshotJobs[ MAX_CLIENTS ];
+
+
+/*
+=======================
+SV_SnapshotJob
+=======================
+*/
+static void SV_SnapshotJob( void *data, int index ) {
+	snapshotJob_t *job = (snapshotJob_t *)data + index;
+
+	SV_BuildClientSnapshot( job->client );
+
+	MSG_Init( &job->msg, job->msg_buf, MAX_MSGLEN );
+	job->msg.allowoverflow = qtrue;
+
+	SV_WriteClientMessage( job->client, &job->msg, job->oldframe, job->lastframe );
+}
+
+
+/*
+=======================
+SV_CanBuildSnapshotInParallel
+
+Client snapshot must not touch anything but its own client_t and PVS slot
+=======================
+*/
+static qboolean SV_CanBuildSnapshotInParallel( const client_t *client ) {
+	const playerState_t *ps;
+
+#ifdef USE_MV
+	if ( client->multiview.protocol > 0 )
+		return qfalse;
+#endif
+
+	if ( client->state == CS_ZOMBIE || !client->gentity )
+		return qtrue;
+
+	// let SV_BuildClientSnapshot raise the error on the main thread
+	ps = SV_GameClientNum( client - svs.clients );
+	if ( ps->clientNum < 0 || ps->clientNum >= MAX_GENTITIES-1 )
+		return qfalse;
+
+	return qtrue;
+}
+
+
+/*
+=======================
+SV_ClientMaskEntities
+
+Returns qtrue if current common snapshot has SVF_CLIENTMASK entities
+=======================
+*/
+static qboolean SV_ClientMaskEntities( void ) {
+	const sharedEntity_t *ent;
+	int i;
+
+	for ( i = 0; i < sv.currFrame->count; i++ ) {
+		ent = SV_GentityNum( sv.currFrame->ents[ i ]->number );
+		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+
+/*
+=======================
+SV_SendClientSnapshots
+
+Builds and encodes snapshots for queued jobs on sv_snapshotThreads threads
+=======================
+*/
+static void SV_SendClientSnapshots( int numJobs ) {
+	snapshotJob_t *job;
+	qboolean clientMask;
+	int i, n;
+
+	if ( sv.currFrame == NULL ) {
+		for ( i = 0; i < numJobs; i++ ) {
+			if ( snapshotJobs[ i ].client->gentity ) {
+				// common snapshot must exist before workers refer to it
+				SV_BuildCommonSnapshot();
+				break;
+			}
+		}
+	}
+
+	// SVF_CLIENTMASK only covers the first 32 client numbers
+	clientMask = ( sv.currFrame && sv_maxclients->integer > 32 && SV_ClientMaskEntities() ) ? qtrue : qfalse;
+
+	for ( i = 0, n = 0; i < numJobs; i++ ) {
+		job = &snapshotJobs[ i ];
+		if ( clientMask && job->client->gentity && job->client->state != CS_ZOMBIE
+			&& SV_GameClientNum( job->client - svs.clients )->clientNum >= 32 ) {
+			// SVF_CLIENTMASK error must be raised on the main thread
+			SV_SendClientSnapshot( job->client );
+			job->client->lastSnapshotTime = svs.time;
+			job->client->rateDelayed = qfalse;
+			continue;
+		}
+		job->oldframe = SV_SelectDeltaFrame( job->client, &job->lastframe );
+		if ( n != i ) {
+			snapshotJobs[ n ].client = job->client;
+			snapshotJobs[ n ].oldframe = job->oldframe;
+			snapshotJobs[ n ].lastframe = job->lastframe;
+		}
+		n++;
+	}
+
+	// fill the visibility cache for direct viewpoints here so workers only read it
+	if ( sv.currFrame && sv.state != SS_DEAD ) {
+		static uint32_t scratch[MAX_GENTITIES/32];
+		const playerState_t *ps;
+		vec3_t org;
+		int leafnum;
+
+		for ( i = 0; i < n; i++ ) {
+			job = &snapshotJobs[ i ];
+			if ( !job->client->gentity || job->client->state == CS_ZOMBIE ) {
+				continue;
+			}
+			ps = SV_GameClientNum( job->client - svs.clients );
+			VectorCopy( ps->origin, org );
+			org[2] += ps->viewheight;
+			leafnum = CM_PointLeafnum( org );
+			SV_VisibleEntities( CM_LeafCluster( leafnum ), CM_LeafArea( leafnum ), scratch );
+		}
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	pvsCache.frozen = qtrue;
+	Sys_RunJobs( SV_SnapshotJob, snapshotJobs, n, sv_snapshotThreads->integer );
+	pvsCache.frozen = qfalse;
+
+	for ( i = 0; i < n; i++ ) {
+		job = &snapshotJobs[ i ];
+		SV_TransmitClientMessage( job->client, &job->msg, 0 );
+		job->client->lastSnapshotTime = svs.time;
+		job->client->rateDelayed = qfalse;
+	}
 }
 
 
@@ -1038,12 +1639,16 @@ void SV_SendClientMessages( void )
 {
 	int		i;
 	client_t	*c;
+	int		numJobs;
 
 	svs.msgTime = Sys_Milliseconds();
 
+	// collect outgoing datagrams of the whole pass
+	Sys_BeginPacketBatch();
+
 #ifdef USE_MV
 	c = svs.clients + sv_maxclients->integer; // recorder slot
-	if ( sv_demoFile != FS_INVALID_HANDLE
+	if ( sv_demoFile != FS_INVALID_HANDLE && sv_worldNum == 0
 	 	&& !svs.emptyFrame // we want to record only synced game frames
 		&& c->state >= CS_PRIMED)
 	{
@@ -1053,6 +1658,8 @@ void SV_SendClientMessages( void )
 	}
 #endif // USE_MV
 
+	numJobs = 0;
+
 	// send a message to each connected client
 	for( i = 0; i < sv_maxclients->integer; i++ )
 	{
@@ -1061,6 +1668,9 @@ void SV_SendClientMessages( void )
 		if ( c->state == CS_FREE || c->demoClient ) // do not send a packet to a democlient, this will cause the engine to crash
 			continue;		// not connected
 
+		if ( c->world != sv_worldNum )
+			continue;		// sent with its own world
+
 		if ( *c->downloadName )
 			continue;		// Client is downloading, don't send snapshots
 
@@ -1083,9 +1693,21 @@ void SV_SendClientMessages( void )
 			continue;
 		}
 
+		// snapshot flags are written from current rateDelayed state
+		if ( sv_snapshotThreads->integer > 1 && SV_CanBuildSnapshotInParallel( c ) ) {
+			snapshotJobs[ numJobs++ ].client = c;
+			continue;
+		}
+
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+
+	if ( numJobs ) {
+		SV_SendClientSnapshots( numJobs );
+	}
+
+	Sys_EndPacketBatch();
 }
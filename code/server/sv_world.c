@@ -53,26 +53,34 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 
 ENTITY CHECKING
 
-To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+Linked entities are kept in a dynamic bounding volume tree.  Every entity owns
+a leaf holding its absolute box grown by a margin and by a short prediction of
+its movement, so relinking an entity that stays inside its leaf box is free and
+other moves only remove and reinsert a single leaf.  New leafs are placed next
+to the sibling whose box grows the least in surface area and rotations keep the
+tree balanced.
+
+With sv_worldTree 0 the world is carved up with the old evenly spaced, axially
+aligned bsp tree instead.  Entities are then kept in chains either at the final
+leafs, or at the first node that splits them.
+
+Game code sees the order of area entity lists and which entity a trace stops
+at when several are hit at the same fraction, so the tree reproduces the
+sector order: sectors are listed in creation order and the latest linked entity
+of a sector first.  Every link stores that position in worldOrder, tree results
+are sorted by it and trace ties go to the lowest one.  sv_worldTreeCheck links
+the sectors as well and compares both on every query.
 
 ===============================================================================
 */
 
-typedef struct worldSector_s {
-	int		axis;		// -1 = leaf node
-	float	dist;
-	struct worldSector_s	*children[2];
-	svEntity_t	*entities;
-} worldSector_t;
+#define	WORLD_STACK			128		// a balanced tree of MAX_GENTITIES leafs is far less deep
+#define	WORLD_MARGIN		4.0f
+#define	WORLD_PREDICT		0.1f	// seconds of movement included in leaf boxes
+#define	WORLD_PREDICT_MAX	128.0f
+#define	WORLD_ORDER_SECTOR	56		// worldOrder bits below the sector number
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
-
-worldSector_t	sv_worldSectors[AREA_NODES];
-int			sv_numworldSectors;
+// sectors and tree nodes live in server_t so every world has its own links
 
 
 /*
@@ -81,12 +89,29 @@ SV_SectorList_f
 ===============
 */
 void SV_SectorList_f( void ) {
-	int				i, c;
+	int				i, c, leafs, nodes;
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
+	if ( sv.useWorldTree ) {
+		leafs = nodes = 0;
+		for ( i = 1 ; i < WORLD_NODES ; i++ ) {
+			if ( sv.worldNodes[i].height < 0 ) {
+				continue;
+			}
+			if ( sv.worldNodes[i].children[0] ) {
+				nodes++;
+			} else if ( sv.svEntities[ sv.worldNodes[i].entityNum ].worldNode == i ) {
+				leafs++;
+			}
+		}
+		Com_Printf( "entity tree: %i entities, %i nodes, height %i\n", leafs, nodes,
+			sv.worldRoot ? sv.worldNodes[ sv.worldRoot ].height : 0 );
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
-		sec = &sv_worldSectors[i];
+		sec = &sv.worldSectors[i];
 
 		c = 0;
 		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
@@ -96,6 +121,7 @@ void SV_SectorList_f( void ) {
 	}
 }
 
+
 /*
 ===============
 SV_CreateworldSector
@@ -108,8 +134,8 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
 
-	anode = &sv_worldSectors[sv_numworldSectors];
-	sv_numworldSectors++;
+	anode = &sv.worldSectors[sv.numworldSectors];
+	sv.numworldSectors++;
 
 	if (depth == AREA_DEPTH) {
 		anode->axis = -1;
@@ -138,18 +164,384 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	return anode;
 }
 
+
 /*
 ===============
-SV_ClearWorld
+SV_AllocWorldNode
+===============
+*/
+static int SV_AllocWorldNode( void ) {
+	int		node;
+
+	node = sv.worldFreeNodes;
+	if ( !node ) {
+		Com_Error( ERR_DROP, "SV_AllocWorldNode: no free nodes" );
+	}
+	sv.worldFreeNodes = sv.worldNodes[ node ].parent;
+
+	Com_Memset( &sv.worldNodes[ node ], 0, sizeof( sv.worldNodes[ node ] ) );
+
+	return node;
+}
+
 
+/*
+===============
+SV_FreeWorldNode
 ===============
 */
-void SV_ClearWorld( void ) {
+static void SV_FreeWorldNode( int node ) {
+	sv.worldNodes[ node ].parent = sv.worldFreeNodes;
+	sv.worldNodes[ node ].height = -1;
+	sv.worldFreeNodes = node;
+}
+
+
+/*
+===============
+SV_BoxArea
+
+Half of the surface area, which is all that is needed to compare costs
+===============
+*/
+static float SV_BoxArea( const vec3_t mins, const vec3_t maxs ) {
+	float	x, y, z;
+
+	x = maxs[0] - mins[0];
+	y = maxs[1] - mins[1];
+	z = maxs[2] - mins[2];
+
+	return x * y + y * z + z * x;
+}
+
+
+/*
+===============
+SV_UnionArea
+===============
+*/
+static float SV_UnionArea( const worldNode_t *a, const worldNode_t *b ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = MIN( a->mins[i], b->mins[i] );
+		maxs[i] = MAX( a->maxs[i], b->maxs[i] );
+	}
+
+	return SV_BoxArea( mins, maxs );
+}
+
+
+/*
+===============
+SV_RefitWorldNode
+
+Recomputes bounds and height of an inner node from its children
+===============
+*/
+static void SV_RefitWorldNode( worldNode_t *node ) {
+	const worldNode_t	*a, *b;
+	int					i;
+
+	a = &sv.worldNodes[ node->children[0] ];
+	b = &sv.worldNodes[ node->children[1] ];
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = MIN( a->mins[i], b->mins[i] );
+		node->maxs[i] = MAX( a->maxs[i], b->maxs[i] );
+	}
+
+	node->height = 1 + MAX( a->height, b->height );
+}
+
+
+/*
+===============
+SV_RotateWorldNode
+
+Lifts the given child of node a into its place, the shorter grandchild
+becomes a child of a.  Returns the new root of the subtree.
+===============
+*/
+static int SV_RotateWorldNode( int a, int side ) {
+	worldNode_t	*A, *C, *P;
+	int			c, f, g, keep, give;
+
+	A = &sv.worldNodes[ a ];
+	c = A->children[ side ];
+	C = &sv.worldNodes[ c ];
+	f = C->children[0];
+	g = C->children[1];
+
+	C->parent = A->parent;
+	A->parent = c;
+	if ( C->parent ) {
+		P = &sv.worldNodes[ C->parent ];
+		if ( P->children[0] == a ) {
+			P->children[0] = c;
+		} else {
+			P->children[1] = c;
+		}
+	} else {
+		sv.worldRoot = c;
+	}
+
+	if ( sv.worldNodes[ f ].height > sv.worldNodes[ g ].height ) {
+		keep = f;
+		give = g;
+	} else {
+		keep = g;
+		give = f;
+	}
+
+	C->children[0] = a;
+	C->children[1] = keep;
+	A->children[ side ] = give;
+	sv.worldNodes[ give ].parent = a;
+
+	SV_RefitWorldNode( A );
+	SV_RefitWorldNode( C );
+
+	return c;
+}
+
+
+/*
+===============
+SV_BalanceWorldNode
+===============
+*/
+static int SV_BalanceWorldNode( int node ) {
+	const worldNode_t	*n;
+	int					balance;
+
+	n = &sv.worldNodes[ node ];
+	if ( !n->children[0] ) {
+		return node;
+	}
+
+	balance = sv.worldNodes[ n->children[1] ].height - sv.worldNodes[ n->children[0] ].height;
+	if ( balance > 1 ) {
+		return SV_RotateWorldNode( node, 1 );
+	}
+	if ( balance < -1 ) {
+		return SV_RotateWorldNode( node, 0 );
+	}
+
+	return node;
+}
+
+
+/*
+===============
+SV_FixWorldNodes
+
+Rebalances and refits all nodes from the given one up to the root
+===============
+*/
+static void SV_FixWorldNodes( int node ) {
+	while ( node ) {
+		node = SV_BalanceWorldNode( node );
+		SV_RefitWorldNode( &sv.worldNodes[ node ] );
+		node = sv.worldNodes[ node ].parent;
+	}
+}
+
+
+/*
+===============
+SV_DescendCost
+
+Cost of placing the leaf somewhere below the given node
+===============
+*/
+static float SV_DescendCost( const worldNode_t *node, const worldNode_t *leaf ) {
+	if ( !node->children[0] ) {
+		return SV_UnionArea( node, leaf );
+	}
+	return SV_UnionArea( node, leaf ) - SV_BoxArea( node->mins, node->maxs );
+}
+
+
+/*
+===============
+SV_InsertWorldLeaf
+===============
+*/
+static void SV_InsertWorldLeaf( int leaf ) {
+	worldNode_t	*l, *node;
+	int			index, parent, oldParent;
+	float		area, combined, cost, inherit, cost0, cost1;
+
+	l = &sv.worldNodes[ leaf ];
+
+	if ( !sv.worldRoot ) {
+		sv.worldRoot = leaf;
+		l->parent = 0;
+		return;
+	}
+
+	// find the sibling that makes the tree grow the least
+	index = sv.worldRoot;
+	while ( sv.worldNodes[ index ].children[0] ) {
+		node = &sv.worldNodes[ index ];
+
+		area = SV_BoxArea( node->mins, node->maxs );
+		combined = SV_UnionArea( node, l );
+
+		// a new parent for this node and the leaf
+		cost = 2.0f * combined;
+
+		// the least that every node below will add
+		inherit = 2.0f * ( combined - area );
+
+		cost0 = SV_DescendCost( &sv.worldNodes[ node->children[0] ], l ) + inherit;
+		cost1 = SV_DescendCost( &sv.worldNodes[ node->children[1] ], l ) + inherit;
+
+		if ( cost < cost0 && cost < cost1 ) {
+			break;
+		}
+
+		index = ( cost0 < cost1 ) ? node->children[0] : node->children[1];
+	}
+
+	oldParent = sv.worldNodes[ index ].parent;
+	parent = SV_AllocWorldNode();
+
+	sv.worldNodes[ parent ].parent = oldParent;
+	sv.worldNodes[ parent ].children[0] = index;
+	sv.worldNodes[ parent ].children[1] = leaf;
+	sv.worldNodes[ index ].parent = parent;
+	l->parent = parent;
+
+	if ( oldParent ) {
+		if ( sv.worldNodes[ oldParent ].children[0] == index ) {
+			sv.worldNodes[ oldParent ].children[0] = parent;
+		} else {
+			sv.worldNodes[ oldParent ].children[1] = parent;
+		}
+	} else {
+		sv.worldRoot = parent;
+	}
+
+	SV_FixWorldNodes( parent );
+}
+
+
+/*
+===============
+SV_RemoveWorldLeaf
+===============
+*/
+static void SV_RemoveWorldLeaf( int leaf ) {
+	int		parent, grandParent, sibling;
+
+	if ( leaf == sv.worldRoot ) {
+		sv.worldRoot = 0;
+		return;
+	}
+
+	parent = sv.worldNodes[ leaf ].parent;
+	grandParent = sv.worldNodes[ parent ].parent;
+	if ( sv.worldNodes[ parent ].children[0] == leaf ) {
+		sibling = sv.worldNodes[ parent ].children[1];
+	} else {
+		sibling = sv.worldNodes[ parent ].children[0];
+	}
+
+	sv.worldNodes[ sibling ].parent = grandParent;
+	SV_FreeWorldNode( parent );
+
+	if ( grandParent ) {
+		if ( sv.worldNodes[ grandParent ].children[0] == parent ) {
+			sv.worldNodes[ grandParent ].children[0] = sibling;
+		} else {
+			sv.worldNodes[ grandParent ].children[1] = sibling;
+		}
+		SV_FixWorldNodes( grandParent );
+	} else {
+		sv.worldRoot = sibling;
+	}
+}
+
+
+/*
+===============
+SV_LinkWorldLeaf
+
+Moves the entity leaf only when the new absolute box doesn't fit the old one
+===============
+*/
+static void SV_LinkWorldLeaf( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	worldNode_t	*node;
+	float		d;
+	int			i;
+
+	if ( ent->worldNode ) {
+		node = &sv.worldNodes[ ent->worldNode ];
+		if ( gEnt->r.absmin[0] >= node->mins[0] && gEnt->r.absmax[0] <= node->maxs[0]
+			&& gEnt->r.absmin[1] >= node->mins[1] && gEnt->r.absmax[1] <= node->maxs[1]
+			&& gEnt->r.absmin[2] >= node->mins[2] && gEnt->r.absmax[2] <= node->maxs[2] ) {
+			return;
+		}
+		SV_RemoveWorldLeaf( ent->worldNode );
+	} else {
+		ent->worldNode = SV_AllocWorldNode();
+		node = &sv.worldNodes[ ent->worldNode ];
+		node->entityNum = ent - sv.svEntities;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = gEnt->r.absmin[i] - WORLD_MARGIN;
+		node->maxs[i] = gEnt->r.absmax[i] + WORLD_MARGIN;
+	}
+
+	// stretch the box along the way the entity is moving
+	if ( gEnt->s.pos.trType != TR_STATIONARY && gEnt->s.pos.trType != TR_SINE ) {
+		for ( i = 0 ; i < 3 ; i++ ) {
+			d = gEnt->s.pos.trDelta[i] * WORLD_PREDICT;
+			if ( d < 0 ) {
+				node->mins[i] += MAX( d, -WORLD_PREDICT_MAX );
+			} else {
+				node->maxs[i] += MIN( d, WORLD_PREDICT_MAX );
+			}
+		}
+	}
+
+	SV_InsertWorldLeaf( ent->worldNode );
+}
+
+
+/*
+===============
+SV_ResetWorld
+===============
+*/
+static void SV_ResetWorld( qboolean tree ) {
 	clipHandle_t	h;
 	vec3_t			mins, maxs;
+	int				i;
+
+	Com_Memset( sv.worldSectors, 0, sizeof(sv.worldSectors) );
+	sv.numworldSectors = 0;
+
+	sv.worldRoot = 0;
+	sv.worldFreeNodes = 0;
+	for ( i = WORLD_NODES - 1 ; i > 0 ; i-- ) {
+		SV_FreeWorldNode( i );
+	}
+
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		sv.svEntities[i].worldSector = NULL;
+		sv.svEntities[i].nextEntityInWorldSector = NULL;
+		sv.svEntities[i].worldNode = 0;
+		sv.svEntities[i].worldOrder = 0;
+	}
 
-	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
-	sv_numworldSectors = 0;
+	sv.useWorldTree = tree;
+	sv.checkWorldTree = tree && sv_worldTreeCheck->integer;
+	sv.worldLinkSequence = 0;
 
 	// get world map bounds
 	h = CM_InlineModel( 0 );
@@ -160,18 +552,24 @@ void SV_ClearWorld( void ) {
 
 /*
 ===============
-SV_UnlinkEntity
+SV_ClearWorld
 
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
+void SV_ClearWorld( void ) {
+	SV_ResetWorld( sv_worldTree->integer != 0 );
+}
 
-	ent = SV_SvEntityForGentity( gEnt );
 
-	gEnt->r.linked = qfalse;
+/*
+===============
+SV_UnlinkWorldSector
+
+===============
+*/
+static void SV_UnlinkWorldSector( svEntity_t *ent ) {
+	svEntity_t		*scan;
+	worldSector_t	*ws;
 
 	ws = ent->worldSector;
 	if ( !ws ) {
@@ -195,6 +593,30 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 }
 
 
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	if ( ent->worldNode ) {
+		SV_RemoveWorldLeaf( ent->worldNode );
+		SV_FreeWorldNode( ent->worldNode );
+		ent->worldNode = 0;
+	}
+
+	// also linked there with sv.checkWorldTree
+	SV_UnlinkWorldSector( ent );
+}
+
+
 /*
 ===============
 SV_LinkEntity
@@ -216,7 +638,8 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	ent = SV_SvEntityForGentity( gEnt );
 
 	if ( ent->worldSector ) {
-		SV_UnlinkEntity( gEnt );	// unlink from old position
+		SV_UnlinkWorldSector( ent );	// unlink from old position
+		gEnt->r.linked = qfalse;
 	}
 
 	// encode the size into the entityState_t for client prediction
@@ -291,6 +714,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		if ( ent->worldNode ) {
+			SV_UnlinkEntity( gEnt );
+		}
 		return;
 	}
 
@@ -333,7 +759,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	gEnt->r.linkcount++;
 
 	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
+	node = sv.worldSectors;
 	while (1)
 	{
 		if (node->axis == -1)
@@ -345,6 +771,18 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		else
 			break;		// crosses the node
 	}
+
+	if ( sv.useWorldTree ) {
+		// sectors in creation order, then the latest linked first
+		sv.worldLinkSequence++;
+		ent->worldOrder = ( (uint64_t)( node - sv.worldSectors ) << WORLD_ORDER_SECTOR )
+			| ( ( ( 1ULL << WORLD_ORDER_SECTOR ) - 1 ) - sv.worldLinkSequence );
+		SV_LinkWorldLeaf( ent, gEnt );
+		if ( !sv.checkWorldTree ) {
+			gEnt->r.linked = qtrue;
+			return;
+		}
+	}
 	
 	// link it in
 	ent->worldSector = node;
@@ -419,11 +857,12 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 }
 
 /*
-================
-SV_AreaEntities
-================
+====================
+SV_AreaEntitiesSectors
+
+====================
 */
-int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+static int SV_AreaEntitiesSectors( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
 	areaParms_t		ap;
 
 	ap.mins = mins;
@@ -432,39 +871,308 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	SV_AreaEntities_r( sv.worldSectors, &ap );
 
 	return ap.count;
 }
 
 
+/*
+====================
+SV_WorldOrderCompare
 
-//===========================================================================
-
+====================
+*/
+static int QDECL SV_WorldOrderCompare( const void *a, const void *b ) {
+	uint64_t oa = sv.svEntities[ *(const int *)a ].worldOrder;
+	uint64_t ob = sv.svEntities[ *(const int *)b ].worldOrder;
 
-typedef struct {
-	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
-	const float	*mins;
-	const float *maxs;	// size of the moving object
-	const float	*start;
-	vec3_t		end;
-	trace_t		trace;
-	int			passEntityNum;
-	int			contentmask;
-	int			capsule;
-} moveclip_t;
+	if ( oa < ob ) {
+		return -1;
+	}
+	if ( oa > ob ) {
+		return 1;
+	}
+	return 0;
+}
 
 
 /*
 ====================
-SV_ClipToEntity
+SV_AreaEntitiesTree
 
+Collects every touched entity and returns the first maxcount in sector order
 ====================
 */
-void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, qboolean capsule ) {
-	sharedEntity_t	*touch;
-	clipHandle_t	clipHandle;
-	float			*origin, *angles;
+static int SV_AreaEntitiesTree( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+	int			stack[WORLD_STACK];
+	int			list[MAX_GENTITIES];
+	int			sp, count;
+	const worldNode_t	*node;
+	const sharedEntity_t *gcheck;
+
+	if ( !sv.worldRoot ) {
+		return 0;
+	}
+
+	count = 0;
+	sp = 0;
+	stack[sp++] = sv.worldRoot;
+
+	while ( sp ) {
+		node = &sv.worldNodes[ stack[--sp] ];
+
+		if ( node->mins[0] > maxs[0]
+		|| node->mins[1] > maxs[1]
+		|| node->mins[2] > maxs[2]
+		|| node->maxs[0] < mins[0]
+		|| node->maxs[1] < mins[1]
+		|| node->maxs[2] < mins[2] ) {
+			continue;
+		}
+
+		if ( node->children[0] ) {
+			stack[sp++] = node->children[1];
+			stack[sp++] = node->children[0];
+			continue;
+		}
+
+		gcheck = SV_GentityNum( node->entityNum );
+
+		if ( gcheck->r.absmin[0] > maxs[0]
+		|| gcheck->r.absmin[1] > maxs[1]
+		|| gcheck->r.absmin[2] > maxs[2]
+		|| gcheck->r.absmax[0] < mins[0]
+		|| gcheck->r.absmax[1] < mins[1]
+		|| gcheck->r.absmax[2] < mins[2]) {
+			continue;
+		}
+
+		list[count++] = node->entityNum;
+	}
+
+	qsort( list, count, sizeof( list[0] ), SV_WorldOrderCompare );
+
+	if ( count > maxcount ) {
+		Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		count = MAX( maxcount, 0 );
+	}
+
+	Com_Memcpy( entityList, list, count * sizeof( list[0] ) );
+
+	return count;
+}
+
+
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+	int		check[MAX_GENTITIES];
+	int		count, n;
+
+	if ( !sv.useWorldTree ) {
+		return SV_AreaEntitiesSectors( mins, maxs, entityList, maxcount );
+	}
+
+	count = SV_AreaEntitiesTree( mins, maxs, entityList, maxcount );
+
+	if ( sv.checkWorldTree ) {
+		n = SV_AreaEntitiesSectors( mins, maxs, check, MIN( maxcount, MAX_GENTITIES ) );
+		if ( n != count || memcmp( check, entityList, count * sizeof( check[0] ) ) ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: SV_AreaEntities: entity tree returned %i entities, sectors %i or in another order\n", count, n );
+		}
+	}
+
+	return count;
+}
+
+
+typedef struct {
+	const float	*start;
+	const float	*mins;
+	const float	*maxs;
+	vec3_t		delta, scale;
+	float		maxFraction;
+} sweepParms_t;
+
+
+/*
+====================
+SV_SweepBounds
+
+Returns qfalse if the box moving from start doesn't touch the given bounds
+before maxFraction, otherwise sets the fraction where it enters them
+====================
+*/
+static qboolean SV_SweepBounds( const sweepParms_t *sp, const vec3_t mins, const vec3_t maxs, float *fraction ) {
+	float	enter, leave, lo, hi, t0, t1, t;
+	int		i;
+
+	enter = 0;
+	leave = sp->maxFraction;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		// same epsilon as the box of the whole move
+		lo = mins[i] - sp->maxs[i] - 1;
+		hi = maxs[i] - sp->mins[i] + 1;
+
+		if ( sp->delta[i] == 0 ) {
+			if ( sp->start[i] < lo || sp->start[i] > hi ) {
+				return qfalse;
+			}
+			continue;
+		}
+
+		t0 = ( lo - sp->start[i] ) * sp->scale[i];
+		t1 = ( hi - sp->start[i] ) * sp->scale[i];
+		if ( t0 > t1 ) {
+			t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		if ( t0 > enter ) {
+			enter = t0;
+		}
+		if ( t1 < leave ) {
+			leave = t1;
+		}
+		if ( enter > leave ) {
+			return qfalse;
+		}
+	}
+
+	*fraction = enter;
+	return qtrue;
+}
+
+
+/*
+====================
+SV_SweepCompare
+
+====================
+*/
+static int QDECL SV_SweepCompare( const void *a, const void *b ) {
+	const sweepEntity_t *ea = (const sweepEntity_t *)a;
+	const sweepEntity_t *eb = (const sweepEntity_t *)b;
+
+	if ( ea->fraction < eb->fraction ) {
+		return -1;
+	}
+	if ( ea->fraction > eb->fraction ) {
+		return 1;
+	}
+	return ea->entityNum - eb->entityNum;
+}
+
+
+/*
+====================
+SV_SweepEntities
+
+====================
+*/
+int SV_SweepEntities( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, float maxFraction, sweepEntity_t *list, int maxcount ) {
+	sweepParms_t	sp;
+	int			stack[WORLD_STACK];
+	int			touch[MAX_GENTITIES];
+	vec3_t		boxmins, boxmaxs;
+	int			i, n, count;
+	float		fraction;
+	const worldNode_t	*node;
+	const sharedEntity_t *gcheck;
+
+	sp.start = start;
+	sp.mins = mins;
+	sp.maxs = maxs;
+	sp.maxFraction = maxFraction;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		sp.delta[i] = end[i] - start[i];
+		sp.scale[i] = sp.delta[i] != 0 ? 1.0f / sp.delta[i] : 0;
+	}
+
+	count = 0;
+
+	if ( sv.useWorldTree ) {
+		n = 0;
+		if ( sv.worldRoot ) {
+			stack[n++] = sv.worldRoot;
+		}
+		while ( n ) {
+			node = &sv.worldNodes[ stack[--n] ];
+			if ( !SV_SweepBounds( &sp, node->mins, node->maxs, &fraction ) ) {
+				continue;
+			}
+			if ( node->children[0] ) {
+				stack[n++] = node->children[1];
+				stack[n++] = node->children[0];
+				continue;
+			}
+			gcheck = SV_GentityNum( node->entityNum );
+			if ( !SV_SweepBounds( &sp, gcheck->r.absmin, gcheck->r.absmax, &fraction ) ) {
+				continue;
+			}
+			if ( count == maxcount ) {
+				Com_Printf ("SV_SweepEntities: MAXCOUNT\n");
+				break;
+			}
+			list[count].entityNum = node->entityNum;
+			list[count].fraction = fraction;
+			count++;
+		}
+	} else {
+		for ( i = 0 ; i < 3 ; i++ ) {
+			boxmins[i] = MIN( start[i], end[i] ) + mins[i] - 1;
+			boxmaxs[i] = MAX( start[i], end[i] ) + maxs[i] + 1;
+		}
+		n = SV_AreaEntities( boxmins, boxmaxs, touch, MIN( maxcount, MAX_GENTITIES ) );
+		for ( i = 0 ; i < n ; i++ ) {
+			gcheck = SV_GentityNum( touch[i] );
+			if ( SV_SweepBounds( &sp, gcheck->r.absmin, gcheck->r.absmax, &fraction ) ) {
+				list[count].entityNum = touch[i];
+				list[count].fraction = fraction;
+				count++;
+			}
+		}
+	}
+
+	qsort( list, count, sizeof( list[0] ), SV_SweepCompare );
+
+	return count;
+}
+
+
+
+//===========================================================================
+
+
+typedef struct {
+	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
+	const float	*mins;
+	const float *maxs;	// size of the moving object
+	const float	*start;
+	vec3_t		end;
+	trace_t		trace;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+	qboolean	worldOrder;		// entities come in any order, see SV_ClipMoveToTreeEntities
+} moveclip_t;
+
+
+/*
+====================
+SV_ClipToEntity
+
+====================
+*/
+void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, qboolean capsule ) {
+	sharedEntity_t	*touch;
+	clipHandle_t	clipHandle;
+	float			*origin, *angles;
 
 	touch = SV_GentityNum( entityNum );
 
@@ -499,87 +1207,182 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntity
 
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-	int			i, num;
-	int			touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToEntity( moveclip_t *clip, int entityNum, int passOwnerNum ) {
 	sharedEntity_t *touch;
-	int			passOwnerNum;
 	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+	touch = SV_GentityNum( entityNum );
 
+	// see if we should ignore this entity
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
-		if ( passOwnerNum == ENTITYNUM_NONE ) {
-			passOwnerNum = -1;
+		if ( entityNum == clip->passEntityNum ) {
+			return;	// don't clip against the pass entity
 		}
-	} else {
-		passOwnerNum = -1;
+		if ( touch->r.ownerNum == clip->passEntityNum ) {
+			return;	// don't clip against own missiles
+		}
+		if ( touch->r.ownerNum == passOwnerNum ) {
+			return;	// don't clip against other missiles from our owner
+		}
+	}
+
+	// if it doesn't have any brushes of a type we
+	// are looking for, ignore it
+	if ( ! ( clip->contentmask & touch->r.contents ) ) {
+		return;
+	}
+
+	// might intersect, so do an exact clip
+	clipHandle = SV_ClipHandleForEntity (touch);
+
+	origin = touch->r.currentOrigin;
+	angles = touch->r.currentAngles;
+
+
+	if ( !touch->r.bmodel ) {
+		angles = vec3_origin;	// boxes don't rotate
 	}
 
+	CM_TransformedBoxTrace ( &trace, (float *)clip->start, (float *)clip->end,
+		(float *)clip->mins, (float *)clip->maxs, clipHandle,  clip->contentmask,
+		origin, angles, clip->capsule);
+
+	if ( trace.allsolid ) {
+		clip->trace.allsolid = qtrue;
+		trace.entityNum = touch->s.number;
+	} else if ( trace.startsolid ) {
+		clip->trace.startsolid = qtrue;
+		trace.entityNum = touch->s.number;
+	}
+
+	// on a tie the entity first in sector order wins, which is always the
+	// one tested first unless the tree path is running, the world stays ahead
+	if ( trace.fraction < clip->trace.fraction || ( clip->worldOrder && trace.fraction < 1
+		&& trace.fraction == clip->trace.fraction && clip->trace.entityNum != ENTITYNUM_WORLD
+		&& sv.svEntities[ entityNum ].worldOrder < sv.svEntities[ clip->trace.entityNum ].worldOrder ) ) {
+		qboolean	oldStart, oldAll;
+
+		// make sure we keep a startsolid from a previous trace
+		oldStart = clip->trace.startsolid;
+		oldAll = clip->trace.allsolid;
+
+		trace.entityNum = touch->s.number;
+		clip->trace = trace;
+		clip->trace.startsolid |= oldStart;
+		if ( clip->worldOrder ) {
+			// the sector path would have stopped at an allsolid entity
+			clip->trace.allsolid |= oldAll;
+		}
+	}
+}
+
+
+/*
+====================
+SV_ClipMoveToSectorEntities
+
+====================
+*/
+static void SV_ClipMoveToSectorEntities( moveclip_t *clip, int passOwnerNum ) {
+	int			i, num;
+	int			touchlist[MAX_GENTITIES];
+
+	num = SV_AreaEntitiesSectors( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES );
+
 	for ( i=0 ; i<num ; i++ ) {
 		if ( clip->trace.allsolid ) {
 			return;
 		}
-		touch = SV_GentityNum( touchlist[i] );
+		SV_ClipMoveToEntity( clip, touchlist[i], passOwnerNum );
+	}
+}
 
-		// see if we should ignore this entity
-		if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-			if ( touchlist[i] == clip->passEntityNum ) {
-				continue;	// don't clip against the pass entity
-			}
-			if ( touch->r.ownerNum == clip->passEntityNum ) {
-				continue;	// don't clip against own missiles
-			}
-			if ( touch->r.ownerNum == passOwnerNum ) {
-				continue;	// don't clip against other missiles from our owner
-			}
-		}
 
-		// if it doesn't have any brushes of a type we
-		// are looking for, ignore it
-		if ( ! ( clip->contentmask & touch->r.contents ) ) {
-			continue;
+/*
+====================
+SV_ClipMoveToTreeEntities
+
+Gives the same result as SV_ClipMoveToSectorEntities: the closest hit, the one
+first in sector order on a tie, and allsolid if any entity was allsolid
+====================
+*/
+static void SV_ClipMoveToTreeEntities( moveclip_t *clip, int passOwnerNum ) {
+	int			i, num;
+	sweepEntity_t	sweeplist[MAX_GENTITIES];
+
+	// nearest first, so we can stop at the first entity entered
+	// after the best hit so far, world included; entities entered
+	// at exactly that fraction are still clipped for the tie break
+	num = SV_SweepEntities( clip->start, clip->end, clip->mins, clip->maxs,
+		clip->trace.fraction, sweeplist, MAX_GENTITIES );
+
+	clip->worldOrder = qtrue;
+	for ( i=0 ; i<num ; i++ ) {
+		if ( sweeplist[i].fraction > clip->trace.fraction ) {
+			break;
 		}
+		SV_ClipMoveToEntity( clip, sweeplist[i].entityNum, passOwnerNum );
+	}
+	clip->worldOrder = qfalse;
+}
 
-		// might intersect, so do an exact clip
-		clipHandle = SV_ClipHandleForEntity (touch);
 
-		origin = touch->r.currentOrigin;
-		angles = touch->r.currentAngles;
+/*
+====================
+SV_SameTrace
+
+====================
+*/
+static qboolean SV_SameTrace( const trace_t *a, const trace_t *b ) {
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->fraction == b->fraction && VectorCompare( a->endpos, b->endpos )
+		&& VectorCompare( a->plane.normal, b->plane.normal ) && a->plane.dist == b->plane.dist
+		&& a->surfaceFlags == b->surfaceFlags && a->contents == b->contents
+		&& a->entityNum == b->entityNum;
+}
 
 
-		if ( !touch->r.bmodel ) {
-			angles = vec3_origin;	// boxes don't rotate
-		}
+/*
+====================
+SV_ClipMoveToEntities
 
-		CM_TransformedBoxTrace ( &trace, (float *)clip->start, (float *)clip->end,
-			(float *)clip->mins, (float *)clip->maxs, clipHandle,  clip->contentmask,
-			origin, angles, clip->capsule);
+====================
+*/
+static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+	moveclip_t	check;
+	int			passOwnerNum;
 
-		if ( trace.allsolid ) {
-			clip->trace.allsolid = qtrue;
-			trace.entityNum = touch->s.number;
-		} else if ( trace.startsolid ) {
-			clip->trace.startsolid = qtrue;
-			trace.entityNum = touch->s.number;
+	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
+		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
+		if ( passOwnerNum == ENTITYNUM_NONE ) {
+			passOwnerNum = -1;
 		}
+	} else {
+		passOwnerNum = -1;
+	}
+
+	if ( !sv.useWorldTree ) {
+		SV_ClipMoveToSectorEntities( clip, passOwnerNum );
+		return;
+	}
 
-		if ( trace.fraction < clip->trace.fraction ) {
-			qboolean	oldStart;
+	if ( sv.checkWorldTree ) {
+		check = *clip;
+	}
 
-			// make sure we keep a startsolid from a previous trace
-			oldStart = clip->trace.startsolid;
+	SV_ClipMoveToTreeEntities( clip, passOwnerNum );
 
-			trace.entityNum = touch->s.number;
-			clip->trace = trace;
-			clip->trace.startsolid |= oldStart;
+	if ( sv.checkWorldTree ) {
+		SV_ClipMoveToSectorEntities( &check, passOwnerNum );
+		if ( !SV_SameTrace( &clip->trace, &check.trace ) ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: SV_Trace: entity tree hit %i at %f, sectors %i at %f\n",
+				clip->trace.entityNum, clip->trace.fraction, check.trace.entityNum, check.trace.fraction );
 		}
 	}
 }
@@ -587,27 +1390,18 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 
 /*
 ==================
-SV_Trace
+SV_ClipTraceToEntities
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+Clips a trace already clipped to the world to other solid entities
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+static void SV_ClipTraceToEntities( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
 	moveclip_t	clip;
 	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
-	}
-
 	Com_Memset ( &clip, 0, sizeof ( clip ) );
 
-	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
+	clip.trace = *results;
 	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
 	if ( clip.trace.fraction == 0 ) {
 		*results = clip.trace;
@@ -644,6 +1438,48 @@ void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const ve
 }
 
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_BoxTrace( results, start, end, mins, maxs, 0, contentmask, capsule );
+
+	SV_ClipTraceToEntities( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+Same as SV_Trace for count boxes, the world part is traced in packets
+==================
+*/
+void SV_TraceBatch( trace_t *results, const traceRay_t *rays, int count, int passEntityNum, int contentmask, qboolean capsule ) {
+	int			i;
+
+	CM_BoxTraceBatch( results, rays, count, 0, contentmask, capsule );
+
+	for ( i = 0; i < count; i++ ) {
+		SV_ClipTraceToEntities( &results[i], rays[i].start, rays[i].mins, rays[i].maxs, rays[i].end, passEntityNum, contentmask, capsule );
+	}
+}
+
+
 
 /*
 =============
@@ -685,3 +1521,195 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 }
 
 
+
+
+/*
+=============
+SV_WorldBench_f
+
+Runs server frames with a crowd of synthetic players, missiles and items on
+the given map, once with the world sectors and once with the entity tree,
+some players share a box to check how ties are broken
+=============
+*/
+void SV_WorldBench_f( void ) {
+	sharedEntity_t	*gentities, *ents, *ent;
+	sweepEntity_t	*results, *res;
+	trace_t			trace;
+	vec3_t			wmins, wmaxs, dir, end;
+	int64_t			linkTime[2], traceTime[2], areaTime[2], start;
+	int				areaCount[2];
+	int				touch[MAX_GENTITIES];
+	int				gentitySize, numEntities;
+	int				count, frames, checksum, failed, height;
+	int				mode, frame, i, j;
+	float			speed;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: worldbench <map> [entities] [frames]\n" );
+		return;
+	}
+
+	if ( com_sv_running->integer ) {
+		Com_Printf( "Server must not be running.\n" );
+		return;
+	}
+
+	count = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 768;
+	frames = ( Cmd_Argc() > 3 ) ? atoi( Cmd_Argv( 3 ) ) : 200;
+	if ( count < 4 ) {
+		count = 4;
+	} else if ( count > ENTITYNUM_MAX_NORMAL ) {
+		count = ENTITYNUM_MAX_NORMAL;
+	}
+	if ( frames < 1 ) {
+		frames = 1;
+	} else if ( frames > 500 ) {
+		frames = 500;
+	}
+
+	CM_LoadMap( va( "maps/%s.bsp", Cmd_Argv( 1 ) ), qfalse, &checksum );
+	CM_ModelBounds( CM_InlineModel( 0 ), wmins, wmaxs );
+
+	gentities = sv.gentities;
+	gentitySize = sv.gentitySize;
+	numEntities = sv.num_entities;
+
+	// movers trace once per frame, players also fire a shot
+	ents = Z_Malloc( count * sizeof( *ents ) );
+	results = Z_Malloc( frames * count * 2 * sizeof( *results ) );
+
+	sv.gentities = ents;
+	sv.gentitySize = sizeof( *ents );
+	sv.num_entities = count;
+
+	failed = 0;
+	height = 0;
+
+	for ( mode = 0; mode < 2; mode++ ) {
+		linkTime[mode] = traceTime[mode] = areaTime[mode] = 0;
+		areaCount[mode] = 0;
+
+		SV_ResetWorld( mode );
+		srand( 1 );
+
+		start = Sys_Microseconds();
+		Com_Memset( ents, 0, count * sizeof( *ents ) );
+		for ( i = 0, ent = ents; i < count; i++, ent++ ) {
+			ent->s.number = i;
+			ent->r.ownerNum = ENTITYNUM_NONE;
+			for ( j = 0; j < 3; j++ ) {
+				ent->r.currentOrigin[j] = wmins[j] + random() * ( wmaxs[j] - wmins[j] );
+			}
+			switch ( i & 3 ) {
+			case 0:		// player
+				VectorSet( ent->r.mins, -15, -15, -24 );
+				VectorSet( ent->r.maxs, 15, 15, 32 );
+				ent->r.contents = CONTENTS_BODY;
+				ent->s.pos.trType = TR_INTERPOLATE;
+				speed = 320;
+				break;
+			case 1:
+			case 2:		// missile of the previous player
+				ent->r.ownerNum = i & ~3;
+				ent->s.pos.trType = TR_LINEAR;
+				speed = 900;
+				break;
+			default:	// item
+				VectorSet( ent->r.mins, -15, -15, -15 );
+				VectorSet( ent->r.maxs, 15, 15, 15 );
+				ent->r.contents = CONTENTS_TRIGGER;
+				speed = 0;
+				break;
+			}
+			VectorSet( dir, crandom(), crandom(), crandom() );
+			VectorNormalize( dir );
+			VectorScale( dir, speed, ent->s.pos.trDelta );
+			if ( ( i & 31 ) == 16 ) {
+				// a player moving inside another one, traces hit both at the same fraction
+				VectorCopy( ents[ i - 4 ].r.currentOrigin, ent->r.currentOrigin );
+				VectorCopy( ents[ i - 4 ].s.pos.trDelta, ent->s.pos.trDelta );
+			}
+			SV_LinkEntity( ent );
+		}
+		linkTime[mode] += Sys_Microseconds() - start;
+
+		res = results;
+		for ( frame = 0; frame < frames; frame++ ) {
+			start = Sys_Microseconds();
+			for ( i = 0, ent = ents; i < count; i++, ent++ ) {
+				if ( ent->s.pos.trType == TR_STATIONARY ) {
+					continue;
+				}
+				VectorMA( ent->r.currentOrigin, 0.05f, ent->s.pos.trDelta, ent->r.currentOrigin );
+				for ( j = 0; j < 3; j++ ) {
+					if ( ent->r.currentOrigin[j] < wmins[j] || ent->r.currentOrigin[j] > wmaxs[j] ) {
+						ent->s.pos.trDelta[j] = -ent->s.pos.trDelta[j];
+					}
+				}
+				SV_LinkEntity( ent );
+			}
+			linkTime[mode] += Sys_Microseconds() - start;
+
+			start = Sys_Microseconds();
+			for ( i = 0, ent = ents; i < count; i++, ent++ ) {
+				if ( ent->s.pos.trType == TR_STATIONARY ) {
+					continue;
+				}
+				VectorMA( ent->r.currentOrigin, 0.05f, ent->s.pos.trDelta, end );
+				SV_Trace( &trace, ent->r.currentOrigin, ent->r.mins, ent->r.maxs, end, i, CONTENTS_SOLID | CONTENTS_BODY, qfalse );
+				if ( mode == 0 ) {
+					res->entityNum = trace.entityNum;
+					res->fraction = trace.fraction;
+				} else if ( res->entityNum != trace.entityNum || res->fraction != trace.fraction ) {
+					failed++;
+				}
+				res++;
+
+				if ( ent->r.contents == CONTENTS_BODY ) {
+					VectorSet( dir, crandom(), crandom(), crandom() );
+					VectorNormalize( dir );
+					VectorMA( ent->r.currentOrigin, 8192, dir, end );
+					SV_Trace( &trace, ent->r.currentOrigin, NULL, NULL, end, i, CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_CORPSE, qfalse );
+					if ( mode == 0 ) {
+						res->entityNum = trace.entityNum;
+						res->fraction = trace.fraction;
+					} else if ( res->entityNum != trace.entityNum || res->fraction != trace.fraction ) {
+						failed++;
+					}
+					res++;
+				}
+			}
+			traceTime[mode] += Sys_Microseconds() - start;
+
+			// trigger touching
+			start = Sys_Microseconds();
+			for ( i = 0, ent = ents; i < count; i += 4, ent += 4 ) {
+				areaCount[mode] += SV_AreaEntities( ent->r.absmin, ent->r.absmax, touch, MAX_GENTITIES );
+			}
+			areaTime[mode] += Sys_Microseconds() - start;
+		}
+
+		if ( mode == 1 && sv.worldRoot ) {
+			height = sv.worldNodes[ sv.worldRoot ].height;
+		}
+	}
+
+	SV_ResetWorld( sv_worldTree->integer != 0 );
+
+	sv.gentities = gentities;
+	sv.gentitySize = gentitySize;
+	sv.num_entities = numEntities;
+
+	Z_Free( results );
+	Z_Free( ents );
+
+	CM_ClearMap();
+
+	Com_Printf( "%i entities, %i frames\n", count, frames );
+	Com_Printf( "sectors: link %i usec, trace %i usec, area %i usec\n",
+		(int)linkTime[0], (int)traceTime[0], (int)areaTime[0] );
+	Com_Printf( "tree: link %i usec, trace %i usec, area %i usec, height %i\n",
+		(int)linkTime[1], (int)traceTime[1], (int)areaTime[1], height );
+	Com_Printf( "%i trace mismatches, area entities %i / %i\n", failed, areaCount[0], areaCount[1] );
+}
@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <pwd.h>
 #include <dlfcn.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
@@ -614,3 +615,175 @@ void Sys_SetAffinityMask( int mask )
 	}
 }
 #endif // USE_AFFINITY_MASK
+
+
+/*
+=================
+Sys_RunJobs
+=================
+*/
+#define MAX_JOB_THREADS 32
+
+static struct {
+	pthread_mutex_t	lock;
+	pthread_cond_t	start;
+	pthread_cond_t	done;
+	int				numWorkers;	// spawned worker threads
+	int				active;		// workers taking part in the current batch
+	int				busy;		// workers that have not finished the current batch
+	unsigned int	batch;
+
+	jobFunc_t		func;
+	void			*data;
+	int				count;
+	volatile int	next;
+} jobs = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+static void Sys_ExecuteJobs( void )
+{
+	int index;
+
+	while ( ( index = __sync_fetch_and_add( &jobs.next, 1 ) ) < jobs.count ) {
+		jobs.func( jobs.data, index );
+	}
+}
+
+
+static void *Sys_JobThread( void *arg )
+{
+	const int id = (intptr_t)arg;
+	unsigned int batch = 0;
+
+	pthread_mutex_lock( &jobs.lock );
+	for ( ;; ) {
+		while ( batch == jobs.batch )
+			pthread_cond_wait( &jobs.start, &jobs.lock );
+		batch = jobs.batch;
+		if ( id >= jobs.active )
+			continue;
+		pthread_mutex_unlock( &jobs.lock );
+
+		Sys_ExecuteJobs();
+
+		pthread_mutex_lock( &jobs.lock );
+		if ( --jobs.busy == 0 )
+			pthread_cond_signal( &jobs.done );
+	}
+
+	return NULL;
+}
+
+
+void Sys_RunJobs( jobFunc_t func, void *data, int count, int numThreads )
+{
+	pthread_t thread;
+	int i;
+
+	if ( numThreads > count )
+		numThreads = count;
+
+	if ( numThreads > MAX_JOB_THREADS )
+		numThreads = MAX_JOB_THREADS;
+
+	// spawn missing workers on demand
+	while ( jobs.numWorkers < numThreads - 1 ) {
+		if ( pthread_create( &thread, NULL, Sys_JobThread, (void *)(intptr_t)jobs.numWorkers ) != 0 ) {
+			Com_Printf( S_COLOR_YELLOW "Sys_RunJobs: pthread_create() failed, using %i threads\n", jobs.numWorkers + 1 );
+			break;
+		}
+		pthread_detach( thread );
+		jobs.numWorkers++;
+	}
+
+	if ( numThreads > jobs.numWorkers + 1 )
+		numThreads = jobs.numWorkers + 1;
+
+	if ( numThreads <= 1 ) {
+		for ( i = 0; i < count; i++ )
+			func( data, i );
+		return;
+	}
+
+	pthread_mutex_lock( &jobs.lock );
+	jobs.func = func;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.next = 0;
+	jobs.active = numThreads - 1;
+	jobs.busy = jobs.active;
+	jobs.batch++;
+	pthread_cond_broadcast( &jobs.start );
+	pthread_mutex_unlock( &jobs.lock );
+
+	Sys_ExecuteJobs();
+
+	pthread_mutex_lock( &jobs.lock );
+	while ( jobs.busy )
+		pthread_cond_wait( &jobs.done, &jobs.lock );
+	pthread_mutex_unlock( &jobs.lock );
+}
+
+
+/*
+=================
+Sys_StartJob
+=================
+*/
+typedef struct {
+	jobFunc_t		func;
+	void			*data;
+	volatile int	*done;
+} asyncJob_t;
+
+
+static void *Sys_AsyncJobThread( void *arg )
+{
+	asyncJob_t job = *(asyncJob_t *)arg;
+
+	free( arg );
+
+	job.func( job.data, 0 );
+
+	__sync_synchronize();
+	*job.done = 1;
+
+	return NULL;
+}
+
+
+qboolean Sys_StartJob( jobFunc_t func, void *data, volatile int *done )
+{
+	pthread_t thread;
+	asyncJob_t *job;
+
+	*done = 0;
+
+	job = malloc( sizeof( *job ) );
+	if ( job ) {
+		job->func = func;
+		job->data = data;
+		job->done = done;
+		if ( pthread_create( &thread, NULL, Sys_AsyncJobThread, job ) == 0 ) {
+			pthread_detach( thread );
+			return qtrue;
+		}
+		free( job );
+	}
+
+	func( data, 0 );
+	*done = 1;
+
+	return qfalse;
+}
+
+
+qboolean Sys_JobDone( volatile int *done )
+{
+	if ( *done ) {
+		__sync_synchronize();
+		return qtrue;
+	}
+
+	return qfalse;
+}
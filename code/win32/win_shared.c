@@ -240,3 +240,163 @@ void Sys_SetAffinityMask( int mask )
 	}
 }
 #endif // USE_AFFINITY_MASK
+
+
+/*
+=================
+Sys_RunJobs
+=================
+*/
+#define MAX_JOB_THREADS 32
+
+static struct {
+	HANDLE			start;		// semaphore released once per participating worker
+	HANDLE			done;		// set by the last worker of a batch
+	int				numWorkers;
+	volatile LONG	busy;
+
+	jobFunc_t		func;
+	void			*data;
+	int				count;
+	volatile LONG	next;
+} jobs;
+
+
+static void Sys_ExecuteJobs( void )
+{
+	int index;
+
+	while ( ( index = InterlockedIncrement( &jobs.next ) - 1 ) < jobs.count ) {
+		jobs.func( jobs.data, index );
+	}
+}
+
+
+static DWORD WINAPI Sys_JobThread( LPVOID arg )
+{
+	for ( ;; ) {
+		WaitForSingleObject( jobs.start, INFINITE );
+		Sys_ExecuteJobs();
+		if ( InterlockedDecrement( &jobs.busy ) == 0 )
+			SetEvent( jobs.done );
+	}
+
+	return 0;
+}
+
+
+void Sys_RunJobs( jobFunc_t func, void *data, int count, int numThreads )
+{
+	HANDLE thread;
+	int i;
+
+	if ( numThreads > count )
+		numThreads = count;
+
+	if ( numThreads > MAX_JOB_THREADS )
+		numThreads = MAX_JOB_THREADS;
+
+	if ( numThreads > 1 && !jobs.start ) {
+		jobs.start = CreateSemaphore( NULL, 0, MAX_JOB_THREADS, NULL );
+		jobs.done = CreateEvent( NULL, FALSE, FALSE, NULL );
+		if ( !jobs.start || !jobs.done ) {
+			Com_Printf( S_COLOR_YELLOW "Sys_RunJobs: failed to create synchronization objects\n" );
+			numThreads = 1;
+		}
+	}
+
+	// spawn missing workers on demand
+	while ( jobs.start && jobs.numWorkers < numThreads - 1 ) {
+		thread = CreateThread( NULL, 0, Sys_JobThread, NULL, 0, NULL );
+		if ( !thread ) {
+			Com_Printf( S_COLOR_YELLOW "Sys_RunJobs: CreateThread() failed, using %i threads\n", jobs.numWorkers + 1 );
+			break;
+		}
+		CloseHandle( thread );
+		jobs.numWorkers++;
+	}
+
+	if ( numThreads > jobs.numWorkers + 1 )
+		numThreads = jobs.numWorkers + 1;
+
+	if ( numThreads <= 1 ) {
+		for ( i = 0; i < count; i++ )
+			func( data, i );
+		return;
+	}
+
+	jobs.func = func;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.next = 0;
+	jobs.busy = numThreads - 1;
+	ReleaseSemaphore( jobs.start, numThreads - 1, NULL );
+
+	Sys_ExecuteJobs();
+
+	WaitForSingleObject( jobs.done, INFINITE );
+}
+
+
+/*
+=================
+Sys_StartJob
+=================
+*/
+typedef struct {
+	jobFunc_t		func;
+	void			*data;
+	volatile int	*done;
+} asyncJob_t;
+
+
+static DWORD WINAPI Sys_AsyncJobThread( LPVOID arg )
+{
+	asyncJob_t job = *(asyncJob_t *)arg;
+
+	free( arg );
+
+	job.func( job.data, 0 );
+
+	InterlockedExchange( (volatile LONG *)job.done, 1 );
+
+	return 0;
+}
+
+
+qboolean Sys_StartJob( jobFunc_t func, void *data, volatile int *done )
+{
+	HANDLE thread;
+	asyncJob_t *job;
+
+	*done = 0;
+
+	job = malloc( sizeof( *job ) );
+	if ( job ) {
+		job->func = func;
+		job->data = data;
+		job->done = done;
+		thread = CreateThread( NULL, 0, Sys_AsyncJobThread, job, 0, NULL );
+		if ( thread ) {
+			CloseHandle( thread );
+			return qtrue;
+		}
+		free( job );
+	}
+
+	func( data, 0 );
+	*done = 1;
+
+	return qfalse;
+}
+
+
+qboolean Sys_JobDone( volatile int *done )
+{
+	if ( *done ) {
+		MemoryBarrier();
+		return qtrue;
+	}
+
+	return qfalse;
+}
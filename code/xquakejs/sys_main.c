@@ -1006,6 +1006,22 @@ int Sys_ParseArgs( int argc, char* argv[] )
 	return 0;
 }
 
+/*
+=================
+Sys_RunJobs
+
+No worker threads in the browser
+=================
+*/
+void Sys_RunJobs( jobFunc_t func, void *data, int count, int numThreads )
+{
+	int i;
+
+	for ( i = 0; i < count; i++ )
+		func( data, i );
+}
+
+
 /*
 =================
 Sys_Frame